@@ -0,0 +1,144 @@
+//Benchmark for the coroutine interface: many thousands of operations are
+//started at once, all suspended in co_await simultaneously, and driven to
+//completion by a single thread. For comparison, a sample of the same requests
+//is also made one at a time with blocking calls.
+//
+//Usage: coroutine_bench [operations [connections [latency_ms [url]]]]
+//
+//By default requests are made to a server on the loopback interface run by the
+//benchmark itself, which delays each response by the given latency to stand
+//in for a remote server. If a URL is given (for which credentials are stored),
+//objects under it are fetched instead, cycling through the first page of its
+//listing.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <s3tools/async_client.h>
+
+#include "../tests/loopback_server.h"
+
+using namespace s3tools;
+
+struct Counters{
+	std::size_t inFlight=0;
+	std::size_t maxInFlight=0;
+	std::size_t completed=0;
+	std::size_t failed=0;
+};
+
+Task<void> fetch(AsyncClient& client, std::string url, Counters& counters){
+	//all tasks' bodies run on the single thread driving the engine, so the
+	//counters need no synchronization
+	counters.maxInFlight=std::max(counters.maxInFlight,++counters.inFlight);
+	try{
+		co_await client.get(url);
+		counters.completed++;
+	}catch(std::exception&){
+		counters.failed++;
+	}
+	counters.inFlight--;
+}
+
+double seconds(std::chrono::steady_clock::duration d){
+	return(std::chrono::duration_cast<std::chrono::duration<double>>(d).count());
+}
+
+int main(int argc, char* argv[]){
+	std::size_t operations=10000;
+	unsigned int connections=64;
+	std::chrono::milliseconds latency(5);
+	std::string target;
+	if(argc>1)
+		operations=std::stoul(argv[1]);
+	if(argc>2)
+		connections=std::stoul(argv[2]);
+	if(argc>3)
+		latency=std::chrono::milliseconds(std::stoul(argv[3]));
+	if(argc>4)
+		target=argv[4];
+
+	std::unique_ptr<LoopbackServer> server;
+	CredentialCollection credentials;
+	std::vector<std::string> urls;
+	RequestEngine::Options options;
+	//requests beyond those which can be given connections wait in the engine's
+	//queue, while the coroutines which made them wait in co_await
+	options.maxConcurrent=connections;
+	options.maxHostConnections=connections;
+	RequestEngine engine(options);
+	try{
+		if(target.empty()){
+			auto respond=LoopbackServer::fixedResponse(std::string(1024,'x'));
+			server.reset(new LoopbackServer([=](const std::string& head, const std::string& body){
+				std::this_thread::sleep_for(latency);
+				return(respond(head,body));
+			}));
+			credentials[server->url("")]=credential{"user","secret",{}};
+			urls.push_back(server->url("/bucket/object"));
+		}
+		else{
+			credentials=fetchStoredCredentials();
+			AsyncClient client(engine,credentials);
+			URL object(target);
+			object.query.clear();
+			const std::string bucket=object.path.substr(0,object.path.find('/',1));
+			auto firstPage=[&]()->Task<ListPage>{
+				auto pages=client.list(target,true);
+				if(!co_await pages.next())
+					co_return ListPage();
+				co_return std::move(pages.value());
+			};
+			for(const auto& info : syncWait(engine,firstPage()).objects){
+				object.path=bucket+"/"+info.key;
+				urls.push_back(object.str());
+			}
+			if(urls.empty()){
+				std::cerr << "No objects found under " << target << std::endl;
+				return(1);
+			}
+		}
+	}catch(std::exception& ex){
+		std::cerr << ex.what() << std::endl;
+		return(1);
+	}
+	AsyncClient client(engine,credentials);
+
+	std::cout << operations << " GET requests over at most " << connections << " connections" << std::endl;
+
+	Counters counters;
+	auto start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<operations; i++)
+		spawn(fetch(client,urls[i%urls.size()],counters));
+	engine.run();
+	double concurrentTime=seconds(std::chrono::steady_clock::now()-start);
+	std::cout << "coroutines: " << concurrentTime << " s, "
+	          << counters.completed/concurrentTime << " requests/s, "
+	          << counters.maxInFlight << " concurrent awaits";
+	if(counters.failed)
+		std::cout << ", " << counters.failed << " failed";
+	std::cout << std::endl;
+
+	//blocking requests are slow, so only make enough to estimate their rate
+	const std::size_t sample=std::min<std::size_t>(operations,500);
+	std::size_t failed=0;
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<sample; i++){
+		try{
+			syncWait(engine,client.get(urls[i%urls.size()]));
+		}catch(std::exception&){
+			failed++;
+		}
+	}
+	double sequentialTime=seconds(std::chrono::steady_clock::now()-start);
+	std::cout << "blocking: " << sequentialTime << " s, "
+	          << (sample-failed)/sequentialTime << " requests/s (" << sample << " requests)";
+	if(failed)
+		std::cout << ", " << failed << " failed";
+	std::cout << std::endl;
+}
@@ -0,0 +1,72 @@
+//Benchmark comparing HTTP/1.1 with multiplexed HTTP/2 for a workload of many
+//small concurrent requests, against a local HTTPS stand-in server which
+//delays each response to imitate a remote one.
+//
+//Usage: http2_bench [operations [concurrency [latency_ms [object_size]]]]
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <s3tools/request_engine.h>
+
+#include "../tests/tls_server.h"
+
+using namespace s3tools;
+
+void run(const std::string& label, bool http2, std::size_t operations, std::size_t concurrency,
+         std::chrono::milliseconds latency, std::size_t objectSize){
+	TLSServer server(std::string(objectSize,'x'),latency);
+	std::size_t completed=0, failed=0;
+	auto start=std::chrono::steady_clock::now();
+	{
+		RequestEngine::Options options;
+		options.caBundlePath=server.caFile;
+		options.maxConcurrent=concurrency;
+		options.http2=http2;
+		RequestEngine engine(options);
+		for(std::size_t i=0; i<operations; i++){
+			HTTPRequest request(URL(server.url("/bucket/object"+std::to_string(i))));
+			//a mixture of the operations the tools perform on small objects
+			if(i%4==1){
+				request.url.verb="PUT";
+				request.body=std::string(objectSize,'y');
+			}
+			else if(i%4==2)
+				request.url.verb="DELETE";
+			engine.submit(request,[&](HTTPResponse response){
+				if(response.complete() && response.status==200)
+					completed++;
+				else
+					failed++;
+			});
+		}
+		engine.run();
+	}
+	double time=std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now()-start).count();
+	std::cout << label << ": " << time << " s, " << completed/time << " requests/s, "
+	          << server.connections << " connections";
+	if(failed)
+		std::cout << ", " << failed << " failed";
+	std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]){
+	std::size_t operations=20000;
+	std::size_t concurrency=256;
+	std::chrono::milliseconds latency(5);
+	std::size_t objectSize=1024;
+	if(argc>1)
+		operations=std::stoul(argv[1]);
+	if(argc>2)
+		concurrency=std::stoul(argv[2]);
+	if(argc>3)
+		latency=std::chrono::milliseconds(std::stoul(argv[3]));
+	if(argc>4)
+		objectSize=std::stoul(argv[4]);
+
+	std::cout << operations << " requests for " << objectSize << " byte objects, "
+	          << concurrency << " at a time, " << latency.count() << " ms server latency" << std::endl;
+	run("HTTP/1.1",false,operations,concurrency,latency,objectSize);
+	run("HTTP/2  ",true,operations,concurrency,latency,objectSize);
+}
@@ -0,0 +1,218 @@
+//Benchmark for parsing listing results: a ListBucketResult document with 1000
+//entries, like a full page from a server, is parsed repeatedly, by building a
+//DOM and reading each field from it with the XML helpers used by the tools
+//(the way s3ls used to), and with the streaming ListParser, both all at once
+//and in the pieces in which it would arrive from the network. The conversions
+//of individual size and time fields are also timed, against the standard
+//library alternatives. Finally, the memory used to hold a large listing, as
+//ObjectInfo structures and in a ListingTable, is compared, along with the time
+//taken to sort the table, and the same listing is written to a listing index,
+//which is then searched. Lastly, the listing is printed as s3ls -l prints it,
+//line by line to a stream and through an OutputBuffer.
+//
+//Usage: listing_bench [iterations]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <s3tools/index.h>
+#include <s3tools/listing.h>
+#include <s3tools/responses.h>
+
+#include "../src/output_utils.h"
+#include "../src/xml_utils.h"
+
+using namespace s3tools;
+
+std::string makeListing(std::size_t entries){
+	std::ostringstream xml;
+	xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    << "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Name>bucket</Name>"
+	    << "<Prefix>data/</Prefix><KeyCount>" << entries << "</KeyCount><MaxKeys>1000</MaxKeys>"
+	    << "<IsTruncated>true</IsTruncated><NextContinuationToken>token</NextContinuationToken>";
+	for(std::size_t i=0; i<entries; i++){
+		xml << "<Contents><Key>data/run" << i/100 << "/file_" << i << ".dat</Key>"
+		    << "<LastModified>2023-06-" << 10+i%20 << "T12:" << 10+i%50 << ":05." << 100+i%900 << "Z</LastModified>"
+		    << "<ETag>&quot;" << std::hex << 0x9e3779b97f4a7c15ULL*(i+1) << std::dec << "0123456789abcdef&quot;</ETag>"
+		    << "<Size>" << 1000+i*7919 << "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+	}
+	xml << "</ListBucketResult>";
+	return(xml.str());
+}
+
+double seconds(std::chrono::steady_clock::time_point start){
+	return(std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now()-start).count());
+}
+
+void report(const std::string& name, double time, std::size_t count, const std::string& unit){
+	std::cout << name << ": " << time << " s, " << count/time << ' ' << unit << "/s" << std::endl;
+}
+
+int main(int argc, char* argv[]){
+	std::size_t iterations=500;
+	if(argc>1)
+		iterations=std::stoul(argv[1]);
+	const std::size_t entries=1000;
+	const std::string xml=makeListing(entries);
+	std::cout << iterations << " documents of " << entries << " entries (" << xml.size() << " bytes each)" << std::endl;
+
+	//a checksum of the sizes, so that the work cannot be skipped
+	std::uint64_t total=0;
+
+	auto start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<iterations; i++){
+		std::unique_ptr<xmlDoc,void(*)(xmlDoc*)> tree(xmlReadMemory(xml.data(),xml.size(),NULL,NULL,XML_PARSE_RECOVER),&xmlFreeDoc);
+		xmlNode* root=xmlDocGetRootElement(tree.get());
+		for(xmlNode* content=firstChild(root,"Contents"); content; content=nextSibling(content,"Contents")){
+			std::string key=getNodeContents<std::string>(firstChild(content,"Key"));
+			std::string modified=getNodeContents<std::string>(firstChild(content,"LastModified"));
+			std::string etag=getNodeContents<std::string>(firstChild(content,"ETag"));
+			total+=getNodeContents<unsigned long>(firstChild(content,"Size"))+key.size()+modified.size()+etag.size();
+		}
+	}
+	report("DOM",seconds(start),iterations*entries,"entries");
+
+	for(std::size_t chunk : {xml.size(),std::size_t(16384)}){
+		start=std::chrono::steady_clock::now();
+		for(std::size_t i=0; i<iterations; i++){
+			ListParser parser([&](const ObjectInfo& object){
+				total+=object.size+object.key.size()+object.lastModified.size()+object.etag.size();
+			},[](const std::string&){});
+			for(std::size_t offset=0; offset<xml.size(); offset+=chunk)
+				parser.feed(xml.data()+offset,std::min(chunk,xml.size()-offset));
+			parser.finish();
+		}
+		report(chunk==xml.size() ? "ListParser" : "ListParser, 16 KB pieces",seconds(start),iterations*entries,"entries");
+	}
+
+	//individual fields
+	const std::size_t fields=iterations*entries;
+	std::vector<std::string> sizes, times;
+	for(std::size_t i=0; i<1000; i++){
+		sizes.push_back(std::to_string(1000+i*7919*1117));
+		times.push_back("2023-06-"+std::to_string(10+i%20)+"T12:"+std::to_string(10+i%50)+":05."+std::to_string(100+i%900)+"Z");
+	}
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<fields; i++)
+		total+=lexical_cast<unsigned long>(sizes[i%sizes.size()]);
+	report("lexical_cast sizes",seconds(start),fields,"fields");
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<fields; i++)
+		total+=std::stoull(sizes[i%sizes.size()]);
+	report("std::stoull sizes",seconds(start),fields,"fields");
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<fields; i++){
+		const std::string& size=sizes[i%sizes.size()];
+		std::uint64_t value;
+		if(parseUnsigned(size.data(),size.data()+size.size(),value))
+			total+=value;
+	}
+	report("parseUnsigned sizes",seconds(start),fields,"fields");
+
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<fields; i++){
+		std::tm time={};
+		strptime(times[i%times.size()].c_str(),"%Y-%m-%dT%H:%M:%S",&time);
+		total+=timegm(&time);
+	}
+	report("strptime/timegm times",seconds(start),fields,"fields");
+	start=std::chrono::steady_clock::now();
+	for(std::size_t i=0; i<fields; i++){
+		const std::string& text=times[i%times.size()];
+		std::chrono::system_clock::time_point time;
+		if(parseTimestamp(text.data(),text.data()+text.size(),time))
+			total+=time.time_since_epoch().count();
+	}
+	report("parseTimestamp times",seconds(start),fields,"fields");
+
+	//holding a whole listing, with the entries generated as above
+	const std::size_t held=iterations*200;
+	{
+		std::vector<ObjectInfo> objects;
+		std::size_t bytes=0;
+		auto capacity=[](const std::string& s){
+			//short strings are stored inline, and long ones have an extra
+			//allocation, with some overhead
+			return(s.capacity()<sizeof(std::string) ? 0 : s.capacity()+1+16);
+		};
+		ListingTable table;
+		ListParser parser([&](const ObjectInfo& object){ table.add(object); objects.push_back(object); },
+		                  [](const std::string&){});
+		std::string document=makeListing(held);
+		for(std::size_t offset=0; offset<document.size(); offset+=65536)
+			parser.feed(document.data()+offset,std::min<std::size_t>(65536,document.size()-offset));
+		parser.finish();
+		for(const auto& object : objects)
+			bytes+=capacity(object.key)+capacity(object.lastModified)+capacity(object.etag);
+		bytes+=objects.capacity()*sizeof(ObjectInfo);
+		std::cout << held << " entries as ObjectInfo: " << bytes/held << " bytes each" << std::endl;
+		std::cout << held << " entries in ListingTable: " << table.memoryUsage()/held << " bytes each" << std::endl;
+		start=std::chrono::steady_clock::now();
+		total+=table.order(ListingTable::Column::Size,true).front();
+		report("ListingTable sort by size",seconds(start),held,"entries");
+		start=std::chrono::steady_clock::now();
+		total+=table.order(ListingTable::Column::Name).front();
+		report("ListingTable sort by name",seconds(start),held,"entries");
+
+		//the generated keys are not quite in order
+		std::sort(objects.begin(),objects.end(),[](const ObjectInfo& a, const ObjectInfo& b){ return(a.key<b.key); });
+		char path[]="/tmp/listing_bench_XXXXXX";
+		close(mkstemp(path));
+		start=std::chrono::steady_clock::now();
+		{
+			IndexWriter writer(path,"bench");
+			for(const auto& object : objects)
+				writer.add(object);
+			writer.finish();
+		}
+		report("IndexWriter",seconds(start),held,"entries");
+		ListingIndex index(path);
+		std::cout << "Index: " << index.fileSize()/held << " bytes per entry" << std::endl;
+		start=std::chrono::steady_clock::now();
+		index.scan("",[&](const ObjectInfo& object){ total+=object.size; return(true); });
+		report("ListingIndex scan",seconds(start),held,"entries");
+		const std::size_t queries=1000;
+		start=std::chrono::steady_clock::now();
+		for(std::size_t i=0; i<queries; i++){
+			ListingIndex::Query query;
+			query.prefix=objects[i*objects.size()/queries].key.substr(0,13);
+			index.find(query,[&](const ObjectInfo& object){ total+=object.size; return(true); });
+		}
+		report("ListingIndex prefix queries",seconds(start),queries,"queries");
+		std::remove(path);
+
+		{
+			std::ofstream null("/dev/null");
+			start=std::chrono::steady_clock::now();
+			for(const auto& object : objects)
+				null << object.key << "\t " << object.lastModified << "\t " << formatSize(object.size,true) << std::endl;
+			report("Printing with std::endl",seconds(start),held,"entries");
+		}
+		{
+			std::ofstream null("/dev/null");
+			start=std::chrono::steady_clock::now();
+			{
+				OutputBuffer out(null);
+				for(const auto& object : objects){
+					out << object.key << "\t " << object.lastModified << "\t ";
+					out.appendSize(object.size,true);
+					out << '\n';
+				}
+			}
+			report("Printing with OutputBuffer",seconds(start),held,"entries");
+		}
+	}
+
+	std::cout << "(checksum " << total << ")" << std::endl;
+}
@@ -0,0 +1,99 @@
+//Benchmark for the command line tools, run against a local mock S3 server
+//which imitates a remote one by delaying each response and limiting the rate
+//at which each connection transfers data. The tools are run as separate
+//processes, from the directory containing the build, so the times include
+//their startup costs.
+//
+//Usage: tool_bench [objects [latency_ms [bandwidth_MB/s [file_MB]]]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <s3tools/cred_manage.h>
+
+#include "../tests/mock_s3.h"
+
+///Run a command, discarding its output
+///\return the time taken, in seconds
+double run(const std::string& command){
+	auto start=std::chrono::steady_clock::now();
+	if(std::system((command+" >/dev/null").c_str())!=0)
+		std::cerr << "Command failed: " << command << std::endl;
+	return(std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now()-start).count());
+}
+
+int main(int argc, char* argv[]){
+	std::size_t objects=20000;
+	std::chrono::milliseconds latency(5);
+	std::size_t bandwidth=200;
+	std::size_t fileSize=64;
+	if(argc>1)
+		objects=std::stoul(argv[1]);
+	if(argc>2)
+		latency=std::chrono::milliseconds(std::stoul(argv[2]));
+	if(argc>3)
+		bandwidth=std::stoul(argv[3]);
+	if(argc>4)
+		fileSize=std::stoul(argv[4]);
+	const std::size_t deletions=std::min<std::size_t>(objects,200);
+
+	MockS3Server::Options options;
+	options.credentials["bench"]="secret";
+	options.latency=latency;
+	options.bandwidth=bandwidth<<20;
+	MockS3Server server(options);
+	const std::string url=server.url("");
+	server.createBucket("bench");
+	for(std::size_t i=0; i<objects; i++)
+		server.putObject("bench","dir/object"+std::to_string(i),std::string(64,'x'));
+
+	char dirTemplate[]="/tmp/s3tools_tool_bench_XXXXXX";
+	const std::string dir=mkdtemp(dirTemplate);
+	const std::string credFile=dir+"/credentials", file=dir+"/file";
+	{
+		std::ofstream creds(credFile);
+		s3tools::exportCredentials(creds,{{url,s3tools::credential{"bench","secret",{}}}});
+	}
+	chmod(credFile.c_str(),0600);
+	setenv("S3_CRED_PATH",credFile.c_str(),1);
+	{
+		std::ofstream data(file,std::ios::binary);
+		const std::string block(1<<20,'x');
+		for(std::size_t i=0; i<fileSize; i++)
+			data << block;
+	}
+
+	std::cout << objects << " objects, " << latency.count() << " ms latency, "
+	          << bandwidth << " MB/s per connection" << std::endl;
+
+	double time=run("bin/s3ls "+url+"/bench/dir/");
+	std::cout << "s3ls: " << time << " s, " << objects/time << " objects/s, "
+	          << server.operationCount("ListObjectsV2") << " pages" << std::endl;
+
+	unsigned int pagesBefore=server.operationCount("ListObjectsV2");
+	time=run("bin/s3ls -r -j 8 "+url+"/bench/dir/");
+	std::cout << "s3ls -r -j 8: " << time << " s, " << objects/time << " objects/s, "
+	          << server.operationCount("ListObjectsV2")-pagesBefore << " pages" << std::endl;
+
+	time=run("bin/s3cp "+file+" "+url+"/bench/file");
+	std::cout << "s3cp upload: " << time << " s, " << fileSize/time << " MB/s" << std::endl;
+	time=run("bin/s3cp "+url+"/bench/file "+file);
+	std::cout << "s3cp download: " << time << " s, " << fileSize/time << " MB/s" << std::endl;
+
+	std::string targets;
+	for(std::size_t i=0; i<deletions; i++)
+		targets+=" "+url+"/bench/dir/object"+std::to_string(i);
+	time=run("bin/s3rm"+targets);
+	std::cout << "s3rm: " << time << " s, " << deletions/time << " objects/s ("
+	          << deletions << " objects)" << std::endl;
+
+	remove(credFile.c_str());
+	remove(file.c_str());
+	rmdir(dir.c_str());
+}
@@ -0,0 +1,53 @@
+//Example of the coroutine interface: list every object under a prefix, then
+//fetch all of them concurrently, reporting how many bytes each contained.
+//
+//Usage: async_example scheme://host/bucket/prefix
+
+#include <iostream>
+#include <string>
+
+#include <s3tools/async_client.h>
+
+using namespace s3tools;
+
+Task<void> fetch(AsyncClient& client, std::string url){
+	try{
+		std::string data=co_await client.get(url);
+		std::cout << url << ": " << data.size() << " bytes" << std::endl;
+	}catch(std::exception& ex){
+		std::cerr << url << ": " << ex.what() << std::endl;
+	}
+}
+
+Task<void> fetchAll(AsyncClient& client, std::string target){
+	URL object(target);
+	object.query.clear();
+	const std::string bucket=object.path.substr(0,object.path.find('/',1));
+
+	auto pages=client.list(target,true);
+	while(co_await pages.next()){
+		for(const ObjectInfo& info : pages.value().objects){
+			object.path=bucket+"/"+info.key;
+			//start each fetch without waiting for it, so that they all proceed
+			//concurrently with each other and with the rest of the listing
+			spawn(fetch(client,object.str()));
+		}
+	}
+}
+
+int main(int argc, char* argv[]){
+	if(argc!=2){
+		std::cerr << "Usage: " << argv[0] << " scheme://host/bucket/prefix" << std::endl;
+		return(1);
+	}
+	try{
+		RequestEngine engine;
+		AsyncClient client(engine,fetchStoredCredentials());
+		syncWait(engine,fetchAll(client,argv[1]));
+		//drive the engine until all of the spawned fetches are done
+		engine.run();
+	}catch(std::exception& ex){
+		std::cerr << ex.what() << std::endl;
+		return(1);
+	}
+}
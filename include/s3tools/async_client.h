@@ -0,0 +1,427 @@
+#ifndef S3TOOLS_ASYNC_CLIENT_H
+#define S3TOOLS_ASYNC_CLIENT_H
+
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "s3tools/async_client.h requires C++20 coroutine support"
+#endif
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/request_engine.h>
+#include <s3tools/responses.h>
+#include <s3tools/signing.h>
+
+namespace s3tools{
+
+template<typename T=void>
+class Task;
+
+namespace detail{
+
+struct TaskPromiseBase{
+	///The coroutine awaiting this one, which is resumed when this one finishes
+	std::coroutine_handle<> continuation;
+	std::exception_ptr exception;
+
+	struct FinalAwaiter{
+		bool await_ready() noexcept{ return(false); }
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept{
+			std::coroutine_handle<> next=handle.promise().continuation;
+			return(next ? next : std::noop_coroutine());
+		}
+		void await_resume() noexcept{}
+	};
+
+	std::suspend_always initial_suspend() noexcept{ return{}; }
+	FinalAwaiter final_suspend() noexcept{ return{}; }
+	void unhandled_exception(){ exception=std::current_exception(); }
+};
+
+template<typename T>
+struct TaskPromise : public TaskPromiseBase{
+	std::optional<T> value;
+
+	Task<T> get_return_object();
+	template<typename U>
+	void return_value(U&& v){ value.emplace(std::forward<U>(v)); }
+	T result(){
+		if(exception)
+			std::rethrow_exception(exception);
+		return(std::move(*value));
+	}
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase{
+	Task<void> get_return_object();
+	void return_void(){}
+	void result(){
+		if(exception)
+			std::rethrow_exception(exception);
+	}
+};
+
+///A coroutine which does nothing but record that it has been resumed, used
+///to learn when a task being waited on synchronously finishes
+struct Signal{
+	struct promise_type{
+		std::mutex& lock;
+		std::condition_variable& cond;
+		bool& done;
+
+		promise_type(std::mutex& lock, std::condition_variable& cond, bool& done):
+		lock(lock),cond(cond),done(done){}
+
+		///Records that the coroutine has finished only once it has suspended
+		///for the last time, since the waiter may then at once destroy it,
+		///and the state it refers to
+		struct FinalAwaiter{
+			bool await_ready() noexcept{ return(false); }
+			void await_suspend(std::coroutine_handle<promise_type> handle) noexcept{
+				promise_type& promise=handle.promise();
+				std::lock_guard<std::mutex> guard(promise.lock);
+				promise.done=true;
+				promise.cond.notify_all();
+			}
+			void await_resume() noexcept{}
+		};
+
+		Signal get_return_object(){
+			return(Signal{std::coroutine_handle<promise_type>::from_promise(*this)});
+		}
+		std::suspend_always initial_suspend() noexcept{ return{}; }
+		FinalAwaiter final_suspend() noexcept{ return{}; }
+		void return_void(){}
+		void unhandled_exception(){ std::terminate(); }
+	};
+	std::coroutine_handle<promise_type> handle;
+};
+
+inline Signal signalOnResume(std::mutex&, std::condition_variable&, bool&){
+	co_return;
+}
+
+///A coroutine which runs as soon as it is created and cleans up after itself
+struct Detached{
+	struct promise_type{
+		Detached get_return_object(){ return{}; }
+		std::suspend_never initial_suspend() noexcept{ return{}; }
+		std::suspend_never final_suspend() noexcept{ return{}; }
+		void return_void(){}
+		void unhandled_exception(){ std::terminate(); }
+	};
+};
+
+} //namespace detail
+
+///A lazily started coroutine producing a value of type T.
+///
+///A task does not begin running until it is awaited (or passed to syncWait()
+///or spawn()), and resumes its awaiter when it finishes. Exceptions escaping
+///the coroutine are rethrown to the awaiter.
+template<typename T>
+class Task{
+public:
+	using promise_type=detail::TaskPromise<T>;
+
+	explicit Task(std::coroutine_handle<promise_type> handle):handle(handle){}
+	Task(const Task&)=delete;
+	Task(Task&& other) noexcept:handle(std::exchange(other.handle,{})){}
+	~Task(){
+		if(handle)
+			handle.destroy();
+	}
+	Task& operator=(const Task&)=delete;
+	Task& operator=(Task&& other) noexcept{
+		if(this!=&other){
+			if(handle)
+				handle.destroy();
+			handle=std::exchange(other.handle,{});
+		}
+		return(*this);
+	}
+
+	bool await_ready() const noexcept{ return(!handle || handle.done()); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept{
+		handle.promise().continuation=awaiting;
+		return(handle);
+	}
+	T await_resume(){ return(handle.promise().result()); }
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	template<typename U>
+	friend U syncWait(RequestEngine&, Task<U>);
+};
+
+namespace detail{
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object(){
+	return(Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this)));
+}
+inline Task<void> TaskPromise<void>::get_return_object(){
+	return(Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this)));
+}
+}
+
+///Run a task to completion, waiting for it on the calling thread. If the
+///engine has not been started, the calling thread drives it while waiting.
+///Must not be called from inside a coroutine or completion callback.
+///\return the task's result
+///\throws anything thrown by the task
+template<typename T>
+T syncWait(RequestEngine& engine, Task<T> task){
+	std::mutex lock;
+	std::condition_variable cond;
+	bool done=false;
+	detail::Signal signal=detail::signalOnResume(lock,cond,done);
+	task.handle.promise().continuation=signal.handle;
+	task.handle.resume();
+	if(engine.started()){
+		std::unique_lock<std::mutex> guard(lock);
+		cond.wait(guard,[&]{ return(done); });
+	}
+	else{
+		//the task can only finish while this thread drives the engine
+		while(true){
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if(done)
+					break;
+			}
+			engine.poll(std::chrono::milliseconds(100));
+		}
+	}
+	signal.handle.destroy();
+	return(task.handle.promise().result());
+}
+
+///Start a task running without waiting for it. The task runs until its first
+///suspension on the calling thread, and thereafter on whichever thread drives
+///the engine; RequestEngine::run() can be used to wait for all spawned tasks.
+///An exception escaping the task is reported to stderr.
+inline void spawn(Task<void> task){
+	[](Task<void> task)->detail::Detached{
+		try{
+			co_await task;
+		}catch(std::exception& ex){
+			std::cerr << "Unhandled exception in spawned task: " << ex.what() << std::endl;
+		}catch(...){
+			std::cerr << "Unhandled exception in spawned task" << std::endl;
+		}
+	}(std::move(task));
+}
+
+///An asynchronous sequence of values, produced by a coroutine using co_yield
+///and consumed by another coroutine with
+///
+///    while(co_await generator.next())
+///        use(generator.value());
+template<typename T>
+class AsyncGenerator{
+public:
+	struct promise_type{
+		std::optional<T> current;
+		std::coroutine_handle<> consumer;
+		std::exception_ptr exception;
+
+		///Transfers control back to the consumer
+		struct YieldAwaiter{
+			bool await_ready() noexcept{ return(false); }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept{
+				return(handle.promise().consumer);
+			}
+			void await_resume() noexcept{}
+		};
+
+		AsyncGenerator get_return_object(){
+			return(AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this)));
+		}
+		std::suspend_always initial_suspend() noexcept{ return{}; }
+		YieldAwaiter final_suspend() noexcept{ return{}; }
+		YieldAwaiter yield_value(T value){
+			current.emplace(std::move(value));
+			return{};
+		}
+		void return_void(){ current.reset(); }
+		void unhandled_exception(){
+			current.reset();
+			exception=std::current_exception();
+		}
+	};
+
+	struct NextAwaiter{
+		std::coroutine_handle<promise_type> handle;
+
+		bool await_ready() const noexcept{ return(!handle || handle.done()); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept{
+			handle.promise().consumer=consumer;
+			return(handle);
+		}
+		bool await_resume(){
+			if(!handle)
+				return(false);
+			if(handle.promise().exception)
+				std::rethrow_exception(std::exchange(handle.promise().exception,nullptr));
+			return(!handle.done());
+		}
+	};
+
+	explicit AsyncGenerator(std::coroutine_handle<promise_type> handle):handle(handle){}
+	AsyncGenerator(const AsyncGenerator&)=delete;
+	AsyncGenerator(AsyncGenerator&& other) noexcept:handle(std::exchange(other.handle,{})){}
+	~AsyncGenerator(){
+		if(handle)
+			handle.destroy();
+	}
+	AsyncGenerator& operator=(const AsyncGenerator&)=delete;
+	AsyncGenerator& operator=(AsyncGenerator&& other) noexcept{
+		if(this!=&other){
+			if(handle)
+				handle.destroy();
+			handle=std::exchange(other.handle,{});
+		}
+		return(*this);
+	}
+
+	///Resume the generator until it produces its next value.
+	///\return an awaitable which yields false when the sequence is exhausted
+	NextAwaiter next(){ return(NextAwaiter{handle}); }
+	///The most recently produced value.
+	///\pre the last result of awaiting next() was true
+	T& value(){ return(*handle.promise().current); }
+
+private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+///Awaitable which submits a request to an engine, suspending the awaiting
+///coroutine until the response arrives. The coroutine is resumed on the thread
+///driving the engine.
+class RequestAwaiter{
+public:
+	RequestAwaiter(RequestEngine& engine, HTTPRequest request):
+	engine(engine),request(std::move(request)){}
+
+	bool await_ready() const noexcept{ return(false); }
+	void await_suspend(std::coroutine_handle<> awaiting){
+		//The response may arrive, and the coroutine be resumed (destroying this
+		//awaiter) on another thread before submit returns, so nothing may touch
+		//this object after the call.
+		engine.submit(std::move(request),[this,awaiting](HTTPResponse r){
+			response=std::move(r);
+			awaiting.resume();
+		});
+	}
+	HTTPResponse await_resume(){ return(std::move(response)); }
+
+private:
+	RequestEngine& engine;
+	HTTPRequest request;
+	HTTPResponse response;
+};
+
+///Coroutine interface for S3 operations.
+///
+///Every operation is a coroutine which signs its requests with the stored
+///credential best matching the target URL and suspends while they are in
+///flight, so a single thread driving the engine can interleave thousands of
+///operations. Operations throw S3Error when the server reports an error and
+///std::runtime_error when a request cannot be made. The client must outlive
+///all of the operations started through it.
+class AsyncClient{
+public:
+	///\param engine the engine through which requests will be made
+	///\param credentials the credentials with which requests will be signed
+	AsyncClient(RequestEngine& engine, const CredentialCollection& credentials):
+	engine(engine),credentials(credentials),hedging(false){}
+
+	///Set whether GET and HEAD requests are hedged, so that those which are
+	///slow to get a response are duplicated (see HTTPRequest::hedge). This
+	///can reduce the latency of reading small objects from servers whose
+	///response times vary, at the cost of some extra requests.
+	void hedgeReads(bool enable){ hedging=enable; }
+
+	///Send a signed request, and wait for the raw response
+	RequestAwaiter request(const std::string& verb, const std::string& url, std::string body=""){
+		HTTPRequest req(sign(verb,URL(url)));
+		req.body=std::move(body);
+		req.hedge=hedging && (verb=="GET" || verb=="HEAD");
+		return(RequestAwaiter(engine,std::move(req)));
+	}
+
+	///Fetch the contents of an object
+	Task<std::string> get(std::string url){
+		HTTPResponse response=co_await request("GET",url);
+		checkResponse(response);
+		co_return std::move(response.body);
+	}
+
+	///Store data as an object, replacing any existing object with the same key
+	Task<void> put(std::string url, std::string data){
+		HTTPResponse response=co_await request("PUT",url,std::move(data));
+		checkResponse(response);
+	}
+
+	///Fetch an object's metadata
+	Task<ObjectInfo> head(std::string url){
+		HTTPResponse response=co_await request("HEAD",url);
+		checkResponse(response);
+		URL target(url);
+		std::size_t slash=target.path.find('/',1);
+		co_return objectInfoFromHeaders(slash==std::string::npos ? "" : target.path.substr(slash+1),response);
+	}
+
+	///Delete an object
+	Task<void> remove(std::string url){
+		HTTPResponse response=co_await request("DELETE",url);
+		checkResponse(response);
+	}
+
+	///List the contents of a bucket, or the part of a bucket under a prefix,
+	///one page of results at a time. The next page is not requested until the
+	///consumer asks for it.
+	///\param url a URL of the form scheme://host/bucket[/prefix]
+	///\param recursive whether to list all keys under the prefix, rather than
+	///                 grouping them into common prefixes at '/'
+	AsyncGenerator<ListPage> list(std::string url, bool recursive=false){
+		URL listURL=listObjectsURL(url,recursive?"":"/");
+		while(true){
+			HTTPRequest req(sign("GET",listURL));
+			req.hedge=hedging;
+			HTTPResponse response=co_await RequestAwaiter(engine,std::move(req));
+			checkResponse(response);
+			ListPage page=parseListPage(response.body);
+			bool more=page.truncated;
+			if(more)
+				listURL.query["continuation-token"]=page.nextContinuationToken;
+			co_yield std::move(page);
+			if(!more)
+				break;
+		}
+	}
+
+private:
+	RequestEngine& engine;
+	CredentialIndex credentials;
+	bool hedging;
+
+	URL sign(const std::string& verb, const URL& url) const{
+		const credential& cred=findCredentials(credentials,url.str()).second;
+		return(genURL(cred.username,cred.key,verb,url,60));
+	}
+};
+
+}
+
+#endif //S3TOOLS_ASYNC_CLIENT_H
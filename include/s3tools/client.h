@@ -0,0 +1,223 @@
+#ifndef S3TOOLS_CLIENT_H
+#define S3TOOLS_CLIENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/deletion.h>
+#include <s3tools/request_engine.h>
+#include <s3tools/responses.h>
+#include <s3tools/url.h>
+
+namespace s3tools{
+
+///An entry of a listing: an object, or a common prefix grouping the keys
+///which continue past a delimiter
+struct ListEntry{
+	///The object, or, for a common prefix, only its key, which is the prefix
+	ObjectInfo object;
+	bool isPrefix;
+
+	ListEntry():isPrefix(false){}
+};
+
+///The entries of a listing, obtained from Client::list(). Entries are
+///fetched as they are consumed, with the next page of a listing requested as
+///soon as the previous one arrives, and can be read either with next() or by
+///iterating from begin() to end(), only once in either case.
+class Listing{
+public:
+	class iterator{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef ListEntry value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const ListEntry* pointer;
+		typedef const ListEntry& reference;
+
+		iterator():listing(nullptr){}
+		reference operator*() const{ return(listing->current); }
+		pointer operator->() const{ return(&listing->current); }
+		///\throws S3Error if the server reports an error
+		///\throws std::runtime_error if a request fails
+		iterator& operator++(){
+			if(!listing->next(listing->current))
+				listing=nullptr;
+			return(*this);
+		}
+		bool operator==(const iterator& other) const{ return(listing==other.listing); }
+		bool operator!=(const iterator& other) const{ return(listing!=other.listing); }
+
+	private:
+		explicit iterator(Listing* listing):listing(listing){}
+		Listing* listing;
+		friend class Listing;
+	};
+
+	Listing(Listing&& other);
+	~Listing();
+	Listing(const Listing&)=delete;
+	Listing& operator=(const Listing&)=delete;
+
+	///Fetch the first entry, and get an iterator referring to it
+	///\throws as for next()
+	iterator begin();
+	iterator end(){ return(iterator()); }
+
+	///Get the next entry, waiting for it to be listed if necessary.
+	///\param entry where the entry is to be stored
+	///\return false if all entries have been listed
+	///\throws S3Error if the server reports an error
+	///\throws std::runtime_error if a request fails
+	bool next(ListEntry& entry);
+
+	///The number of listing requests which have been made so far
+	std::size_t requests() const;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+	ListEntry current;
+
+	explicit Listing(std::unique_ptr<Impl> impl);
+	friend class Client;
+};
+
+///A synchronous interface to S3 for programs which embed the library, and
+///the basis of the command line tools.
+///
+///A client owns a RequestEngine, whose connections, DNS results, and TLS
+///sessions are reused by every operation, and a set of credentials, from
+///which each request is signed with the one best matching its URL. Any
+///equivalent endpoints listed with the credentials are given to the engine.
+///
+///Operations throw S3Error when the server reports an error, and
+///std::runtime_error when a request cannot be made. Each drives the engine
+///until it is finished if the engine has not been started, so a client may
+///be used by only one thread at a time unless engine().start() has been
+///called.
+class Client{
+public:
+	///Use the stored credentials, as read by fetchStoredCredentials()
+	///\param options the settings for the client's engine
+	explicit Client(RequestEngine::Options options=RequestEngine::Options());
+	///\param credentials the credentials with which requests will be signed
+	///\param options the settings for the client's engine
+	explicit Client(const CredentialCollection& credentials,
+	                RequestEngine::Options options=RequestEngine::Options());
+	Client(const Client&)=delete;
+	Client& operator=(const Client&)=delete;
+
+	///Set whether GET and HEAD requests are hedged (see HTTPRequest::hedge)
+	void hedgeReads(bool enable){ hedging=enable; }
+	///Set whether curl's progress meter is shown for each request
+	void showProgress(bool enable){ progress=enable; }
+
+	///The engine through which all requests are made, which can also be
+	///used directly, for instance to make requests asynchronously
+	RequestEngine& engine(){ return(eng); }
+	///The credential to be used for a URL
+	///\throws std::runtime_error if no credential matches
+	const credential& credentialFor(const std::string& url) const;
+	///Make a signed request for a URL
+	///\param verb the HTTP verb
+	///\param url the URL, with any headers which must be signed
+	///\throws std::runtime_error if no credential matches
+	HTTPRequest request(const std::string& verb, const URL& url) const;
+	///Make a request, waiting for it to finish. HTTP error statuses are left
+	///to the caller to interpret.
+	///\throws std::runtime_error if the request does not complete
+	HTTPResponse perform(HTTPRequest request);
+
+	///Fetch the contents of an object
+	std::string get(const std::string& url);
+	///Fetch the contents of an object, writing them to a stream as they
+	///arrive. Nothing is written if the server reports an error.
+	void get(const std::string& url, std::ostream& out);
+	///Fetch the contents of an object into a file. If the object cannot be
+	///fetched, the file is removed.
+	void getFile(const std::string& url, const std::string& path);
+
+	///Store data as an object, replacing any existing object with the same key
+	void put(const std::string& url, const std::string& data);
+	///Store an object, reading its contents from a stream
+	///\param size the number of bytes to read
+	void put(const std::string& url, std::istream& in, std::uint64_t size);
+	///Store the contents of a file as an object
+	void putFile(const std::string& url, const std::string& path);
+
+	///Fetch an object's metadata
+	///\return the object's information, with its key relative to the bucket
+	ObjectInfo head(const std::string& url);
+
+	///Copy an object within a server, without transferring its data. This is
+	///done with a single CopyObject request, which S3 allows only for objects
+	///of up to 5 GiB; larger objects must be copied in parts, which is not
+	///done here.
+	///\param source the URL of the existing object
+	///\param destination the URL of the new object, on the same server
+	///\throws S3Error if the server reports an error, including an
+	///        InvalidRequest error from S3 if the source is larger than 5 GiB
+	///\throws std::runtime_error if the objects are on different servers
+	void copy(const std::string& source, const std::string& destination);
+
+	///Delete an object
+	void remove(const std::string& url);
+	///Delete many objects, grouping them by bucket into DeleteObjects
+	///requests of up to 1000 objects each, with the requests for all buckets
+	///made together.
+	///\param urls the URLs of the objects
+	///\param onError the function to be told about each object which could
+	///               not be deleted, with its URL
+	///\param concurrency the largest number of requests to have in progress
+	///                   at once for each bucket
+	///\return the number of objects deleted
+	///\throws std::runtime_error if a URL does not name an object
+	std::size_t remove(const std::vector<std::string>& urls,
+	                   const std::function<void(const std::string&,const DeleteError&)>& onError,
+	                   std::size_t concurrency=4);
+	///Delete many objects which have already been grouped by bucket, as by
+	///groupByBucket(), with the requests for all buckets made together.
+	///\param objects the keys of the objects in each bucket
+	///\param onError the function to be told about each object which could
+	///               not be deleted, with its URL
+	///\param concurrency the largest number of requests to have in progress
+	///                   at once for each bucket
+	///\return the number of objects deleted
+	std::size_t remove(const std::vector<BucketObjects>& objects,
+	                   const std::function<void(const std::string&,const DeleteError&)>& onError,
+	                   std::size_t concurrency=4);
+
+	///List the contents of a bucket, or the part of a bucket under a prefix.
+	///\param url a URL of the form scheme://host/bucket[/prefix]
+	///\param recursive whether to list all keys under the prefix, rather than
+	///                 grouping them into common prefixes at '/'. Recursive
+	///                 listings are divided into ranges of keys which are
+	///                 listed in parallel, as by ObjectLister, and produce no
+	///                 prefixes.
+	///\param concurrency the largest number of requests to have in progress
+	///                   at once for a recursive listing
+	///\return the listing, which must not outlive the client
+	///\throws std::runtime_error if the URL does not name a bucket
+	Listing list(const std::string& url, bool recursive=false, std::size_t concurrency=8);
+
+private:
+	CredentialIndex credentials;
+	RequestEngine eng;
+	bool hedging;
+	bool progress;
+
+	///Make a request, and check that it succeeded
+	HTTPResponse performChecked(HTTPRequest request);
+};
+
+}
+
+#endif //S3TOOLS_CLIENT_H
@@ -1,19 +1,32 @@
 #ifndef S3TOOLS_CRED_MANAGE_H
 #define S3TOOLS_CRED_MANAGE_H
 
+#include <cstddef>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace s3tools{
 	
 struct credential{
 	std::string username;
 	std::string key;
+	///URLs of other servers which are equivalent to the one with which the
+	///credential is associated, such as the individual nodes behind a load
+	///balanced gateway, among which requests may be spread. Only the host and
+	///port of each are significant.
+	std::vector<std::string> endpoints;
 };
 	
 using CredentialCollection=std::unordered_map<std::string,credential>;
 	
-///Read all credentials from the on-disk credential store
+///Read all credentials from the on-disk credential store.
+///The contents of the store are kept in a binary cache beside it, readable
+///only by its owner, which is used in place of the store for as long as the
+///store's modification time and size are unchanged, and the results are
+///also remembered for the rest of the process, so that repeated calls cost
+///only a stat.
 CredentialCollection fetchStoredCredentials();
 
 ///Add a credential to the credential store
@@ -41,6 +54,38 @@ bool removeCredential(std::string url);
 std::pair<std::string,credential> findCredentials(const CredentialCollection& credentials,
                                                   const std::string& urlStr);
 
+///An index of credentials for repeated lookups, which finds the credential
+///whose URL is the longest prefix of a given URL by binary searches over the
+///URLs in sorted order. Each search rules out at least one more character of
+///the target URL, so a lookup takes time which depends on the length of the
+///URL and the logarithm of the number of credentials, rather than on the
+///number of credentials.
+class CredentialIndex{
+public:
+	typedef std::pair<std::string,credential> Entry;
+
+	CredentialIndex(){}
+	explicit CredentialIndex(const CredentialCollection& credentials);
+
+	///Find the credential whose associated URL is the longest prefix of a URL
+	///\return the matching URL and credential, or nullptr if there is none
+	const Entry* find(const std::string& urlStr) const;
+	///The number of credentials in the index
+	std::size_t size() const{ return(entries.size()); }
+
+private:
+	///Sorted by URL
+	std::vector<Entry> entries;
+};
+
+///Find credentials as findCredentials does, using an index
+///\param index the index of avaialable credentials
+///\param urlStr the URL for which to find matching credentials
+///\return the root URL for the best matching credential, and the credential
+///        itself, which remain valid as long as the index
+///\throws std::runtime_error if no match is found
+const CredentialIndex::Entry& findCredentials(const CredentialIndex& index, const std::string& urlStr);
+
 enum class CredFormat{
 	Internal,
 	JSON
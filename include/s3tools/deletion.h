@@ -0,0 +1,101 @@
+#ifndef S3TOOLS_DELETION_H
+#define S3TOOLS_DELETION_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/request_engine.h>
+#include <s3tools/responses.h>
+#include <s3tools/url.h>
+
+namespace s3tools{
+
+///Deletes objects from a bucket with DeleteObjects requests, each of which
+///removes a batch of up to 1000 objects, rather than with a request for each
+///object.
+///
+///Keys are collected into a batch as they are given, and each batch is sent
+///as soon as it is full, with a limited number of requests in progress at
+///once. Keys can therefore be produced, by a listing for instance, while
+///earlier batches are being deleted, without all of them being held in
+///memory.
+///
+///Requests are made through a RequestEngine, which is driven by remove() and
+///finish() if it has not been started.
+class BatchDeleter{
+public:
+	///A function to be told about each object which could not be deleted.
+	///It is called on the thread which calls remove() or finish().
+	typedef std::function<void(const DeleteError&)> ErrorCallback;
+
+	///The most keys which one DeleteObjects request may name
+	static const std::size_t maxBatchSize=1000;
+
+	///\param engine the engine through which to make requests, which must
+	///              outlive the deleter
+	///\param cred the credential with which to sign requests
+	///\param bucket the URL of the bucket
+	///\param concurrency the largest number of requests to have in progress
+	///                   at once
+	///\param onError the function to be told about objects which could not
+	///               be deleted. If a whole request fails, it is called for
+	///               each object in the batch.
+	///\param batchSize the number of keys to send in each request, at most
+	///                 maxBatchSize
+	BatchDeleter(RequestEngine& engine, const credential& cred, const URL& bucket,
+	             std::size_t concurrency=4, ErrorCallback onError=ErrorCallback(),
+	             std::size_t batchSize=maxBatchSize);
+	///Requests still in progress are cancelled, so finish() must be called
+	///for all deletions to be made.
+	~BatchDeleter();
+	BatchDeleter(const BatchDeleter&)=delete;
+	BatchDeleter& operator=(const BatchDeleter&)=delete;
+
+	///Add an object to be deleted. If this fills a batch, it is sent, after
+	///waiting for an earlier request to finish if too many are in progress.
+	void remove(const std::string& key);
+	///Send the last, partial batch, and wait for all requests to finish
+	void finish();
+
+	///The number of objects which have been deleted so far
+	std::size_t deleted() const;
+	///The number of objects which could not be deleted
+	std::size_t failed() const;
+	///The number of requests which have been made so far
+	std::size_t requests() const;
+
+private:
+	struct State;
+	std::shared_ptr<State> state;
+};
+
+///The keys of objects to be deleted from one bucket
+struct BucketObjects{
+	///The URL of the bucket
+	URL bucket;
+	std::vector<std::string> keys;
+};
+
+///Sort the URLs of objects by bucket, keeping the buckets in the order in
+///which they are first named, and the keys in the order in which they are
+///given
+///\param urls the URLs of the objects
+///\param onInvalid the function to be told about each URL which does not name
+///                 an object, which is left out. If it is empty, such a URL
+///                 is instead an error.
+///\throws std::runtime_error if a URL does not name an object and onInvalid
+///        is empty
+std::vector<BucketObjects> groupByBucket(const std::vector<std::string>& urls,
+                                         const std::function<void(const std::string&)>& onInvalid=nullptr);
+
+///Build the body of a DeleteObjects request, in quiet mode, so that the
+///response lists only the objects which could not be deleted
+std::string deleteObjectsBody(const std::vector<std::string>& keys);
+
+}
+
+#endif //S3TOOLS_DELETION_H
@@ -0,0 +1,189 @@
+#ifndef S3TOOLS_INDEX_H
+#define S3TOOLS_INDEX_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/request_engine.h>
+#include <s3tools/responses.h>
+
+namespace s3tools{
+
+///Writes a listing index: a file holding the keys, sizes, modification times
+///and ETags of the objects under a prefix, in order by key, which can be
+///searched without listing the objects again.
+///
+///Entries are stored in blocks of 64, each key stored as the length of the
+///prefix it shares with the previous key in its block followed by the rest of
+///it, and each block carries a checksum. The index is written to a file with
+///the suffix ".partial" and only put in place when finished, so that if
+///writing is interrupted, another writer for the same path, target, and
+///starting key can resume from the last complete block.
+///
+///A writer may also extend an existing index, with entries following its
+///last key, in which case the existing entries are copied when the new ones
+///are finished.
+class IndexWriter{
+public:
+	///\param path the path of the index file
+	///\param target the URL of the bucket and prefix being indexed, which is
+	///              recorded in the index
+	///\param after if not empty, the last key of the existing index at path,
+	///             which is to be extended
+	///\throws std::runtime_error if the file cannot be written
+	IndexWriter(const std::string& path, const std::string& target, const std::string& after="");
+	///Complete blocks which have been added are written out, so that they
+	///can be resumed.
+	~IndexWriter();
+	IndexWriter(const IndexWriter&)=delete;
+	IndexWriter& operator=(const IndexWriter&)=delete;
+
+	///Whether entries from an interrupted index were recovered
+	bool resumed() const{ return(entries>0); }
+	///The number of entries added so far, including any recovered
+	std::size_t size() const{ return(entries); }
+	///The key of the last entry, or the key after which entries begin if
+	///there are none
+	const std::string& lastKey() const{ return(previous); }
+
+	///Add an object, whose key must follow that of the last one
+	///\throws std::runtime_error if the key is out of order or the file
+	///        cannot be written
+	void add(const ObjectInfo& object);
+	///Ensure that all complete blocks are stored on disk, so that they will
+	///be recovered if writing is interrupted
+	///\throws std::runtime_error if the file cannot be written
+	void checkpoint();
+	///Write out the remaining entries and put the index in place, replacing
+	///the older index at the same path, if any
+	///\throws std::runtime_error if the file cannot be written
+	void finish();
+
+private:
+	std::string path;
+	std::string partialPath;
+	std::string target;
+	std::string after;
+	///When writing began, in milliseconds since the epoch
+	std::int64_t startTime;
+	int fd;
+	std::size_t entries;
+	std::string previous;
+	///The encoded entries of the block being filled
+	std::string block;
+	std::size_t blockEntries;
+	///Encoded data not yet written to the file
+	std::string buffer;
+	///The position in the file at which the contents of buffer belong
+	std::uint64_t position;
+	std::vector<std::uint64_t> blockOffsets;
+	bool finished;
+
+	///Recover the complete blocks of an interrupted index
+	///\return false if there is no interrupted index for the same target
+	///        and starting key
+	bool recover();
+	void endBlock();
+	void flush();
+};
+
+///A listing index, as written by IndexWriter, mapped into memory so that it
+///can be searched without being read in full.
+class ListingIndex{
+public:
+	///Conditions on the entries to be found. All must be satisfied.
+	struct Query{
+		///The prefix which keys must have
+		std::string prefix;
+		///A shell-style pattern which keys must match, in which '*' matches
+		///any sequence of characters other than '/', '?' matches any one
+		///such character, and '[...]' matches any of a set of characters.
+		///Keys are searched only from the point where they could match the
+		///part of the pattern before the first of these.
+		std::string glob;
+		std::uint64_t minSize;
+		std::uint64_t maxSize;
+
+		Query():minSize(0),maxSize(std::numeric_limits<std::uint64_t>::max()){}
+	};
+
+	///\throws std::runtime_error if the file cannot be read or is not a
+	///        complete index
+	explicit ListingIndex(const std::string& path);
+	~ListingIndex();
+	ListingIndex(const ListingIndex&)=delete;
+	ListingIndex& operator=(const ListingIndex&)=delete;
+
+	///The URL of the bucket and prefix which were indexed
+	const std::string& target() const{ return(indexTarget); }
+	///When the listing from which the index was most recently written began
+	std::chrono::system_clock::time_point updated() const{ return(updateTime); }
+	///The number of entries
+	std::size_t size() const{ return(entries); }
+	///The size of the index file in bytes
+	std::size_t fileSize() const{ return(length); }
+	///The key of the last entry, or an empty string if there are none
+	std::string lastKey() const;
+
+	///Visit the entries in order, starting with the first whose key is not
+	///before a given key.
+	///\param from the key at which to start
+	///\param visitor called with each entry, returning whether to continue
+	///\throws std::runtime_error if the index is found to be corrupt
+	void scan(const std::string& from, const std::function<bool(const ObjectInfo&)>& visitor) const;
+	///Visit the entries which satisfy a query, in order.
+	///\throws std::runtime_error if the index is found to be corrupt
+	void find(const Query& query, const std::function<bool(const ObjectInfo&)>& visitor) const;
+
+private:
+	friend class IndexWriter;
+	struct Entry;
+
+	const char* data;
+	std::size_t length;
+	std::string indexTarget;
+	std::chrono::system_clock::time_point updateTime;
+	std::size_t entries;
+	std::size_t blocks;
+	///The offsets of the blocks, stored in the file
+	const char* blockTable;
+
+	std::uint64_t blockOffset(std::size_t index) const;
+	///Get the first key of a block, which is stored in full
+	std::string firstKey(std::size_t index) const;
+	///Decode the entries of a block, calling visitor with each which is not
+	///before from, until it returns false
+	///\return whether the visitor asked to continue
+	bool scanBlock(std::size_t index, const std::string& from,
+	               const std::function<bool(const Entry&)>& visitor) const;
+	void scanEntries(const std::string& from, const std::function<bool(const Entry&)>& visitor) const;
+};
+
+///Bring a listing index up to date. If the index exists and is of the same
+///target, the objects following the last one in it are listed and appended to
+///it, which finds objects added since it was written if, as for logs or other
+///keys based on times or serial numbers, new keys sort after old ones. Objects
+///deleted or changed since the index was written are only found by rebuilding
+///it. If a previous update was interrupted, it is resumed.
+///\param engine the engine through which to make listing requests
+///\param cred the credential with which to sign requests
+///\param path the path of the index file
+///\param target the URL of the bucket and prefix to be indexed
+///\param concurrency the largest number of listing requests to make at once
+///\param rebuild whether to list all objects, rather than only those
+///               following the existing index
+///\return the number of objects listed
+///\throws S3Error if the server reports an error
+///\throws std::runtime_error if a request fails or the index cannot be written
+std::size_t updateIndex(RequestEngine& engine, const credential& cred, const std::string& path,
+                        const std::string& target, std::size_t concurrency=8, bool rebuild=false);
+
+}
+
+#endif //S3TOOLS_INDEX_H
@@ -0,0 +1,181 @@
+#ifndef S3TOOLS_LISTING_H
+#define S3TOOLS_LISTING_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/request_engine.h>
+#include <s3tools/responses.h>
+
+namespace s3tools{
+
+///Lists every object whose key begins with a given prefix, in sorted order.
+///
+///Since each page of a listing can be requested only with the continuation
+///token from the previous one, listing a large bucket one page at a time is
+///slow. Instead, the range of keys is divided into partitions which are
+///listed concurrently: initially at the common prefixes one level below the
+///listed prefix, and then, whenever a partition turns out to hold more than
+///one page of keys, at points extrapolated from the spacing of the keys in
+///that page. The results of the partitions are buffered, a few pages at a
+///time, and produced in order.
+///
+///Requests are made through a RequestEngine, which is driven by next() if it
+///has not been started.
+///
+///A filter may be given to select the objects to be produced. It is applied
+///as each page is parsed, so objects which do not pass it are never stored,
+///and take no space in the buffers.
+class ObjectLister{
+public:
+	///A predicate selecting the objects to be listed. It is called on the
+	///thread driving the engine, and must not use the lister.
+	typedef std::function<bool(const ObjectInfo&)> Filter;
+
+	///\param engine the engine through which to make requests, which must
+	///              outlive the lister
+	///\param cred the credential with which to sign requests
+	///\param target the URL of the bucket, followed by the prefix of the keys
+	///              to be listed, if any
+	///\param concurrency the largest number of listing requests to have in
+	///                   progress at once. With one, pages are simply
+	///                   requested in turn.
+	///\param startAfter if not empty, only objects whose keys follow this
+	///                  are listed
+	///\param filter if set, only objects for which this returns true are
+	///              listed
+	///\throws std::runtime_error if the URL does not name a bucket
+	ObjectLister(RequestEngine& engine, const credential& cred, const std::string& target,
+	             std::size_t concurrency=8, const std::string& startAfter="", const Filter& filter=Filter());
+	///Outstanding requests are cancelled.
+	~ObjectLister();
+	ObjectLister(const ObjectLister&)=delete;
+	ObjectLister& operator=(const ObjectLister&)=delete;
+
+	///Get the next object, waiting for it to be listed if necessary.
+	///\param object where the object's information is to be stored
+	///\return false if all objects have been listed
+	///\throws S3Error if the server reports an error
+	///\throws std::runtime_error if a request fails
+	bool next(ObjectInfo& object);
+
+	///The number of listing requests which have been made so far
+	std::size_t requests() const;
+
+private:
+	struct State;
+	std::shared_ptr<State> state;
+};
+
+///Find the part of a shell-style pattern before its first special character
+///('*', '?', '[' or '\\'), which every key matching it must begin with.
+std::string globPrefix(const std::string& pattern);
+
+///Match a key against a shell-style pattern, in which '*' matches any sequence
+///of characters other than '/', '?' matches any one such character, and
+///'[...]' matches any of a set of characters.
+bool matchGlob(const std::string& pattern, const std::string& key);
+
+///A compact store for the entries of a listing, able to hold many millions of
+///them. Rather than each being kept as an ObjectInfo, with its strings
+///allocated separately, keys are packed together into large blocks, and
+///sizes, modification times and ETags are kept in arrays of fixed-width
+///values, so that an entry costs little more than the length of its key plus
+///24 bytes, or 42 with ETags. Modification times are kept to the millisecond,
+///and ones which cannot be parsed are dropped.
+///
+///Entries are identified by their indices, in the order in which they were
+///added.
+class ListingTable{
+public:
+	///The properties by which entries may be ordered
+	enum class Column{Name,Size,Time};
+
+	///\param keepETags whether to store the ETags of objects
+	explicit ListingTable(bool keepETags=false);
+
+	///Add an object
+	///\throws std::runtime_error if its key is longer than 65535 bytes, or the
+	///        table already holds the largest possible number of entries
+	void add(const ObjectInfo& object);
+	///Add a common prefix, which is stored like an object with no size,
+	///modification time or ETag
+	///\throws std::runtime_error as for add
+	void addPrefix(const std::string& prefix);
+
+	///The number of entries
+	std::size_t size() const{ return(sizes.size()); }
+	bool empty() const{ return(sizes.empty()); }
+	///Whether an entry is a common prefix rather than an object
+	bool isPrefix(std::size_t index) const{ return(prefixes[index]); }
+	///Get the key of an entry, without copying it
+	///\param index the index of the entry
+	///\param length where the length of the key is stored
+	///\return the start of the key, which remains valid as long as the table
+	const char* key(std::size_t index, std::size_t& length) const;
+	std::string key(std::size_t index) const;
+	std::uint64_t objectSize(std::size_t index) const{ return(sizes[index]); }
+	///Whether an entry has a known modification time
+	bool hasTime(std::size_t index) const{ return(times[index]!=noTime); }
+	std::chrono::system_clock::time_point lastModified(std::size_t index) const;
+	///\return the ETag of an object, with its quotes, or an empty string if
+	///        ETags are not kept or the entry has none
+	std::string etag(std::size_t index) const;
+	///Fill in all of the information for an entry, reusing the storage of
+	///object's strings
+	void get(std::size_t index, ObjectInfo& object) const;
+
+	///Find the order of the entries according to one of their properties.
+	///Entries which are equal in that respect are ordered by key.
+	///\param column the property by which to order the entries
+	///\param descending whether the largest entries should be first
+	///\return the indices of the entries, in order
+	std::vector<std::uint32_t> order(Column column, bool descending=false) const;
+
+	///The approximate number of bytes of memory used
+	std::size_t memoryUsage() const;
+
+private:
+	static const std::int64_t noTime;
+	static const std::size_t blockSize=1<<20;
+
+	bool keepETags;
+	///Blocks of packed keys
+	std::vector<std::unique_ptr<char[]>> blocks;
+	///The number of bytes used in the last block
+	std::size_t blockUsed;
+	///For each entry, the position of its key, from the start of the first
+	///block, in the high 48 bits and its length in the low 16
+	std::vector<std::uint64_t> keys;
+	std::vector<std::uint64_t> sizes;
+	///Milliseconds since the epoch, or noTime
+	std::vector<std::int64_t> times;
+	std::vector<bool> prefixes;
+	///If ETags are kept, the MD5 digest in each entry's ETag, which is of the
+	///whole object for objects uploaded at once, or of the digests of its
+	///parts for multipart uploads
+	std::vector<std::array<unsigned char,16>> digests;
+	///For each entry, if ETags are kept, the number of parts given in its
+	///ETag, zero for a plain digest, or noETag or otherETag
+	std::vector<std::uint16_t> parts;
+	///ETags which are not of the usual forms, by entry
+	std::map<std::uint32_t,std::string> otherETags;
+
+	static const std::uint16_t noETag=0xFFFE;
+	static const std::uint16_t otherETag=0xFFFF;
+
+	void addEntry(const std::string& key, bool prefix);
+	void storeETag(const std::string& etag);
+};
+
+}
+
+#endif //S3TOOLS_LISTING_H
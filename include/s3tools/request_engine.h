@@ -0,0 +1,261 @@
+#ifndef S3TOOLS_REQUEST_ENGINE_H
+#define S3TOOLS_REQUEST_ENGINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <s3tools/url.h>
+
+namespace s3tools{
+
+///A description of a single HTTP request
+struct HTTPRequest{
+	///Value which a bodySource may return to abort the transfer
+	static constexpr std::size_t abortRead=0x10000000;
+
+	///The target URL, which should already be signed. Its verb and headers are
+	///used for the request.
+	URL url;
+	///Data to send as the request body, used if bodySource is not set
+	std::string body;
+	///If set, the request body is obtained by calling this function, which
+	///should fill the buffer it is given with up to the given number of bytes
+	///and return the number of bytes written, zero at the end of the data, or
+	///abortRead.
+	std::function<std::size_t(char*,std::size_t)> bodySource;
+	///The amount of data which bodySource will supply
+	std::uint64_t bodySize;
+	///If set, the response body is passed to this function as it arrives,
+	///rather than being collected in the HTTPResponse. Returning false aborts
+	///the transfer.
+	std::function<bool(const char*,std::size_t)> sink;
+	///Whether the body of a response with an error status (400 or above) is
+	///passed to sink. If not, it is collected in the HTTPResponse as usual,
+	///where the error it describes can be read, and sink receives nothing.
+	bool sinkErrors;
+	///Whether curl's progress meter should be shown
+	bool showProgress;
+	///The time by which the request must be complete, including any time
+	///spent waiting to be started. It will fail with RequestStatus::TimedOut
+	///if this is exceeded.
+	std::chrono::steady_clock::time_point deadline;
+	///Whether the request may be hedged: if it is a GET or HEAD request which
+	///has not begun to receive a response after a delay (see
+	///RequestEngine::Options::hedgePercentile), a duplicate is sent, to
+	///another endpoint if there is a choice. Whichever begins to receive a
+	///response first is used, and the other is cancelled.
+	bool hedge;
+
+	HTTPRequest(URL url):
+	url(std::move(url)),bodySize(0),sinkErrors(true),showProgress(false),
+	deadline(std::chrono::steady_clock::time_point::max()),hedge(false){}
+
+	///Send the given amount of data read from a stream as the request body
+	void readFrom(std::istream& in, std::uint64_t size);
+	///Write the response body to a stream
+	void writeTo(std::ostream& out);
+	///Set the deadline to be the given duration from now
+	void setTimeout(std::chrono::milliseconds timeout){
+		deadline=std::chrono::steady_clock::now()+timeout;
+	}
+};
+
+enum class RequestStatus{
+	///The request was made and a response received. The response may still
+	///have an HTTP error status.
+	Complete,
+	///The request could not be carried out
+	Failed,
+	///The request was cancelled before it could be completed
+	Cancelled,
+	///The request's deadline passed before it could be completed
+	TimedOut
+};
+
+///How long the phases of a request took, as reported by curl. Each time is
+///measured from the start of the transfer, so that later phases include the
+///earlier ones. Phases which were skipped, such as the TLS handshake for a
+///plain HTTP request, or the DNS lookup and connection setup when an existing
+///connection was reused, are zero.
+struct TransferTiming{
+	///Time until the host name was resolved
+	std::chrono::microseconds nameLookup;
+	///Time until the TCP connection to the server was established
+	std::chrono::microseconds connect;
+	///Time until the TLS handshake was complete
+	std::chrono::microseconds appConnect;
+	///Time until the first byte of the response was received
+	std::chrono::microseconds startTransfer;
+	///Time until the transfer finished
+	std::chrono::microseconds total;
+	///The number of bytes of request body sent
+	std::uint64_t bytesSent;
+	///The number of bytes of response body received
+	std::uint64_t bytesReceived;
+
+	TransferTiming():nameLookup(0),connect(0),appConnect(0),startTransfer(0),total(0),
+	bytesSent(0),bytesReceived(0){}
+};
+
+struct HTTPResponse{
+	RequestStatus result;
+	///The HTTP status code returned by the server, or zero if none was
+	///received
+	long status;
+	///The response body, unless it was directed to HTTPRequest::sink
+	std::string body;
+	///The response headers, with names converted to lowercase
+	std::map<std::string,std::string> headers;
+	///A description of what went wrong, if result is not Complete
+	std::string error;
+	///The timing of the transfer, which is left zero if it never started
+	TransferTiming timing;
+	///The number of times the request was moved to another of a set of
+	///equivalent endpoints after failing to connect to one
+	unsigned int retries;
+	///Whether a duplicate of the request was sent because it was slow to
+	///begin receiving a response
+	bool hedged;
+
+	HTTPResponse():result(RequestStatus::Failed),status(0),retries(0),hedged(false){}
+	bool complete() const{ return(result==RequestStatus::Complete); }
+};
+
+///An event driven engine for making many HTTP requests concurrently from a
+///single thread, built on libcurl's multi interface.
+///
+///Requests may be submitted from any thread. The engine makes progress only
+///while it is being driven, either by a thread which calls run() or poll(), or
+///by the background thread created by start(); in either case all transfers
+///are carried out and all completion callbacks are invoked on the driving
+///thread. Completion callbacks may submit or cancel further requests, but
+///must not block waiting for other requests, since nothing else will make
+///progress while they do.
+///
+///Connections, DNS results, and TLS sessions are retained by the engine and
+///reused between requests to the same server.
+class RequestEngine{
+public:
+	typedef std::uint64_t RequestID;
+	typedef std::function<void(HTTPResponse)> Callback;
+	///A function to be told about each request as it finishes
+	typedef std::function<void(const HTTPRequest&,const HTTPResponse&)> Observer;
+
+	struct Options{
+		///The largest number of requests which will be in progress at once.
+		///Further requests are queued until earlier ones finish.
+		std::size_t maxConcurrent;
+		///The largest number of connections which will be opened to a single
+		///host, or zero for no limit (or a limit of 4 when using HTTP/2).
+		long maxHostConnections;
+		///The path to a CA certificate bundle. If empty, a number of standard
+		///locations are checked.
+		std::string caBundlePath;
+		///Whether to use HTTP/2, so that concurrent requests to the same
+		///server are multiplexed over a few shared connections rather than
+		///each using its own. HTTP/2 is negotiated with HTTPS servers, which
+		///may fall back to HTTP/1.1, but plain HTTP servers are assumed to
+		///support it without negotiation, and requests to those which do not
+		///will fail. Otherwise, HTTP/1.1 is used.
+		bool http2;
+		///If set, this is called for each request when it finishes, whether
+		///successfully or not, just before the request's own completion
+		///callback. It is called on the thread driving the engine, and must
+		///not throw.
+		Observer observer;
+		///Sets of equivalent servers among which requests should be spread.
+		///Requests whose URLs have the same host and port as a key are sent
+		///to one of the servers whose URLs are listed for it, although their
+		///URLs (and so signatures, Host headers, and TLS certificate checks)
+		///are left unchanged. Only the hosts and ports of these URLs are
+		///used.
+		///
+		///Each request goes to the less loaded of two servers picked at
+		///random, judged by the number of requests each has in progress and
+		///how quickly each has recently begun responding. A server which
+		///cannot be reached, or which reports that it is overloaded or
+		///unavailable, is not used again for a while, and requests which
+		///could not connect to a server are retried on another.
+		std::map<std::string,std::vector<std::string>> endpoints;
+		///Hedged requests are duplicated if they have not begun to receive a
+		///response after this percentile of the times taken by recent GET and
+		///HEAD requests to do so.
+		double hedgePercentile;
+		///The delay after which hedged requests are duplicated until enough
+		///requests have been made to estimate the percentile
+		std::chrono::milliseconds hedgeDelay;
+		///The number of duplicates which may be sent, as a fraction of the
+		///number of hedged requests, limiting the extra load hedging may add.
+		///A few duplicates are allowed beyond this, so that hedging is useful
+		///when only a few requests are made.
+		double hedgeBudget;
+
+		Options():maxConcurrent(256),maxHostConnections(0),http2(false),
+		hedgePercentile(0.95),hedgeDelay(100),hedgeBudget(0.05){}
+	};
+
+	///\throws std::runtime_error if HTTP/2 is requested but libcurl does not
+	///        support it
+	RequestEngine(Options options=Options());
+	///Outstanding requests are cancelled when the engine is destroyed.
+	~RequestEngine();
+	RequestEngine(const RequestEngine&)=delete;
+	RequestEngine& operator=(const RequestEngine&)=delete;
+
+	///Queue a request to be performed.
+	///\param request the request
+	///\param callback the function to be called when the request finishes,
+	///                whether successfully or not
+	///\return an identifier which can be used to cancel the request
+	RequestID submit(HTTPRequest request, Callback callback);
+	///Queue a request to be performed.
+	///\return a future which will hold the response when the request finishes
+	std::future<HTTPResponse> submit(HTTPRequest request);
+
+	///Perform a request, waiting for it to finish. If the engine has not been
+	///started, the calling thread drives it (and so also progresses any other
+	///requests) until the request is finished.
+	///Must not be called from a completion callback.
+	HTTPResponse perform(HTTPRequest request);
+
+	///Cancel a request. Its callback will be invoked with a response whose
+	///result is RequestStatus::Cancelled, unless it finishes before the
+	///cancellation can take effect.
+	///\return false if the request is not known to be outstanding
+	bool cancel(RequestID id);
+
+	///Drive the engine until no requests are outstanding
+	void run();
+	///Drive the engine until at least one request finishes, no requests are
+	///outstanding, or the given amount of time passes.
+	///\return the number of requests which finished
+	std::size_t poll(std::chrono::milliseconds maxWait);
+
+	///Start a background thread which drives the engine
+	void start();
+	///Stop the background thread, if one is running. Outstanding requests are
+	///not cancelled, and will continue if the engine is driven again.
+	void stop();
+	///Whether a background thread started by start() is driving the engine
+	bool started() const;
+
+	///The number of requests which have been submitted but have not finished
+	std::size_t outstanding() const;
+
+	const Options& options() const;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+};
+
+}
+
+#endif //S3TOOLS_REQUEST_ENGINE_H
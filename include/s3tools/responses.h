@@ -0,0 +1,188 @@
+#ifndef S3TOOLS_RESPONSES_H
+#define S3TOOLS_RESPONSES_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <s3tools/request_engine.h>
+#include <s3tools/url.h>
+
+namespace s3tools{
+
+///Information about a stored object
+struct ObjectInfo{
+	std::string key;
+	std::uint64_t size;
+	std::string lastModified;
+	std::string etag;
+
+	ObjectInfo():size(0){}
+};
+
+///One page of results from a ListObjectsV2 request
+struct ListPage{
+	std::vector<ObjectInfo> objects;
+	std::vector<std::string> commonPrefixes;
+	///Whether there are further results to be fetched
+	bool truncated;
+	///The token with which to request the next page, if truncated
+	std::string nextContinuationToken;
+
+	ListPage():truncated(false){}
+};
+
+///An error reported by an S3 server
+class S3Error : public std::runtime_error{
+public:
+	S3Error(long status, std::string code, std::string message);
+	///The HTTP status of the response, or zero if not known
+	long status() const{ return(status_); }
+	///The S3 error code, e.g. 'NoSuchKey'
+	const std::string& code() const{ return(code_); }
+	const std::string& message() const{ return(message_); }
+private:
+	long status_;
+	std::string code_;
+	std::string message_;
+};
+
+///Construct the URL for a ListObjectsV2 request for the contents of a bucket,
+///or the part of a bucket under a prefix.
+///\param target a URL of the form scheme://host/bucket[/prefix]
+///\param delimiter the delimiter used to group keys into common prefixes, or
+///                 empty to list all keys under the prefix
+URL listObjectsURL(const std::string& target, const std::string& delimiter="/");
+
+///An incremental parser for ListBucketResult documents, which reports each
+///object and common prefix as soon as it has been read. This allows a listing
+///to be processed while it is still being received, using a fixed amount of
+///memory however long it is.
+class ListParser{
+public:
+	typedef std::function<void(const ObjectInfo&)> ObjectCallback;
+	typedef std::function<void(const std::string&)> PrefixCallback;
+	typedef std::function<void(const std::string&)> TokenCallback;
+
+	///\param onObject the function to be called for each object, in the order
+	///                they appear in the document. The object passed to it is
+	///                reused, so it must be copied if it is to be kept.
+	///\param onPrefix the function to be called for each common prefix
+	ListParser(ObjectCallback onObject, PrefixCallback onPrefix);
+	~ListParser();
+	ListParser(const ListParser&)=delete;
+	ListParser& operator=(const ListParser&)=delete;
+
+	///Parse the next part of the document.
+	///\throws std::runtime_error if the data is not well-formed XML, and
+	///        anything thrown by the callbacks
+	void feed(const char* data, std::size_t size);
+	///Finish parsing, once all of the document has been fed to the parser.
+	///\param status the HTTP status of the response containing the document,
+	///              if known, for use in reporting errors
+	///\throws S3Error if the document describes an error
+	///\throws std::runtime_error if the document is incomplete or is not a
+	///        ListBucketResult
+	void finish(long status=0);
+
+	///Whether there are further results to be fetched.
+	///\pre finish() has been called
+	bool truncated() const;
+	///The token with which to request the next page, if truncated
+	///\pre finish() has been called
+	const std::string& nextContinuationToken() const;
+	///Set a function to be called with the token for the next page as soon
+	///as it has been read. Servers send it before the entries of the page,
+	///so this allows the next page to be requested while the rest of this
+	///one is still being received.
+	void onContinuationToken(TokenCallback callback);
+
+	///Get a function which feeds data to this parser, suitable for use as
+	///HTTPRequest::sink. The parser must outlive the request.
+	std::function<bool(const char*,std::size_t)> sink();
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+};
+
+///Parse a ListBucketResult document.
+///\throws S3Error if the document describes an error
+///\throws std::runtime_error if the document cannot be interpreted
+ListPage parseListPage(const std::string& xml);
+
+///An object which a DeleteObjects request failed to delete
+struct DeleteError{
+	std::string key;
+	///The S3 error code, e.g. 'AccessDenied', or empty if the request as a
+	///whole failed without one
+	std::string code;
+	std::string message;
+};
+
+///Parse a DeleteResult document, the response to a DeleteObjects request.
+///\return the objects which could not be deleted
+///\throws S3Error if the document describes an error
+///\throws std::runtime_error if the document cannot be interpreted
+std::vector<DeleteError> parseDeleteResult(const std::string& xml);
+
+///Parse a CopyObjectResult document, the response to a CopyObject request.
+///A copy which fails after it has begun is reported by an Error document in
+///a response with a successful status, so the document must be checked even
+///if the status was.
+///\return the ETag of the new object
+///\throws S3Error if the document describes an error
+///\throws std::runtime_error if the document cannot be interpreted
+std::string parseCopyResult(const std::string& xml);
+
+///Check that a request completed and received a successful HTTP status.
+///\throws std::runtime_error if the request did not complete
+///\throws S3Error if the response has an HTTP error status, using the details
+///        from the S3 Error document in the body if there is one
+void checkResponse(const HTTPResponse& response);
+
+///Extract an object's metadata from the headers of a response to a HEAD or
+///GET request
+ObjectInfo objectInfoFromHeaders(const std::string& key, const HTTPResponse& response);
+
+///Parse an unsigned decimal integer, such as an object size. Unlike the
+///standard library's conversions, this neither allocates memory nor depends
+///on the locale, and it accepts only digits.
+///\param begin the start of the text
+///\param end the end of the text
+///\param result where the value is stored if it is valid
+///\return whether the text was a number which fits in the result
+bool parseUnsigned(const char* begin, const char* end, std::uint64_t& result);
+
+///Parse a timestamp in the format used by S3 listings, which is ISO 8601 in
+///UTC with optional fractional seconds: YYYY-MM-DDThh:mm:ss[.fff]Z
+///\param begin the start of the text
+///\param end the end of the text
+///\param result where the time is stored if it is valid
+///\return whether the text was a valid timestamp
+bool parseTimestamp(const char* begin, const char* end, std::chrono::system_clock::time_point& result);
+///\throws std::runtime_error if the text is not a valid timestamp
+std::chrono::system_clock::time_point parseTimestamp(const std::string& text);
+///Parse an ETag of the form S3 gives most objects: a quoted, lower case,
+///hexadecimal MD5 digest, followed, for objects uploaded in parts, by a dash
+///and the number of parts.
+///\param etag the ETag, with its quotes
+///\param digest where the digest is stored
+///\param parts where the number of parts is stored, or zero if none is given
+///\return whether the ETag is of that form, written as formatETag would
+bool parseETag(const std::string& etag, std::array<unsigned char,16>& digest, std::uint32_t& parts);
+///The inverse of parseETag
+std::string formatETag(const std::array<unsigned char,16>& digest, std::uint32_t parts);
+
+///Format a time in the form used by S3 listings, to the millisecond:
+///YYYY-MM-DDThh:mm:ss.fffZ
+std::string formatTimestamp(std::chrono::system_clock::time_point time);
+
+}
+
+#endif //S3TOOLS_RESPONSES_H
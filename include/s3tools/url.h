@@ -37,7 +37,7 @@ struct URL{
 	
 	//TODO: in general default port should depend on the scheme
 	URL(const std::string raw):verb("GET"),port(80){
-		std::regex url_regex(R"(^([^:]+)://(([^:]+)(:[^@]+)?@)?(([^:/]+)(:[0-9]+)?)?(/[^?#]*)?(\?[^#]*)?(#.*)?)",std::regex::extended);
+		static const std::regex url_regex(R"(^([^:]+)://(([^:]+)(:[^@]+)?@)?(([^:/]+)(:[0-9]+)?)?(/[^?#]*)?(\?[^#]*)?(#.*)?)",std::regex::extended);
 		std::smatch matches;
 		if(!std::regex_match(raw,matches,url_regex))
 			throw std::runtime_error("String '"+raw+"' not recognized as a valid URL (no match)");
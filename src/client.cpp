@@ -0,0 +1,268 @@
+#include <s3tools/client.h>
+
+#include <cstdio>
+#include <fstream>
+#include <future>
+
+#include <s3tools/deletion.h>
+#include <s3tools/listing.h>
+#include <s3tools/signing.h>
+
+namespace s3tools{
+
+namespace{
+
+///Add the equivalent endpoints listed with a collection of credentials to
+///engine options
+RequestEngine::Options withEndpoints(RequestEngine::Options options, const CredentialCollection& credentials){
+	for(const auto& record : credentials){
+		if(!record.second.endpoints.empty())
+			options.endpoints[record.first]=record.second.endpoints;
+	}
+	return(options);
+}
+
+///Wait for a request submitted to an engine, driving the engine if it has
+///not been started
+HTTPResponse wait(RequestEngine& engine, std::future<HTTPResponse>& result){
+	while(result.wait_for(std::chrono::seconds(0))!=std::future_status::ready)
+		engine.poll(std::chrono::milliseconds(100));
+	return(result.get());
+}
+
+} //anonymous namespace
+
+struct Listing::Impl{
+	RequestEngine& engine;
+	///Set for recursive listings, which are made entirely by the lister
+	std::unique_ptr<ObjectLister> lister;
+
+	//For listings grouped by prefix, which are made a page at a time
+	std::function<HTTPRequest(const URL&)> sign;
+	URL listURL;
+	///The request for the next page, if one has been made
+	std::future<HTTPResponse> nextPage;
+	bool pending;
+	ListPage page;
+	///The position in the current page, counting its objects and then its
+	///prefixes
+	std::size_t position;
+	std::size_t requestCount;
+
+	explicit Impl(RequestEngine& engine):
+	engine(engine),pending(false),position(0),requestCount(0){}
+
+	void request(){
+		nextPage=engine.submit(sign(listURL));
+		pending=true;
+		requestCount++;
+	}
+
+	bool next(ListEntry& entry){
+		if(lister){
+			entry.isPrefix=false;
+			return(lister->next(entry.object));
+		}
+		while(position==page.objects.size()+page.commonPrefixes.size()){
+			if(!pending)
+				return(false);
+			pending=false;
+			HTTPResponse response=wait(engine,nextPage);
+			checkResponse(response);
+			page=parseListPage(response.body);
+			position=0;
+			if(page.truncated){
+				listURL.query["continuation-token"]=page.nextContinuationToken;
+				request();
+			}
+		}
+		if(position<page.objects.size()){
+			entry.object=page.objects[position];
+			entry.isPrefix=false;
+		}
+		else{
+			entry.object=ObjectInfo();
+			entry.object.key=page.commonPrefixes[position-page.objects.size()];
+			entry.isPrefix=true;
+		}
+		position++;
+		return(true);
+	}
+};
+
+Listing::Listing(std::unique_ptr<Impl> impl):impl(std::move(impl)){}
+
+Listing::Listing(Listing&& other):impl(std::move(other.impl)),current(std::move(other.current)){}
+
+Listing::~Listing(){}
+
+Listing::iterator Listing::begin(){
+	if(!next(current))
+		return(end());
+	return(iterator(this));
+}
+
+bool Listing::next(ListEntry& entry){
+	return(impl->next(entry));
+}
+
+std::size_t Listing::requests() const{
+	return(impl->lister ? impl->lister->requests() : impl->requestCount);
+}
+
+Client::Client(RequestEngine::Options options):
+Client(fetchStoredCredentials(),std::move(options)){}
+
+Client::Client(const CredentialCollection& credentials, RequestEngine::Options options):
+credentials(credentials),eng(withEndpoints(std::move(options),credentials)),hedging(false),progress(false){}
+
+const credential& Client::credentialFor(const std::string& url) const{
+	return(findCredentials(credentials,url).second);
+}
+
+HTTPRequest Client::request(const std::string& verb, const URL& url) const{
+	const credential& cred=credentialFor(url.str());
+	HTTPRequest req(genURL(cred.username,cred.key,verb,url,60));
+	req.hedge=hedging && (verb=="GET" || verb=="HEAD");
+	req.showProgress=progress;
+	return(req);
+}
+
+HTTPResponse Client::perform(HTTPRequest request){
+	std::string verb=request.url.verb;
+	HTTPResponse response=eng.perform(std::move(request));
+	if(!response.complete())
+		throw std::runtime_error(verb+" request failed: "+response.error);
+	return(response);
+}
+
+HTTPResponse Client::performChecked(HTTPRequest request){
+	HTTPResponse response=perform(std::move(request));
+	checkResponse(response);
+	return(response);
+}
+
+std::string Client::get(const std::string& url){
+	return(performChecked(request("GET",URL(url))).body);
+}
+
+void Client::get(const std::string& url, std::ostream& out){
+	HTTPRequest req=request("GET",URL(url));
+	req.writeTo(out);
+	//an error document is collected in the response, for checkResponse
+	req.sinkErrors=false;
+	performChecked(std::move(req));
+}
+
+void Client::getFile(const std::string& url, const std::string& path){
+	std::ofstream file(path,std::ios::out|std::ios::binary);
+	if(!file)
+		throw std::runtime_error("Unable to open "+path+" for writing");
+	try{
+		get(url,file);
+		file.close();
+		if(file.fail())
+			throw std::runtime_error("Failed to write to "+path);
+	}catch(...){
+		file.close();
+		std::remove(path.c_str());
+		throw;
+	}
+}
+
+void Client::put(const std::string& url, const std::string& data){
+	HTTPRequest req=request("PUT",URL(url));
+	req.body=data;
+	performChecked(std::move(req));
+}
+
+void Client::put(const std::string& url, std::istream& in, std::uint64_t size){
+	HTTPRequest req=request("PUT",URL(url));
+	req.readFrom(in,size);
+	performChecked(std::move(req));
+}
+
+void Client::putFile(const std::string& url, const std::string& path){
+	std::ifstream file(path,std::ios::in|std::ios::binary);
+	if(!file)
+		throw std::runtime_error("Unable to open "+path+" for reading");
+	file.seekg(0,std::ios_base::end);
+	std::streampos size=file.tellg();
+	file.seekg(0,std::ios_base::beg);
+	if(size<0)
+		throw std::runtime_error("Unable to determine the size of "+path);
+	put(url,file,size);
+}
+
+ObjectInfo Client::head(const std::string& url){
+	URL target(url);
+	HTTPResponse response=performChecked(request("HEAD",target));
+	std::size_t slash=target.path.find('/',1);
+	return(objectInfoFromHeaders(slash==std::string::npos ? "" : target.path.substr(slash+1),response));
+}
+
+void Client::copy(const std::string& source, const std::string& destination){
+	URL sourceURL(source);
+	URL destURL(destination);
+	if(destURL.host!=sourceURL.host)
+		throw std::runtime_error("Cannot do a server-side copy between two different hosts");
+	destURL.headers["x-amz-copy-source"]=sourceURL.path;
+	destURL.headers["x-amz-content-sha256"]=lowercase(SHA256Hash(""));
+	const credential& cred=credentialFor(destination);
+	HTTPRequest req(genURLNoQuery(cred.username,cred.key,"PUT",destURL,60));
+	req.showProgress=progress;
+	HTTPResponse response=performChecked(std::move(req));
+	//a copy which fails after it has begun is reported in a successful response
+	parseCopyResult(response.body);
+}
+
+void Client::remove(const std::string& url){
+	performChecked(request("DELETE",URL(url)));
+}
+
+std::size_t Client::remove(const std::vector<std::string>& urls,
+                           const std::function<void(const std::string&,const DeleteError&)>& onError,
+                           std::size_t concurrency){
+	return(remove(groupByBucket(urls),onError,concurrency));
+}
+
+std::size_t Client::remove(const std::vector<BucketObjects>& objects,
+                           const std::function<void(const std::string&,const DeleteError&)>& onError,
+                           std::size_t concurrency){
+	std::vector<std::string> bucketURLs;
+	for(const auto& bucket : objects)
+		bucketURLs.push_back(bucket.bucket.str());
+	//the deletions from all buckets proceed together
+	std::vector<std::unique_ptr<BatchDeleter>> deleters;
+	for(std::size_t i=0; i<objects.size(); i++){
+		const BucketObjects& bucket=objects[i];
+		const std::string& bucketURL=bucketURLs[i];
+		deleters.emplace_back(new BatchDeleter(eng,credentialFor(bucketURL),bucket.bucket,concurrency,
+		  [&onError,&bucketURL](const DeleteError& error){
+			if(onError)
+				onError(bucketURL+'/'+error.key,error);
+		}));
+		for(const auto& key : bucket.keys)
+			deleters.back()->remove(key);
+	}
+	std::size_t deleted=0;
+	for(auto& deleter : deleters){
+		deleter->finish();
+		deleted+=deleter->deleted();
+	}
+	return(deleted);
+}
+
+Listing Client::list(const std::string& url, bool recursive, std::size_t concurrency){
+	std::unique_ptr<Listing::Impl> impl(new Listing::Impl(eng));
+	if(recursive)
+		impl->lister.reset(new ObjectLister(eng,credentialFor(url),url,concurrency));
+	else{
+		impl->listURL=listObjectsURL(url);
+		impl->sign=[this](const URL& url){ return(request("GET",url)); };
+		impl->request();
+	}
+	return(Listing(std::move(impl)));
+}
+
+}
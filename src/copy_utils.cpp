@@ -0,0 +1,82 @@
+#include "copy_utils.h"
+
+#include <stdexcept>
+
+#include <sys/stat.h> //for stat
+
+#include <s3tools/url.h>
+
+bool isURL(const std::string& s){
+	try{
+		s3tools::URL url(s);
+		return(true);
+	}catch(...){}
+	return(false);
+}
+
+bool isDirectory(const std::string& path){
+	struct stat data;
+	int err=stat(path.c_str(),&data);
+	if(err!=0){
+		//Treat all errors as indicating that the path is not a directory.
+		//This is not entirely right since it might be an inaccessible regular 
+		//file or there might have been a true failure of stat(), but for our 
+		//use it mostly doesn't matter; we'll just fail when we try to write to 
+		//the file
+		return(false);
+	}
+	return((data.st_mode&S_IFMT)==S_IFDIR);
+}
+
+namespace{
+
+void serversideCopy(s3tools::Client& client, const std::string& src, const std::string& dest){
+	try{
+		client.copy(src,dest);
+	}catch(s3tools::S3Error& err){
+		if(err.code()!="NoSuchKey")
+			throw;
+		throw s3tools::S3Error(err.status(),err.code(),"The source object "+src+" does not exist.");
+	}
+}
+
+void downloadFile(s3tools::Client& client, const std::string& src, std::string dest){
+	//if writing to a directory, figure out the basename of the source file
+	//and append it. 
+	if(isDirectory(dest)){
+		std::string srcPath=s3tools::URL(src).path;
+		//just assume POSIX path syntax
+		size_t lastSlash=srcPath.rfind('/');
+		if(lastSlash==std::string::npos) //no slash, take the whole thing
+			dest+="/"+srcPath;
+		else if(lastSlash+1==srcPath.size()){
+			//we don't yet know how to download 'directories'!
+			throw std::runtime_error("Source path does not appear to be a single file");
+		}
+		else
+			dest+=srcPath.substr(lastSlash);
+	}
+	client.getFile(src,dest);
+}
+
+void uploadFile(s3tools::Client& client, const std::string& src, const std::string& dest){
+	//we don't yet know how to upload directories!
+	if(isDirectory(src))
+		throw std::runtime_error("Source path does not appear to be a single file");
+	client.putFile(dest,src);
+}
+
+} //anonymous namespace
+
+void copyObject(s3tools::Client& client, const std::string& src, std::string dest){
+	bool srcIsURL=isURL(src);
+	bool destIsURL=isURL(dest);
+	if(srcIsURL && destIsURL)
+		serversideCopy(client,src,dest);
+	else if(srcIsURL)
+		downloadFile(client,src,std::move(dest));
+	else if(destIsURL)
+		uploadFile(client,src,dest);
+	else
+		throw std::runtime_error("Either the source or the destination must be a URL");
+}
@@ -0,0 +1,25 @@
+#ifndef S3TOOLS_COPY_UTILS_H
+#define S3TOOLS_COPY_UTILS_H
+
+#include <string>
+
+#include <s3tools/client.h>
+
+///Checks whether a string can be parsed as a URL
+bool isURL(const std::string& s);
+
+///Checks whether the path exists and is a directory
+bool isDirectory(const std::string& path);
+
+///Copy an object within its server, download an object to a file, or upload
+///a file as an object, according to which of the source and destination are
+///URLs. A download to a directory is written to a file named for the last
+///component of the object's key.
+///\throws S3Error if the server reports an error. If the source of a copy
+///        within a server does not exist, the error's code is NoSuchKey and
+///        its message names the source.
+///\throws std::runtime_error if neither argument is a URL, a directory is
+///        given as the source, or a request cannot be made
+void copyObject(s3tools::Client& client, const std::string& src, std::string dest);
+
+#endif //S3TOOLS_COPY_UTILS_H
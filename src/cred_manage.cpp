@@ -1,12 +1,18 @@
 #include <s3tools/cred_manage.h>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <map>
+#include <mutex>
 #include <sstream>
 
-#include <cstdlib> //for getenv
-#include <unistd.h> //for getuid
+#include <cstdint>
+#include <cstdio> //for rename
+#include <cstdlib> //for getenv, mkstemp
+#include <ctime> //for time
+#include <unistd.h> //for getuid, write, close, unlink
 #include <sys/stat.h> //for stat
 #include <sys/types.h> //
 #include <sys/errno.h> //for errno, error codes
@@ -91,7 +97,22 @@ CredentialCollection parseCredentials(std::istream& credFile, const std::string&
 		if(!credFile)
 			throw std::runtime_error("Failed to find expected delimiter (\") for end of key in entry "
 			                         +std::to_string(entry)+" of "+path);
-		credentials.emplace(url,credential{username,key});
+		//an optional list of endpoints, which cannot be confused with the url
+		//beginning the next entry
+		std::vector<std::string> endpoints;
+		credFile >> std::ws;
+		if(credFile.peek()=='['){
+			credFile.get();
+			while(credFile >> delim && delim=='"'){
+				std::string endpoint;
+				std::getline(credFile,endpoint,'"');
+				endpoints.push_back(endpoint);
+			}
+			if(delim!=']' || !credFile)
+				throw std::runtime_error("Failed to find expected delimiter (]) for end of endpoints in entry "
+				                         +std::to_string(entry)+" of "+path);
+		}
+		credentials.emplace(url,credential{username,key,endpoints});
 	}
 	if(credFile.bad())
 		throw std::runtime_error("Error reading from "+path);
@@ -209,6 +230,8 @@ CredentialCollection parseCredentialsJSON(std::istream& credFile, const std::str
 	auto parseRecord=[&]()->std::pair<std::string,credential>{
 		//read the JSON into a raw data map
 		std::map<std::string,std::string> rawData;
+		//except for endpoints, which are an array of strings
+		std::vector<std::string> endpoints;
 		auto recordStart=credFile.tellg();
 		char c;
 		while(true){
@@ -228,8 +251,33 @@ CredentialCollection parseCredentialsJSON(std::istream& credFile, const std::str
 			//Member value:
 			skipWhitespace();
 			checkUnexpectedEnd();
-			std::string value=parseString();
-			rawData[key]=value;
+			if(key=="endpoints" && credFile.peek()=='['){
+				credFile.get();
+				skipWhitespace();
+				checkUnexpectedEnd();
+				if(credFile.peek()==']')
+					credFile.get();
+				else{
+					while(true){
+						skipWhitespace();
+						endpoints.push_back(parseString());
+						credFile >> c;
+						checkUnexpectedEnd();
+						if(c==']')
+							break;
+						else if(c!=','){
+							auto offset=credFile.tellg()-startPos;
+							throw std::runtime_error("Unexpected character '"+std::string(1,c)+
+							                         "' where a value-separator between array items was expected at offset "+
+							                         std::to_string(offset)+" of "+path);
+						}
+					}
+				}
+			}
+			else{
+				std::string value=parseString();
+				rawData[key]=value;
+			}
 			//Value separator or end of object:
 			credFile >> c;
 			checkUnexpectedEnd();
@@ -255,7 +303,7 @@ CredentialCollection parseCredentialsJSON(std::istream& credFile, const std::str
 		checkKey("username");
 		checkKey("key");
 		
-		return std::make_pair(rawData["url"],credential{rawData["username"],rawData["key"]});
+		return std::make_pair(rawData["url"],credential{rawData["username"],rawData["key"],endpoints});
 	};
 	
 	CredentialCollection credentials;
@@ -304,6 +352,190 @@ CredentialCollection readCredentials(std::istream& credFile, const std::string&
 		throw std::runtime_error("Unable to recognize the format of "+path);
 }
 	
+///The identity of one version of the credential file, with which a cached
+///copy of its contents is labelled
+struct CredFileVersion{
+	std::uint64_t device;
+	std::uint64_t inode;
+	std::uint64_t size;
+	std::uint64_t mtimeSec;
+	std::uint64_t mtimeNsec;
+	
+	bool operator==(const CredFileVersion& other) const{
+		return(device==other.device && inode==other.inode && size==other.size
+		       && mtimeSec==other.mtimeSec && mtimeNsec==other.mtimeNsec);
+	}
+};
+
+///\return false if the file could not be examined
+bool getFileVersion(const std::string& path, CredFileVersion& version){
+	struct stat data;
+	if(stat(path.c_str(),&data)!=0)
+		return(false);
+	version.device=data.st_dev;
+	version.inode=data.st_ino;
+	version.size=data.st_size;
+#if __APPLE__ && __MACH__
+	version.mtimeSec=data.st_mtimespec.tv_sec;
+	version.mtimeNsec=data.st_mtimespec.tv_nsec;
+#else
+	version.mtimeSec=data.st_mtim.tv_sec;
+	version.mtimeNsec=data.st_mtim.tv_nsec;
+#endif
+	return(true);
+}
+
+///Whether a file was modified so recently that it could be modified again
+///without its modification time changing, on file systems with coarse
+///timestamps. The contents of such a file are not cached, since the cache
+///could not be told apart from one of the next version.
+bool racilyModified(const CredFileVersion& version){
+	return(version.mtimeSec+2>=(std::uint64_t)std::time(nullptr));
+}
+
+//The binary cache of the credential file holds the cacheMagic, the version of
+//the file from which it was made, the number of credentials, and then each
+//credential's URL, username, key, and endpoints, followed by an FNV-1a hash of
+//everything before it. Strings are written as their lengths followed by their
+//contents, and all integers in the machine's byte order, since the cache is
+//only meaningful on the machine which wrote it.
+const char cacheMagic[8]={'s','3','t','c','r','e','d','1'};
+
+///Compute the 64 bit FNV-1a hash of some data
+std::uint64_t fnv1aHash(const char* data, std::size_t size){
+	std::uint64_t hash=14695981039346656037ULL;
+	for(std::size_t i=0; i<size; i++){
+		hash^=(unsigned char)data[i];
+		hash*=1099511628211ULL;
+	}
+	return(hash);
+}
+
+std::string serializeCredentials(const CredFileVersion& version, const CredentialCollection& credentials){
+	std::string data(cacheMagic,sizeof(cacheMagic));
+	auto appendInt=[&data](std::uint64_t value){
+		data.append((const char*)&value,sizeof(value));
+	};
+	auto appendString=[&](const std::string& value){
+		appendInt(value.size());
+		data+=value;
+	};
+	for(std::uint64_t field : {version.device,version.inode,version.size,version.mtimeSec,version.mtimeNsec})
+		appendInt(field);
+	appendInt(credentials.size());
+	for(const auto& record : credentials){
+		appendString(record.first);
+		appendString(record.second.username);
+		appendString(record.second.key);
+		appendInt(record.second.endpoints.size());
+		for(const auto& endpoint : record.second.endpoints)
+			appendString(endpoint);
+	}
+	appendInt(fnv1aHash(data.data(),data.size()));
+	return(data);
+}
+
+///\return false if the data is not a valid cache of the given version of the
+///        credential file
+bool deserializeCredentials(const std::string& data, const CredFileVersion& version,
+                            CredentialCollection& credentials){
+	const std::size_t hashSize=sizeof(std::uint64_t);
+	if(data.size()<sizeof(cacheMagic)+hashSize || data.compare(0,sizeof(cacheMagic),cacheMagic,sizeof(cacheMagic))!=0)
+		return(false);
+	const std::size_t end=data.size()-hashSize;
+	std::uint64_t hash;
+	std::memcpy(&hash,data.data()+end,hashSize);
+	if(hash!=fnv1aHash(data.data(),end))
+		return(false);
+	
+	std::size_t offset=sizeof(cacheMagic);
+	auto readInt=[&](std::uint64_t& value)->bool{
+		if(end-offset<sizeof(value))
+			return(false);
+		std::memcpy(&value,data.data()+offset,sizeof(value));
+		offset+=sizeof(value);
+		return(true);
+	};
+	auto readString=[&](std::string& value)->bool{
+		std::uint64_t length;
+		if(!readInt(length) || end-offset<length)
+			return(false);
+		value.assign(data,offset,length);
+		offset+=length;
+		return(true);
+	};
+	CredFileVersion cachedVersion;
+	std::uint64_t count;
+	if(!readInt(cachedVersion.device) || !readInt(cachedVersion.inode) || !readInt(cachedVersion.size)
+	   || !readInt(cachedVersion.mtimeSec) || !readInt(cachedVersion.mtimeNsec) || !readInt(count))
+		return(false);
+	if(!(cachedVersion==version))
+		return(false);
+	CredentialCollection result;
+	for(std::uint64_t i=0; i<count; i++){
+		std::string url;
+		credential cred;
+		std::uint64_t endpointCount;
+		if(!readString(url) || !readString(cred.username) || !readString(cred.key) || !readInt(endpointCount))
+			return(false);
+		for(std::uint64_t j=0; j<endpointCount; j++){
+			std::string endpoint;
+			if(!readString(endpoint))
+				return(false);
+			cred.endpoints.push_back(std::move(endpoint));
+		}
+		result.emplace(std::move(url),std::move(cred));
+	}
+	if(offset!=end)
+		return(false);
+	credentials.swap(result);
+	return(true);
+}
+
+///Read the cached contents of the credential file, if the cache is valid
+///and matches the file's current version
+bool loadCredentialCache(const std::string& cachePath, const CredFileVersion& version,
+                         CredentialCollection& credentials){
+	try{
+		//a cache which others could have written is not trusted
+		if(checkPermissions(cachePath)!=PermState::VALID)
+			return(false);
+	}catch(std::runtime_error&){
+		return(false);
+	}
+	std::ifstream cacheFile(cachePath,std::ios::binary);
+	if(!cacheFile)
+		return(false);
+	std::ostringstream contents;
+	contents << cacheFile.rdbuf();
+	return(deserializeCredentials(contents.str(),version,credentials));
+}
+
+///Write the cache of the credential file. This is done by writing a new file,
+///created with mode 0600, and renaming it over the old one, so that a cache
+///is never seen partly written. Failure is not an error, since the cache can
+///always be rebuilt.
+void saveCredentialCache(const std::string& cachePath, const CredFileVersion& version,
+                         const CredentialCollection& credentials){
+	std::string data=serializeCredentials(version,credentials);
+	std::string tempPath=cachePath+".XXXXXX";
+	int fd=mkstemp(&tempPath[0]);
+	if(fd<0)
+		return;
+	std::size_t written=0;
+	while(written<data.size()){
+		ssize_t result=write(fd,data.data()+written,data.size()-written);
+		if(result<0 && errno==EINTR)
+			continue;
+		if(result<=0)
+			break;
+		written+=result;
+	}
+	bool success=(close(fd)==0 && written==data.size());
+	if(!success || std::rename(tempPath.c_str(),cachePath.c_str())!=0)
+		unlink(tempPath.c_str());
+}
+
 CredentialCollection fetchStoredCredentials(){
 	std::string path=getCredFilePath();
 	PermState perms=checkPermissions(path);
@@ -313,16 +545,49 @@ CredentialCollection fetchStoredCredentials(){
 	if(perms==PermState::DOES_NOT_EXIST)
 		return(credentials); //nothing to read, we're done
 	
-	std::ifstream credFile(path);
-	if(!credFile) //this mostly shouldn't happen since we already checked the permissions
-		throw std::runtime_error("Failed to open credentials file "+path+" for reading");
+	//the most recently read credentials, kept for the rest of the process
+	static std::mutex cacheLock;
+	static std::string cachedPath;
+	static CredFileVersion cachedVersion;
+	static CredentialCollection cachedCredentials;
+	CredFileVersion version;
+	if(!getFileVersion(path,version))
+		throw std::runtime_error("Unable to stat "+path);
+	{
+		std::lock_guard<std::mutex> guard(cacheLock);
+		if(!cachedPath.empty() && cachedPath==path && cachedVersion==version)
+			return(cachedCredentials);
+	}
 	
-	credentials=parseCredentials(credFile,path);
+	bool racy=racilyModified(version);
+	const std::string cachePath=path+".cache";
+	if(racy || !loadCredentialCache(cachePath,version,credentials)){
+		std::ifstream credFile(path);
+		if(!credFile) //this mostly shouldn't happen since we already checked the permissions
+			throw std::runtime_error("Failed to open credentials file "+path+" for reading");
+		
+		credentials=parseCredentials(credFile,path);
+		if(!racy)
+			saveCredentialCache(cachePath,version,credentials);
+	}
+	if(!racy){
+		std::lock_guard<std::mutex> guard(cacheLock);
+		cachedPath=path;
+		cachedVersion=version;
+		cachedCredentials=credentials;
+	}
 	return(credentials);
 }
 	
 std::ostream& writeCredentialRecord(std::ostream& os, const std::string& url, const credential& cred){
-	return(os << url << "\n\t\"" << cred.username << "\"\n\t\"" << cred.key << "\"\n");
+	os << url << "\n\t\"" << cred.username << "\"\n\t\"" << cred.key << "\"\n";
+	if(!cred.endpoints.empty()){
+		os << "\t[";
+		for(const auto& endpoint : cred.endpoints)
+			os << "\n\t\t\"" << endpoint << '"';
+		os << "\n\t]\n";
+	}
+	return(os);
 }
 
 void writeCredentials(std::ostream& os, const CredentialCollection& credentials){
@@ -360,7 +625,14 @@ void writeCredentialsJSON(std::ostream& os, const CredentialCollection& credenti
 			os << ',';
 		os << "{\"url\":\"" << jsonSafeString(record.first) << "\",\"username\":\"" 
 		   << jsonSafeString(record.second.username) << "\",\"key\":\""
-		   << jsonSafeString(record.second.key) << "\"}";
+		   << jsonSafeString(record.second.key) << '"';
+		if(!record.second.endpoints.empty()){
+			os << ",\"endpoints\":[";
+			for(std::size_t i=0; i<record.second.endpoints.size(); i++)
+				os << (i ? "," : "") << '"' << jsonSafeString(record.second.endpoints[i]) << '"';
+			os << ']';
+		}
+		os << '}';
 	}
 	os << "]\n";
 }
@@ -502,6 +774,50 @@ std::pair<std::string,credential> findCredentials(const CredentialCollection& cr
 	return(*credentials.find(bestMatch));
 }
 
+CredentialIndex::CredentialIndex(const CredentialCollection& credentials){
+	entries.reserve(credentials.size());
+	for(const auto& record : credentials){
+		//as in findCredentials, an empty URL matches nothing
+		if(!record.first.empty())
+			entries.push_back(record);
+	}
+	std::sort(entries.begin(),entries.end(),
+	          [](const Entry& a, const Entry& b){ return(a.first<b.first); });
+}
+
+const CredentialIndex::Entry* CredentialIndex::find(const std::string& urlStr) const{
+	//If the greatest URL in the index which is not after the first length
+	//characters of the target is a prefix of the target, it is the longest
+	//one, since any longer prefix would fall between them. Otherwise, no
+	//prefix can extend beyond the characters which the two have in common, so
+	//the search is repeated for those, which are fewer than before.
+	std::size_t length=urlStr.size();
+	while(true){
+		auto it=std::upper_bound(entries.begin(),entries.end(),urlStr,
+		  [length](const std::string& url, const Entry& entry){
+			return(url.compare(0,length,entry.first)<0);
+		  });
+		if(it==entries.begin())
+			return(nullptr);
+		--it;
+		const std::string& candidate=it->first;
+		std::size_t common=std::mismatch(candidate.begin(),candidate.begin()+std::min(candidate.size(),length),
+		                                 urlStr.begin()).first-candidate.begin();
+		if(common==candidate.size())
+			return(&*it);
+		if(common==0)
+			return(nullptr);
+		length=common;
+	}
+}
+
+const CredentialIndex::Entry& findCredentials(const CredentialIndex& index, const std::string& urlStr){
+	const CredentialIndex::Entry* entry=index.find(urlStr);
+	if(!entry)
+		throw std::runtime_error("No stored credentials found for URL "+urlStr);
+	return(*entry);
+}
+
 void exportCredentials(std::ostream& targetStream,
                        const CredentialCollection& credentials,
                        CredFormat format){
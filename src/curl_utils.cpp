@@ -1,10 +1,11 @@
 #include "curl_utils.h"
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
-#include <sys/stat.h> //for stat
-
 size_t collectOutput(void* buffer, size_t size, size_t nmemb, void* userp){
 	std::string* out=static_cast<std::string*>(userp);
 	//curl can't tolerate exceptions, so stop them and log them to stderr here
@@ -27,23 +28,136 @@ void reportCurlError(std::string expl, CURLcode err, const char* errBuf){
 		throw std::runtime_error(expl+"\n curl error: "+curl_easy_strerror(err));
 }
 
-#ifdef USE_CURLOPT_CAINFO
-std::string detectCABundlePath(){
-	//collection of known paths, copied from curl's acinclude.m4
-	const static auto possiblePaths={
-		"/etc/ssl/certs/ca-certificates.crt",     //Debian systems
-		"/etc/pki/tls/certs/ca-bundle.crt",       //Redhat and Mandriva
-		"/usr/share/ssl/certs/ca-bundle.crt",     //old(er) Redhat
-		"/usr/local/share/certs/ca-root-nss.crt", //FreeBSD
-		"/etc/ssl/cert.pem",                      //OpenBSD, FreeBSD (symlink)
-		"/etc/ssl/certs/",                        //SUSE
-	};
-	struct stat data;
-	for(const auto path : possiblePaths){
-		int err=stat(path,&data);
-		if(err==0)
-			return path;
+namespace{
+
+std::string jsonString(const std::string& input){
+	std::ostringstream output;
+	output << '"' << std::hex << std::setfill('0');
+	for(char c : input){
+		if(c=='"')
+			output << R"(\")";
+		else if(c=='\\')
+			output << R"(\\)";
+		else if((unsigned char)c<=0x1F)
+			output << "\\u" << std::setw(4) << (int)c;
+		else
+			output << c;
+	}
+	output << '"';
+	return(output.str());
+}
+
+double seconds(std::chrono::steady_clock::duration time){
+	return(std::chrono::duration_cast<std::chrono::duration<double>>(time).count());
+}
+
+}
+
+RequestTrace::RequestTrace(const std::string& path):
+out(path),begin(std::chrono::steady_clock::now()),
+first(std::chrono::steady_clock::time_point::max()),last(begin),bytes(0),failures(0){
+	if(!out)
+		throw std::runtime_error("Unable to open trace file "+path);
+	out << std::fixed << std::setprecision(6);
+}
+
+void RequestTrace::record(const HTTPRequest& request, const HTTPResponse& response){
+	const s3tools::TransferTiming& timing=response.timing;
+	auto finish=std::chrono::steady_clock::now();
+	auto start=finish-timing.total;
+	first=std::min(first,start);
+	last=std::max(last,finish);
+	latencies.push_back(timing.total);
+	bytes+=timing.bytesSent+timing.bytesReceived;
+	if(!response.complete() || response.status>=400)
+		failures++;
+
+	//presigned URLs carry their signatures in the query, which should not be
+	//copied anywhere
+	s3tools::URL url=request.url;
+	url.username.clear();
+	url.password.clear();
+	for(auto it=url.query.begin(); it!=url.query.end();){
+		if(s3tools::lowercase(it->first.substr(0,6))=="x-amz-")
+			it=url.query.erase(it);
+		else
+			++it;
+	}
+	const char* result="failed";
+	switch(response.result){
+		case s3tools::RequestStatus::Complete: result="complete"; break;
+		case s3tools::RequestStatus::Failed: result="failed"; break;
+		case s3tools::RequestStatus::Cancelled: result="cancelled"; break;
+		case s3tools::RequestStatus::TimedOut: result="timed out"; break;
+	}
+	out << "{\"verb\":" << jsonString(url.verb)
+	    << ",\"url\":" << jsonString(url.str())
+	    << ",\"result\":\"" << result << '"'
+	    << ",\"status\":" << response.status;
+	if(!response.complete())
+		out << ",\"error\":" << jsonString(response.error);
+	out << ",\"start\":" << seconds(std::max(start,begin)-begin)
+	    << ",\"namelookup\":" << seconds(timing.nameLookup)
+	    << ",\"connect\":" << seconds(timing.connect)
+	    << ",\"appconnect\":" << seconds(timing.appConnect)
+	    << ",\"starttransfer\":" << seconds(timing.startTransfer)
+	    << ",\"total\":" << seconds(timing.total)
+	    << ",\"bytes_sent\":" << timing.bytesSent
+	    << ",\"bytes_received\":" << timing.bytesReceived
+	    << ",\"retries\":" << response.retries
+	    << ",\"hedged\":" << (response.hedged ? "true" : "false")
+	    << "}\n";
+}
+
+void RequestTrace::summarize(std::ostream& os) const{
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(1);
+	summary << "Requests: " << latencies.size() << " (" << failures << " failed)\n";
+	if(!latencies.empty()){
+		std::vector<std::chrono::microseconds> sorted=latencies;
+		std::sort(sorted.begin(),sorted.end());
+		//nearest-rank percentiles
+		auto percentile=[&](unsigned int p){
+			std::size_t rank=(p*sorted.size()+99)/100;
+			return(seconds(sorted[std::max<std::size_t>(rank,1)-1])*1000);
+		};
+		summary << "Latency: p50 " << percentile(50) << " ms, p95 " << percentile(95)
+		        << " ms, p99 " << percentile(99) << " ms\n";
+		double elapsed=seconds(last-std::min(first,last));
+		summary << "Throughput: " << bytes << " bytes in " << std::setprecision(3) << elapsed << " s";
+		if(elapsed>0)
+			summary << " (" << std::setprecision(2) << bytes/elapsed/(1<<20) << " MiB/s)";
+		summary << '\n';
+	}
+	os << summary.str();
+}
+
+s3tools::RequestEngine::Options CurlSession::observe(s3tools::RequestEngine::Options options, RequestTrace* trace){
+	if(trace){
+		s3tools::RequestEngine::Observer next=std::move(options.observer);
+		options.observer=[trace,next](const HTTPRequest& request, const HTTPResponse& response){
+			trace->record(request,response);
+			if(next)
+				next(request,response);
+		};
 	}
-	return "";
+	return(options);
+}
+
+CurlSession::CurlSession(const s3tools::CredentialCollection& credentials,
+                         s3tools::RequestEngine::Options options, const std::string& tracePath):
+trace(tracePath.empty() ? nullptr : new RequestTrace(tracePath)),
+cli(credentials,observe(std::move(options),trace.get())){}
+
+CurlSession::~CurlSession(){
+	if(trace)
+		trace->summarize(std::cerr);
+}
+
+HTTPResponse CurlSession::perform(HTTPRequest request){
+	std::string verb=request.url.verb;
+	HTTPResponse response=cli.engine().perform(std::move(request));
+	if(!response.complete())
+		throw std::runtime_error("curl perform "+verb+" failed\n curl error: "+response.error);
+	return(response);
 }
-#endif
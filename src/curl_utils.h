@@ -1,23 +1,95 @@
 #ifndef S3TOOLS_CURL_UTILS_H
 #define S3TOOLS_CURL_UTILS_H
 
+#include <chrono>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <curl/curl.h>
 
-#if ! ( __APPLE__ && __MACH__ )
-	//Whether to use CURLOPT_CAINFO to specifiy a CA bundle path.
-	//According to https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
-	//this should not be used on Mac OS
-	#define USE_CURLOPT_CAINFO
-#endif
+#include <s3tools/client.h>
+#include <s3tools/cred_manage.h>
+#include <s3tools/request_engine.h>
 
 size_t collectOutput(void* buffer, size_t size, size_t nmemb, void* userp);
 
 void reportCurlError(std::string expl, CURLcode err, const char* errBuf);
 
-#ifdef USE_CURLOPT_CAINFO
-std::string detectCABundlePath();
-#endif
+using s3tools::HTTPRequest;
+using s3tools::HTTPResponse;
+
+///A record of the requests made by a tool, kept to help find out why
+///transfers are slow. Each request is written to a file as a JSON object on a
+///line of its own, with its verb, URL (less any signature), result, HTTP
+///status, the times at which each phase of it finished, the amount of data
+///transferred, how many times it was retried, and whether it was hedged.
+///A summary of request latencies and overall throughput can be printed at
+///the end.
+class RequestTrace{
+public:
+	///\param path the file to which request records should be written
+	///\throws std::runtime_error if the file cannot be opened
+	explicit RequestTrace(const std::string& path);
+
+	///Add a finished request to the trace
+	void record(const HTTPRequest& request, const HTTPResponse& response);
+
+	///Write the number of requests, the 50th, 95th, and 99th percentile
+	///request latencies, and the overall rate of data transfer
+	void summarize(std::ostream& os) const;
+
+private:
+	std::ofstream out;
+	///When the trace began, to which the start of each request is relative
+	std::chrono::steady_clock::time_point begin;
+	///The earliest start and latest finish of any request
+	std::chrono::steady_clock::time_point first, last;
+	std::vector<std::chrono::microseconds> latencies;
+	std::uint64_t bytes;
+	std::size_t failures;
+};
+
+///The tools' synchronous interface to the request engine, by way of a
+///s3tools::Client, with optional tracing of requests. Requests made through
+///the same session share its connections, DNS results and TLS sessions, so
+///consecutive requests to the same server do not each pay for a fresh lookup
+///and handshake.
+class CurlSession{
+public:
+	///\param credentials the credentials with which the session's client signs
+	///                   requests, and whose equivalent endpoints it uses
+	///\param options the settings for the session's engine
+	///\param tracePath if not empty, the file to which a record of every request
+	///                 made through the session is written, as for RequestTrace.
+	///                 A summary of the requests is printed to stderr when the
+	///                 session is destroyed.
+	///\throws std::runtime_error if the trace file cannot be opened
+	CurlSession(const s3tools::CredentialCollection& credentials,
+	            s3tools::RequestEngine::Options options=s3tools::RequestEngine::Options(),
+	            const std::string& tracePath="");
+	~CurlSession();
+
+	///Make a request, waiting for it to complete.
+	///\throws std::runtime_error if the request cannot be made, or curl
+	///        reports an error in the course of making it. HTTP error statuses
+	///        are not treated as errors, and are left to the caller to
+	///        interpret.
+	HTTPResponse perform(HTTPRequest request);
+
+	///Get the underlying engine, for making requests asynchronously
+	s3tools::RequestEngine& engine(){ return(cli.engine()); }
+	///Get the client through which the session makes requests
+	s3tools::Client& client(){ return(cli); }
+
+private:
+	//the trace must outlive the engine, which may finish requests as it is
+	//destroyed
+	std::unique_ptr<RequestTrace> trace;
+	s3tools::Client cli;
+
+	static s3tools::RequestEngine::Options observe(s3tools::RequestEngine::Options options, RequestTrace* trace);
+};
 
 #endif //S3TOOLS_CURL_UTILS_H
@@ -0,0 +1,248 @@
+#include <s3tools/deletion.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/md5.h>
+
+#include <s3tools/signing.h>
+
+namespace s3tools{
+
+namespace{
+
+///Append text to an XML document, escaping the characters which are special
+///in element content
+void appendEscaped(std::string& out, const std::string& s){
+	std::size_t start=0;
+	for(std::size_t i=0; i<s.size(); i++){
+		const char* entity;
+		switch(s[i]){
+			case '<': entity="&lt;"; break;
+			case '>': entity="&gt;"; break;
+			case '&': entity="&amp;"; break;
+			case '"': entity="&quot;"; break;
+			case '\'': entity="&apos;"; break;
+			default: continue;
+		}
+		out.append(s,start,i-start);
+		out+=entity;
+		start=i+1;
+	}
+	out.append(s,start,std::string::npos);
+}
+
+///Compute the base64 encoded MD5 digest of some data, as required for the
+///Content-MD5 header
+std::string contentMD5(const std::string& data){
+	using namespace CryptoPP;
+	std::string digest;
+	Weak::MD5 hash;
+	StringSource s(data, true, new HashFilter(hash, new Base64Encoder(new StringSink(digest), false)));
+	return(digest);
+}
+
+} //anonymous namespace
+
+std::vector<BucketObjects> groupByBucket(const std::vector<std::string>& urls,
+                                         const std::function<void(const std::string&)>& onInvalid){
+	std::vector<BucketObjects> buckets;
+	std::map<std::string,std::size_t> indices;
+	for(const std::string& target : urls){
+		URL url(target);
+		std::size_t slash=url.path.find('/',1);
+		if(slash==std::string::npos || slash+1==url.path.size()){
+			if(!onInvalid)
+				throw std::runtime_error(target+" does not name an object");
+			onInvalid(target);
+			continue;
+		}
+		std::string key=url.path.substr(slash+1);
+		url.path.erase(slash);
+		url.query.clear();
+		auto index=indices.emplace(url.str(),buckets.size());
+		if(index.second)
+			buckets.push_back(BucketObjects{url,{}});
+		buckets[index.first->second].keys.push_back(key);
+	}
+	return(buckets);
+}
+
+std::string deleteObjectsBody(const std::vector<std::string>& keys){
+	const static std::string header="<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Delete><Quiet>true</Quiet>";
+	const static std::string objectStart="<Object><Key>";
+	const static std::string objectEnd="</Key></Object>";
+	const static std::string footer="</Delete>";
+	std::size_t size=header.size()+footer.size();
+	for(const auto& key : keys)
+		size+=objectStart.size()+key.size()+objectEnd.size();
+	std::string body;
+	//escaping may make this an underestimate, but rarely
+	body.reserve(size);
+	body+=header;
+	for(const auto& key : keys){
+		body+=objectStart;
+		appendEscaped(body,key);
+		body+=objectEnd;
+	}
+	body+=footer;
+	return(body);
+}
+
+struct BatchDeleter::State{
+	RequestEngine& engine;
+	credential cred;
+	URL bucket;
+	std::size_t concurrency;
+	std::size_t batchSize;
+	ErrorCallback onError;
+
+	std::mutex lock;
+	///The keys collected for the next request
+	std::vector<std::string> batch;
+	std::size_t inFlight;
+	std::size_t requestCount;
+	std::size_t deletedCount;
+	std::size_t failedCount;
+	std::set<RequestEngine::RequestID> outstanding;
+	///Failures which have not yet been passed to onError
+	std::vector<DeleteError> errors;
+
+	State(RequestEngine& engine, const credential& cred, const URL& bucket, std::size_t concurrency,
+	      ErrorCallback onError, std::size_t batchSize):
+	engine(engine),cred(cred),bucket(bucket),concurrency(std::max<std::size_t>(concurrency,1)),
+	batchSize(std::min(std::max<std::size_t>(batchSize,1),maxBatchSize)),onError(std::move(onError)),
+	inFlight(0),requestCount(0),deletedCount(0),failedCount(0){
+		this->bucket.query.clear();
+		this->bucket.query["delete"]="";
+		batch.reserve(this->batchSize);
+	}
+
+	///Send the collected keys
+	///\pre lock is held
+	void send(const std::shared_ptr<State>& self){
+		auto keys=std::make_shared<std::vector<std::string>>();
+		keys->swap(batch);
+		batch.reserve(batchSize);
+		std::string body=deleteObjectsBody(*keys);
+		URL url=bucket;
+		url.headers["Content-MD5"]=contentMD5(body);
+		HTTPRequest request(genURL(cred.username,cred.key,"POST",url,60));
+		request.body=std::move(body);
+		inFlight++;
+		requestCount++;
+		//the callback cannot run until the lock is released, by which time
+		//the ID will have been filled in
+		auto id=std::make_shared<RequestEngine::RequestID>(0);
+		*id=engine.submit(std::move(request),[self,keys,id](HTTPResponse response){
+			std::lock_guard<std::mutex> guard(self->lock);
+			self->inFlight--;
+			self->outstanding.erase(*id);
+			self->finished(*keys,response);
+		});
+		outstanding.insert(*id);
+	}
+
+	///Record the outcome of a request
+	///\pre lock is held
+	void finished(const std::vector<std::string>& keys, const HTTPResponse& response){
+		std::vector<DeleteError> failures;
+		try{
+			checkResponse(response);
+			failures=parseDeleteResult(response.body);
+		}catch(S3Error& err){
+			failures.clear();
+			for(const auto& key : keys)
+				failures.push_back(DeleteError{key,err.code(),err.message()});
+		}catch(std::exception& ex){
+			failures.clear();
+			for(const auto& key : keys)
+				failures.push_back(DeleteError{key,"",ex.what()});
+		}
+		deletedCount+=keys.size()-std::min(failures.size(),keys.size());
+		failedCount+=failures.size();
+		if(onError)
+			errors.insert(errors.end(),failures.begin(),failures.end());
+	}
+
+	///Drive the engine until at most a given number of requests are in
+	///progress, and report any failures
+	void wait(std::size_t count){
+		std::unique_lock<std::mutex> guard(lock);
+		while(true){
+			if(!errors.empty()){
+				std::vector<DeleteError> report;
+				report.swap(errors);
+				guard.unlock();
+				for(const auto& error : report)
+					onError(error);
+				guard.lock();
+				continue;
+			}
+			if(inFlight<=count)
+				return;
+			guard.unlock();
+			engine.poll(std::chrono::milliseconds(100));
+			guard.lock();
+		}
+	}
+};
+
+const std::size_t BatchDeleter::maxBatchSize;
+
+BatchDeleter::BatchDeleter(RequestEngine& engine, const credential& cred, const URL& bucket,
+                           std::size_t concurrency, ErrorCallback onError, std::size_t batchSize):
+state(std::make_shared<State>(engine,cred,bucket,concurrency,std::move(onError),batchSize)){}
+
+BatchDeleter::~BatchDeleter(){
+	std::set<RequestEngine::RequestID> outstanding;
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		outstanding.swap(state->outstanding);
+	}
+	for(auto id : outstanding)
+		state->engine.cancel(id);
+}
+
+void BatchDeleter::remove(const std::string& key){
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		state->batch.push_back(key);
+		if(state->batch.size()<state->batchSize)
+			return;
+	}
+	state->wait(state->concurrency-1);
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->send(state);
+}
+
+void BatchDeleter::finish(){
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		if(!state->batch.empty())
+			state->send(state);
+	}
+	state->wait(0);
+}
+
+std::size_t BatchDeleter::deleted() const{
+	std::lock_guard<std::mutex> guard(state->lock);
+	return(state->deletedCount);
+}
+
+std::size_t BatchDeleter::failed() const{
+	std::lock_guard<std::mutex> guard(state->lock);
+	return(state->failedCount);
+}
+
+std::size_t BatchDeleter::requests() const{
+	std::lock_guard<std::mutex> guard(state->lock);
+	return(state->requestCount);
+}
+
+} //namespace s3tools
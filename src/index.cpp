@@ -0,0 +1,651 @@
+#include <s3tools/index.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <s3tools/listing.h>
+
+//An index file consists of a header, a sequence of blocks, a table of the
+//offsets of the blocks, and a trailer. All integers are little-endian.
+//
+//The header is the magic string "S3INDEX1", the format version (32 bits), the
+//lengths of the target URL and of the key after which the entries begin (32
+//bits each), the time at which the listing began, in milliseconds since the
+//epoch (64 bits), and then the target and the key.
+//
+//Each block is the length of its data, the number of entries in it, and a
+//checksum of the data (32 bits each), followed by the data, which is the
+//entries one after another, each made up of:
+// - the number of bytes the key shares with the previous key in the block
+//   (zero for the first), and the number of bytes which follow (varints)
+// - those bytes
+// - the object's size (varint)
+// - a byte of flags: bit 2 is set if the modification time is known, and bits
+//   0 and 1 give the form of the ETag: none, a digest, or other
+// - the modification time, in milliseconds since the epoch (zigzag varint)
+// - for a digest, its 16 bytes and the number of parts (varint); for other
+//   ETags, the length (varint) and the text
+//
+//The trailer is the number of entries, the number of blocks, and the offset
+//of the block table (64 bits each), followed by the magic string "S3IDXEND".
+//Files which are still being written have no block table or trailer.
+
+namespace s3tools{
+
+namespace{
+
+const char headerMagic[]="S3INDEX1";
+const char trailerMagic[]="S3IDXEND";
+const std::uint32_t formatVersion=1;
+const std::size_t headerSize=28;
+const std::size_t blockHeaderSize=12;
+const std::size_t trailerSize=32;
+const std::uint32_t entriesPerBlock=64;
+///How much encoded data to collect before writing it to the file
+const std::size_t writeBufferSize=1<<20;
+
+enum ETagForm : unsigned char{NoETag=0, DigestETag=1, OtherETag=2};
+const unsigned char hasTimeFlag=4;
+
+void putU32(std::string& out, std::uint32_t value){
+	for(unsigned int i=0; i<4; i++)
+		out+=(char)(value>>(8*i));
+}
+
+void putU64(std::string& out, std::uint64_t value){
+	for(unsigned int i=0; i<8; i++)
+		out+=(char)(value>>(8*i));
+}
+
+void putVarint(std::string& out, std::uint64_t value){
+	while(value>=0x80){
+		out+=(char)(value|0x80);
+		value>>=7;
+	}
+	out+=(char)value;
+}
+
+std::uint32_t getU32(const char* data){
+	std::uint32_t value=0;
+	for(unsigned int i=0; i<4; i++)
+		value|=(std::uint32_t)(unsigned char)data[i]<<(8*i);
+	return(value);
+}
+
+std::uint64_t getU64(const char* data){
+	std::uint64_t value=0;
+	for(unsigned int i=0; i<8; i++)
+		value|=(std::uint64_t)(unsigned char)data[i]<<(8*i);
+	return(value);
+}
+
+std::runtime_error corrupt(){
+	return(std::runtime_error("Listing index is corrupt"));
+}
+
+std::uint64_t getVarint(const char*& pos, const char* end){
+	std::uint64_t value=0;
+	for(unsigned int shift=0; shift<64; shift+=7){
+		if(pos==end)
+			throw corrupt();
+		unsigned char byte=*pos++;
+		value|=(std::uint64_t)(byte&0x7F)<<shift;
+		if(!(byte&0x80))
+			return(value);
+	}
+	throw corrupt();
+}
+
+///FNV-1a
+std::uint32_t checksum(const char* data, std::size_t length){
+	std::uint32_t hash=2166136261u;
+	for(std::size_t i=0; i<length; i++)
+		hash=(hash^(unsigned char)data[i])*16777619u;
+	return(hash);
+}
+
+std::int64_t currentTime(){
+	return(std::chrono::duration_cast<std::chrono::milliseconds>(
+	  std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::chrono::system_clock::time_point fromMilliseconds(std::int64_t ms){
+	return(std::chrono::system_clock::time_point(
+	  std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(ms))));
+}
+
+void readFully(int fd, char* data, std::size_t length, std::uint64_t offset){
+	while(length){
+		ssize_t result=pread(fd,data,length,offset);
+		if(result<0 && errno==EINTR)
+			continue;
+		if(result<=0)
+			throw std::runtime_error("Failed to read listing index: "+std::string(result ? strerror(errno) : "unexpected end of file"));
+		data+=result;
+		length-=result;
+		offset+=result;
+	}
+}
+
+void writeFully(int fd, const char* data, std::size_t length, std::uint64_t offset){
+	while(length){
+		ssize_t result=pwrite(fd,data,length,offset);
+		if(result<0 && errno==EINTR)
+			continue;
+		if(result<0)
+			throw std::runtime_error("Failed to write listing index: "+std::string(strerror(errno)));
+		data+=result;
+		length-=result;
+		offset+=result;
+	}
+}
+
+std::string encodeHeader(const std::string& target, const std::string& after, std::int64_t time){
+	std::string header(headerMagic,8);
+	putU32(header,formatVersion);
+	putU32(header,target.size());
+	putU32(header,after.size());
+	putU64(header,(std::uint64_t)time);
+	return(header+target+after);
+}
+
+struct Header{
+	std::string target;
+	std::string after;
+	std::int64_t time;
+	std::size_t size;
+};
+
+///\return false if the data do not begin with a valid header
+bool decodeHeader(const char* data, std::size_t length, Header& header, std::size_t& needed){
+	needed=headerSize;
+	if(length<headerSize || std::memcmp(data,headerMagic,8)!=0 || getU32(data+8)!=formatVersion)
+		return(false);
+	std::size_t targetLength=getU32(data+12), afterLength=getU32(data+16);
+	needed=headerSize+targetLength+afterLength;
+	if(length<needed)
+		return(false);
+	header.time=(std::int64_t)getU64(data+20);
+	header.target.assign(data+headerSize,targetLength);
+	header.after.assign(data+headerSize+targetLength,afterLength);
+	header.size=needed;
+	return(true);
+}
+
+} //anonymous namespace
+
+///An entry as it is stored
+struct ListingIndex::Entry{
+	std::string key;
+	std::uint64_t size;
+	bool hasTime;
+	std::int64_t time;
+	unsigned char etagForm;
+	std::array<unsigned char,16> digest;
+	std::uint32_t parts;
+	const char* otherETag;
+	std::size_t otherETagLength;
+
+	///Decode the next entry of a block
+	///\param pos the position of the entry, which is advanced past it
+	///\param end the end of the block's data
+	///\param first whether this is the first entry of the block
+	///\throws std::runtime_error if the entry is not valid
+	void decode(const char*& pos, const char* end, bool first){
+		std::uint64_t shared=getVarint(pos,end);
+		std::uint64_t suffix=getVarint(pos,end);
+		if(shared>key.size() || (first && shared) || suffix>(std::uint64_t)(end-pos))
+			throw corrupt();
+		key.resize(shared);
+		key.append(pos,suffix);
+		pos+=suffix;
+		size=getVarint(pos,end);
+		if(pos==end)
+			throw corrupt();
+		unsigned char flags=*pos++;
+		hasTime=flags&hasTimeFlag;
+		etagForm=flags&3;
+		if(hasTime){
+			std::uint64_t zigzag=getVarint(pos,end);
+			time=(std::int64_t)(zigzag>>1)^-(std::int64_t)(zigzag&1);
+		}
+		if(etagForm==DigestETag){
+			if(end-pos<16)
+				throw corrupt();
+			std::memcpy(digest.data(),pos,16);
+			pos+=16;
+			std::uint64_t count=getVarint(pos,end);
+			if(count>std::numeric_limits<std::uint32_t>::max())
+				throw corrupt();
+			parts=(std::uint32_t)count;
+		}
+		else if(etagForm==OtherETag){
+			otherETagLength=getVarint(pos,end);
+			if(otherETagLength>(std::uint64_t)(end-pos))
+				throw corrupt();
+			otherETag=pos;
+			pos+=otherETagLength;
+		}
+		else if(etagForm!=NoETag)
+			throw corrupt();
+	}
+
+	void get(ObjectInfo& object) const{
+		object.key=key;
+		object.size=size;
+		if(hasTime)
+			object.lastModified=formatTimestamp(fromMilliseconds(time));
+		else
+			object.lastModified.clear();
+		if(etagForm==DigestETag)
+			object.etag=formatETag(digest,parts);
+		else if(etagForm==OtherETag)
+			object.etag.assign(otherETag,otherETagLength);
+		else
+			object.etag.clear();
+	}
+};
+
+//--- IndexWriter ---
+
+IndexWriter::IndexWriter(const std::string& path, const std::string& target, const std::string& after):
+path(path),partialPath(path+".partial"),target(target),after(after),fd(-1),entries(0),
+previous(after),blockEntries(0),position(0),finished(false){
+	fd=open(partialPath.c_str(),O_RDWR|O_CREAT,0644);
+	if(fd<0)
+		throw std::runtime_error("Unable to open "+partialPath+": "+strerror(errno));
+	try{
+		if(!recover()){
+			if(ftruncate(fd,0)!=0)
+				throw std::runtime_error("Unable to truncate "+partialPath+": "+strerror(errno));
+			startTime=currentTime();
+			buffer=encodeHeader(target,after,startTime);
+		}
+	}catch(...){
+		close(fd);
+		throw;
+	}
+}
+
+IndexWriter::~IndexWriter(){
+	if(fd<0)
+		return;
+	try{
+		//keep what can be resumed
+		flush();
+	}catch(...){}
+	close(fd);
+}
+
+bool IndexWriter::recover(){
+	struct stat info;
+	if(fstat(fd,&info)!=0)
+		throw std::runtime_error("Unable to stat "+partialPath+": "+strerror(errno));
+	const std::uint64_t fileLength=info.st_size;
+	Header header;
+	std::size_t needed;
+	std::string data(std::min<std::uint64_t>(fileLength,headerSize),'\0');
+	readFully(fd,&data[0],data.size(),0);
+	if(!decodeHeader(data.data(),data.size(),header,needed)){
+		if(needed<=headerSize || needed>fileLength)
+			return(false);
+		data.resize(needed);
+		readFully(fd,&data[0],needed,0);
+		if(!decodeHeader(data.data(),data.size(),header,needed))
+			return(false);
+	}
+	if(header.target!=target || header.after!=after)
+		return(false);
+	startTime=header.time;
+	position=header.size;
+	//take every complete block which is intact, stopping at the first which
+	//is not, or which was not full and so could only have been the last
+	ListingIndex::Entry entry;
+	std::string blockHeader(blockHeaderSize,'\0');
+	while(position+blockHeaderSize<=fileLength){
+		readFully(fd,&blockHeader[0],blockHeaderSize,position);
+		std::uint32_t length=getU32(blockHeader.data());
+		std::uint32_t count=getU32(blockHeader.data()+4);
+		if(count!=entriesPerBlock || position+blockHeaderSize+length>fileLength)
+			break;
+		data.resize(length);
+		readFully(fd,&data[0],length,position+blockHeaderSize);
+		if(checksum(data.data(),length)!=getU32(blockHeader.data()+8))
+			break;
+		const char* pos=data.data();
+		const char* end=pos+length;
+		try{
+			for(std::uint32_t i=0; i<count; i++)
+				entry.decode(pos,end,i==0);
+		}catch(std::runtime_error&){
+			break;
+		}
+		if(pos!=end)
+			break;
+		blockOffsets.push_back(position);
+		entries+=count;
+		previous=entry.key;
+		position+=blockHeaderSize+length;
+	}
+	if(ftruncate(fd,position)!=0)
+		throw std::runtime_error("Unable to truncate "+partialPath+": "+strerror(errno));
+	return(true);
+}
+
+void IndexWriter::add(const ObjectInfo& object){
+	if(finished)
+		throw std::runtime_error("Entries may not be added to a finished index");
+	if((entries || !after.empty()) && !(previous<object.key))
+		throw std::runtime_error("Index entries must be added in order: '"+object.key+"' follows '"+previous+"'");
+	std::size_t shared=0;
+	if(blockEntries){
+		std::size_t limit=std::min(previous.size(),object.key.size());
+		while(shared<limit && previous[shared]==object.key[shared])
+			shared++;
+	}
+	putVarint(block,shared);
+	putVarint(block,object.key.size()-shared);
+	block.append(object.key,shared,std::string::npos);
+	putVarint(block,object.size);
+	unsigned char flags=0;
+	std::chrono::system_clock::time_point time;
+	bool hasTime=parseTimestamp(object.lastModified.data(),object.lastModified.data()+object.lastModified.size(),time);
+	if(hasTime)
+		flags|=hasTimeFlag;
+	std::array<unsigned char,16> digest;
+	std::uint32_t parts;
+	unsigned char form=NoETag;
+	if(parseETag(object.etag,digest,parts))
+		form=DigestETag;
+	else if(!object.etag.empty())
+		form=OtherETag;
+	block+=(char)(flags|form);
+	if(hasTime){
+		std::int64_t ms=std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+		putVarint(block,((std::uint64_t)ms<<1)^(std::uint64_t)(ms>>63));
+	}
+	if(form==DigestETag){
+		block.append((const char*)digest.data(),16);
+		putVarint(block,parts);
+	}
+	else if(form==OtherETag){
+		putVarint(block,object.etag.size());
+		block+=object.etag;
+	}
+	previous=object.key;
+	entries++;
+	if(++blockEntries==entriesPerBlock)
+		endBlock();
+	if(buffer.size()>=writeBufferSize)
+		flush();
+}
+
+void IndexWriter::endBlock(){
+	if(!blockEntries)
+		return;
+	blockOffsets.push_back(position+buffer.size());
+	putU32(buffer,block.size());
+	putU32(buffer,blockEntries);
+	putU32(buffer,checksum(block.data(),block.size()));
+	buffer+=block;
+	block.clear();
+	blockEntries=0;
+}
+
+void IndexWriter::flush(){
+	writeFully(fd,buffer.data(),buffer.size(),position);
+	position+=buffer.size();
+	buffer.clear();
+}
+
+void IndexWriter::checkpoint(){
+	flush();
+	if(fsync(fd)!=0)
+		throw std::runtime_error("Unable to sync "+partialPath+": "+strerror(errno));
+}
+
+void IndexWriter::finish(){
+	if(finished)
+		return;
+	endBlock();
+	std::uint64_t firstBlock=encodeHeader(target,after,startTime).size();
+	if(after.empty()){
+		std::uint64_t tableOffset=position+buffer.size();
+		for(std::uint64_t offset : blockOffsets)
+			putU64(buffer,offset);
+		putU64(buffer,entries);
+		putU64(buffer,blockOffsets.size());
+		putU64(buffer,tableOffset);
+		buffer.append(trailerMagic,8);
+		checkpoint();
+		close(fd);
+		fd=-1;
+		if(std::rename(partialPath.c_str(),path.c_str())!=0)
+			throw std::runtime_error("Unable to rename "+partialPath+" to "+path+": "+strerror(errno));
+		finished=true;
+		return;
+	}
+	//the new entries follow those of the existing index, so the blocks of
+	//the two can simply be concatenated
+	flush();
+	ListingIndex old(path);
+	if(old.target()!=target || old.lastKey()!=after)
+		throw std::runtime_error("The index at "+path+" has changed while being updated");
+	const std::string newPath=path+".new";
+	int out=open(newPath.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if(out<0)
+		throw std::runtime_error("Unable to open "+newPath+": "+strerror(errno));
+	try{
+		std::string header=encodeHeader(target,"",startTime);
+		std::uint64_t outPosition=0;
+		writeFully(out,header.data(),header.size(),outPosition);
+		outPosition+=header.size();
+		std::vector<std::uint64_t> offsets;
+		offsets.reserve(old.blocks+blockOffsets.size());
+		if(old.blocks){
+			std::uint64_t start=old.blockOffset(0);
+			std::uint64_t end=getU64(old.data+old.length-trailerSize+16);
+			for(std::size_t i=0; i<old.blocks; i++)
+				offsets.push_back(old.blockOffset(i)-start+outPosition);
+			writeFully(out,old.data+start,end-start,outPosition);
+			outPosition+=end-start;
+		}
+		std::vector<char> copy(writeBufferSize);
+		for(std::uint64_t offset : blockOffsets)
+			offsets.push_back(offset-firstBlock+outPosition);
+		for(std::uint64_t offset=firstBlock; offset<position; ){
+			std::size_t length=std::min<std::uint64_t>(copy.size(),position-offset);
+			readFully(fd,copy.data(),length,offset);
+			writeFully(out,copy.data(),length,outPosition);
+			outPosition+=length;
+			offset+=length;
+		}
+		std::string trailer;
+		for(std::uint64_t offset : offsets)
+			putU64(trailer,offset);
+		putU64(trailer,old.size()+entries);
+		putU64(trailer,offsets.size());
+		putU64(trailer,outPosition);
+		trailer.append(trailerMagic,8);
+		writeFully(out,trailer.data(),trailer.size(),outPosition);
+		if(fsync(out)!=0)
+			throw std::runtime_error("Unable to sync "+newPath+": "+strerror(errno));
+	}catch(...){
+		close(out);
+		throw;
+	}
+	close(out);
+	if(std::rename(newPath.c_str(),path.c_str())!=0)
+		throw std::runtime_error("Unable to rename "+newPath+" to "+path+": "+strerror(errno));
+	close(fd);
+	fd=-1;
+	unlink(partialPath.c_str());
+	finished=true;
+}
+
+//--- ListingIndex ---
+
+ListingIndex::ListingIndex(const std::string& path):data(nullptr),length(0),entries(0),blocks(0){
+	int fd=open(path.c_str(),O_RDONLY);
+	if(fd<0)
+		throw std::runtime_error("Unable to open "+path+": "+strerror(errno));
+	struct stat info;
+	if(fstat(fd,&info)!=0){
+		close(fd);
+		throw std::runtime_error("Unable to stat "+path+": "+strerror(errno));
+	}
+	length=info.st_size;
+	if(length<headerSize+trailerSize){
+		close(fd);
+		throw std::runtime_error(path+" is not a complete listing index");
+	}
+	void* mapping=mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(mapping==MAP_FAILED)
+		throw std::runtime_error("Unable to map "+path+": "+strerror(errno));
+	data=(const char*)mapping;
+	Header header;
+	std::size_t needed;
+	const char* trailer=data+length-trailerSize;
+	if(!decodeHeader(data,length,header,needed) || std::memcmp(trailer+24,trailerMagic,8)!=0){
+		munmap((void*)data,length);
+		throw std::runtime_error(path+" is not a complete listing index");
+	}
+	indexTarget=header.target;
+	updateTime=fromMilliseconds(header.time);
+	entries=getU64(trailer);
+	blocks=getU64(trailer+8);
+	std::uint64_t tableOffset=getU64(trailer+16);
+	if(tableOffset<header.size || tableOffset>length-trailerSize || (length-trailerSize-tableOffset)/8!=blocks
+	   || (length-trailerSize-tableOffset)%8){
+		munmap((void*)data,length);
+		throw corrupt();
+	}
+	blockTable=data+tableOffset;
+	//the pages will be read in no particular order by searches
+	madvise((void*)data,length,MADV_RANDOM);
+}
+
+ListingIndex::~ListingIndex(){
+	munmap((void*)data,length);
+}
+
+std::uint64_t ListingIndex::blockOffset(std::size_t index) const{
+	std::uint64_t offset=getU64(blockTable+8*index);
+	if(offset+blockHeaderSize>(std::uint64_t)(blockTable-data)
+	   || offset+blockHeaderSize+getU32(data+offset)>(std::uint64_t)(blockTable-data))
+		throw corrupt();
+	return(offset);
+}
+
+std::string ListingIndex::firstKey(std::size_t index) const{
+	std::uint64_t offset=blockOffset(index);
+	const char* pos=data+offset+blockHeaderSize;
+	const char* end=pos+getU32(data+offset);
+	getVarint(pos,end); //the shared length, which must be zero
+	std::uint64_t keyLength=getVarint(pos,end);
+	if(keyLength>(std::uint64_t)(end-pos))
+		throw corrupt();
+	return(std::string(pos,keyLength));
+}
+
+bool ListingIndex::scanBlock(std::size_t index, const std::string& from,
+                             const std::function<bool(const Entry&)>& visitor) const{
+	std::uint64_t offset=blockOffset(index);
+	std::uint32_t count=getU32(data+offset+4);
+	const char* pos=data+offset+blockHeaderSize;
+	const char* end=pos+getU32(data+offset);
+	Entry entry;
+	for(std::uint32_t i=0; i<count; i++){
+		entry.decode(pos,end,i==0);
+		if(entry.key<from)
+			continue;
+		if(!visitor(entry))
+			return(false);
+	}
+	return(true);
+}
+
+void ListingIndex::scanEntries(const std::string& from, const std::function<bool(const Entry&)>& visitor) const{
+	//find the last block whose first key is not after the starting key
+	std::size_t low=0, high=blocks;
+	while(low<high){
+		std::size_t middle=low+(high-low)/2;
+		if(from<firstKey(middle))
+			high=middle;
+		else
+			low=middle+1;
+	}
+	for(std::size_t block=(low ? low-1 : 0); block<blocks; block++){
+		if(!scanBlock(block,from,visitor))
+			return;
+	}
+}
+
+std::string ListingIndex::lastKey() const{
+	std::string key;
+	if(blocks)
+		scanBlock(blocks-1,"",[&](const Entry& entry){ key=entry.key; return(true); });
+	return(key);
+}
+
+void ListingIndex::scan(const std::string& from, const std::function<bool(const ObjectInfo&)>& visitor) const{
+	ObjectInfo object;
+	scanEntries(from,[&](const Entry& entry){
+		entry.get(object);
+		return(visitor(object));
+	});
+}
+
+void ListingIndex::find(const Query& query, const std::function<bool(const ObjectInfo&)>& visitor) const{
+	//only keys which begin with the literal part of the pattern can match it
+	std::string literal=globPrefix(query.glob);
+	ObjectInfo object;
+	scanEntries(std::max(query.prefix,literal),[&](const Entry& entry){
+		if(entry.key.compare(0,query.prefix.size(),query.prefix)!=0
+		   || entry.key.compare(0,literal.size(),literal)!=0)
+			return(false);
+		if(entry.size<query.minSize || entry.size>query.maxSize)
+			return(true);
+		if(!query.glob.empty() && !matchGlob(query.glob,entry.key))
+			return(true);
+		entry.get(object);
+		return(visitor(object));
+	});
+}
+
+//--- updateIndex ---
+
+std::size_t updateIndex(RequestEngine& engine, const credential& cred, const std::string& path,
+                        const std::string& target, std::size_t concurrency, bool rebuild){
+	//an existing index of the same target is extended, unless it is empty
+	std::string after;
+	if(!rebuild && access(path.c_str(),F_OK)==0){
+		ListingIndex old(path);
+		if(old.target()==target)
+			after=old.lastKey();
+	}
+	IndexWriter writer(path,target,after);
+	ObjectLister lister(engine,cred,target,concurrency,writer.lastKey());
+	ObjectInfo object;
+	std::size_t listed=0;
+	//how often to make sure that progress is saved
+	const std::size_t checkpointInterval=100000;
+	while(lister.next(object)){
+		writer.add(object);
+		if(++listed%checkpointInterval==0)
+			writer.checkpoint();
+	}
+	writer.finish();
+	return(listed);
+}
+
+} //namespace s3tools
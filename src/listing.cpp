@@ -0,0 +1,564 @@
+#include <s3tools/listing.h>
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <set>
+
+#include <fnmatch.h>
+
+#include <s3tools/signing.h>
+
+namespace s3tools{
+
+namespace{
+
+///A numbering of keys, used to estimate where the keys following a page of a
+///listing lie. The characters which follow the prefix shared by the keys in
+///the page are treated as the digits of a number, whose base is the number of
+///distinct characters used by those keys, so that keys made up of decimal or
+///hexadecimal digits, for example, are spaced as their numeric values are.
+///
+///Keys are added one at a time as the page is parsed, so that the page need
+///not be kept: since they arrive in order, the prefix shared by all of them is
+///the one shared by the first and the latest, and the characters before it in
+///every key are those of the first.
+class KeyScale{
+public:
+	KeyScale():count(0),common(0),width(0),first(0),last(0){}
+
+	///Add the next key of the page
+	void add(const std::string& key){
+		if(!count++){
+			firstKey=key;
+			common=key.size();
+		}
+		std::size_t shared=0;
+		while(shared<common && shared<key.size() && firstKey[shared]==key[shared])
+			shared++;
+		markUsed(firstKey,shared,common);
+		markUsed(key,shared,key.size());
+		common=shared;
+		lastKey=key;
+	}
+
+	///The number of keys added
+	std::size_t size() const{ return(count); }
+	///The last key added
+	const std::string& back() const{ return(lastKey); }
+
+	///Set up the numbering, once all keys in the page have been added
+	void finish(){
+		if(count<2)
+			return;
+		//leave room for carries into a few of the shared characters
+		std::size_t start=common-std::min<std::size_t>(common,2);
+		markUsed(firstKey,start,common);
+		prefix=firstKey.substr(0,start);
+		//split points are made only of printable ASCII, which servers will
+		//accept in a query, and which cannot form an invalid UTF-8 sequence
+		for(unsigned int c=0x20; c<0x7F; c++){
+			if(used[c])
+				alphabet+=(char)c;
+		}
+		if(alphabet.size()<2)
+			return;
+		//as many digits as can be exactly represented
+		width=std::min<std::size_t>(12,(std::size_t)(52/std::log2((double)alphabet.size())));
+		first=value(firstKey);
+		last=value(lastKey);
+	}
+
+	///\param t the position of the key, where 0 is the first key of the page
+	///         and 1 is the last
+	///\return the key at that position, or an empty string if it cannot be
+	///        represented
+	std::string at(double t) const{
+		if(!width)
+			return("");
+		double x=std::floor(first+t*(last-first));
+		const double base=alphabet.size();
+		if(x<0 || x>=std::pow(base,(double)width))
+			return("");
+		std::string digits(width,alphabet.front());
+		for(std::size_t i=width; i>0; i--){
+			double digit=std::fmod(x,base);
+			digits[i-1]=alphabet[(std::size_t)digit];
+			x=(x-digit)/base;
+		}
+		//trailing copies of the smallest digit only make the key longer
+		digits.erase(digits.find_last_not_of(alphabet.front())+1);
+		return(prefix+digits);
+	}
+
+private:
+	std::size_t count;
+	std::string firstKey, lastKey;
+	///The length of the prefix shared by all keys added
+	std::size_t common;
+	///The characters which appear in any key after the shared prefix
+	std::bitset<256> used;
+	std::string prefix;
+	std::string alphabet;
+	std::size_t width;
+	double first, last;
+
+	void markUsed(const std::string& key, std::size_t begin, std::size_t end){
+		for(std::size_t i=begin; i<end; i++)
+			used[(unsigned char)key[i]]=true;
+	}
+
+	double value(const std::string& key) const{
+		double v=0;
+		for(std::size_t i=0; i<width; i++){
+			std::size_t digit=0;
+			if(prefix.size()+i<key.size()){
+				//other characters are counted as the closest digit below them
+				unsigned char c=key[prefix.size()+i];
+				digit=std::upper_bound(alphabet.begin(),alphabet.end(),c,
+				  [](unsigned char c, char d){ return(c<(unsigned char)d); })-alphabet.begin();
+				digit-=std::min<std::size_t>(digit,1);
+			}
+			v=v*alphabet.size()+digit;
+		}
+		return(v);
+	}
+};
+
+} //anonymous namespace
+
+//Partitions are ranges of keys, each listed with its own sequence of
+//requests, starting after one key and (except for the last) ending at another.
+//Splitting a partition only shortens its range, so the requests already made
+//for it remain valid.
+struct ObjectLister::State{
+	struct Partition{
+		///The key after which the partition begins, or empty for the first
+		std::string after;
+		///The last key which may belong to the partition, if bounded
+		std::string upper;
+		bool bounded;
+		///The token with which to request the partition's next page, once
+		///its first page has been received
+		std::string token;
+		///Objects which have been listed but not yet consumed
+		std::deque<ObjectInfo> objects;
+		bool fetching;
+		bool finished;
+
+		Partition(std::string after, std::string upper, bool bounded):
+		after(std::move(after)),upper(std::move(upper)),bounded(bounded),
+		fetching(false),finished(false){}
+	};
+
+	///The data collected for a single listing request. Every key listed is
+	///used to place split points, but only the objects which pass the filter
+	///are kept.
+	struct Page{
+		std::vector<ObjectInfo> objects;
+		std::vector<std::string> prefixes;
+		KeyScale scale;
+		Filter filter;
+		ListParser parser;
+
+		explicit Page(const Filter& filter):filter(filter),
+		parser([this](const ObjectInfo& object){ add(object); },
+		       [this](const std::string& prefix){ prefixes.push_back(prefix); }){}
+
+		void add(const ObjectInfo& object){
+			scale.add(object.key);
+			if(!filter || filter(object))
+				objects.push_back(object);
+		}
+	};
+
+	///The number of listed objects which may be held for each partition
+	///before requests for it are paused
+	static const std::size_t maxBuffered=4000;
+	///The approximate number of pages of keys to put in each new partition
+	static const std::size_t pagesPerPartition=4;
+
+	RequestEngine& engine;
+	credential cred;
+	URL baseURL;
+	std::string startAfter;
+	Filter filter;
+	std::size_t concurrency;
+	///The most partitions there may be, which bounds the memory used
+	std::size_t maxPartitions;
+
+	std::mutex lock;
+	std::deque<std::shared_ptr<Partition>> partitions;
+	///Whether the initial partitions have been set up
+	bool started;
+	std::size_t inFlight;
+	std::size_t requestCount;
+	std::set<RequestEngine::RequestID> outstanding;
+	std::exception_ptr error;
+	///Set when the lister is destroyed, after which responses are ignored
+	bool closed;
+
+	State(RequestEngine& engine, const credential& cred, const std::string& target, std::size_t concurrency,
+	      const std::string& startAfter, const Filter& filter):
+	engine(engine),cred(cred),baseURL(listObjectsURL(target,"")),startAfter(startAfter),filter(filter),
+	concurrency(std::max<std::size_t>(concurrency,1)),maxPartitions(4*this->concurrency),
+	started(false),inFlight(0),requestCount(0),closed(false){}
+
+	///\pre lock is held
+	void submit(URL url, std::function<void(const std::shared_ptr<Page>&, HTTPResponse&)> handler,
+	            const std::shared_ptr<State>& self){
+		auto page=std::make_shared<Page>(filter);
+		HTTPRequest request(genURL(cred.username,cred.key,"GET",url,60));
+		request.sink=page->parser.sink();
+		inFlight++;
+		requestCount++;
+		//the callback cannot run until the lock is released, by which time
+		//the ID will have been filled in
+		auto id=std::make_shared<RequestEngine::RequestID>(0);
+		*id=engine.submit(std::move(request),[self,page,handler,id](HTTPResponse response){
+			std::lock_guard<std::mutex> guard(self->lock);
+			self->inFlight--;
+			self->outstanding.erase(*id);
+			if(self->closed || self->error)
+				return;
+			try{
+				if(!response.complete())
+					throw std::runtime_error("Listing request failed: "+response.error);
+				page->parser.finish(response.status);
+				handler(page,response);
+			}catch(...){
+				self->error=std::current_exception();
+			}
+		});
+		outstanding.insert(*id);
+	}
+
+	///Find the common prefixes one level below the listed prefix, and divide
+	///the keys among them.
+	///\pre lock is held
+	void discover(const std::shared_ptr<State>& self){
+		URL url=baseURL;
+		url.query["delimiter"]="/";
+		submit(url,[self](const std::shared_ptr<Page>& page, HTTPResponse&){
+			std::vector<std::string>& prefixes=page->prefixes;
+			//only boundaries after the start of the listing are useful
+			prefixes.erase(prefixes.begin(),std::upper_bound(prefixes.begin(),prefixes.end(),self->startAfter));
+			std::size_t count=std::min(prefixes.size()+1,self->concurrency);
+			std::string previous=self->startAfter;
+			for(std::size_t i=1; i<count; i++){
+				const std::string& boundary=prefixes[i*prefixes.size()/count];
+				self->partitions.push_back(std::make_shared<Partition>(previous,boundary,true));
+				previous=boundary;
+			}
+			self->partitions.push_back(std::make_shared<Partition>(previous,"",false));
+			self->started=true;
+			self->fetch(self);
+		},self);
+	}
+
+	///Request further pages for as many partitions as possible, in order.
+	///\pre lock is held
+	void fetch(const std::shared_ptr<State>& self){
+		for(const auto& partition : partitions){
+			if(inFlight>=concurrency)
+				break;
+			if(!partition->finished && !partition->fetching && partition->objects.size()<maxBuffered)
+				fetch(partition,self);
+		}
+	}
+
+	///\pre lock is held
+	void fetch(const std::shared_ptr<Partition>& partition, const std::shared_ptr<State>& self){
+		URL url=baseURL;
+		if(!partition->token.empty())
+			url.query["continuation-token"]=partition->token;
+		else if(!partition->after.empty())
+			url.query["start-after"]=partition->after;
+		partition->fetching=true;
+		submit(url,[self,partition](const std::shared_ptr<Page>& page, HTTPResponse&){
+			partition->fetching=false;
+			self->receive(*partition,*page);
+			if(!partition->finished){
+				page->scale.finish();
+				self->split(partition,page->scale,page->scale.back());
+			}
+			self->fetch(self);
+		},self);
+	}
+
+	///Store the objects from a page of a partition's listing
+	///\pre lock is held
+	void receive(Partition& partition, Page& page){
+		for(auto& object : page.objects){
+			if(partition.bounded && object.key>partition.upper){
+				partition.finished=true;
+				return;
+			}
+			partition.objects.push_back(std::move(object));
+		}
+		//objects which were filtered out may also have passed the end
+		if(partition.bounded && page.scale.size() && page.scale.back()>partition.upper){
+			partition.finished=true;
+			return;
+		}
+		if(page.parser.truncated() && page.scale.size())
+			partition.token=page.parser.nextContinuationToken();
+		else
+			partition.finished=true;
+	}
+
+	///Divide the remainder of a partition which has more pages to list, if
+	///requests can be made for more partitions. The split points are placed
+	///at intervals of a few times the span of the partition's last page, on
+	///the assumption that the density of keys is similar in the following
+	///range. Each partition generally ends with a partial page, so making
+	///them much shorter would waste requests.
+	///\param scale the spacing of the keys in the partition's last page
+	///\param last the last key of the partition's last page
+	///\pre lock is held
+	void split(const std::shared_ptr<Partition>& partition, const KeyScale& scale, const std::string& last){
+		if(concurrency<2)
+			return;
+		std::size_t available=std::min(concurrency-std::min(concurrency,inFlight+1),
+		                               maxPartitions-std::min(maxPartitions,partitions.size()));
+		if(!available)
+			return;
+		auto position=std::find(partitions.begin(),partitions.end(),partition);
+		std::vector<std::shared_ptr<Partition>> added;
+		std::string previous=last;
+		for(std::size_t i=1; i<=available; i++){
+			std::string boundary=scale.at(1+i*pagesPerPartition);
+			if(boundary.empty() || boundary<=previous || (partition->bounded && boundary>=partition->upper))
+				break;
+			added.push_back(std::make_shared<Partition>(boundary,"",false));
+			if(added.size()>1){
+				added[added.size()-2]->upper=boundary;
+				added[added.size()-2]->bounded=true;
+			}
+			previous=boundary;
+		}
+		if(added.empty())
+			return;
+		added.back()->upper=partition->upper;
+		added.back()->bounded=partition->bounded;
+		partition->upper=added.front()->after;
+		partition->bounded=true;
+		partitions.insert(position+1,added.begin(),added.end());
+	}
+};
+
+const std::size_t ObjectLister::State::maxBuffered;
+const std::size_t ObjectLister::State::pagesPerPartition;
+
+ObjectLister::ObjectLister(RequestEngine& engine, const credential& cred, const std::string& target,
+                           std::size_t concurrency, const std::string& startAfter, const Filter& filter):
+state(std::make_shared<State>(engine,cred,target,concurrency,startAfter,filter)){
+	std::lock_guard<std::mutex> guard(state->lock);
+	if(state->concurrency>1)
+		state->discover(state);
+	else{
+		state->partitions.push_back(std::make_shared<State::Partition>(startAfter,"",false));
+		state->started=true;
+		state->fetch(state);
+	}
+}
+
+ObjectLister::~ObjectLister(){
+	std::set<RequestEngine::RequestID> outstanding;
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		state->closed=true;
+		outstanding.swap(state->outstanding);
+	}
+	for(auto id : outstanding)
+		state->engine.cancel(id);
+}
+
+bool ObjectLister::next(ObjectInfo& object){
+	std::unique_lock<std::mutex> guard(state->lock);
+	while(true){
+		if(state->error)
+			std::rethrow_exception(state->error);
+		if(state->started){
+			if(state->partitions.empty())
+				return(false);
+			State::Partition& head=*state->partitions.front();
+			if(!head.objects.empty()){
+				object=std::move(head.objects.front());
+				head.objects.pop_front();
+				if(head.objects.size()==State::maxBuffered-1)
+					state->fetch(state);
+				return(true);
+			}
+			if(head.finished){
+				state->partitions.pop_front();
+				state->fetch(state);
+				continue;
+			}
+		}
+		guard.unlock();
+		state->engine.poll(std::chrono::milliseconds(100));
+		guard.lock();
+	}
+}
+
+std::size_t ObjectLister::requests() const{
+	std::lock_guard<std::mutex> guard(state->lock);
+	return(state->requestCount);
+}
+
+std::string globPrefix(const std::string& pattern){
+	return(pattern.substr(0,pattern.find_first_of("*?[\\")));
+}
+
+bool matchGlob(const std::string& pattern, const std::string& key){
+	return(fnmatch(pattern.c_str(),key.c_str(),FNM_PATHNAME)==0);
+}
+
+const std::int64_t ListingTable::noTime=std::numeric_limits<std::int64_t>::min();
+const std::size_t ListingTable::blockSize;
+const std::uint16_t ListingTable::noETag;
+const std::uint16_t ListingTable::otherETag;
+
+ListingTable::ListingTable(bool keepETags):keepETags(keepETags),blockUsed(0){}
+
+void ListingTable::add(const ObjectInfo& object){
+	addEntry(object.key,false);
+	sizes.back()=object.size;
+	std::chrono::system_clock::time_point time;
+	if(parseTimestamp(object.lastModified.data(),object.lastModified.data()+object.lastModified.size(),time))
+		times.back()=std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+	if(keepETags)
+		storeETag(object.etag);
+}
+
+void ListingTable::addPrefix(const std::string& prefix){
+	addEntry(prefix,true);
+}
+
+void ListingTable::addEntry(const std::string& key, bool prefix){
+	if(key.size()>0xFFFF)
+		throw std::runtime_error("Key too long to be stored in a listing: "+key.substr(0,64)+"...");
+	if(sizes.size()>=std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Too many entries to be stored in a listing");
+	if(blocks.empty() || blockUsed+key.size()>blockSize){
+		blocks.emplace_back(new char[blockSize]);
+		blockUsed=0;
+	}
+	std::uint64_t position=(blocks.size()-1)*blockSize+blockUsed;
+	std::memcpy(blocks.back().get()+blockUsed,key.data(),key.size());
+	blockUsed+=key.size();
+	keys.push_back(position<<16 | key.size());
+	sizes.push_back(0);
+	times.push_back(noTime);
+	prefixes.push_back(prefix);
+	if(keepETags){
+		digests.emplace_back();
+		parts.push_back(noETag);
+	}
+}
+
+void ListingTable::storeETag(const std::string& etag){
+	if(etag.empty())
+		return;
+	std::array<unsigned char,16> digest;
+	std::uint32_t count;
+	if(!parseETag(etag,digest,count) || count>=noETag){
+		otherETags[(std::uint32_t)(sizes.size()-1)]=etag;
+		parts.back()=otherETag;
+		return;
+	}
+	digests.back()=digest;
+	parts.back()=(std::uint16_t)count;
+}
+
+const char* ListingTable::key(std::size_t index, std::size_t& length) const{
+	std::uint64_t position=keys[index]>>16;
+	length=keys[index]&0xFFFF;
+	return(blocks[position/blockSize].get()+position%blockSize);
+}
+
+std::string ListingTable::key(std::size_t index) const{
+	std::size_t length;
+	const char* data=key(index,length);
+	return(std::string(data,length));
+}
+
+std::chrono::system_clock::time_point ListingTable::lastModified(std::size_t index) const{
+	return(std::chrono::system_clock::time_point(
+	  std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(times[index]))));
+}
+
+std::string ListingTable::etag(std::size_t index) const{
+	if(!keepETags || parts[index]==noETag)
+		return("");
+	if(parts[index]==otherETag)
+		return(otherETags.find((std::uint32_t)index)->second);
+	return(formatETag(digests[index],parts[index]));
+}
+
+void ListingTable::get(std::size_t index, ObjectInfo& object) const{
+	std::size_t length;
+	const char* data=key(index,length);
+	object.key.assign(data,length);
+	object.size=sizes[index];
+	if(hasTime(index))
+		object.lastModified=formatTimestamp(lastModified(index));
+	else
+		object.lastModified.clear();
+	object.etag=etag(index);
+}
+
+std::vector<std::uint32_t> ListingTable::order(Column column, bool descending) const{
+	std::vector<std::uint32_t> indices(size());
+	for(std::size_t i=0; i<indices.size(); i++)
+		indices[i]=(std::uint32_t)i;
+	auto keyLess=[this](std::uint32_t a, std::uint32_t b){
+		std::size_t aLength, bLength;
+		const char* aKey=key(a,aLength);
+		const char* bKey=key(b,bLength);
+		int result=std::memcmp(aKey,bKey,std::min(aLength,bLength));
+		return(result<0 || (result==0 && aLength<bLength));
+	};
+	switch(column){
+		case Column::Name:
+			if(descending)
+				std::sort(indices.begin(),indices.end(),[&](std::uint32_t a, std::uint32_t b){ return(keyLess(b,a)); });
+			else
+				std::sort(indices.begin(),indices.end(),keyLess);
+			break;
+		case Column::Size:
+			std::sort(indices.begin(),indices.end(),[&](std::uint32_t a, std::uint32_t b){
+				if(sizes[a]!=sizes[b])
+					return(descending ? sizes[a]>sizes[b] : sizes[a]<sizes[b]);
+				return(keyLess(a,b));
+			});
+			break;
+		case Column::Time:
+			std::sort(indices.begin(),indices.end(),[&](std::uint32_t a, std::uint32_t b){
+				if(times[a]!=times[b])
+					return(descending ? times[a]>times[b] : times[a]<times[b]);
+				return(keyLess(a,b));
+			});
+			break;
+	}
+	return(indices);
+}
+
+std::size_t ListingTable::memoryUsage() const{
+	return(blocks.size()*blockSize
+	       +keys.capacity()*sizeof(std::uint64_t)
+	       +sizes.capacity()*sizeof(std::uint64_t)
+	       +times.capacity()*sizeof(std::int64_t)
+	       +prefixes.capacity()/8
+	       +digests.capacity()*sizeof(std::array<unsigned char,16>)
+	       +parts.capacity()*sizeof(std::uint16_t)
+	       +otherETags.size()*(sizeof(std::string)+64));
+}
+
+} //namespace s3tools
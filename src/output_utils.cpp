@@ -0,0 +1,240 @@
+#include "output_utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include <s3tools/responses.h>
+
+namespace{
+
+const char digitPairs[]=
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+///The most characters a formatted size can take
+const std::size_t maxSizeLength=24;
+
+///Write a number in decimal, ending at a given position
+///\return the start of the number
+char* formatUnsigned(std::uint64_t value, char* end){
+	while(value>=100){
+		unsigned int pair=value%100;
+		value/=100;
+		end-=2;
+		std::memcpy(end,digitPairs+2*pair,2);
+	}
+	if(value>=10){
+		end-=2;
+		std::memcpy(end,digitPairs+2*value,2);
+	}
+	else
+		*--end='0'+value;
+	return(end);
+}
+
+///Write a size, as formatSize does
+///\param out where to write the size, which must have room for at least
+///           maxSizeLength characters
+///\return the end of the size
+char* formatSize(std::uint64_t size, bool readable, char* out){
+	char digits[20];
+	char* end=digits+sizeof(digits);
+	if(!readable){
+		char* start=formatUnsigned(size,end);
+		std::memcpy(out,start,end-start);
+		return(out+(end-start));
+	}
+	const static char suffixes[]="BKMGTPE";
+	unsigned int index=0;
+	while(index<6 && size>>(10*(index+1)))
+		index++;
+	if(!index){
+		char* start=formatUnsigned(size,end);
+		std::memcpy(out,start,end-start);
+		out+=end-start;
+		*out++='B';
+		return(out);
+	}
+	//the size in units of 1024^index is whole+part/2^shift, which is rounded
+	//to hundredths exactly, with ties going to the even value as printf does
+	unsigned int shift=10*index;
+	std::uint64_t whole=size>>shift;
+	std::uint64_t part=size&((std::uint64_t(1)<<shift)-1);
+	//keep part*100 from overflowing, at the cost of exact ties for the
+	//very largest sizes
+	unsigned int drop=(shift>50 ? shift-50 : 0);
+	part>>=drop;
+	shift-=drop;
+	std::uint64_t scaled=part*100;
+	std::uint64_t hundredths=scaled>>shift;
+	std::uint64_t remainder=scaled&((std::uint64_t(1)<<shift)-1);
+	std::uint64_t half=std::uint64_t(1)<<(shift-1);
+	if(remainder>half || (remainder==half && (hundredths&1)))
+		hundredths++;
+	if(hundredths==100){
+		whole++;
+		hundredths=0;
+	}
+	char* start=formatUnsigned(whole,end);
+	std::memcpy(out,start,end-start);
+	out+=end-start;
+	*out++='.';
+	std::memcpy(out,digitPairs+2*hundredths,2);
+	out+=2;
+	*out++=suffixes[index];
+	return(out);
+}
+
+} //anonymous namespace
+
+std::string formatSize(std::uint64_t size, bool readable){
+	char buffer[maxSizeLength];
+	return(std::string(buffer,formatSize(size,readable,buffer)));
+}
+
+std::uint64_t parseSize(const std::string& text){
+	const static std::string suffixes="KMGTPE";
+	std::size_t digits=text.size();
+	unsigned int shift=0;
+	if(!text.empty()){
+		std::size_t suffix=suffixes.find(std::toupper(text.back()));
+		if(suffix!=std::string::npos){
+			digits--;
+			shift=10*(suffix+1);
+		}
+	}
+	std::uint64_t value;
+	if(!s3tools::parseUnsigned(text.data(),text.data()+digits,value) || (shift && value>>(64-shift)))
+		throw std::runtime_error("Invalid size: "+text);
+	return(value<<shift);
+}
+
+OutputFormat parseOutputFormat(const std::string& name){
+	if(name=="text")
+		return(OutputFormat::Text);
+	if(name=="tsv")
+		return(OutputFormat::TSV);
+	if(name=="json")
+		return(OutputFormat::JSON);
+	throw std::runtime_error("Unknown output format: "+name);
+}
+
+OutputBuffer::OutputBuffer(std::ostream& out, std::size_t capacity):
+out(out),data(new char[std::max<std::size_t>(capacity,maxSizeLength)]),
+capacity(std::max<std::size_t>(capacity,maxSizeLength)),used(0){}
+
+OutputBuffer::~OutputBuffer(){
+	flush();
+}
+
+OutputBuffer& OutputBuffer::operator<<(const char* s){
+	append(s,std::strlen(s));
+	return(*this);
+}
+
+void OutputBuffer::append(const char* s, std::size_t length){
+	if(length>capacity-used){
+		flush();
+		//long strings need not be copied at all
+		if(length>=capacity){
+			out.write(s,length);
+			return;
+		}
+	}
+	std::memcpy(data.get()+used,s,length);
+	used+=length;
+}
+
+void OutputBuffer::appendUnsigned(std::uint64_t value){
+	appendSize(value,false);
+}
+
+void OutputBuffer::appendSize(std::uint64_t size, bool readable){
+	reserve(maxSizeLength);
+	used=formatSize(size,readable,data.get()+used)-data.get();
+}
+
+void OutputBuffer::appendTSV(const std::string& s){
+	std::size_t start=0;
+	for(std::size_t i=0; i<s.size(); i++){
+		char escape;
+		switch(s[i]){
+			case '\t': escape='t'; break;
+			case '\n': escape='n'; break;
+			case '\r': escape='r'; break;
+			case '\\': escape='\\'; break;
+			default: continue;
+		}
+		append(s.data()+start,i-start);
+		*this << '\\' << escape;
+		start=i+1;
+	}
+	append(s.data()+start,s.size()-start);
+}
+
+void OutputBuffer::appendJSON(const std::string& s){
+	*this << '"';
+	std::size_t start=0;
+	for(std::size_t i=0; i<s.size(); i++){
+		unsigned char c=s[i];
+		if(c>=0x20 && c!='"' && c!='\\')
+			continue;
+		append(s.data()+start,i-start);
+		switch(c){
+			case '"': append("\\\"",2); break;
+			case '\\': append("\\\\",2); break;
+			case '\n': append("\\n",2); break;
+			case '\r': append("\\r",2); break;
+			case '\t': append("\\t",2); break;
+			default:
+				append("\\u00",4);
+				*this << "0123456789abcdef"[c>>4] << "0123456789abcdef"[c&0xF];
+		}
+		start=i+1;
+	}
+	append(s.data()+start,s.size()-start);
+	*this << '"';
+}
+
+void OutputBuffer::flush(){
+	if(used)
+		out.write(data.get(),used);
+	used=0;
+	out.flush();
+}
+
+void printBucket(OutputBuffer& out, const std::string& name, const std::string& created,
+                 OutputFormat format, bool verbose){
+	switch(format){
+		case OutputFormat::Text:
+			out << name;
+			if(verbose && !created.empty())
+				out << "\t " << created;
+			break;
+		case OutputFormat::TSV:
+			out.appendTSV(name);
+			out << '\t';
+			out.appendTSV(created);
+			break;
+		case OutputFormat::JSON:
+			out << "{\"name\":";
+			out.appendJSON(name);
+			if(!created.empty()){
+				out << ",\"creation_date\":";
+				out.appendJSON(created);
+			}
+			out << '}';
+			break;
+	}
+	out << '\n';
+}
@@ -0,0 +1,99 @@
+#ifndef S3TOOLS_OUTPUT_UTILS_H
+#define S3TOOLS_OUTPUT_UTILS_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+///Format a size in bytes for display.
+///\param size the number of bytes
+///\param readable whether to use a unit suffix (B, K, M, G, T, P, or E, in
+///                powers of 1024), with two decimal places for sizes of a
+///                kilobyte or more
+std::string formatSize(std::uint64_t size, bool readable);
+
+///Parse a size, which may have a unit suffix (K, M, G, T, P, or E, in powers
+///of 1024)
+///\throws std::runtime_error if the size is not valid
+std::uint64_t parseSize(const std::string& text);
+
+///The ways in which listings can be printed
+enum class OutputFormat{
+	///Columns aligned for reading, as the tools have always printed them
+	Text,
+	///One entry per line, with fields separated by tabs. Tabs, newlines,
+	///carriage returns and backslashes within fields are written as \t, \n,
+	///\r and \\.
+	TSV,
+	///One JSON object per line
+	JSON
+};
+
+///\throws std::runtime_error if the name is not text, tsv, or json
+OutputFormat parseOutputFormat(const std::string& name);
+
+///Collects output in a large buffer, which is passed to a stream in a single
+///write whenever it fills, so that printing a long listing costs a few large
+///writes rather than one per line. Numbers are formatted directly into the
+///buffer, without going through the stream's formatting.
+///
+///Anything written to the stream directly must be preceded by flush(), to
+///keep it in order with the buffered output.
+class OutputBuffer{
+public:
+	///\param out the stream to which output should be written
+	///\param capacity the number of bytes to collect between writes
+	explicit OutputBuffer(std::ostream& out=std::cout, std::size_t capacity=1<<18);
+	///Remaining output is written.
+	~OutputBuffer();
+	OutputBuffer(const OutputBuffer&)=delete;
+	OutputBuffer& operator=(const OutputBuffer&)=delete;
+
+	OutputBuffer& operator<<(char c){
+		if(used==capacity)
+			flush();
+		data[used++]=c;
+		return(*this);
+	}
+	OutputBuffer& operator<<(const std::string& s){
+		append(s.data(),s.size());
+		return(*this);
+	}
+	OutputBuffer& operator<<(const char* s);
+	void append(const char* s, std::size_t length);
+
+	///Write a number in decimal
+	void appendUnsigned(std::uint64_t value);
+	///Write a size as formatSize would
+	void appendSize(std::uint64_t size, bool readable);
+	///Write a field of a TSV record, escaping its special characters
+	void appendTSV(const std::string& s);
+	///Write a JSON string, with its quotes
+	void appendJSON(const std::string& s);
+
+	///Pass everything collected on to the stream, and flush it
+	void flush();
+
+private:
+	std::ostream& out;
+	std::unique_ptr<char[]> data;
+	std::size_t capacity;
+	std::size_t used;
+
+	///Make sure that at least a given number of bytes, no more than the
+	///capacity, can be added without flushing
+	void reserve(std::size_t length){
+		if(used+length>capacity)
+			flush();
+	}
+};
+
+///Print an entry of a listing of buckets, ending the line. In TSV form, the
+///fields are the name and creation date.
+///\param created the bucket's creation date, which is printed as text only
+///               if verbose is set
+void printBucket(OutputBuffer& out, const std::string& name, const std::string& created,
+                 OutputFormat format, bool verbose);
+
+#endif //S3TOOLS_OUTPUT_UTILS_H
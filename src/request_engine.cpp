@@ -0,0 +1,1104 @@
+#include <s3tools/request_engine.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h> //for stat
+
+#include <curl/curl.h>
+
+#if ! ( __APPLE__ && __MACH__ )
+	//Whether to use CURLOPT_CAINFO to specifiy a CA bundle path.
+	//According to https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
+	//this should not be used on Mac OS
+	#define USE_CURLOPT_CAINFO
+#endif
+
+namespace s3tools{
+
+constexpr std::size_t HTTPRequest::abortRead;
+static_assert(HTTPRequest::abortRead==CURL_READFUNC_ABORT,
+              "HTTPRequest::abortRead must match CURL_READFUNC_ABORT");
+
+void HTTPRequest::readFrom(std::istream& in, std::uint64_t size){
+	//the stream may continue past the body, which must not be sent
+	std::uint64_t remaining=size;
+	bodySource=[&in,remaining](char* buffer, std::size_t size) mutable ->std::size_t{
+		if(in.eof() || remaining==0)
+			return(0);
+		in.read(buffer, std::min<std::uint64_t>(size,remaining));
+		if(in.fail() && !in.eof()){
+			std::cerr << "Error reading input data" << std::endl;
+			return(abortRead);
+		}
+		remaining-=in.gcount();
+		return(in.gcount());
+	};
+	bodySize=size;
+}
+
+void HTTPRequest::writeTo(std::ostream& out){
+	sink=[&out](const char* data, std::size_t size)->bool{
+		out.write(data, size);
+		if(!out){
+			std::cerr << "Error writing output data" << std::endl;
+			return(false);
+		}
+		return(true);
+	};
+}
+
+namespace{
+
+#ifdef USE_CURLOPT_CAINFO
+std::string detectCABundlePath(){
+	//collection of known paths, copied from curl's acinclude.m4
+	const static auto possiblePaths={
+		"/etc/ssl/certs/ca-certificates.crt",     //Debian systems
+		"/etc/pki/tls/certs/ca-bundle.crt",       //Redhat and Mandriva
+		"/usr/share/ssl/certs/ca-bundle.crt",     //old(er) Redhat
+		"/usr/local/share/certs/ca-root-nss.crt", //FreeBSD
+		"/etc/ssl/cert.pem",                      //OpenBSD, FreeBSD (symlink)
+		"/etc/ssl/certs/",                        //SUSE
+	};
+	struct stat data;
+	for(const auto path : possiblePaths){
+		int err=stat(path,&data);
+		if(err==0)
+			return path;
+	}
+	return "";
+}
+#endif
+
+///An easy handle together with its error buffer
+struct EasyHandle{
+	CURL* curl;
+	char errBuf[CURL_ERROR_SIZE];
+
+	EasyHandle():curl(curl_easy_init()){
+		if(!curl)
+			throw std::runtime_error("Failed to create a curl handle");
+		errBuf[0]=0;
+	}
+	~EasyHandle(){
+		curl_easy_cleanup(curl);
+	}
+
+	template<typename T>
+	void set(CURLoption option, T value, const std::string& desc){
+		CURLcode err=curl_easy_setopt(curl, option, value);
+		if(err!=CURLE_OK){
+			if(errBuf[0]!=0)
+				throw std::runtime_error("Failed to set curl "+desc+"\n curl error: "+errBuf);
+			throw std::runtime_error("Failed to set curl "+desc+"\n curl error: "+curl_easy_strerror(err));
+		}
+	}
+};
+
+///One of a set of equivalent servers among which requests are spread
+struct Endpoint{
+	///The value for CURLOPT_CONNECT_TO which sends a request to this server
+	std::unique_ptr<curl_slist,void (*)(curl_slist*)> connectTo;
+	///The number of requests currently being made to this server
+	std::size_t inFlight;
+	///A moving average of the time taken by this server to begin responding
+	double latency;
+	///Whether latency has been measured yet
+	bool measured;
+	///The number of consecutive failed requests
+	unsigned int failures;
+	///The time before which this server should not be used
+	std::chrono::steady_clock::time_point ejectedUntil;
+
+	Endpoint(const std::string& target):
+	connectTo(curl_slist_append(nullptr,("::"+target).c_str()),curl_slist_free_all),
+	inFlight(0),latency(0),measured(false),failures(0){
+		if(!connectTo)
+			throw std::runtime_error("Failed to allocate curl connection target list");
+	}
+
+	///How expensive it is likely to be to send another request to this server
+	double cost() const{
+		return((inFlight+1)*latency);
+	}
+};
+
+///The host and port of a URL, taking the scheme's default port into account
+std::string hostAndPort(const URL& url){
+	unsigned int port=url.port;
+	//URL does not know that HTTPS has a different default port
+	if(port==80 && url.scheme=="https")
+		port=443;
+	return(url.host+":"+std::to_string(port));
+}
+
+///A request together with all of the state needed to carry it out
+struct Transfer{
+	RequestEngine::RequestID id;
+	HTTPRequest request;
+	HTTPResponse response;
+	RequestEngine::Callback callback;
+	std::unique_ptr<EasyHandle> handle;
+	std::unique_ptr<curl_slist,void (*)(curl_slist*)> headerList;
+	std::string urlStr;
+	///How much of request.body has been sent
+	std::size_t bodyOffset;
+	///Set if request.sink rejected data or threw an exception
+	bool sinkFailed;
+	///The server to which the request is being sent, if it is one of a set of
+	///equivalent endpoints
+	Endpoint* endpoint;
+	///The result reported by curl
+	CURLcode curlResult;
+	///Whether any part of the response has arrived
+	bool responding;
+	///For a hedged request, the other transfer of the pair racing to make it
+	Transfer* twin;
+	///Whether this is the duplicate sent to hedge another transfer, rather
+	///than the transfer which owns the request's ID and callback
+	bool duplicate;
+	///Set when the twin has begun receiving a response first, after which
+	///this transfer must stop
+	bool lostRace;
+	///Where to note that this transfer has won a race, so that its twin can
+	///be stopped once curl returns control
+	std::vector<Transfer*>* raceWinners;
+
+	Transfer(RequestEngine::RequestID id, HTTPRequest&& request, RequestEngine::Callback&& callback):
+	id(id),request(std::move(request)),callback(std::move(callback)),
+	headerList(nullptr,curl_slist_free_all),bodyOffset(0),sinkFailed(false),
+	endpoint(nullptr),curlResult(CURLE_OK),responding(false),twin(nullptr),
+	duplicate(false),lostRace(false),raceWinners(nullptr){}
+};
+
+size_t readCallback(char* buffer, size_t size, size_t nitems, void* userp){
+	Transfer* t=static_cast<Transfer*>(userp);
+	size_t space=size*nitems;
+	if(t->request.bodySource){
+		//curl can't tolerate exceptions, so stop them here
+		try{
+			return(t->request.bodySource(buffer,space));
+		}catch(std::exception& ex){
+			t->response.error=std::string("Exception thrown while reading input: ")+ex.what();
+		}catch(...){
+			t->response.error="Exception thrown while reading input";
+		}
+		return(CURL_READFUNC_ABORT);
+	}
+	size_t amount=std::min(space,t->request.body.size()-t->bodyOffset);
+	std::memcpy(buffer,t->request.body.data()+t->bodyOffset,amount);
+	t->bodyOffset+=amount;
+	return(amount);
+}
+
+///Whether the response being received has an error status
+bool errorStatus(Transfer* t){
+	long status=0;
+	curl_easy_getinfo(t->handle->curl,CURLINFO_RESPONSE_CODE,&status);
+	return(status>=400);
+}
+
+size_t writeCallback(char* buffer, size_t size, size_t nmemb, void* userp){
+	Transfer* t=static_cast<Transfer*>(userp);
+	size_t amount=size*nmemb;
+	if(t->lostRace)
+		return(amount?0:1);
+	//curl can't tolerate exceptions, so stop them here
+	try{
+		if(t->request.sink && (t->request.sinkErrors || !errorStatus(t))){
+			if(!t->request.sink(buffer,amount)){
+				t->sinkFailed=true;
+				return(amount?0:1); //return a different number to indicate error
+			}
+		}
+		else
+			t->response.body.append(buffer,amount);
+	}catch(std::exception& ex){
+		t->sinkFailed=true;
+		t->response.error=std::string("Exception thrown while collecting output: ")+ex.what();
+		return(amount?0:1);
+	}catch(...){
+		t->sinkFailed=true;
+		t->response.error="Exception thrown while collecting output";
+		return(amount?0:1);
+	}
+	return(amount);
+}
+
+size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userp){
+	Transfer* t=static_cast<Transfer*>(userp);
+	size_t amount=size*nitems;
+	if(t->lostRace)
+		return(amount?0:1);
+	if(!t->responding){
+		t->responding=true;
+		//the first of a hedged pair to get a response wins
+		if(t->twin){
+			t->twin->lostRace=true;
+			t->raceWinners->push_back(t);
+		}
+	}
+	try{
+		std::string line(buffer,amount);
+		while(!line.empty() && (line.back()=='\n' || line.back()=='\r'))
+			line.pop_back();
+		//a new status line means that any headers seen so far belonged to an
+		//interim response, like '100 Continue'
+		if(line.compare(0,5,"HTTP/")==0)
+			t->response.headers.clear();
+		else{
+			size_t colon=line.find(':');
+			if(colon!=std::string::npos){
+				size_t valueStart=line.find_first_not_of(" \t",colon+1);
+				t->response.headers[lowercase(line.substr(0,colon))]=
+				  (valueStart==std::string::npos ? "" : line.substr(valueStart));
+			}
+		}
+	}catch(...){
+		return(amount?0:1);
+	}
+	return(amount);
+}
+
+///Collect the timing information for a finished transfer
+void recordTiming(CURL* easy, TransferTiming& timing){
+	auto getTime=[easy](CURLINFO info, std::chrono::microseconds& time){
+		curl_off_t value=0;
+		if(curl_easy_getinfo(easy, info, &value)==CURLE_OK)
+			time=std::chrono::microseconds(value);
+	};
+	auto getSize=[easy](CURLINFO info, std::uint64_t& size){
+		curl_off_t value=0;
+		if(curl_easy_getinfo(easy, info, &value)==CURLE_OK && value>0)
+			size=value;
+	};
+	getTime(CURLINFO_NAMELOOKUP_TIME_T,timing.nameLookup);
+	getTime(CURLINFO_CONNECT_TIME_T,timing.connect);
+	getTime(CURLINFO_APPCONNECT_TIME_T,timing.appConnect);
+	getTime(CURLINFO_STARTTRANSFER_TIME_T,timing.startTransfer);
+	getTime(CURLINFO_TOTAL_TIME_T,timing.total);
+	getSize(CURLINFO_SIZE_UPLOAD_T,timing.bytesSent);
+	getSize(CURLINFO_SIZE_DOWNLOAD_T,timing.bytesReceived);
+}
+
+} //anonymous namespace
+
+struct RequestEngine::Impl{
+	///The number of recent response times used to choose the hedging delay
+	static constexpr std::size_t responseTimeWindow=1000;
+	///The smallest number of response times from which to choose the delay
+	static constexpr std::size_t minResponseTimes=20;
+	///The number of duplicates which may be sent in a burst
+	static constexpr double maxHedgeTokens=2;
+
+	Options opts;
+	std::unique_ptr<CURLM,CURLMcode(*)(CURLM*)> multi;
+	std::unique_ptr<CURLSH,CURLSHcode(*)(CURLSH*)> share;
+	///Sets of equivalent endpoints, indexed by the host and port for which
+	///they stand in
+	std::unordered_map<std::string,std::vector<Endpoint>> pools;
+	std::minstd_rand rng;
+
+	///Protects everything which may be touched by threads other than the one
+	///driving the engine: pending, cancellations, live, and nextID
+	std::mutex lock;
+	std::deque<std::unique_ptr<Transfer>> pending;
+	std::vector<RequestID> cancellations;
+	std::unordered_set<RequestID> live;
+	RequestID nextID;
+	///The earliest deadline of any pending request, if one might have passed
+	std::chrono::steady_clock::time_point nextPendingDeadline;
+
+	///Transfers currently attached to the multi handle
+	std::unordered_map<RequestID,std::unique_ptr<Transfer>> active;
+	///Easy handles not currently in use
+	std::vector<std::unique_ptr<EasyHandle>> idle;
+
+	///When each hedged request should be duplicated, if it is still waiting
+	std::multimap<std::chrono::steady_clock::time_point,RequestID> hedgeTimers;
+	///Recent times to first byte for GET and HEAD requests
+	std::vector<std::chrono::microseconds> responseTimes;
+	///The position in responseTimes at which to store the next time
+	std::size_t nextResponseTime;
+	///The hedging delay computed from responseTimes
+	std::chrono::microseconds hedgeDelay;
+	///The number of times recorded since hedgeDelay was computed
+	std::size_t staleResponseTimes;
+	///The number of duplicate requests which may currently be sent
+	double hedgeTokens;
+	///Transfers which have won races, whose twins must be stopped
+	std::vector<Transfer*> raceWinners;
+
+	std::atomic<std::size_t> outstanding;
+	///The number of requests which have finished, guarded by doneLock, so
+	///that threads waiting in poll() while others submit requests can tell
+	///when any request finishes
+	std::size_t completed;
+	std::mutex doneLock;
+	std::condition_variable doneCond;
+
+	std::thread worker;
+	std::atomic<bool> stopping;
+
+	Impl(Options opts):
+	opts(std::move(opts)),multi(nullptr,curl_multi_cleanup),share(nullptr,curl_share_cleanup),
+	nextID(1),nextPendingDeadline(std::chrono::steady_clock::time_point::max()),
+	nextResponseTime(0),hedgeDelay(0),staleResponseTimes(0),hedgeTokens(maxHedgeTokens),
+	outstanding(0),completed(0),stopping(false){
+		//curl_global_init is not thread-safe, so make sure it has happened
+		//before any handles might be created concurrently
+		static const CURLcode globalInit=curl_global_init(CURL_GLOBAL_ALL);
+		if(globalInit!=CURLE_OK)
+			throw std::runtime_error(std::string("Failed to initialize curl: ")+curl_easy_strerror(globalInit));
+
+		if(this->opts.maxConcurrent==0)
+			this->opts.maxConcurrent=1;
+		multi.reset(curl_multi_init());
+		if(!multi)
+			throw std::runtime_error("Failed to create a curl multi handle");
+		if(this->opts.http2){
+			if(!(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+				throw std::runtime_error("HTTP/2 was requested, but libcurl was built without HTTP/2 support");
+			CURLMcode err=curl_multi_setopt(multi.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+			if(err==CURLM_OK)
+				err=curl_multi_setopt(multi.get(), CURLMOPT_MAX_CONCURRENT_STREAMS, (long)std::min<std::size_t>(this->opts.maxConcurrent,1000));
+			if(err!=CURLM_OK)
+				throw std::runtime_error(std::string("Failed to enable curl multiplexing: ")+curl_multi_strerror(err));
+			//Once a connection carries as many streams as the server allows,
+			//curl opens a new connection for each further request, unless
+			//made to queue them.
+			if(this->opts.maxHostConnections==0)
+				this->opts.maxHostConnections=4;
+		}
+		if(this->opts.maxHostConnections>0){
+			CURLMcode err=curl_multi_setopt(multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, this->opts.maxHostConnections);
+			if(err!=CURLM_OK)
+				throw std::runtime_error(std::string("Failed to set curl connection limit: ")+curl_multi_strerror(err));
+		}
+
+		//The multi handle already shares its connection cache and DNS results
+		//among its transfers, but TLS session IDs must be shared explicitly.
+		share.reset(curl_share_init());
+		if(!share)
+			throw std::runtime_error("Failed to create a curl share handle");
+		CURLSHcode err=curl_share_setopt(share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		if(err!=CURLSHE_OK)
+			throw std::runtime_error(std::string("Failed to configure curl share handle: ")+curl_share_strerror(err));
+
+#ifdef USE_CURLOPT_CAINFO
+		if(this->opts.caBundlePath.empty())
+			this->opts.caBundlePath=detectCABundlePath();
+#endif
+
+		for(const auto& set : this->opts.endpoints){
+			if(set.second.empty())
+				continue;
+			std::vector<Endpoint>& pool=pools[hostAndPort(URL(set.first))];
+			for(const auto& endpoint : set.second)
+				pool.emplace_back(hostAndPort(URL(endpoint)));
+		}
+		rng.seed(std::random_device()());
+	}
+
+	~Impl(){
+		//Anything left over is cancelled, so that nothing waits forever
+		std::vector<std::unique_ptr<Transfer>> remaining;
+		for(auto& entry : active){
+			curl_multi_remove_handle(multi.get(), entry.second->handle->curl);
+			entry.second->twin=nullptr;
+			if(entry.second->duplicate){
+				entry.second->response.result=RequestStatus::Cancelled;
+				discard(std::move(entry.second));
+			}
+			else
+				remaining.push_back(std::move(entry.second));
+		}
+		active.clear();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for(auto& t : pending)
+				remaining.push_back(std::move(t));
+			pending.clear();
+		}
+		for(auto& t : remaining){
+			t->response.result=RequestStatus::Cancelled;
+			t->response.error="Request cancelled";
+			finish(std::move(t));
+		}
+		//easy handles must be cleaned up before the share they use
+		idle.clear();
+	}
+
+	RequestID enqueue(HTTPRequest&& request, Callback&& callback){
+		RequestID id;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			id=nextID++;
+			auto deadline=request.deadline;
+			pending.emplace_back(new Transfer(id,std::move(request),std::move(callback)));
+			live.insert(id);
+			nextPendingDeadline=std::min(nextPendingDeadline,deadline);
+			outstanding++;
+		}
+		curl_multi_wakeup(multi.get());
+		return(id);
+	}
+
+	std::unique_ptr<EasyHandle> acquireHandle(){
+		std::unique_ptr<EasyHandle> handle;
+		if(!idle.empty()){
+			handle=std::move(idle.back());
+			idle.pop_back();
+			//Clears all options set for previous requests, but leaves the
+			//handle's caches and its attachment to the share alone.
+			curl_easy_reset(handle->curl);
+			handle->errBuf[0]=0;
+		}
+		else{
+			handle.reset(new EasyHandle);
+			handle->set(CURLOPT_SHARE, share.get(), "share handle");
+		}
+		return(handle);
+	}
+
+	///Pick the server to which a request should be sent
+	///\return the chosen server, or null if the request's URL does not have
+	///        a set of equivalent endpoints
+	Endpoint* chooseEndpoint(const URL& url, const Endpoint* avoid=nullptr){
+		if(pools.empty())
+			return(nullptr);
+		auto it=pools.find(hostAndPort(url));
+		if(it==pools.end())
+			return(nullptr);
+		std::vector<Endpoint>& pool=it->second;
+		auto now=std::chrono::steady_clock::now();
+		std::vector<Endpoint*> candidates;
+		for(Endpoint& endpoint : pool){
+			if(endpoint.ejectedUntil<=now)
+				candidates.push_back(&endpoint);
+		}
+		if(candidates.empty()){
+			//all have failed recently, so try whichever should recover first
+			return(&*std::min_element(pool.begin(),pool.end(),
+			  [](const Endpoint& a, const Endpoint& b){ return(a.ejectedUntil<b.ejectedUntil); }));
+		}
+		if(avoid && candidates.size()>1)
+			candidates.erase(std::remove(candidates.begin(),candidates.end(),avoid),candidates.end());
+		if(candidates.size()==1)
+			return(candidates.front());
+		//the better of two random choices
+		std::size_t first=std::uniform_int_distribution<std::size_t>(0,candidates.size()-1)(rng);
+		std::size_t second=std::uniform_int_distribution<std::size_t>(0,candidates.size()-2)(rng);
+		if(second>=first)
+			second++;
+		Endpoint* a=candidates[first];
+		Endpoint* b=candidates[second];
+		//servers not yet measured are tried first
+		if(a->measured!=b->measured)
+			return(a->measured ? b : a);
+		if(a->cost()!=b->cost())
+			return(a->cost()<b->cost() ? a : b);
+		return(a->inFlight<=b->inFlight ? a : b);
+	}
+
+	///Record that a server is unusable, and keep it out of use for a time
+	///which grows with the number of consecutive failures
+	void eject(Endpoint& endpoint){
+		endpoint.failures++;
+		auto penalty=std::chrono::milliseconds(500)*(1u<<std::min(endpoint.failures-1,6u));
+		endpoint.ejectedUntil=std::chrono::steady_clock::now()+penalty;
+	}
+
+	///Update the state of the server to which a transfer was sent, once it is
+	///no longer using it
+	void releaseEndpoint(Transfer& t){
+		if(!t.endpoint)
+			return;
+		Endpoint& endpoint=*t.endpoint;
+		t.endpoint=nullptr;
+		endpoint.inFlight--;
+		const HTTPResponse& response=t.response;
+		if(response.result==RequestStatus::Cancelled)
+			return;
+		bool serverFailed;
+		switch(t.curlResult){
+			case CURLE_COULDNT_RESOLVE_HOST:
+			case CURLE_COULDNT_CONNECT:
+			case CURLE_OPERATION_TIMEDOUT:
+			case CURLE_SSL_CONNECT_ERROR:
+			case CURLE_GOT_NOTHING:
+			case CURLE_SEND_ERROR:
+			case CURLE_RECV_ERROR:
+			case CURLE_PARTIAL_FILE:
+				serverFailed=true;
+				break;
+			default:
+				serverFailed=(response.status==502 || response.status==503 || response.status==504);
+		}
+		if(serverFailed)
+			eject(endpoint);
+		else if(response.complete()){
+			endpoint.failures=0;
+			double sample=response.timing.startTransfer.count();
+			if(endpoint.measured)
+				endpoint.latency+=0.25*(sample-endpoint.latency);
+			else{
+				endpoint.latency=sample;
+				endpoint.measured=true;
+			}
+		}
+	}
+
+	///Set up all of the options for a transfer
+	///\param avoid an endpoint which should not be used if there is another
+	void configure(Transfer& t, const Endpoint* avoid=nullptr){
+		t.handle=acquireHandle();
+		EasyHandle& h=*t.handle;
+		const URL& url=t.request.url;
+
+		h.set(CURLOPT_ERRORBUFFER, h.errBuf, "error buffer");
+		h.set(CURLOPT_PRIVATE, &t, "private data");
+		h.set(CURLOPT_NOSIGNAL, 1L, "signal suppression");
+#ifdef USE_CURLOPT_CAINFO
+		if(!opts.caBundlePath.empty())
+			h.set(CURLOPT_CAINFO, opts.caBundlePath.c_str(), "CA bundle path");
+#endif
+		t.urlStr=url.str();
+		h.set(CURLOPT_URL, t.urlStr.c_str(), "URL option");
+		if(Endpoint* endpoint=chooseEndpoint(url,avoid)){
+			h.set(CURLOPT_CONNECT_TO, endpoint->connectTo.get(), "connection target");
+			t.endpoint=endpoint;
+			endpoint->inFlight++;
+		}
+		if(opts.http2){
+			h.set(CURLOPT_HTTP_VERSION, (long)(url.scheme=="https" ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE), "HTTP version");
+			//wait for a connection which can be shared, rather than opening a new one
+			h.set(CURLOPT_PIPEWAIT, 1L, "multiplexing option");
+		}
+		else
+			h.set(CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1, "HTTP version");
+
+		if(url.verb=="GET")
+			h.set(CURLOPT_HTTPGET, 1L, "GET option");
+		else if(url.verb=="PUT")
+			h.set(CURLOPT_UPLOAD, 1L, "PUT/upload option");
+		else if(url.verb=="HEAD")
+			h.set(CURLOPT_NOBODY, 1L, "HEAD option");
+		else if(url.verb=="POST")
+			h.set(CURLOPT_POST, 1L, "POST option");
+		else
+			h.set(CURLOPT_CUSTOMREQUEST, url.verb.c_str(), url.verb+"/CUSTOMREQUEST option");
+
+		if(t.request.bodySource || !t.request.body.empty() || url.verb=="PUT" || url.verb=="POST"){
+			curl_off_t size=(t.request.bodySource ? t.request.bodySize : t.request.body.size());
+			h.set(CURLOPT_READFUNCTION, readCallback, "input callback");
+			h.set(CURLOPT_READDATA, &t, "input callback data");
+			if(url.verb=="POST")
+				h.set(CURLOPT_POSTFIELDSIZE_LARGE, size, "input data size");
+			else
+				h.set(CURLOPT_INFILESIZE_LARGE, size, "input data size");
+		}
+		h.set(CURLOPT_WRITEFUNCTION, writeCallback, "output callback");
+		h.set(CURLOPT_WRITEDATA, &t, "output callback data");
+		h.set(CURLOPT_HEADERFUNCTION, headerCallback, "header callback");
+		h.set(CURLOPT_HEADERDATA, &t, "header callback data");
+		if(t.request.showProgress)
+			h.set(CURLOPT_NOPROGRESS, 0L, "progress indicator");
+
+		if(!url.headers.empty()){
+			for(const auto& header : url.headers)
+				t.headerList.reset(curl_slist_append(t.headerList.release(),(header.first+":"+header.second).c_str()));
+			//suppress unwanted 'Accept' header
+			t.headerList.reset(curl_slist_append(t.headerList.release(),"Accept:"));
+			h.set(CURLOPT_HTTPHEADER, t.headerList.get(), "request headers");
+		}
+
+		if(t.request.deadline!=std::chrono::steady_clock::time_point::max()){
+			auto remaining=std::chrono::duration_cast<std::chrono::milliseconds>(t.request.deadline-std::chrono::steady_clock::now());
+			h.set(CURLOPT_TIMEOUT_MS, std::max(1L,(long)remaining.count()), "timeout");
+		}
+	}
+
+	///Whether a request may be hedged
+	static bool hedgeable(const Transfer& t){
+		return(t.request.hedge && (t.request.url.verb=="GET" || t.request.url.verb=="HEAD")
+		       && !t.request.bodySource && t.request.body.empty());
+	}
+
+	///Note how long a GET or HEAD request took to begin receiving a response
+	void recordResponseTime(const Transfer& t){
+		if(t.request.url.verb!="GET" && t.request.url.verb!="HEAD")
+			return;
+		if(responseTimes.size()<responseTimeWindow)
+			responseTimes.push_back(t.response.timing.startTransfer);
+		else{
+			responseTimes[nextResponseTime]=t.response.timing.startTransfer;
+			nextResponseTime=(nextResponseTime+1)%responseTimeWindow;
+		}
+		staleResponseTimes++;
+	}
+
+	///How long to wait before duplicating a hedged request
+	std::chrono::microseconds currentHedgeDelay(){
+		if(responseTimes.size()<minResponseTimes)
+			return(opts.hedgeDelay);
+		//recomputing the percentile for every request would be wasteful
+		if(staleResponseTimes>=minResponseTimes || hedgeDelay.count()==0){
+			std::vector<std::chrono::microseconds> times=responseTimes;
+			std::size_t rank=std::min(times.size()-1,(std::size_t)(opts.hedgePercentile*times.size()));
+			std::nth_element(times.begin(),times.begin()+rank,times.end());
+			hedgeDelay=times[rank];
+			staleResponseTimes=0;
+		}
+		return(hedgeDelay);
+	}
+
+	///Arrange for a hedged request which has just been started to be
+	///duplicated if it is slow to get a response
+	void scheduleHedge(const Transfer& t){
+		hedgeTokens=std::min(hedgeTokens+opts.hedgeBudget,maxHedgeTokens);
+		hedgeTimers.emplace(std::chrono::steady_clock::now()+currentHedgeDelay(),t.id);
+	}
+
+	///Send duplicates of any hedged requests which have waited too long
+	void launchHedges(){
+		auto now=std::chrono::steady_clock::now();
+		while(!hedgeTimers.empty() && hedgeTimers.begin()->first<=now){
+			RequestID id=hedgeTimers.begin()->second;
+			hedgeTimers.erase(hedgeTimers.begin());
+			auto it=active.find(id);
+			if(it==active.end())
+				continue;
+			Transfer& original=*it->second;
+			if(original.responding || original.twin || hedgeTokens<1)
+				continue;
+			RequestID duplicateID;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				duplicateID=nextID++;
+			}
+			std::unique_ptr<Transfer> duplicate(new Transfer(duplicateID,HTTPRequest(original.request),Callback()));
+			duplicate->duplicate=true;
+			duplicate->response.retries=original.response.retries;
+			try{
+				configure(*duplicate,original.endpoint);
+				CURLMcode err=curl_multi_add_handle(multi.get(), duplicate->handle->curl);
+				if(err!=CURLM_OK)
+					throw std::runtime_error(std::string("Failed to start transfer: ")+curl_multi_strerror(err));
+			}catch(std::exception&){
+				discard(std::move(duplicate));
+				continue;
+			}
+			hedgeTokens-=1;
+			original.twin=duplicate.get();
+			duplicate->twin=&original;
+			original.raceWinners=duplicate->raceWinners=&raceWinners;
+			original.response.hedged=duplicate->response.hedged=true;
+			active.emplace(duplicateID,std::move(duplicate));
+		}
+	}
+
+	///Make a duplicate transfer stand in for the transfer it duplicated, taking
+	///over its ID and callback
+	void promote(Transfer& duplicate, Transfer& original){
+		auto it=active.find(duplicate.id);
+		std::unique_ptr<Transfer> t=std::move(it->second);
+		active.erase(it);
+		t->id=original.id;
+		t->callback=std::move(original.callback);
+		t->duplicate=false;
+		RequestID id=t->id;
+		active[id]=std::move(t);
+	}
+
+	///Stop the losers of any hedging races which have been decided
+	void resolveRaces(){
+		for(Transfer* winner : raceWinners){
+			Transfer* loser=winner->twin;
+			if(!loser)
+				continue;
+			winner->twin=nullptr;
+			loser->twin=nullptr;
+			auto it=active.find(loser->id);
+			std::unique_ptr<Transfer> lost=std::move(it->second);
+			active.erase(it);
+			curl_multi_remove_handle(multi.get(), lost->handle->curl);
+			if(winner->duplicate)
+				promote(*winner,*lost);
+			lost->response.result=RequestStatus::Cancelled;
+			discard(std::move(lost));
+		}
+		raceWinners.clear();
+	}
+
+	///Dispose of a transfer which is no longer needed, but which does not
+	///represent a request to its owner, such as a losing hedge
+	void discard(std::unique_ptr<Transfer> t){
+		releaseEndpoint(*t);
+		if(t->handle){
+			t->handle->set(CURLOPT_PRIVATE, (void*)nullptr, "private data");
+			idle.push_back(std::move(t->handle));
+		}
+	}
+
+	///Hand a finished transfer back to its owner
+	void finish(std::unique_ptr<Transfer> t){
+		releaseEndpoint(*t);
+		if(t->handle){
+			t->handle->set(CURLOPT_PRIVATE, (void*)nullptr, "private data");
+			idle.push_back(std::move(t->handle));
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			live.erase(t->id);
+		}
+		if(opts.observer){
+			try{
+				opts.observer(t->request,t->response);
+			}catch(std::exception& ex){
+				std::cerr << "Exception thrown by request observer: " << ex.what() << std::endl;
+			}catch(...){
+				std::cerr << "Exception thrown by request observer" << std::endl;
+			}
+		}
+		Callback callback=std::move(t->callback);
+		HTTPResponse response=std::move(t->response);
+		t.reset();
+		if(callback){
+			//the driving loop can't tolerate exceptions, so stop them here
+			try{
+				callback(std::move(response));
+			}catch(std::exception& ex){
+				std::cerr << "Exception thrown by request completion callback: " << ex.what() << std::endl;
+			}catch(...){
+				std::cerr << "Exception thrown by request completion callback" << std::endl;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> guard(doneLock);
+			outstanding--;
+			completed++;
+		}
+		doneCond.notify_all();
+	}
+
+	///Apply cancellations, fail pending requests whose deadlines have passed,
+	///and start as many pending requests as the concurrency limit allows.
+	///\return the number of requests which finished
+	std::size_t admit(){
+		std::vector<std::unique_ptr<Transfer>> finished;
+		std::vector<RequestID> cancelled;
+		auto now=std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			std::swap(cancelled,cancellations);
+			for(RequestID id : cancelled){
+				auto it=std::find_if(pending.begin(),pending.end(),
+				                     [id](const std::unique_ptr<Transfer>& t){ return(t->id==id); });
+				if(it!=pending.end()){
+					(*it)->response.result=RequestStatus::Cancelled;
+					(*it)->response.error="Request cancelled";
+					finished.push_back(std::move(*it));
+					pending.erase(it);
+				}
+			}
+			if(now>=nextPendingDeadline){
+				nextPendingDeadline=std::chrono::steady_clock::time_point::max();
+				for(auto it=pending.begin(); it!=pending.end();){
+					if((*it)->request.deadline<=now){
+						(*it)->response.result=RequestStatus::TimedOut;
+						(*it)->response.error="Request deadline passed before it could be started";
+						finished.push_back(std::move(*it));
+						it=pending.erase(it);
+					}
+					else{
+						nextPendingDeadline=std::min(nextPendingDeadline,(*it)->request.deadline);
+						++it;
+					}
+				}
+			}
+		}
+		for(RequestID id : cancelled){
+			auto it=active.find(id);
+			if(it!=active.end()){
+				curl_multi_remove_handle(multi.get(), it->second->handle->curl);
+				it->second->response.result=RequestStatus::Cancelled;
+				it->second->response.error="Request cancelled";
+				finished.push_back(std::move(it->second));
+				active.erase(it);
+				if(Transfer* twin=finished.back()->twin){
+					finished.back()->twin=nullptr;
+					auto twinIt=active.find(twin->id);
+					curl_multi_remove_handle(multi.get(), twin->handle->curl);
+					twin->twin=nullptr;
+					twin->response.result=RequestStatus::Cancelled;
+					std::unique_ptr<Transfer> duplicate=std::move(twinIt->second);
+					active.erase(twinIt);
+					discard(std::move(duplicate));
+				}
+			}
+		}
+		while(active.size()<opts.maxConcurrent){
+			std::unique_ptr<Transfer> t;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if(pending.empty())
+					break;
+				t=std::move(pending.front());
+				pending.pop_front();
+			}
+			try{
+				configure(*t);
+				CURLMcode err=curl_multi_add_handle(multi.get(), t->handle->curl);
+				if(err!=CURLM_OK)
+					throw std::runtime_error(std::string("Failed to start transfer: ")+curl_multi_strerror(err));
+				RequestID id=t->id;
+				if(hedgeable(*t))
+					scheduleHedge(*t);
+				active.emplace(id,std::move(t));
+			}catch(std::exception& ex){
+				t->response.error=ex.what();
+				finished.push_back(std::move(t));
+			}
+		}
+		launchHedges();
+		std::size_t count=finished.size();
+		for(auto& t : finished)
+			finish(std::move(t));
+		return(count);
+	}
+
+	///If a transfer failed because it could not connect to one of a set of
+	///equivalent endpoints, send it to another instead. Nothing has been sent
+	///or received, so it can simply be started again.
+	///\return whether the transfer was queued again
+	bool retryElsewhere(std::unique_ptr<Transfer>& t){
+		if(!t->endpoint || (t->curlResult!=CURLE_COULDNT_CONNECT && t->curlResult!=CURLE_COULDNT_RESOLVE_HOST))
+			return(false);
+		auto pool=pools.find(hostAndPort(t->request.url));
+		if(t->response.retries+1>=pool->second.size())
+			return(false);
+		releaseEndpoint(*t);
+		t->handle->set(CURLOPT_PRIVATE, (void*)nullptr, "private data");
+		idle.push_back(std::move(t->handle));
+		t->headerList.reset();
+		unsigned int retries=t->response.retries+1;
+		t->response=HTTPResponse();
+		t->response.retries=retries;
+		t->curlResult=CURLE_OK;
+		std::lock_guard<std::mutex> guard(lock);
+		pending.push_front(std::move(t));
+		return(true);
+	}
+
+	///Collect the results of any transfers which curl has finished
+	///\return the number of requests which finished
+	std::size_t reap(){
+		std::size_t count=0;
+		CURLMsg* msg;
+		int remaining;
+		while((msg=curl_multi_info_read(multi.get(),&remaining))){
+			if(msg->msg!=CURLMSG_DONE)
+				continue;
+			CURL* easy=msg->easy_handle;
+			CURLcode result=msg->data.result;
+			char* priv=nullptr;
+			curl_easy_getinfo(easy, CURLINFO_PRIVATE, &priv);
+			Transfer* raw=reinterpret_cast<Transfer*>(priv);
+			//msg is invalidated by removing the handle
+			curl_multi_remove_handle(multi.get(), easy);
+			if(!raw)
+				continue;
+			auto it=active.find(raw->id);
+			if(it==active.end())
+				continue;
+			std::unique_ptr<Transfer> t=std::move(it->second);
+			active.erase(it);
+
+			t->curlResult=result;
+			if(t->twin){
+				//One of a hedged pair failed before either began receiving a
+				//response, so the other carries on alone.
+				Transfer* other=t->twin;
+				t->twin=other->twin=nullptr;
+				if(!t->duplicate)
+					promote(*other,*t);
+				discard(std::move(t));
+				continue;
+			}
+			if(retryElsewhere(t))
+				continue;
+			curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &t->response.status);
+			recordTiming(easy,t->response.timing);
+			if(result==CURLE_OK){
+				t->response.result=RequestStatus::Complete;
+				recordResponseTime(*t);
+			}
+			else{
+				t->response.result=(result==CURLE_OPERATION_TIMEDOUT ? RequestStatus::TimedOut : RequestStatus::Failed);
+				if(!t->sinkFailed || t->response.error.empty()){
+					if(t->handle->errBuf[0]!=0)
+						t->response.error=t->handle->errBuf;
+					else
+						t->response.error=curl_easy_strerror(result);
+				}
+			}
+			finish(std::move(t));
+			count++;
+		}
+		return(count);
+	}
+
+	///Make whatever progress is possible, waiting up to the given time for
+	///something to happen if nothing is immediately ready.
+	///\return the number of requests which finished
+	std::size_t step(std::chrono::milliseconds maxWait){
+		std::size_t finished=admit();
+		int running=0;
+		curl_multi_perform(multi.get(),&running);
+		resolveRaces();
+		finished+=reap();
+		if(finished)
+			return(finished);
+
+		//While requests are queued, wake up periodically to check their
+		//deadlines
+		bool havePending;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			havePending=!pending.empty() || !cancellations.empty();
+		}
+		if(havePending && maxWait>std::chrono::milliseconds(100))
+			maxWait=std::chrono::milliseconds(100);
+		//wake up in time to send any duplicates of hedged requests
+		if(!hedgeTimers.empty()){
+			auto untilHedge=std::chrono::duration_cast<std::chrono::milliseconds>(
+			  hedgeTimers.begin()->first-std::chrono::steady_clock::now())+std::chrono::milliseconds(1);
+			maxWait=std::max(std::chrono::milliseconds(0),std::min(maxWait,untilHedge));
+		}
+		curl_multi_poll(multi.get(),nullptr,0,maxWait.count(),nullptr);
+		curl_multi_perform(multi.get(),&running);
+		resolveRaces();
+		finished+=admit();
+		finished+=reap();
+		return(finished);
+	}
+
+	void work(){
+		while(!stopping)
+			step(std::chrono::milliseconds(1000));
+	}
+};
+
+constexpr std::size_t RequestEngine::Impl::responseTimeWindow;
+constexpr std::size_t RequestEngine::Impl::minResponseTimes;
+constexpr double RequestEngine::Impl::maxHedgeTokens;
+
+RequestEngine::RequestEngine(Options options):impl(new Impl(std::move(options))){}
+
+RequestEngine::~RequestEngine(){
+	stop();
+}
+
+RequestEngine::RequestID RequestEngine::submit(HTTPRequest request, Callback callback){
+	return(impl->enqueue(std::move(request),std::move(callback)));
+}
+
+std::future<HTTPResponse> RequestEngine::submit(HTTPRequest request){
+	std::shared_ptr<std::promise<HTTPResponse>> promise=std::make_shared<std::promise<HTTPResponse>>();
+	std::future<HTTPResponse> result=promise->get_future();
+	impl->enqueue(std::move(request),[promise](HTTPResponse response){
+		promise->set_value(std::move(response));
+	});
+	return(result);
+}
+
+HTTPResponse RequestEngine::perform(HTTPRequest request){
+	std::future<HTTPResponse> result=submit(std::move(request));
+	if(!impl->worker.joinable()){
+		while(result.wait_for(std::chrono::seconds(0))!=std::future_status::ready)
+			impl->step(std::chrono::milliseconds(1000));
+	}
+	return(result.get());
+}
+
+bool RequestEngine::cancel(RequestID id){
+	{
+		std::lock_guard<std::mutex> guard(impl->lock);
+		if(!impl->live.count(id))
+			return(false);
+		impl->cancellations.push_back(id);
+	}
+	curl_multi_wakeup(impl->multi.get());
+	return(true);
+}
+
+void RequestEngine::run(){
+	if(impl->worker.joinable()){
+		std::unique_lock<std::mutex> guard(impl->doneLock);
+		impl->doneCond.wait(guard,[this]{ return(impl->outstanding==0); });
+		return;
+	}
+	while(impl->outstanding)
+		impl->step(std::chrono::milliseconds(1000));
+}
+
+std::size_t RequestEngine::poll(std::chrono::milliseconds maxWait){
+	auto end=std::chrono::steady_clock::now()+maxWait;
+	if(impl->worker.joinable()){
+		std::unique_lock<std::mutex> guard(impl->doneLock);
+		std::size_t before=impl->completed;
+		impl->doneCond.wait_until(guard,end,[&]{ return(impl->completed!=before || !impl->outstanding); });
+		return(impl->completed-before);
+	}
+	std::size_t finished=0;
+	while(impl->outstanding && !finished){
+		auto now=std::chrono::steady_clock::now();
+		if(now>=end)
+			break;
+		finished+=impl->step(std::chrono::duration_cast<std::chrono::milliseconds>(end-now));
+	}
+	return(finished);
+}
+
+void RequestEngine::start(){
+	if(impl->worker.joinable())
+		return;
+	impl->stopping=false;
+	impl->worker=std::thread(&Impl::work,impl.get());
+}
+
+void RequestEngine::stop(){
+	if(!impl->worker.joinable())
+		return;
+	impl->stopping=true;
+	curl_multi_wakeup(impl->multi.get());
+	impl->worker.join();
+}
+
+bool RequestEngine::started() const{
+	return(impl->worker.joinable());
+}
+
+std::size_t RequestEngine::outstanding() const{
+	return(impl->outstanding);
+}
+
+const RequestEngine::Options& RequestEngine::options() const{
+	return(impl->opts);
+}
+
+} //namespace s3tools
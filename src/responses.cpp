@@ -0,0 +1,538 @@
+#include <s3tools/responses.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <regex>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+namespace s3tools{
+
+namespace{
+
+std::unique_ptr<xmlDoc,void(*)(xmlDoc*)> readXML(const std::string& raw){
+	return(std::unique_ptr<xmlDoc,void(*)(xmlDoc*)>(
+	  xmlReadMemory(raw.data(),raw.size(),NULL,NULL,XML_PARSE_RECOVER|XML_PARSE_NONET),&xmlFreeDoc));
+}
+
+xmlNode* firstChild(xmlNode* node, const char* name){
+	for(xmlNode* child=node->children; child!=NULL; child=child->next){
+		if(child->type==XML_ELEMENT_NODE && xmlStrcmp(child->name,(const xmlChar*)name)==0)
+			return(child);
+	}
+	return(NULL);
+}
+
+std::string& trim(std::string& s){
+	const static std::string whitespace=" \t\n\r";
+	s.erase(s.find_last_not_of(whitespace)+1);
+	return(s.erase(0,s.find_first_not_of(whitespace)));
+}
+
+std::string contents(xmlNode* node){
+	if(!node)
+		return("");
+	std::unique_ptr<xmlChar,void(*)(void*)> content(xmlNodeGetContent(node),xmlFree);
+	if(!content)
+		return("");
+	std::string s((const char*)content.get());
+	return(trim(s));
+}
+
+///\pre root is an Error element
+S3Error makeError(long status, xmlNode* root){
+	std::string code=contents(firstChild(root,"Code"));
+	std::string message=contents(firstChild(root,"Message"));
+	return(S3Error(status,code.empty()?"<None>":code,message.empty()?"<None>":message));
+}
+
+} //anonymous namespace
+
+S3Error::S3Error(long status, std::string code, std::string message):
+std::runtime_error("Query returned error:\n Code: "+code+"\n Message: "+message),
+status_(status),code_(std::move(code)),message_(std::move(message)){}
+
+URL listObjectsURL(const std::string& target, const std::string& delimiter){
+	URL url(target);
+	url.query["list-type"]="2";
+	if(!delimiter.empty())
+		url.query["delimiter"]=delimiter;
+	//pick apart the path into bucket name and prefix parts
+	static const std::regex path_regex(R"((/[^/]*)(/(.*))?)",std::regex::extended);
+	std::smatch matches;
+	if(!std::regex_match(url.path,matches,path_regex) || matches.size()!=4)
+		throw std::runtime_error("Unable to determine bucket name from "+target);
+	url.query["prefix"]=matches[3].str();
+	url.path=matches[1].str();
+	return(url);
+}
+
+//The parser is driven by libxml2's SAX interface, and keeps track of only the
+//element currently being read, so no tree is built for the document. Text is
+//collected into the field to which the innermost open element corresponds, if
+//any; everything else is skipped.
+struct ListParser::Impl{
+	enum Root{Unknown,Listing,Failure,Other};
+
+	ObjectCallback onObject;
+	PrefixCallback onPrefix;
+	TokenCallback onToken;
+	std::unique_ptr<xmlParserCtxt,void(*)(xmlParserCtxt*)> context;
+	///The depth of the element currently open, with the root at 1
+	unsigned int depth;
+	Root root;
+	std::string rootName;
+	bool inContents, inPrefixes;
+	///Where text is to be collected, if anywhere
+	std::string* target;
+	ObjectInfo object;
+	std::string size, prefix, truncated, token, code, message;
+	///An exception thrown by a callback, to be rethrown once control has
+	///returned from libxml2
+	std::exception_ptr failure;
+	bool finished;
+
+	Impl(ObjectCallback onObject, PrefixCallback onPrefix):
+	onObject(std::move(onObject)),onPrefix(std::move(onPrefix)),
+	context(nullptr,&xmlFreeParserCtxt),depth(0),root(Unknown),
+	inContents(false),inPrefixes(false),target(nullptr),finished(false){
+		static xmlSAXHandler handler=makeHandler();
+		context.reset(xmlCreatePushParserCtxt(&handler,this,nullptr,0,nullptr));
+		if(!context)
+			throw std::runtime_error("Failed to create XML parser");
+		xmlCtxtUseOptions(context.get(),XML_PARSE_NONET);
+	}
+
+	static xmlSAXHandler makeHandler(){
+		xmlSAXHandler handler;
+		std::memset(&handler,0,sizeof(handler));
+		handler.initialized=XML_SAX2_MAGIC;
+		handler.startElementNs=&startElement;
+		handler.endElementNs=&endElement;
+		handler.characters=&characters;
+		handler.cdataBlock=&characters;
+		//errors are reported through the result of xmlParseChunk instead
+		handler.serror=&ignoreError;
+		return(handler);
+	}
+
+	//libxml2 2.12 made the error passed to structured handlers const
+#if LIBXML_VERSION >= 21200
+	static void ignoreError(void*, const xmlError*){}
+#else
+	static void ignoreError(void*, xmlErrorPtr){}
+#endif
+
+	static bool is(const xmlChar* name, const char* expected){
+		return(xmlStrcmp(name,(const xmlChar*)expected)==0);
+	}
+
+	static void startElement(void* data, const xmlChar* name, const xmlChar*, const xmlChar*,
+	                         int, const xmlChar**, int, int, const xmlChar**){
+		Impl& impl=*static_cast<Impl*>(data);
+		impl.depth++;
+		impl.target=nullptr;
+		if(impl.depth==1){
+			impl.rootName=(const char*)name;
+			if(is(name,"ListBucketResult"))
+				impl.root=Listing;
+			else if(is(name,"Error"))
+				impl.root=Failure;
+			else
+				impl.root=Other;
+		}
+		else if(impl.depth==2 && impl.root==Listing){
+			if(is(name,"Contents")){
+				impl.inContents=true;
+				impl.object.key.clear();
+				impl.object.lastModified.clear();
+				impl.object.etag.clear();
+				impl.object.size=0;
+				impl.size.clear();
+			}
+			else if(is(name,"CommonPrefixes")){
+				impl.inPrefixes=true;
+				impl.prefix.clear();
+			}
+			else if(is(name,"IsTruncated"))
+				impl.target=&impl.truncated;
+			else if(is(name,"NextContinuationToken"))
+				impl.target=&impl.token;
+		}
+		else if(impl.depth==2 && impl.root==Failure){
+			if(is(name,"Code"))
+				impl.target=&impl.code;
+			else if(is(name,"Message"))
+				impl.target=&impl.message;
+		}
+		else if(impl.depth==3 && impl.inContents){
+			if(is(name,"Key"))
+				impl.target=&impl.object.key;
+			else if(is(name,"LastModified"))
+				impl.target=&impl.object.lastModified;
+			else if(is(name,"ETag"))
+				impl.target=&impl.object.etag;
+			else if(is(name,"Size"))
+				impl.target=&impl.size;
+		}
+		else if(impl.depth==3 && impl.inPrefixes && is(name,"Prefix"))
+			impl.target=&impl.prefix;
+	}
+
+	static void endElement(void* data, const xmlChar* name, const xmlChar*, const xmlChar*){
+		Impl& impl=*static_cast<Impl*>(data);
+		impl.target=nullptr;
+		if(impl.depth==2 && impl.root==Listing && is(name,"NextContinuationToken"))
+			impl.emitToken();
+		else if(impl.depth==2 && impl.inContents){
+			impl.inContents=false;
+			impl.emitObject();
+		}
+		else if(impl.depth==2 && impl.inPrefixes){
+			impl.inPrefixes=false;
+			impl.emitPrefix();
+		}
+		impl.depth--;
+	}
+
+	static void characters(void* data, const xmlChar* text, int length){
+		Impl& impl=*static_cast<Impl*>(data);
+		if(impl.target)
+			impl.target->append((const char*)text,length);
+	}
+
+	void emitObject(){
+		if(failure)
+			return;
+		try{
+			trim(object.lastModified);
+			trim(object.etag);
+			if(!trim(size).empty() && !parseUnsigned(size.data(),size.data()+size.size(),object.size))
+				throw std::runtime_error("Failed to parse object size '"+size+"' for "+object.key);
+			onObject(object);
+		}catch(...){
+			abort(std::current_exception());
+		}
+	}
+
+	void emitPrefix(){
+		if(failure)
+			return;
+		try{
+			onPrefix(prefix);
+		}catch(...){
+			abort(std::current_exception());
+		}
+	}
+
+	void emitToken(){
+		if(failure || !onToken)
+			return;
+		try{
+			onToken(trim(token));
+		}catch(...){
+			abort(std::current_exception());
+		}
+	}
+
+	///Stop parsing because of an exception, which will be rethrown by feed
+	void abort(std::exception_ptr ex){
+		failure=ex;
+		xmlStopParser(context.get());
+	}
+
+	void parse(const char* data, std::size_t size, bool last){
+		if(finished)
+			throw std::logic_error("ListParser has already finished");
+		//libxml2 takes the length as an int, so feed very large buffers in pieces
+		do{
+			int amount=(int)std::min<std::size_t>(size,1<<30);
+			int result=xmlParseChunk(context.get(),data,amount,last && (std::size_t)amount==size);
+			if(failure)
+				std::rethrow_exception(failure);
+			if(result!=XML_ERR_OK)
+				throw std::runtime_error("Got invalid XML data");
+			data+=amount;
+			size-=amount;
+		}while(size);
+		finished=last;
+	}
+};
+
+ListParser::ListParser(ObjectCallback onObject, PrefixCallback onPrefix):
+impl(new Impl(std::move(onObject),std::move(onPrefix))){}
+
+ListParser::~ListParser(){}
+
+void ListParser::feed(const char* data, std::size_t size){
+	if(size)
+		impl->parse(data,size,false);
+}
+
+void ListParser::finish(long status){
+	impl->parse(nullptr,0,true);
+	switch(impl->root){
+		case Impl::Listing: break;
+		case Impl::Failure:
+			throw S3Error(status,impl->code.empty()?"<None>":trim(impl->code),
+			              impl->message.empty()?"<None>":trim(impl->message));
+		case Impl::Unknown:
+			throw std::runtime_error("Got invalid XML data");
+		case Impl::Other:
+			throw std::runtime_error("Unexpected XML node type: "+impl->rootName);
+	}
+	trim(impl->truncated);
+	trim(impl->token);
+	if(truncated() && impl->token.empty())
+		throw std::runtime_error("Result contains <IsTruncated> but not <NextContinuationToken>");
+}
+
+bool ListParser::truncated() const{
+	return(impl->truncated=="true");
+}
+
+const std::string& ListParser::nextContinuationToken() const{
+	return(impl->token);
+}
+
+void ListParser::onContinuationToken(TokenCallback callback){
+	impl->onToken=std::move(callback);
+}
+
+std::function<bool(const char*,std::size_t)> ListParser::sink(){
+	return([this](const char* data, std::size_t size){
+		feed(data,size);
+		return(true);
+	});
+}
+
+ListPage parseListPage(const std::string& xml){
+	ListPage page;
+	ListParser parser([&](const ObjectInfo& object){ page.objects.push_back(object); },
+	                  [&](const std::string& prefix){ page.commonPrefixes.push_back(prefix); });
+	parser.feed(xml.data(),xml.size());
+	parser.finish();
+	page.truncated=parser.truncated();
+	page.nextContinuationToken=parser.nextContinuationToken();
+	return(page);
+}
+
+std::vector<DeleteError> parseDeleteResult(const std::string& xml){
+	auto tree=readXML(xml);
+	xmlNode* root=xmlDocGetRootElement(tree.get());
+	if(!root)
+		throw std::runtime_error("Unable to parse DeleteObjects response");
+	if(xmlStrcmp(root->name,(const xmlChar*)"Error")==0)
+		throw makeError(0,root);
+	if(xmlStrcmp(root->name,(const xmlChar*)"DeleteResult")!=0)
+		throw std::runtime_error("Unexpected DeleteObjects response: "+std::string((const char*)root->name));
+	std::vector<DeleteError> errors;
+	for(xmlNode* child=root->children; child!=NULL; child=child->next){
+		if(child->type==XML_ELEMENT_NODE && xmlStrcmp(child->name,(const xmlChar*)"Error")==0)
+			errors.push_back(DeleteError{contents(firstChild(child,"Key")),contents(firstChild(child,"Code")),
+			                             contents(firstChild(child,"Message"))});
+	}
+	return(errors);
+}
+
+std::string parseCopyResult(const std::string& xml){
+	auto tree=readXML(xml);
+	xmlNode* root=xmlDocGetRootElement(tree.get());
+	if(!root)
+		throw std::runtime_error("Unable to parse CopyObject response");
+	if(xmlStrcmp(root->name,(const xmlChar*)"Error")==0)
+		throw makeError(0,root);
+	if(xmlStrcmp(root->name,(const xmlChar*)"CopyObjectResult")!=0)
+		throw std::runtime_error("Unexpected CopyObject response: "+std::string((const char*)root->name));
+	return(contents(firstChild(root,"ETag")));
+}
+
+void checkResponse(const HTTPResponse& response){
+	if(!response.complete())
+		throw std::runtime_error("Request failed: "+response.error);
+	if(response.status>=200 && response.status<300)
+		return;
+	if(!response.body.empty()){
+		auto tree=readXML(response.body);
+		xmlNode* root=xmlDocGetRootElement(tree.get());
+		if(root && xmlStrcmp(root->name,(const xmlChar*)"Error")==0)
+			throw makeError(response.status,root);
+	}
+	throw S3Error(response.status,"HTTP"+std::to_string(response.status),"Request failed with HTTP status "+std::to_string(response.status));
+}
+
+ObjectInfo objectInfoFromHeaders(const std::string& key, const HTTPResponse& response){
+	ObjectInfo info;
+	info.key=key;
+	auto it=response.headers.find("content-length");
+	if(it!=response.headers.end() && !parseUnsigned(it->second.data(),it->second.data()+it->second.size(),info.size))
+		throw std::runtime_error("Failed to parse object size '"+it->second+"' for "+key);
+	it=response.headers.find("last-modified");
+	if(it!=response.headers.end())
+		info.lastModified=it->second;
+	it=response.headers.find("etag");
+	if(it!=response.headers.end())
+		info.etag=it->second;
+	return(info);
+}
+
+bool parseUnsigned(const char* begin, const char* end, std::uint64_t& result){
+	if(begin==end)
+		return(false);
+	std::uint64_t value=0;
+	for(; begin!=end; begin++){
+		unsigned int digit=(unsigned char)*begin-'0';
+		if(digit>9)
+			return(false);
+		if(value>(UINT64_MAX-digit)/10)
+			return(false);
+		value=value*10+digit;
+	}
+	result=value;
+	return(true);
+}
+
+namespace{
+
+///Read a fixed number of digits
+bool digits(const char*& pos, unsigned int count, unsigned int& result){
+	result=0;
+	for(unsigned int i=0; i<count; i++, pos++){
+		unsigned int digit=(unsigned char)*pos-'0';
+		if(digit>9)
+			return(false);
+		result=result*10+digit;
+	}
+	return(true);
+}
+
+///The number of days from 1970-01-01 to a date in the proleptic Gregorian
+///calendar, following http://howardhinnant.github.io/date_algorithms.html
+std::int64_t daysFromCivil(std::int64_t year, unsigned int month, unsigned int day){
+	year-=(month<=2);
+	const std::int64_t era=(year>=0 ? year : year-399)/400;
+	const unsigned int yearOfEra=(unsigned int)(year-era*400);
+	const unsigned int dayOfYear=(153*(month>2 ? month-3 : month+9)+2)/5+day-1;
+	const unsigned int dayOfEra=yearOfEra*365+yearOfEra/4-yearOfEra/100+dayOfYear;
+	return(era*146097+(std::int64_t)dayOfEra-719468);
+}
+
+///The inverse of daysFromCivil
+void civilFromDays(std::int64_t days, std::int64_t& year, unsigned int& month, unsigned int& day){
+	days+=719468;
+	const std::int64_t era=(days>=0 ? days : days-146096)/146097;
+	const unsigned int dayOfEra=(unsigned int)(days-era*146097);
+	const unsigned int yearOfEra=(dayOfEra-dayOfEra/1460+dayOfEra/36524-dayOfEra/146096)/365;
+	const unsigned int dayOfYear=dayOfEra-(365*yearOfEra+yearOfEra/4-yearOfEra/100);
+	const unsigned int monthIndex=(5*dayOfYear+2)/153;
+	day=dayOfYear-(153*monthIndex+2)/5+1;
+	month=(monthIndex<10 ? monthIndex+3 : monthIndex-9);
+	year=(std::int64_t)yearOfEra+era*400+(month<=2);
+}
+
+} //anonymous namespace
+
+bool parseTimestamp(const char* begin, const char* end, std::chrono::system_clock::time_point& result){
+	//the shortest form is YYYY-MM-DDThh:mm:ssZ
+	if(end-begin<20)
+		return(false);
+	const char* pos=begin;
+	unsigned int year, month, day, hour, minute, second;
+	if(!digits(pos,4,year) || *pos++!='-' || !digits(pos,2,month) || *pos++!='-' || !digits(pos,2,day)
+	   || *pos++!='T' || !digits(pos,2,hour) || *pos++!=':' || !digits(pos,2,minute) || *pos++!=':'
+	   || !digits(pos,2,second))
+		return(false);
+	static const unsigned char monthDays[12]={31,29,31,30,31,30,31,31,30,31,30,31};
+	if(month<1 || month>12 || day<1 || day>monthDays[month-1] || hour>23 || minute>59 || second>60)
+		return(false);
+	if(month==2 && day==29 && (year%4!=0 || (year%100==0 && year%400!=0)))
+		return(false);
+	std::chrono::nanoseconds fraction(0);
+	if(*pos=='.'){
+		pos++;
+		std::int64_t scale=1000000000;
+		if(pos==end || *pos<'0' || *pos>'9')
+			return(false);
+		for(; pos!=end && *pos>='0' && *pos<='9'; pos++){
+			scale/=10;
+			fraction+=std::chrono::nanoseconds((*pos-'0')*scale);
+		}
+	}
+	if(pos==end || *pos++!='Z' || pos!=end)
+		return(false);
+	std::chrono::seconds sinceEpoch(((daysFromCivil(year,month,day)*24+hour)*60+minute)*60+second);
+	result=std::chrono::system_clock::time_point(
+	  std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceEpoch+fraction));
+	return(true);
+}
+
+std::chrono::system_clock::time_point parseTimestamp(const std::string& text){
+	std::chrono::system_clock::time_point result;
+	if(!parseTimestamp(text.data(),text.data()+text.size(),result))
+		throw std::runtime_error("Failed to parse timestamp '"+text+"'");
+	return(result);
+}
+
+bool parseETag(const std::string& etag, std::array<unsigned char,16>& digest, std::uint32_t& parts){
+	if(etag.size()<34 || etag.front()!='"' || etag.back()!='"')
+		return(false);
+	auto hexValue=[](char c)->int{
+		if(c>='0' && c<='9')
+			return(c-'0');
+		if(c>='a' && c<='f')
+			return(c-'a'+10);
+		return(-1);
+	};
+	for(std::size_t i=0; i<16; i++){
+		int high=hexValue(etag[1+2*i]), low=hexValue(etag[2+2*i]);
+		if(high<0 || low<0)
+			return(false);
+		digest[i]=(unsigned char)(high<<4 | low);
+	}
+	parts=0;
+	if(etag.size()==34)
+		return(true);
+	//the count must be written as it would be formatted
+	std::uint64_t count;
+	if(etag[33]!='-' || etag[34]=='0' || !parseUnsigned(etag.data()+34,etag.data()+etag.size()-1,count)
+	   || count>std::numeric_limits<std::uint32_t>::max())
+		return(false);
+	parts=(std::uint32_t)count;
+	return(true);
+}
+
+std::string formatETag(const std::array<unsigned char,16>& digest, std::uint32_t parts){
+	static const char hexDigits[]="0123456789abcdef";
+	std::string result(34,'"');
+	for(std::size_t i=0; i<16; i++){
+		result[1+2*i]=hexDigits[digest[i]>>4];
+		result[2+2*i]=hexDigits[digest[i]&0xF];
+	}
+	if(parts)
+		result.insert(33,"-"+std::to_string(parts));
+	return(result);
+}
+
+std::string formatTimestamp(std::chrono::system_clock::time_point time){
+	std::int64_t ms=std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+	std::int64_t days=(ms>=0 ? ms : ms-86399999)/86400000;
+	std::int64_t msOfDay=ms-days*86400000;
+	std::int64_t year;
+	unsigned int month, day;
+	civilFromDays(days,year,month,day);
+	//the fields are all in range, but the buffer has room for any values of
+	//their types, so that the output can never be cut short
+	char buffer[96];
+	snprintf(buffer,sizeof(buffer),"%04lld-%02u-%02uT%02u:%02u:%02u.%03uZ",(long long)year,month,day,
+	         (unsigned int)(msOfDay/3600000),(unsigned int)(msOfDay/60000%60),
+	         (unsigned int)(msOfDay/1000%60),(unsigned int)(msOfDay%1000));
+	return(buffer);
+}
+
+} //namespace s3tools
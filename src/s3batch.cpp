@@ -0,0 +1,352 @@
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <s3tools/client.h>
+#include <s3tools/url.h>
+#include <s3tools/signing.h>
+#include <s3tools/cred_manage.h>
+
+#include "copy_utils.h"
+#include "curl_utils.h"
+#include "external/cl_options.h"
+
+///One line of input, and the result of carrying it out
+struct Operation{
+	///The line's number in the input, counting from 1
+	std::size_t line;
+	std::string text;
+	bool finished;
+	bool failed;
+	///The result, following the line number and status
+	std::string result;
+	///Further lines of output, such as listing entries, which have not yet
+	///been printed
+	std::vector<std::string> details;
+};
+
+///The largest number of lines of output an operation may hold while waiting
+///for them to be printed
+const std::size_t maxHeldDetails=1024;
+
+///Replace line breaks in a message so that it fits on one line of output
+std::string oneLine(std::string message){
+	for(char& c : message){
+		if(c=='\n' || c=='\r' || c=='\t')
+			c=' ';
+	}
+	return(message);
+}
+
+///Carry out one operation, filling in its result
+///\param emit the function to be given each further line of output
+///\throws S3Error or std::runtime_error if the operation fails
+void execute(s3tools::Client& client, Operation& op, const std::function<void(std::string)>& emit){
+	std::istringstream fields(op.text);
+	std::string command;
+	std::vector<std::string> args;
+	fields >> command;
+	for(std::string arg; fields >> arg;)
+		args.push_back(arg);
+	auto expect=[&](std::size_t min, std::size_t max, const char* usage){
+		if(args.size()<min || args.size()>max)
+			throw std::runtime_error(std::string("usage: ")+usage);
+	};
+
+	if(command=="cp"){
+		expect(2,2,"cp source destination");
+		copyObject(client,args[0],args[1]);
+	}
+	else if(command=="rm"){
+		expect(1,1,"rm url");
+		client.remove(args[0]);
+	}
+	else if(command=="sign"){
+		expect(1,3,"sign url [verb [validity]]");
+		std::string verb=(args.size()>1 ? args[1] : "GET");
+		unsigned long validity=24UL*60*60; //seconds
+		if(args.size()>2){
+			try{
+				validity=std::stoul(args[2]);
+			}catch(std::exception&){
+				throw std::runtime_error("Invalid validity duration: "+args[2]);
+			}
+		}
+		const s3tools::credential& cred=client.credentialFor(args[0]);
+		op.result=s3tools::genURL(cred.username,cred.key,verb,args[0],validity).str();
+	}
+	else if(command=="head"){
+		expect(1,1,"head url");
+		s3tools::ObjectInfo info=client.head(args[0]);
+		op.result=std::to_string(info.size)+'\t'+info.etag+'\t'+info.lastModified;
+	}
+	else if(command=="ls"){
+		bool recursive=(!args.empty() && args[0]=="-r");
+		if(recursive)
+			args.erase(args.begin());
+		expect(1,1,"ls [-r] url");
+		std::size_t entries=0;
+		for(const s3tools::ListEntry& entry : client.list(args[0],recursive,4)){
+			if(entry.isPrefix)
+				emit(entry.object.key);
+			else
+				emit(entry.object.key+'\t'+std::to_string(entry.object.size));
+			entries++;
+		}
+		op.result=std::to_string(entries);
+	}
+	else
+		throw std::runtime_error("Unknown operation: "+command);
+}
+
+///Hands lines of input to worker threads, and collects the results so that
+///they can be printed in input order. Only a limited number of operations,
+///and of lines of output from each, are held at once, so arbitrarily long
+///input, and arbitrarily long listings, can be streamed through.
+class Batch{
+public:
+	Batch(s3tools::Client& client, std::size_t workers):
+	client(client),window(workers*64),inputDone(false){
+		for(std::size_t i=0; i<workers; i++)
+			threads.emplace_back(&Batch::work,this);
+	}
+
+	~Batch(){
+		finishInput();
+		for(auto& thread : threads)
+			thread.join();
+	}
+
+	///Add an operation, waiting if too many are unfinished or unprinted
+	void add(std::size_t line, std::string text){
+		std::unique_lock<std::mutex> guard(lock);
+		spaceCond.wait(guard,[this]{ return(operations.size()<window); });
+		operations.emplace_back(new Operation{line,std::move(text),false,false,"",{}});
+		queue.push_back(operations.back().get());
+		workCond.notify_one();
+	}
+
+	///Note that there are no more operations
+	void finishInput(){
+		std::lock_guard<std::mutex> guard(lock);
+		inputDone=true;
+		workCond.notify_all();
+		doneCond.notify_all();
+	}
+
+	///Get the output of the earliest operation in input order, waiting for
+	///there to be some.
+	///\param line where the operation's line number is to be stored
+	///\param details where any further lines of output from the operation
+	///               are to be stored
+	///\param done where the operation is to be stored if it has finished,
+	///            after which its output is complete
+	///\return false if all operations have been taken
+	bool next(std::size_t& line, std::vector<std::string>& details, std::unique_ptr<Operation>& done){
+		std::unique_lock<std::mutex> guard(lock);
+		doneCond.wait(guard,[this]{
+			return(operations.empty() ? inputDone :
+			       operations.front()->finished || !operations.front()->details.empty());
+		});
+		if(operations.empty())
+			return(false);
+		Operation& front=*operations.front();
+		line=front.line;
+		details.clear();
+		details.swap(front.details);
+		if(front.finished){
+			done=std::move(operations.front());
+			operations.pop_front();
+		}
+		//both a new operation and output held by the next may now fit
+		spaceCond.notify_all();
+		return(true);
+	}
+
+private:
+	s3tools::Client& client;
+	const std::size_t window;
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable workCond, doneCond, spaceCond;
+	///All operations which have not been printed, in input order
+	std::deque<std::unique_ptr<Operation>> operations;
+	///Operations which have not been started
+	std::deque<Operation*> queue;
+	bool inputDone;
+
+	///Add a line of output from an operation, waiting if it already holds
+	///too many, until they have been printed. The earliest operation's output
+	///is taken by next() whenever it holds any, and, as operations are started
+	///in order, it is always running or finished, so it cannot be stuck behind
+	///a later one.
+	void emit(Operation& op, std::string line){
+		std::unique_lock<std::mutex> guard(lock);
+		spaceCond.wait(guard,[&]{ return(op.details.size()<maxHeldDetails); });
+		op.details.push_back(std::move(line));
+		doneCond.notify_all();
+	}
+
+	void work(){
+		std::unique_lock<std::mutex> guard(lock);
+		while(true){
+			workCond.wait(guard,[this]{ return(!queue.empty() || inputDone); });
+			if(queue.empty())
+				return;
+			Operation* op=queue.front();
+			queue.pop_front();
+			guard.unlock();
+			try{
+				execute(client,*op,[this,op](std::string line){ emit(*op,std::move(line)); });
+			}catch(s3tools::S3Error& err){
+				op->failed=true;
+				op->result=oneLine(err.code()+": "+err.message());
+			}catch(std::exception& ex){
+				op->failed=true;
+				op->result=oneLine(ex.what());
+			}
+			guard.lock();
+			op->finished=true;
+			doneCond.notify_all();
+		}
+	}
+};
+
+int main(int argc, char* argv[]){
+	std::string usage=
+R"(NAME
+ s3batch - carry out many operations on S3 servers from one process
+
+USAGE
+ s3batch [-j workers] [--http2] [--trace-file path] [file]
+    Read operations, one per line, from the given file, or from standard input
+    if no file is given or the file is '-', and carry them out concurrently.
+
+OPERATIONS
+ cp source destination
+    Copy an object within a server, download an object to a file, or upload
+    a file as an object, as s3cp does.
+ rm url
+    Delete an object.
+ sign url [verb [validity]]
+    Create a presigned URL, as s3sign does. The verb defaults to GET and the
+    validity to one day.
+ head url
+    Fetch an object's size, ETag and modification time.
+ ls [-r] url
+    List a bucket, or the part of a bucket under a prefix, grouping keys at
+    '/' unless -r is given.
+
+ Fields are separated by whitespace. Blank lines, and lines beginning with '#',
+ are ignored.
+
+OUTPUT
+ For each operation, a line is printed with the operation's line number, 'ok'
+ or 'error', and its result or error message, separated by tabs. The lines are
+ printed in input order, each as soon as its operation and all those before it
+ have finished. Presigned URLs, and sizes, ETags and modification times, are
+ the results of sign and head; the result of ls is the number of entries.
+ The entries are printed before that, as they are listed, each on a line of
+ its own with the operation's line number, an empty status, the key or
+ prefix, and for keys the size.
+
+NOTES
+ All operations share one set of connections, credentials are read once, and
+ the exit status is non-zero if any operation fails, so s3batch can replace a
+ script which runs a tool for each of many objects.
+
+ Operations are started in input order, but several run at once, so one
+ which depends on the result of an earlier one (such as copying an object
+ which an earlier line uploads) is only safe with -j 1.
+
+OPTIONS)";
+
+	unsigned long workers=8;
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
+	OptionParser op;
+	op.setBaseUsage(usage);
+	op.addOption({"j","jobs"},workers,
+				 "Carry out up to this many operations at once (default 8).","workers");
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
+	op.allowsOptionTerminator(true);
+	auto arguments=op.parseArgs(argc,argv);
+
+	if(op.didPrintUsage())
+		return(0);
+	if(arguments.size()>2){
+		std::cout << op.getUsage() << std::endl;
+		return(1);
+	}
+	if(workers==0)
+		workers=1;
+
+	std::ifstream file;
+	std::istream* input=&std::cin;
+	if(arguments.size()==2 && arguments[1]!="-"){
+		file.open(arguments[1]);
+		if(!file){
+			std::cerr << "Error: Unable to open " << arguments[1] << " for reading" << std::endl;
+			return(1);
+		}
+		input=&file;
+	}
+
+	std::unique_ptr<CurlSession> session;
+	try{
+		session.reset(new CurlSession(s3tools::fetchStoredCredentials(),engineOptions,tracePath));
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return(1);
+	}
+	//the workers all wait on the engine, so it must drive itself
+	session->engine().start();
+
+	bool success=true;
+	{
+		Batch batch(session->client(),workers);
+		//input is read while results are printed, so that neither waits for
+		//the other
+		std::thread reader([&]{
+			std::string text;
+			std::size_t line=0;
+			while(std::getline(*input,text)){
+				line++;
+				std::size_t start=text.find_first_not_of(" \t\r");
+				if(start==std::string::npos || text[start]=='#')
+					continue;
+				batch.add(line,text);
+			}
+			batch.finishInput();
+		});
+		std::size_t line;
+		std::vector<std::string> details;
+		std::unique_ptr<Operation> done;
+		while(batch.next(line,details,done)){
+			for(const auto& detail : details)
+				std::cout << line << "\t\t" << detail << '\n';
+			if(done){
+				success&=!done->failed;
+				std::cout << line << '\t' << (done->failed ? "error" : "ok");
+				if(!done->result.empty())
+					std::cout << '\t' << done->result;
+				std::cout << '\n';
+				done.reset();
+			}
+			std::cout.flush();
+		}
+		reader.join();
+	}
+	return(success ? 0 : 1);
+}
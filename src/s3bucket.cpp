@@ -1,13 +1,23 @@
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <curl/curl.h>
 
 #include <s3tools/cred_manage.h>
+#include <s3tools/deletion.h>
+#include <s3tools/listing.h>
+#include <s3tools/responses.h>
 #include <s3tools/signing.h>
 #include <s3tools/url.h>
 
 #include "curl_utils.h"
+#include "output_utils.h"
 #include "xml_utils.h"
 #include "external/cl_options.h"
 
@@ -15,23 +25,32 @@
 struct optionsType{
 	bool verbose;
 	bool readableSizes;
+	OutputFormat format;
+	///Whether to remove a bucket's contents before deleting it
+	bool force;
+	///The number of listing requests, and of deletion requests, to make at
+	///once when removing a bucket's contents
+	unsigned long jobs;
+	///Whether to report progress while removing a bucket's contents
+	bool progress;
+	///Whether to list each bucket's location, versioning status, and contents
+	bool details;
 };
+
+typedef std::function<void(const std::string& name, const std::string& created)> BucketCallback;
 		
+///\param onBucket the function to be called with the name and creation date
+///                of each bucket
 ///\return the continuation token, if any
-std::string parseListAllBucketsResult(xmlNode* node, const optionsType& options){
+std::string parseListAllBucketsResult(xmlNode* node, const BucketCallback& onBucket){
 	xmlNode* buckets=firstChild(node,"Buckets");
 	if(!buckets)
 		return("");
 	for(xmlNode* bucket=firstChild(buckets,"Bucket"); bucket; bucket=nextSibling(bucket,"Bucket")){
 		xmlNode* name=firstChild(bucket,"Name");
-		if(name)
-			std::cout << getNodeContents<std::string>(name);
-		if(options.verbose){
-			xmlNode* ctime=firstChild(bucket,"CreationDate");
-			if(ctime)
-				std::cout << "\t " << getNodeContents<std::string>(ctime);
-		}
-		std::cout << std::endl;
+		xmlNode* ctime=firstChild(bucket,"CreationDate");
+		onBucket(name ? getNodeContents<std::string>(name) : "",
+		         ctime ? getNodeContents<std::string>(ctime) : "");
 	}
 	xmlNode* truncated=firstChild(node,"IsTruncated");
 	if(truncated && getNodeContents<std::string>(truncated)=="true"){
@@ -43,58 +62,203 @@ std::string parseListAllBucketsResult(xmlNode* node, const optionsType& options)
 	return("");
 }
 
-bool listBuckets(const std::string rawURL, optionsType options){
-	auto credentials=s3tools::fetchStoredCredentials();
+///Interpret the response to a request for a bucket's location subresource
+///\throws std::runtime_error if the request failed
+std::string parseLocation(const HTTPResponse& response){
+	if(!response.complete())
+		throw std::runtime_error(response.error);
+	std::string location;
+	//TODO: "When the bucket's region is US East (N. Virginia), Amazon S3 returns 
+	//an empty string for the bucket's region"
+	handleXMLRepsonse(response.body,
+	  {{"LocationConstraint",[&](xmlNode* node){location=getNodeContents<std::string>(node);}}});
+	return(location);
+}
+
+///Interpret the response to a request for a bucket's versioning subresource
+///\throws std::runtime_error if the request failed
+std::string parseVersioning(const HTTPResponse& response){
+	if(!response.complete())
+		throw std::runtime_error(response.error);
+	std::string versioning;
+	handleXMLRepsonse(response.body,
+	  {{"VersioningConfiguration",[&](xmlNode* node){
+		versioning=getNodeContents<std::string>(node);
+		if(versioning.empty())
+			versioning="Not enabled";
+	  }}},
+	  {{"NotImplemented",[&](std::string){versioning="Not supported";}}});
+	return(versioning);
+}
+
+///Everything shown about a bucket by list --details
+struct BucketDetails{
+	std::string name;
+	std::string created;
+	std::string location;
+	std::string versioning;
+	std::uint64_t objects;
+	std::uint64_t size;
+	///The first problem met while gathering the details, if any
+	std::string error;
+
+	BucketDetails(std::string name, std::string created):
+	name(std::move(name)),created(std::move(created)),objects(0),size(0){}
+};
+
+///Fetch the location, versioning status, object count, and total size of
+///every bucket. The requests for all of the buckets are submitted together,
+///so that the engine spreads them over its pooled connections; only the pages
+///of each bucket's listing must be fetched one after another, since each needs
+///the token from the page before it.
+void gatherDetails(std::vector<BucketDetails>& buckets, const s3tools::URL& serverURL,
+                   const s3tools::credential& cred, s3tools::RequestEngine& engine){
+	//run a step of handling a response, recording anything it throws
+	auto record=[](BucketDetails& bucket, const std::function<void()>& step){
+		try{
+			step();
+		}catch(s3tools::S3Error& err){
+			if(bucket.error.empty())
+				bucket.error=err.code()+": "+err.message();
+		}catch(std::exception& ex){
+			if(bucket.error.empty())
+				bucket.error=ex.what();
+		}
+	};
+	auto sign=[&](const s3tools::URL& url){
+		return(HTTPRequest(s3tools::genURL(cred.username,cred.key,"GET",url,60)));
+	};
+	//Objects are counted by the listing parser as they arrive, so no page
+	//is held in memory.
+	std::function<void(BucketDetails&,const std::string&)> listPage=
+	  [&](BucketDetails& bucket, const std::string& token){
+		s3tools::URL url=serverURL;
+		url.path="/"+bucket.name;
+		url=s3tools::listObjectsURL(url.str(),"");
+		if(!token.empty())
+			url.query["continuation-token"]=token;
+		auto parser=std::make_shared<s3tools::ListParser>(
+		  [&bucket](const s3tools::ObjectInfo& object){
+			bucket.objects++;
+			bucket.size+=object.size;
+		  },[](const std::string&){});
+		HTTPRequest request=sign(url);
+		request.sink=parser->sink();
+		engine.submit(std::move(request),[&,parser](HTTPResponse response){
+			record(bucket,[&]{
+				if(!response.complete())
+					throw std::runtime_error(response.error);
+				parser->finish(response.status);
+				if(parser->truncated())
+					listPage(bucket,parser->nextContinuationToken());
+			});
+		});
+	};
+	for(BucketDetails& bucket : buckets){
+		s3tools::URL url=serverURL;
+		url.path="/"+bucket.name;
+		url.query.clear();
+		url.query["location"]="";
+		engine.submit(sign(url),[&](HTTPResponse response){
+			record(bucket,[&]{ bucket.location=parseLocation(response); });
+		});
+		url.query.clear();
+		url.query["versioning"]="";
+		engine.submit(sign(url),[&](HTTPResponse response){
+			record(bucket,[&]{ bucket.versioning=parseVersioning(response); });
+		});
+		listPage(bucket,"");
+	}
+	engine.run();
+}
+
+///Print an entry of a detailed listing of buckets. In TSV form, the fields are
+///the name, creation date, location, versioning status, number of objects,
+///and total size in bytes.
+void printBucketDetails(OutputBuffer& out, const BucketDetails& bucket, OutputFormat format){
+	switch(format){
+		case OutputFormat::Text:
+			out << bucket.name << "\t " << (bucket.location.empty() ? "-" : bucket.location)
+			    << "\t " << bucket.versioning << "\t ";
+			out.appendUnsigned(bucket.objects);
+			out << " objects\t ";
+			out.appendUnsigned(bucket.size);
+			out << " bytes";
+			break;
+		case OutputFormat::TSV:
+			for(const std::string* field : {&bucket.name,&bucket.created,&bucket.location,&bucket.versioning}){
+				out.appendTSV(*field);
+				out << '\t';
+			}
+			out.appendUnsigned(bucket.objects);
+			out << '\t';
+			out.appendUnsigned(bucket.size);
+			break;
+		case OutputFormat::JSON:
+			out << "{\"name\":";
+			out.appendJSON(bucket.name);
+			if(!bucket.created.empty()){
+				out << ",\"creation_date\":";
+				out.appendJSON(bucket.created);
+			}
+			out << ",\"location\":";
+			out.appendJSON(bucket.location);
+			out << ",\"versioning\":";
+			out.appendJSON(bucket.versioning);
+			out << ",\"objects\":";
+			out.appendUnsigned(bucket.objects);
+			out << ",\"size\":";
+			out.appendUnsigned(bucket.size);
+			out << '}';
+			break;
+	}
+	out << '\n';
+}
+
+bool listBuckets(const std::string rawURL, optionsType options,
+                 const s3tools::CredentialCollection& credentials, CurlSession& session){
 	auto cred=findCredentials(credentials,rawURL).second;
 	s3tools::URL basicURL(rawURL);
+	OutputBuffer out;
+	//without details, buckets are printed as each page arrives
+	std::vector<BucketDetails> buckets;
+	BucketCallback onBucket=[&](const std::string& name, const std::string& created){
+		if(options.details)
+			buckets.emplace_back(name,created);
+		else
+			printBucket(out,name,created,options.format,options.verbose);
+	};
 	
 	std::string continuation;
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-	if(err!=CURLE_OK){
-		std::cerr << "Failed to set curl error buffer" << std::endl;
-		return(false);
-	}
-#ifdef USE_CURLOPT_CAINFO
-	std::string caBundlePath=detectCABundlePath();
-#endif
 	do{
 		s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"GET",basicURL.str(),60);
-		std::string resultData;
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_URL, signedURL.str().c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl URL option",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_HTTPGET, 1);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl GET option",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, collectOutput);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEDATA, &resultData);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback data",err,errBuf.get());
-#ifdef USE_CURLOPT_CAINFO
-		if(!caBundlePath.empty()){
-			err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-			if(err!=CURLE_OK)
-				reportCurlError("Failed to set curl CA bundle path",err,errBuf.get());
-		}
-#endif
-		err=curl_easy_perform(curlSession.get());
-		if(err!=CURLE_OK)
-			reportCurlError("curl perform GET failed",err,errBuf.get());
+		HTTPResponse response=session.perform(HTTPRequest(signedURL));
 		
-		handleXMLRepsonse(resultData,
+		handleXMLRepsonse(response.body,
 		         {
-					 {"ListAllMyBucketsResult",[&](xmlNode* node){continuation=parseListAllBucketsResult(node,options);}}
+					 {"ListAllMyBucketsResult",[&](xmlNode* node){continuation=parseListAllBucketsResult(node,onBucket);}}
 				 });
+		//errors in the next page are reported directly to the stream
+		out.flush();
 		if(!continuation.empty())
 			basicURL.query["continuation-token"]=continuation;
 	}while(!continuation.empty());
-	return(true);
+	if(!options.details)
+		return(true);
+	
+	basicURL.query.clear();
+	gatherDetails(buckets,basicURL,cred,session.engine());
+	bool success=true;
+	for(const BucketDetails& bucket : buckets){
+		if(bucket.error.empty()){
+			printBucketDetails(out,bucket,options.format);
+			continue;
+		}
+		out.flush();
+		std::cerr << "Error: " << bucket.name << ": " << bucket.error << std::endl;
+		success=false;
+	}
+	return(success);
 }
 	
 ///Compare a potential bucket name to the rules for allowed names:
@@ -128,7 +292,8 @@ bool validateBucketName(const std::string& bucket){
 	return(true);
 }
 		
-bool addBucket(std::string rawURL, const std::string bucket){
+bool addBucket(std::string rawURL, const std::string bucket,
+               const s3tools::CredentialCollection& credentials, CurlSession& session){
 	if(!validateBucketName(bucket)){
 		std::cerr << "Invalid bucket name: " << bucket << std::endl;
 		std::cerr << " See https://docs.aws.amazon.com/AmazonS3/latest/dev/BucketRestrictions.html\n";
@@ -140,160 +305,151 @@ bool addBucket(std::string rawURL, const std::string bucket){
 //	xmlDocSetRootElement(tree.get(),root.release());
 	s3tools::URL url(rawURL);
 	url.path="/"+bucket;
-	auto credentials=s3tools::fetchStoredCredentials();
 	auto cred=findCredentials(credentials,rawURL).second;
 	s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"PUT",url.str(),60);
 	
-	std::string resultData;
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-	if(err!=CURLE_OK)
-		std::cerr << "Failed to set curl error buffer" << std::endl;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_URL, signedURL.str().c_str());
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl URL option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_UPLOAD, 1);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl PUT/upload option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_INFILESIZE_LARGE, (curl_off_t)0);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl input data size",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, collectOutput);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEDATA, &resultData);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback data",err,errBuf.get());
-#ifdef USE_CURLOPT_CAINFO
-	std::string caBundlePath=detectCABundlePath();
-	if(!caBundlePath.empty()){
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl CA bundle path",err,errBuf.get());
-	}
-#endif
-	err=curl_easy_perform(curlSession.get());
-	if(err!=CURLE_OK)
-		reportCurlError("curl perform PUT failed",err,errBuf.get());
+	HTTPResponse response=session.perform(HTTPRequest(signedURL));
 	
-	if(!resultData.empty())
-		handleXMLRepsonse(resultData,{});
+	if(!response.body.empty())
+		handleXMLRepsonse(response.body,{});
 	return(true);
 }
 		
-bool deleteBucket(std::string rawURL, const std::string bucket){
+///Abort every multipart upload in progress in a bucket, since their parts
+///also keep it from being deleted
+///\return the number of uploads aborted
+std::size_t abortUploads(const s3tools::URL& bucketURL, const s3tools::credential& cred, CurlSession& session){
+	s3tools::URL listURL=bucketURL;
+	listURL.query["uploads"]="";
+	std::size_t aborted=0;
+	bool truncated;
+	do{
+		HTTPResponse response=session.perform(HTTPRequest(s3tools::genURL(cred.username,cred.key,"GET",listURL,60)));
+		s3tools::checkResponse(response);
+		//the uploads on each page are aborted together
+		std::vector<std::future<HTTPResponse>> aborts;
+		truncated=false;
+		handleXMLRepsonse(response.body,
+		  {{"ListMultipartUploadsResult",[&](xmlNode* node){
+			for(xmlNode* upload=firstChild(node,"Upload"); upload; upload=nextSibling(upload,"Upload")){
+				s3tools::URL url=bucketURL;
+				url.path+="/"+getNodeContents<std::string>(firstChild(upload,"Key",true));
+				url.query["uploadId"]=getNodeContents<std::string>(firstChild(upload,"UploadId",true));
+				aborts.push_back(session.engine().submit(HTTPRequest(s3tools::genURL(cred.username,cred.key,"DELETE",url,60))));
+			}
+			xmlNode* isTruncated=firstChild(node,"IsTruncated");
+			if(isTruncated && getNodeContents<std::string>(isTruncated)=="true"){
+				truncated=true;
+				listURL.query["key-marker"]=getNodeContents<std::string>(firstChild(node,"NextKeyMarker",true));
+				listURL.query["upload-id-marker"]=getNodeContents<std::string>(firstChild(node,"NextUploadIdMarker",true));
+			}
+		  }}});
+		session.engine().run();
+		for(auto& abort : aborts){
+			try{
+				s3tools::checkResponse(abort.get());
+			}catch(s3tools::S3Error& err){
+				//an upload may have finished since it was listed
+				if(err.code()!="NoSuchUpload")
+					throw;
+			}
+			aborted++;
+		}
+	}while(truncated);
+	return(aborted);
+}
+
+///Report the progress of removing a bucket's contents
+void reportRemoval(std::size_t removed, std::chrono::steady_clock::time_point start, char end){
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	std::cerr << "\rRemoved " << removed << " objects, "
+	          << (std::size_t)(seconds>0 ? removed/seconds : 0) << " per second" << end << std::flush;
+}
+
+///Remove all objects from a bucket, and abort its multipart uploads, so that
+///it can be deleted. The bucket is listed in parallel ranges of keys, and the
+///objects are removed in batches as they are listed.
+///\return whether everything was removed
+bool purgeBucket(const s3tools::URL& bucketURL, const s3tools::credential& cred,
+                 const optionsType& options, CurlSession& session){
+	const std::string target=bucketURL.str();
+	bool success=true;
+	auto start=std::chrono::steady_clock::now();
+	auto lastReport=start;
+	s3tools::BatchDeleter deleter(session.engine(),cred,bucketURL,options.jobs,
+	  [&](const s3tools::DeleteError& error){
+		std::cerr << "Error: " << target << '/' << error.key << ": "
+		          << (error.code.empty() ? "" : error.code+": ") << error.message << std::endl;
+		success=false;
+	});
+	s3tools::ObjectLister lister(session.engine(),cred,target,options.jobs);
+	s3tools::ObjectInfo object;
+	while(lister.next(object)){
+		deleter.remove(object.key);
+		if(options.progress && std::chrono::steady_clock::now()-lastReport>=std::chrono::seconds(1)){
+			lastReport=std::chrono::steady_clock::now();
+			reportRemoval(deleter.deleted(),start,'\r');
+		}
+	}
+	deleter.finish();
+	if(options.progress)
+		reportRemoval(deleter.deleted(),start,'\n');
+	if(!success)
+		return(false);
+	std::size_t aborted=abortUploads(bucketURL,cred,session);
+	if(options.progress && aborted)
+		std::cerr << "Aborted " << aborted << " multipart uploads" << std::endl;
+	return(true);
+}
+
+bool deleteBucket(std::string rawURL, const std::string bucket, const optionsType& options,
+                  const s3tools::CredentialCollection& credentials, CurlSession& session){
 	s3tools::URL url(rawURL);
 	url.path="/"+bucket;
-	auto credentials=s3tools::fetchStoredCredentials();
 	auto cred=findCredentials(credentials,rawURL).second;
+	if(options.force){
+		try{
+			if(!purgeBucket(url,cred,options,session)){
+				std::cerr << "Error: Bucket " << bucket << " could not be emptied, so it has not been deleted.\n";
+				return(false);
+			}
+		}catch(s3tools::S3Error& err){
+			if(err.code()=="NoSuchBucket"){
+				std::cerr << "Error: Bucket " << bucket << " does not exist.\n";
+				return(false);
+			}
+			throw;
+		}
+	}
 	s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"DELETE",url.str(),60);
 	
-	std::string resultData;
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-	if(err!=CURLE_OK)
-		std::cerr << "Failed to set curl error buffer" << std::endl;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_URL, signedURL.str().c_str());
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl URL option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_CUSTOMREQUEST, "DELETE");
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl DELETE/CUSTOMREQUEST option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_INFILESIZE_LARGE, (curl_off_t)0);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl input data size",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, collectOutput);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEDATA, &resultData);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback data",err,errBuf.get());
-#ifdef USE_CURLOPT_CAINFO
-	std::string caBundlePath=detectCABundlePath();
-	if(!caBundlePath.empty()){
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl CA bundle path",err,errBuf.get());
-	}
-#endif
-	err=curl_easy_perform(curlSession.get());
-	if(err!=CURLE_OK)
-		reportCurlError("curl perform DELETE failed",err,errBuf.get());
+	HTTPResponse response=session.perform(HTTPRequest(signedURL));
 	
-	if(!resultData.empty())
-		handleXMLRepsonse(resultData,{},
+	if(!response.body.empty())
+		handleXMLRepsonse(response.body,{},
 				 {{"BucketNotEmpty",[&](std::string){std::cerr << "Error: Bucket " << bucket << " cannot be deleted because it is not empty.\n";}},
 				  {"NoSuchBucket",[&](std::string){std::cerr << "Error: Bucket " << bucket << " does not exist.\n";}}});
 	return(true);
 }
 
-bool bucketInfo(std::string rawURL, const std::string bucket){
+bool bucketInfo(std::string rawURL, const std::string bucket,
+                const s3tools::CredentialCollection& credentials, CurlSession& session){
 	s3tools::URL url(rawURL);
 	url.path="/"+bucket;
-	auto credentials=s3tools::fetchStoredCredentials();
 	auto cred=findCredentials(credentials,rawURL).second;
 	
-#ifdef USE_CURLOPT_CAINFO
-	std::string caBundlePath=detectCABundlePath();
-#endif
-	
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	
-	auto querySubresource=[&](s3tools::URL url, std::string subresource)->std::string{
+	auto querySubresource=[&](s3tools::URL url, std::string subresource){
 		url.query[subresource]="";
 		s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"GET",url.str(),60);
-		std::string resultData;
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-		if(err!=CURLE_OK)
-			std::cerr << "Failed to set curl error buffer" << std::endl;
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_URL, signedURL.str().c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl URL option",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_INFILESIZE_LARGE, (curl_off_t)0);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl input data size",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, collectOutput);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback",err,errBuf.get());
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEDATA, &resultData);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback data",err,errBuf.get());
-#ifdef USE_CURLOPT_CAINFO
-		if(!caBundlePath.empty()){
-			err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-			if(err!=CURLE_OK)
-				reportCurlError("Failed to set curl CA bundle path",err,errBuf.get());
-		}
-#endif
-		err=curl_easy_perform(curlSession.get());
-		if(err!=CURLE_OK)
-			reportCurlError("curl perform GET failed",err,errBuf.get());
-		
-		return(resultData);
+		return(session.engine().submit(HTTPRequest(signedURL)));
 	};
 	
-	std::string location;
-	//TODO: "When the bucket's region is US East (N. Virginia), Amazon S3 returns 
-	//an empty string for the bucket's region"
-	handleXMLRepsonse(querySubresource(url,"location"),
-	  {{"LocationConstraint",[&](xmlNode* node){location=getNodeContents<std::string>(node);}}});
-	std::string versioning;
-	handleXMLRepsonse(querySubresource(url,"versioning"),
-	  {{"VersioningConfiguration",[&](xmlNode* node){
-		versioning=getNodeContents<std::string>(node);
-		if(versioning.empty())
-			versioning="Not enabled";
-	  }}},
-	  {{"NotImplemented",[&](std::string){versioning="Not supported";}}});
+	//the subresources are fetched at once
+	auto locationResponse=querySubresource(url,"location");
+	auto versioningResponse=querySubresource(url,"versioning");
+	session.engine().run();
+	std::string location=parseLocation(locationResponse.get());
+	std::string versioning=parseVersioning(versioningResponse.get());
 	
 	std::cout << "Bucket: " << bucket << "\n\t";
 	std::cout << "Location: " << location << "\n\t";
@@ -307,20 +463,56 @@ int main(int argc, char* argv[]){
  s3bucket - list and manipulate S3 buckets
 	
 USAGE
- s3bucket list|add|delete|help [arguments]
+ s3bucket [--format text|tsv|json] [--details] [--force [-j jobs] [--progress]]
+          [--http2] [--trace-file path] list|add|delete|info|help [arguments]
 
 SUBCOMMANDS
  list URL
-    List all buckets at URL.
+    List all buckets at URL. With --details, also show each bucket's location,
+    versioning status, number of objects, and total size, gathering them for
+    all buckets at once.
  add URL bucket
     Create bucket at URL.
  delete URL bucket
-    Delete bucket from URL.
+    Delete bucket from URL. Unless --force is used, the bucket must be empty.
  info URL bucket
     List information about bucket at URL.
-    Currently only the location and versioning status are shown.)";
+    Currently only the location and versioning status are shown.
+
+OPTIONS)";
+	optionsType options;
+	options.verbose=false;
+	options.readableSizes=false;
+	options.format=OutputFormat::Text;
+	options.force=false;
+	options.jobs=8;
+	options.progress=false;
+	options.details=false;
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath, format;
 	OptionParser op(true);
 	op.setBaseUsage(usage);
+	op.addOption("format",format,
+				 "Print the list of buckets as text (the default), as tab-separated names and\n"
+				 "creation dates, or as JSON objects, one per line.","text|tsv|json");
+	op.addOption("details",[&]{options.details=true;},
+				 "When listing buckets, also show the location, versioning status, number of\n"
+				 "objects, and total size in bytes of each. In TSV form, these follow the\n"
+				 "creation date.");
+	op.addOption("force",[&]{options.force=true;},
+				 "When deleting a bucket, first remove all of its objects and abort its\n"
+				 "multipart uploads.");
+	op.addOption({"j","jobs"},options.jobs,
+				 "When removing a bucket's objects, divide the listing into ranges of keys and\n"
+				 "list up to this many at once, and make up to this many deletion requests,\n"
+				 "each for up to 1000 objects, at once (default 8).","jobs");
+	op.addOption("progress",[&]{options.progress=true;},
+				 "Report the number of objects removed, and the rate of removal, to stderr.");
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
 	auto arguments=op.parseArgs(argc,argv);
 	
 	if(op.didPrintUsage())
@@ -330,17 +522,26 @@ SUBCOMMANDS
 		return(0);
 	}
 	std::string subcommand=arguments[1];
+	//the credentials are read once, for all operations
+	s3tools::CredentialCollection credentials;
+	std::unique_ptr<CurlSession> session;
+	try{
+		credentials=s3tools::fetchStoredCredentials();
+		session.reset(new CurlSession(credentials,engineOptions,tracePath));
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return(1);
+	}
 	if(subcommand=="list"){
 		if(arguments.size()!=3){
 			std::cout << "Usage: s3bucket list URL" << std::endl;
 			return(1);
 		}
-		optionsType options;
-		options.verbose=false;
-		options.readableSizes=false;
 		std::string url=arguments[2];
 		try{
-			return(listBuckets(url,options) ? 0 : 1);
+			if(!format.empty())
+				options.format=parseOutputFormat(format);
+			return(listBuckets(url,options,credentials,*session) ? 0 : 1);
 		}catch(std::exception& ex){
 			std::cerr << "Error: " << ex.what() << std::endl;
 			return(1);
@@ -354,7 +555,7 @@ SUBCOMMANDS
 		std::string url=arguments[2];
 		std::string bucket=arguments[3];
 		try{
-			return(addBucket(url,bucket) ? 0 : 1);
+			return(addBucket(url,bucket,credentials,*session) ? 0 : 1);
 		}catch(std::exception& ex){
 			std::cerr << "Error: " << ex.what() << std::endl;
 			return(1);
@@ -368,7 +569,7 @@ SUBCOMMANDS
 		std::string url=arguments[2];
 		std::string bucket=arguments[3];
 		try{
-			return(deleteBucket(url,bucket) ? 0 : 1);
+			return(deleteBucket(url,bucket,options,credentials,*session) ? 0 : 1);
 		}catch(std::exception& ex){
 			std::cerr << "Error: " << ex.what() << std::endl;
 			return(1);
@@ -382,7 +583,7 @@ SUBCOMMANDS
 		std::string url=arguments[2];
 		std::string bucket=arguments[3];
 		try{
-			return(bucketInfo(url,bucket) ? 0 : 1);
+			return(bucketInfo(url,bucket,credentials,*session) ? 0 : 1);
 		}catch(std::exception& ex){
 			std::cerr << "Error: " << ex.what() << std::endl;
 			return(1);
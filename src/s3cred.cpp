@@ -5,6 +5,7 @@
 #include <termios.h>
 
 #include <s3tools/cred_manage.h>
+#include <s3tools/url.h>
 
 #include "external/cl_options.h"
 
@@ -13,7 +14,7 @@ int main(int argc, char* argv[]){
  s3cred - manage S3 credentials
 	
 USAGE
- s3cred list|add|delete|help [arguments]
+ s3cred list|add|delete|endpoints|help [arguments]
 
 SUBCOMMANDS
  list
@@ -23,6 +24,13 @@ SUBCOMMANDS
     Interactive prompts are given for necessary information. 
  delete URL
     Delete any credential record associated with URL.
+ endpoints URL [endpoint...]
+    Set the equivalent endpoints for the credential record associated with
+    URL, replacing any set previously. Requests for URL are spread among the
+    endpoints, each of which should be a URL for a server (for example, one
+    node of a cluster behind a load balancer) which can handle the same
+    requests. Requests are still signed for URL. If no endpoints are given,
+    any set previously are removed.
  import [file]
     Add credential records read from a file,
     or from stdin if no file is specified.
@@ -56,8 +64,11 @@ NOTES
 	if(subcommand=="list"){
 		try{
 			auto credentials=s3tools::fetchStoredCredentials();
-			for(const auto& cred : credentials)
+			for(const auto& cred : credentials){
 				std::cout << cred.first << ": " << cred.second.username << std::endl;
+				for(const auto& endpoint : cred.second.endpoints)
+					std::cout << "  " << endpoint << std::endl;
+			}
 			return(0);
 		}catch(std::exception& ex){
 			std::cerr << "s3cred: Error: " << ex.what() << std::endl;
@@ -90,14 +101,22 @@ NOTES
 			return(1);
 		}
 		try{
-			bool stored=storeCredential(url,s3tools::credential{username,key});
+			s3tools::credential cred{username,key,{}};
+			bool stored=storeCredential(url,cred);
 			if(!stored){
 				std::cout << "The credential store already contains an entry for "
 				<< url << "\nDo you want to overwrite it? [y/N]: "; std::cout.flush();
 				char overwrite;
 				std::cin >> overwrite;
-				if(overwrite=='y' || overwrite=='Y')
-					stored=storeCredential(url,s3tools::credential{username,key},true);
+				if(overwrite=='y' || overwrite=='Y'){
+					//replacing the key should not forget the endpoints set
+					//with 'endpoints'
+					auto credentials=s3tools::fetchStoredCredentials();
+					auto existing=credentials.find(url);
+					if(existing!=credentials.end())
+						cred.endpoints=existing->second.endpoints;
+					stored=storeCredential(url,cred,true);
+				}
 			}
 			return(0);
 		}catch(std::exception& ex){
@@ -126,6 +145,30 @@ NOTES
 			return(1);
 		}
 	}
+	if(subcommand=="endpoints"){
+		if(arguments.size()<3){
+			std::cerr << "Usage: s3cred endpoints URL [endpoint...]" << std::endl;
+			return(1);
+		}
+		try{
+			std::string url=arguments[2];
+			s3tools::CredentialCollection credentials=s3tools::fetchStoredCredentials();
+			auto it=credentials.find(url);
+			if(it==credentials.end()){
+				std::cout << "Found no credential information associated with " << url << std::endl;
+				return(1);
+			}
+			s3tools::credential cred=it->second;
+			cred.endpoints.assign(arguments.begin()+3,arguments.end());
+			for(const auto& endpoint : cred.endpoints)
+				s3tools::URL parsed(endpoint); //reject anything which is not a URL
+			s3tools::storeCredential(url,cred,true);
+			return(0);
+		}catch(std::exception& ex){
+			std::cerr << "s3cred: Error: " << ex.what() << std::endl;
+			return(1);
+		}
+	}
 	if(subcommand=="import"){
 		try{
 			int added=0;
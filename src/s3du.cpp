@@ -0,0 +1,174 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/listing.h>
+
+#include "curl_utils.h"
+#include "output_utils.h"
+#include "external/cl_options.h"
+
+struct optionsType{
+	bool readableSizes;
+	///The deepest level of directories to report, where the listed prefix
+	///is level 0
+	unsigned long maxDepth;
+	///The number of listing requests to make at once
+	unsigned long jobs;
+};
+
+///Totals the sizes and numbers of objects in each 'directory' (prefix ending
+///at a '/') under a listed prefix. Since objects are listed in order, the
+///objects in a directory are all listed together, so only the directories
+///containing the current object need to be kept, and each is reported as
+///soon as an object outside of it is seen.
+class DirectoryTotals{
+public:
+	///\param root the listed prefix
+	///\param rootName the name with which to report the totals for the root
+	DirectoryTotals(const std::string& root, const std::string& rootName, const optionsType& options):
+	rootName(rootName),options(options){
+		open.push_back(Directory{root,0,0});
+	}
+
+	void add(const s3tools::ObjectInfo& object){
+		//close the directories which do not contain this object
+		while(open.size()>1 && object.key.compare(0,open.back().path.size(),open.back().path)!=0)
+			close();
+		//and open those which do, below the deepest one already open
+		for(std::size_t slash=object.key.find('/',open.back().path.size());
+		    slash!=std::string::npos; slash=object.key.find('/',slash+1))
+			open.push_back(Directory{object.key.substr(0,slash+1),0,0});
+		open.back().size+=object.size;
+		open.back().count++;
+	}
+
+	///Report all remaining directories, including the root
+	void finish(){
+		while(!open.empty())
+			close();
+	}
+
+private:
+	struct Directory{
+		std::string path;
+		std::uint64_t size;
+		std::uint64_t count;
+	};
+
+	std::string rootName;
+	const optionsType& options;
+	///The directories containing the last object, from the root down
+	std::vector<Directory> open;
+
+	void close(){
+		const Directory& directory=open.back();
+		std::size_t depth=open.size()-1;
+		if(depth<=options.maxDepth){
+			std::cout << formatSize(directory.size,options.readableSizes) << '\t' << directory.count << '\t'
+			          << (depth ? directory.path : rootName) << '\n';
+		}
+		if(depth){
+			open[depth-1].size+=directory.size;
+			open[depth-1].count+=directory.count;
+		}
+		open.pop_back();
+	}
+};
+
+bool summarize(const std::string& target, const s3tools::CredentialCollection& credentials,
+               const optionsType& options, CurlSession& session){
+	auto cred=findCredentials(credentials,target).second;
+	s3tools::URL url=s3tools::listObjectsURL(target,"");
+	s3tools::ObjectLister lister(session.engine(),cred,target,options.jobs);
+	DirectoryTotals totals(url.query["prefix"],target,options);
+	s3tools::ObjectInfo object;
+	try{
+		while(lister.next(object))
+			totals.add(object);
+	}catch(s3tools::S3Error& err){
+		std::cout.flush();
+		std::cerr << "Error: " << target << ": " << err.code() << ": " << err.message() << std::endl;
+		return(false);
+	}
+	totals.finish();
+	std::cout.flush();
+	return(true);
+}
+
+int main(int argc, char* argv[]){
+	std::string usage=
+R"(NAME
+ s3du - summarize the space used by objects on an S3 server
+
+USAGE
+ s3du [-hs] [-d depth] [-j jobs] [--http2] [--trace-file path] url [additional urls...]
+
+DESCRIPTION
+ Lists all objects under each url, which names a bucket and optionally a
+ prefix, and prints the total size and number of objects in each 'directory'
+ of keys, treating '/' as the separator, as size, count, and prefix separated
+ by tabs. Directories are printed after their contents, finishing with the
+ totals for the whole url.
+
+OPTIONS)";
+	optionsType options;
+	options.readableSizes=false;
+	options.maxDepth=-1;
+	options.jobs=8;
+	bool didPrintHelp=false;
+	OptionParser op(false);
+	op.setBaseUsage(usage);
+	op.addOption({"?","help","usage"},[&]{
+		didPrintHelp=true;
+		std::cout << op.getUsage() << std::endl;
+	},"Print usage information.");
+	op.addOption('h',[&]{options.readableSizes=true;},
+				 "Use unit suffixes for sizes");
+	op.addOption({"d","max-depth"},options.maxDepth,
+				 "Only print directories at most this many levels below the url.","depth");
+	op.addOption({"s","summarize"},[&]{options.maxDepth=0;},
+				 "Only print the totals for each url.");
+	op.addOption({"j","jobs"},options.jobs,
+				 "Divide the listing into ranges of keys and list up to this many at once.","jobs");
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
+	op.allowsShortOptionCombination(true);
+	op.allowsOptionTerminator(true);
+	auto arguments=op.parseArgs(argc,argv);
+
+	if(didPrintHelp)
+		return(0);
+	if(arguments.size()<2){
+		std::cout << op.getUsage() << std::endl;
+		return(1);
+	}
+	//ignore the program name
+	arguments.erase(arguments.begin());
+
+	auto credentials=s3tools::fetchStoredCredentials();
+	std::unique_ptr<CurlSession> session;
+	try{
+		session.reset(new CurlSession(credentials,engineOptions,tracePath));
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		return(1);
+	}
+
+	bool success=true;
+	for(const std::string& target : arguments){
+		try{
+			success&=summarize(target,credentials,options,*session);
+		}catch(std::exception& err){
+			std::cerr << err.what() << std::endl;
+			success=false;
+		}
+	}
+	return(success ? 0 : 1);
+}
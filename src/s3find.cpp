@@ -0,0 +1,285 @@
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/deletion.h>
+#include <s3tools/listing.h>
+#include <s3tools/signing.h>
+
+#include "curl_utils.h"
+#include "output_utils.h"
+#include "external/cl_options.h"
+
+enum class Action{Print,Delete,Sign};
+
+struct optionsType{
+	bool verbose;
+	bool readableSizes;
+	///The number of listing requests, and of deletions, to make at once
+	unsigned long jobs;
+	Action action;
+	///How long signed URLs remain valid, in seconds
+	unsigned long validity;
+};
+
+///The conditions which objects must satisfy to be found. These are applied as
+///each page of the listing is parsed, so that objects which fail them are
+///never stored.
+struct Predicates{
+	///A pattern which whole keys must match
+	std::string glob;
+	///A pattern which the last component of keys must match
+	std::string name;
+	std::uint64_t minSize;
+	std::uint64_t maxSize;
+	bool newer, older;
+	std::chrono::system_clock::time_point newerThan, olderThan;
+
+	Predicates():minSize(0),maxSize(std::numeric_limits<std::uint64_t>::max()),
+	newer(false),older(false){}
+
+	bool operator()(const s3tools::ObjectInfo& object) const{
+		//the cheapest tests come first
+		if(object.size<minSize || object.size>maxSize)
+			return(false);
+		if(newer || older){
+			std::chrono::system_clock::time_point time;
+			if(!s3tools::parseTimestamp(object.lastModified.data(),
+			                            object.lastModified.data()+object.lastModified.size(),time))
+				return(false);
+			if((newer && time<=newerThan) || (older && time>=olderThan))
+				return(false);
+		}
+		if(!name.empty()){
+			std::size_t slash=object.key.rfind('/');
+			if(!s3tools::matchGlob(name,slash==std::string::npos ? object.key : object.key.substr(slash+1)))
+				return(false);
+		}
+		if(!glob.empty() && !s3tools::matchGlob(glob,object.key))
+			return(false);
+		return(true);
+	}
+};
+
+///Parse a point in time, given either as a timestamp in the form used by S3
+///(YYYY-MM-DDThh:mm:ss.sssZ) or as an age: a number of seconds, minutes,
+///hours, days, or weeks, with the suffix s, m, h, d, or w, before now
+///\throws std::runtime_error if the time is not valid
+std::chrono::system_clock::time_point parseTime(const std::string& text){
+	std::chrono::system_clock::time_point time;
+	if(s3tools::parseTimestamp(text.data(),text.data()+text.size(),time))
+		return(time);
+	const static std::string suffixes="smhdw";
+	const static std::uint64_t units[]={1,60,3600,86400,604800};
+	std::size_t unit=(text.empty() ? std::string::npos : suffixes.find(std::tolower(text.back())));
+	std::uint64_t count;
+	if(unit==std::string::npos || !s3tools::parseUnsigned(text.data(),text.data()+text.size()-1,count)
+	   || count>(std::uint64_t)std::numeric_limits<std::int32_t>::max())
+		throw std::runtime_error("Invalid time: "+text);
+	return(std::chrono::system_clock::now()-std::chrono::seconds(count*units[unit]));
+}
+
+void printObject(const s3tools::ObjectInfo& object, const optionsType& options){
+	std::cout << object.key;
+	if(options.verbose){
+		if(!object.lastModified.empty())
+			std::cout << "\t " << object.lastModified;
+		std::cout << "\t " << formatSize(object.size,options.readableSizes);
+		if(!object.etag.empty())
+			std::cout << "\t " << object.etag;
+	}
+	std::cout << '\n';
+}
+
+bool find(const std::string& target, const Predicates& predicates, const s3tools::CredentialCollection& credentials,
+          const optionsType& options, CurlSession& session){
+	auto cred=findCredentials(credentials,target).second;
+	s3tools::URL bucket=s3tools::listObjectsURL(target,"");
+	const std::string prefix=bucket.query["prefix"];
+	//list only the keys which could match the pattern, so that the
+	//server, rather than the filter, passes over the rest
+	std::string listTarget=target;
+	std::string literal=s3tools::globPrefix(predicates.glob);
+	if(literal.size()>prefix.size() && literal.compare(0,prefix.size(),prefix)==0){
+		if(target.size()<prefix.size() || target.compare(target.size()-prefix.size(),prefix.size(),prefix)!=0)
+			throw std::runtime_error("Unable to find the prefix in "+target);
+		listTarget=target.substr(0,target.size()-prefix.size());
+		if(prefix.empty() && listTarget.back()!='/')
+			listTarget+='/';
+		listTarget+=literal;
+	}
+	else if(prefix.compare(0,literal.size(),literal)!=0)
+		return(true); //the pattern cannot match any key under the prefix
+
+	//objects are deleted in batches as they are found, while the listing
+	//continues
+	bool success=true;
+	std::unique_ptr<s3tools::BatchDeleter> deleter;
+	if(options.action==Action::Delete){
+		s3tools::URL bucketOnly=bucket;
+		bucketOnly.query.clear();
+		const std::string bucketURL=bucketOnly.str();
+		deleter.reset(new s3tools::BatchDeleter(session.engine(),cred,bucketOnly,options.jobs,
+		  [&success,bucketURL](const s3tools::DeleteError& error){
+			std::cerr << "Error: " << bucketURL << '/' << error.key << ": "
+			          << (error.code.empty() ? "" : error.code+": ") << error.message << std::endl;
+			success=false;
+		}));
+	}
+	s3tools::ObjectLister lister(session.engine(),cred,listTarget,options.jobs,"",predicates);
+	s3tools::ObjectInfo object;
+	try{
+		while(lister.next(object)){
+			switch(options.action){
+				case Action::Print:
+					printObject(object,options);
+					break;
+				case Action::Delete:
+					deleter->remove(object.key);
+					break;
+				case Action::Sign:
+				{
+					s3tools::URL url=bucket;
+					url.query.clear();
+					url.path+="/"+object.key;
+					std::cout << s3tools::genURL(cred.username,cred.key,"GET",url,options.validity).str() << '\n';
+					break;
+				}
+			}
+		}
+	}catch(s3tools::S3Error& err){
+		std::cout.flush();
+		std::cerr << "Error: " << target << ": " << err.code() << ": " << err.message() << std::endl;
+		success=false;
+	}
+	//objects already found are still deleted
+	if(deleter)
+		deleter->finish();
+	std::cout.flush();
+	return(success);
+}
+
+int main(int argc, char* argv[]){
+	std::string usage=
+R"(NAME
+ s3find - search for objects on an S3 server
+
+USAGE
+ s3find [options] url [additional urls...]
+
+DESCRIPTION
+ Lists the objects under each url, which names a bucket and optionally a
+ prefix, and prints the keys of those which satisfy all of the given
+ conditions, or deletes them or prints signed URLs for them.
+
+ Only the keys which begin with the part of the --glob pattern before its
+ first '*', '?', or '[' are listed, and the listing is divided into ranges of
+ keys which are listed concurrently. The conditions are checked as each page
+ of the listing is received, so searching a large listing for a few objects
+ takes little memory.
+
+OPTIONS)";
+	optionsType options;
+	options.verbose=false;
+	options.readableSizes=false;
+	options.jobs=8;
+	options.action=Action::Print;
+	options.validity=3600;
+	Predicates predicates;
+	std::string minSize, maxSize, newer, older;
+	bool didPrintHelp=false;
+	OptionParser op(false);
+	op.setBaseUsage(usage);
+	op.addOption({"?","help","usage"},[&]{
+		didPrintHelp=true;
+		std::cout << op.getUsage() << std::endl;
+	},"Print usage information.");
+	op.addOption("glob",predicates.glob,
+				 "Only find objects whose whole keys match this pattern, in which '*' and '?'\n"
+				 "do not match '/'.","pattern");
+	op.addOption("name",predicates.name,
+				 "Only find objects the last component of whose keys, following the last '/',\n"
+				 "matches this pattern.","pattern");
+	op.addOption("min-size",minSize,
+				 "Only find objects of at least this size, which may have a unit suffix\n"
+				 "(K, M, G, ...).","size");
+	op.addOption("max-size",maxSize,"Only find objects of at most this size.","size");
+	op.addOption("newer",newer,
+				 "Only find objects modified after this time, which may be a timestamp\n"
+				 "(2024-01-31T12:00:00Z) or an age (30s, 15m, 12h, 7d, or 2w).","time");
+	op.addOption("older",older,"Only find objects modified before this time.","time");
+	op.addOption({"l","long"},[&]{options.verbose=true;},
+				 "Show sizes, modification times and ETags");
+	op.addOption('h',[&]{options.readableSizes=true;},
+				 "Use unit suffixes for sizes");
+	op.addOption("delete",[&]{options.action=Action::Delete;},
+				 "Delete the objects found, rather than printing them.");
+	op.addOption("sign",[&]{options.action=Action::Sign;},
+				 "Print a presigned GET URL for each object found, rather than its key.");
+	op.addOption("validity",options.validity,
+				 "The number of seconds for which signed URLs remain valid (default 3600).","seconds");
+	op.addOption({"j","jobs"},options.jobs,
+				 "Divide the listing into ranges of keys and list up to this many at once,\n"
+				 "and have up to this many deletion requests, each for up to 1000 objects,\n"
+				 "in progress at once.","jobs");
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
+	op.allowsShortOptionCombination(true);
+	op.allowsOptionTerminator(true);
+	auto arguments=op.parseArgs(argc,argv);
+
+	if(didPrintHelp)
+		return(0);
+	if(arguments.size()<2){
+		std::cout << op.getUsage() << std::endl;
+		return(1);
+	}
+	//ignore the program name
+	arguments.erase(arguments.begin());
+
+	try{
+		if(!minSize.empty())
+			predicates.minSize=parseSize(minSize);
+		if(!maxSize.empty())
+			predicates.maxSize=parseSize(maxSize);
+		if(!newer.empty()){
+			predicates.newer=true;
+			predicates.newerThan=parseTime(newer);
+		}
+		if(!older.empty()){
+			predicates.older=true;
+			predicates.olderThan=parseTime(older);
+		}
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return(1);
+	}
+
+	auto credentials=s3tools::fetchStoredCredentials();
+	std::unique_ptr<CurlSession> session;
+	try{
+		session.reset(new CurlSession(credentials,engineOptions,tracePath));
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		return(1);
+	}
+
+	bool success=true;
+	for(const std::string& target : arguments){
+		try{
+			success&=find(target,predicates,credentials,options,*session);
+		}catch(std::exception& err){
+			std::cerr << err.what() << std::endl;
+			success=false;
+		}
+	}
+	return(success ? 0 : 1);
+}
@@ -0,0 +1,164 @@
+#include <iostream>
+#include <memory>
+
+#include <s3tools/cred_manage.h>
+#include <s3tools/index.h>
+
+#include "curl_utils.h"
+#include "output_utils.h"
+#include "external/cl_options.h"
+
+struct optionsType{
+	bool verbose;
+	bool readableSizes;
+	///The number of listing requests to make at once
+	unsigned long jobs;
+};
+
+void printObject(const s3tools::ObjectInfo& object, const optionsType& options){
+	std::cout << object.key;
+	if(options.verbose){
+		if(!object.lastModified.empty())
+			std::cout << "\t " << object.lastModified;
+		std::cout << "\t " << formatSize(object.size,options.readableSizes);
+		if(!object.etag.empty())
+			std::cout << "\t " << object.etag;
+	}
+	std::cout << '\n';
+}
+
+///Build or update an index, reporting how many objects were listed
+int update(const std::string& target, const std::string& path, bool rebuild,
+           const s3tools::CredentialCollection& credentials, const optionsType& options, CurlSession& session){
+	auto cred=findCredentials(credentials,target).second;
+	std::size_t listed=s3tools::updateIndex(session.engine(),cred,path,target,options.jobs,rebuild);
+	s3tools::ListingIndex index(path);
+	std::cout << "Listed " << listed << " objects; " << index.size() << " in index" << std::endl;
+	return(0);
+}
+
+int main(int argc, char* argv[]){
+	std::string usage=R"(NAME
+ s3index - keep a local index of the objects in a bucket
+
+USAGE
+ s3index [options] build|update|query|info|help [arguments]
+
+SUBCOMMANDS
+ build URL index
+    List all objects under URL, which names a bucket and optionally a prefix,
+    and store their keys, sizes, modification times and ETags in the file
+    index. If a previous build of the same index was interrupted, it is
+    resumed.
+ update index
+    List the objects following the last one in index, and add them to it.
+    This finds new objects when keys are added in order, as for logs, but not
+    objects which have been deleted or changed, for which the index must be
+    rebuilt.
+ query index
+    Print the entries of index which match all of --prefix, --glob,
+    --min-size, and --max-size.
+ info index
+    Print the target, size and age of index.
+
+OPTIONS)";
+	optionsType options;
+	options.verbose=false;
+	options.readableSizes=false;
+	options.jobs=8;
+	s3tools::ListingIndex::Query query;
+	std::string minSize, maxSize;
+	bool didPrintHelp=false;
+	OptionParser op(false);
+	op.setBaseUsage(usage);
+	op.addOption({"?","help","usage"},[&]{
+		didPrintHelp=true;
+		std::cout << op.getUsage() << std::endl;
+	},"Print usage information.");
+	op.addOption({"j","jobs"},options.jobs,
+				 "The number of listing requests to make at once when building or updating.","jobs");
+	op.addOption("prefix",query.prefix,"Only show keys beginning with this prefix.","prefix");
+	op.addOption("glob",query.glob,
+				 "Only show keys matching this pattern, in which '*' and '?' do not match '/'.","pattern");
+	op.addOption("min-size",minSize,
+				 "Only show objects of at least this size, which may have a unit suffix\n"
+				 "(K, M, G, ...).","size");
+	op.addOption("max-size",maxSize,"Only show objects of at most this size.","size");
+	op.addOption({"l","long"},[&]{options.verbose=true;},
+				 "Show sizes, modification times and ETags");
+	op.addOption('h',[&]{options.readableSizes=true;},
+				 "Use unit suffixes for sizes");
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
+	op.allowsShortOptionCombination(true);
+	op.allowsOptionTerminator(true);
+	auto arguments=op.parseArgs(argc,argv);
+
+	if(didPrintHelp)
+		return(0);
+	if(arguments.size()<2){
+		std::cout << op.getUsage() << std::endl;
+		return(1);
+	}
+	const std::string subcommand=arguments[1];
+	try{
+		if(subcommand=="build" || subcommand=="update"){
+			bool rebuild=(subcommand=="build");
+			if(arguments.size()!=(rebuild ? 4 : 3)){
+				std::cout << "Usage: s3index " << (rebuild ? "build URL index" : "update index") << std::endl;
+				return(1);
+			}
+			const std::string path=arguments.back();
+			const std::string target=(rebuild ? arguments[2] : s3tools::ListingIndex(path).target());
+			auto credentials=s3tools::fetchStoredCredentials();
+			CurlSession session(credentials,engineOptions,tracePath);
+			return(update(target,path,rebuild,credentials,options,session));
+		}
+		if(subcommand=="query"){
+			if(arguments.size()!=3){
+				std::cout << "Usage: s3index query index" << std::endl;
+				return(1);
+			}
+			if(!minSize.empty())
+				query.minSize=parseSize(minSize);
+			if(!maxSize.empty())
+				query.maxSize=parseSize(maxSize);
+			s3tools::ListingIndex index(arguments[2]);
+			index.find(query,[&](const s3tools::ObjectInfo& object){
+				printObject(object,options);
+				return(true);
+			});
+			std::cout.flush();
+			return(0);
+		}
+		if(subcommand=="info"){
+			if(arguments.size()!=3){
+				std::cout << "Usage: s3index info index" << std::endl;
+				return(1);
+			}
+			s3tools::ListingIndex index(arguments[2]);
+			std::cout << "Target: " << index.target() << '\n';
+			std::cout << "Objects: " << index.size() << '\n';
+			std::cout << "Updated: " << s3tools::formatTimestamp(index.updated()) << '\n';
+			std::cout << "Index size: " << index.fileSize() << " bytes" << std::endl;
+			return(0);
+		}
+		if(subcommand=="help"){
+			std::cout << op.getUsage() << std::endl;
+			return(0);
+		}
+	}catch(s3tools::S3Error& err){
+		std::cerr << "Error: " << err.code() << ": " << err.message() << std::endl;
+		return(1);
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return(1);
+	}
+	std::cerr << "Unrecognized subcommand" << std::endl;
+	return(1);
+}
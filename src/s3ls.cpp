@@ -1,85 +1,223 @@
-#include <cmath>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #include <curl/curl.h>
 
 #include <s3tools/url.h>
 #include <s3tools/signing.h>
 #include <s3tools/cred_manage.h>
+#include <s3tools/listing.h>
+#include <s3tools/responses.h>
 
 #include "curl_utils.h"
+#include "output_utils.h"
 #include "xml_utils.h"
 #include "external/cl_options.h"
 	
 struct optionsType{
 	bool verbose;
 	bool readableSizes;
+	bool recursive;
+	///The number of listing requests to make at once when listing recursively
+	unsigned long jobs;
+	///Whether to print entries as they are received, rather than collecting
+	///and sorting them
+	bool online;
+	s3tools::ListingTable::Column sortBy;
+	bool reverse;
+	OutputFormat format;
+	///Whether, when listing several targets, the output for each should be
+	///printed as soon as it is finished, rather than in the order given
+	bool unordered;
 };
 		
-///\return the continuation token, if any
-void parseListAllBucketsResult(xmlNode* node, const optionsType& options){
+void parseListAllBucketsResult(xmlNode* node, OutputBuffer& out, const optionsType& options){
 	xmlNode* buckets=firstChild(node,"Buckets");
 	if(!buckets)
 		return;
 	for(xmlNode* bucket=firstChild(buckets,"Bucket"); bucket; bucket=nextSibling(bucket,"Bucket")){
 		xmlNode* name=firstChild(bucket,"Name");
-		if(name)
-			std::cout << getNodeContents<std::string>(name) << '/';
-		if(options.verbose){
-			xmlNode* ctime=firstChild(bucket,"CreationDate");
-			if(ctime)
-				std::cout << "\t " << getNodeContents<std::string>(ctime);
-		}
-		std::cout << std::endl;
+		xmlNode* ctime=firstChild(bucket,"CreationDate");
+		//as text, buckets are marked like common prefixes
+		printBucket(out,name ? getNodeContents<std::string>(name)+(options.format==OutputFormat::Text ? "/" : "") : "",
+		            ctime ? getNodeContents<std::string>(ctime) : "",options.format,options.verbose);
 	}
 }
-	
-///\return the continuation token, if any
-void parseListBucketResult(xmlNode* node, const optionsType& options){
-	for(xmlNode* prefixes=firstChild(node,"CommonPrefixes"); prefixes; prefixes=nextSibling(prefixes,"CommonPrefixes")){
-		xmlNode* prefix=firstChild(prefixes,"Prefix");
-		if(prefix)
-			std::cout << getNodeContents<std::string>(prefix) << std::endl;
-	}
-	if(options.readableSizes)
-		std::cout.precision(2);
-	for(xmlNode* content=firstChild(node,"Contents"); content; content=nextSibling(content,"Contents")){
-		xmlNode* key=firstChild(content,"Key");
-		if(key)
-			std::cout << getNodeContents<std::string>(key);
-		if(options.verbose){
-			xmlNode* mtime=firstChild(content,"LastModified");
-			if(mtime)
-				std::cout << "\t " << getNodeContents<std::string>(mtime);
-			xmlNode* size=firstChild(content,"Size");
-			if(size){
-				if(options.readableSizes){
-					unsigned long isize=getNodeContents<unsigned long>(size);
-					const static std::string suffixes="BKMGTPE";
-					unsigned int index=0;
-					double frac=0;
-					while(isize>=(1UL<<10)){
-						index++;
-						frac=fmod(isize+frac,1024.)/1024.;
-						isize>>=10;
-					}
-					if(index)
-						std::cout << "\t " << isize+frac << suffixes[index];
-					else
-						std::cout << "\t " << isize << suffixes[index];
-				}
-				else
-					std::cout << "\t " << getNodeContents<std::string>(size);
+
+///Print an object in the format selected by the options. In TSV form, the
+///fields are the key, size in bytes, modification time, and ETag.
+void printObject(OutputBuffer& out, const s3tools::ObjectInfo& object, const optionsType& options){
+	switch(options.format){
+		case OutputFormat::Text:
+			out << object.key;
+			if(options.verbose){
+				if(!object.lastModified.empty())
+					out << "\t " << object.lastModified;
+				out << "\t ";
+				out.appendSize(object.size,options.readableSizes);
 			}
+			break;
+		case OutputFormat::TSV:
+			out.appendTSV(object.key);
+			out << '\t';
+			out.appendUnsigned(object.size);
+			out << '\t' << object.lastModified << '\t';
+			out.appendTSV(object.etag);
+			break;
+		case OutputFormat::JSON:
+			out << "{\"key\":";
+			out.appendJSON(object.key);
+			out << ",\"size\":";
+			out.appendUnsigned(object.size);
+			if(!object.lastModified.empty()){
+				out << ",\"last_modified\":";
+				out.appendJSON(object.lastModified);
+			}
+			if(!object.etag.empty()){
+				out << ",\"etag\":";
+				out.appendJSON(object.etag);
+			}
+			out << '}';
+			break;
+	}
+	out << '\n';
+}
+
+///Print a common prefix, which in TSV form has the same fields as an object,
+///with all but the first empty
+void printPrefix(OutputBuffer& out, const std::string& prefix, const optionsType& options){
+	switch(options.format){
+		case OutputFormat::Text:
+			out << prefix;
+			break;
+		case OutputFormat::TSV:
+			out.appendTSV(prefix);
+			out << "\t\t\t";
+			break;
+		case OutputFormat::JSON:
+			out << "{\"prefix\":";
+			out.appendJSON(prefix);
+			out << '}';
+			break;
+	}
+	out << '\n';
+}
+
+///Print the entries of a listing in the order selected by the options
+void printTable(OutputBuffer& out, const s3tools::ListingTable& table, const optionsType& options){
+	s3tools::ObjectInfo object;
+	for(std::uint32_t index : table.order(options.sortBy,options.reverse)){
+		if(table.isPrefix(index))
+			printPrefix(out,table.key(index),options);
+		else{
+			table.get(index,object);
+			printObject(out,object,options);
 		}
-		std::cout << std::endl;
 	}
 }
-		
+
+void printError(OutputBuffer& out, const s3tools::S3Error& err){
+	out << "Error: \n Code: " << err.code() << "\n Message: " << err.message() << '\n';
+	out.flush();
+}
+
+///A page of a bucket listing which has been requested. Its entries are
+///collected as it is received, to be passed on once the pages before it have
+///been, and its continuation token, which servers send ahead of the entries,
+///is noted as soon as it has been read, so that the next page can be
+///requested while the rest of this one is still arriving.
+class PendingPage{
+public:
+	///Request a page
+	///\param url the signed URL for the page
+	static std::shared_ptr<PendingPage> request(const s3tools::URL& url, s3tools::RequestEngine& engine){
+		std::shared_ptr<PendingPage> page(new PendingPage(engine));
+		HTTPRequest request(url);
+		request.sink=page->parser.sink();
+		page->id=engine.submit(std::move(request),[page](HTTPResponse response){
+			std::lock_guard<std::mutex> guard(page->lock);
+			page->response=std::move(response);
+			page->done=true;
+		});
+		return(page);
+	}
+
+	///Wait until the token for the next page has been read, or the page has
+	///been received without one
+	///\return the token, or an empty string if it is not yet known
+	std::string nextToken(){
+		wait([this]{ return(tokenSeen || done); });
+		std::lock_guard<std::mutex> guard(lock);
+		return(token);
+	}
+
+	///Wait for the page to be received, and pass on its entries
+	///\return the token for the next page, if there is one
+	///\throws S3Error if the server reports an error
+	///\throws std::runtime_error if the request fails
+	std::string finish(const s3tools::ListParser::ObjectCallback& objectCallback,
+	                   const s3tools::ListParser::PrefixCallback& prefixCallback){
+		wait([this]{ return(done); });
+		if(!response.complete())
+			throw std::runtime_error("Listing request failed: "+response.error);
+		parser.finish(response.status);
+		for(const auto& object : objects)
+			objectCallback(object);
+		for(const auto& prefix : prefixes)
+			prefixCallback(prefix);
+		return(parser.truncated() ? parser.nextContinuationToken() : "");
+	}
+
+	///Abandon the request, if it is still in progress
+	void cancel(){
+		engine.cancel(id);
+	}
+
+private:
+	s3tools::RequestEngine& engine;
+	s3tools::RequestEngine::RequestID id;
+	s3tools::ListParser parser;
+	std::vector<s3tools::ObjectInfo> objects;
+	std::vector<std::string> prefixes;
+	std::mutex lock;
+	bool tokenSeen;
+	std::string token;
+	bool done;
+	HTTPResponse response;
+
+	explicit PendingPage(s3tools::RequestEngine& engine):engine(engine),id(0),
+	parser([this](const s3tools::ObjectInfo& object){ objects.push_back(object); },
+	       [this](const std::string& prefix){ prefixes.push_back(prefix); }),
+	tokenSeen(false),done(false){
+		parser.onContinuationToken([this](const std::string& next){
+			std::lock_guard<std::mutex> guard(lock);
+			tokenSeen=true;
+			token=next;
+		});
+	}
+
+	///Drive the engine until a condition holds
+	template<typename Condition>
+	void wait(Condition condition){
+		std::unique_lock<std::mutex> guard(lock);
+		while(!condition()){
+			guard.unlock();
+			engine.poll(std::chrono::milliseconds(100));
+			guard.lock();
+		}
+	}
+};
+
 ///\return the continuation token, if any
-std::string parseXML(const std::string& raw, const optionsType& options){
+std::string parseXML(const std::string& raw, OutputBuffer& out, const optionsType& options){
 	//xmlSetStructuredErrorFunc(this,&xmlErrorCallback);
 	std::unique_ptr<xmlDoc,void(*)(xmlDoc*)> tree(xmlReadDoc((const xmlChar*)raw.c_str(),NULL,NULL,XML_PARSE_RECOVER|XML_PARSE_PEDANTIC),&xmlFreeDoc);
 	/*if(!tree || fatalErrorOccurred){
@@ -94,10 +232,9 @@ std::string parseXML(const std::string& raw, const optionsType& options){
 	}
 	std::string nodeName((char*)root->name);
 	if(nodeName=="ListAllMyBucketsResult")
-		parseListAllBucketsResult(root,options);
-	else if(nodeName=="ListBucketResult")
-		parseListBucketResult(root,options);
+		parseListAllBucketsResult(root,out,options);
 	else if(nodeName=="Error"){
+		out.flush();
 		std::cout << "Error: " << std::endl;
 		xmlNode* code=firstChild(root,"Code");
 		if(code)
@@ -117,8 +254,29 @@ std::string parseXML(const std::string& raw, const optionsType& options){
 	return("");
 }
 
+///List all objects under a prefix, without grouping them into common prefixes
+void listRecursive(const std::string& target, const s3tools::credential& cred,
+                   OutputBuffer& out, const optionsType& options, CurlSession& session){
+	s3tools::ObjectLister lister(session.engine(),cred,target,options.jobs);
+	//objects are listed in order by name, so need not be collected to be sorted that way
+	bool direct=options.online || (options.sortBy==s3tools::ListingTable::Column::Name && !options.reverse);
+	s3tools::ListingTable table(options.format!=OutputFormat::Text);
+	s3tools::ObjectInfo object;
+	try{
+		while(lister.next(object)){
+			if(direct)
+				printObject(out,object,options);
+			else
+				table.add(object);
+		}
+	}catch(s3tools::S3Error& err){
+		printError(out,err);
+	}
+	printTable(out,table,options);
+}
+
 void list(const std::string& target, const s3tools::CredentialCollection& credentials, 
-          const optionsType& options, CURL* curlSession, char* errBuf){
+          OutputBuffer& out, const optionsType& options, CurlSession& session){
 	auto cred=findCredentials(credentials,target).second;
 	s3tools::URL basicURL(target);
 	basicURL.query["list-type"]="2";
@@ -133,46 +291,180 @@ void list(const std::string& target, const s3tools::CredentialCollection& creden
 			basicURL.path=matches[1].str(); //the bucket
 		}
 	}
-	std::string continuation;
+	//a listing of buckets is short, so it is simply parsed once it has all arrived
+	bool listingBuckets=(basicURL.path.empty() || basicURL.path=="/");
+	if(options.recursive && !listingBuckets){
+		listRecursive(target,cred,out,options,session);
+		return;
+	}
+	if(listingBuckets){
+		std::string continuation;
+		do{
+			s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"GET",basicURL.str(),60);
+			HTTPResponse response=session.perform(HTTPRequest(signedURL));
+			continuation=parseXML(response.body,out,options);
+			if(!continuation.empty())
+				basicURL.query["continuation-token"]=continuation;
+		}while(!continuation.empty());
+		return;
+	}
+	s3tools::ListingTable table(options.format!=OutputFormat::Text);
+	s3tools::ListParser::ObjectCallback objectCallback;
+	s3tools::ListParser::PrefixCallback prefixCallback;
+	if(options.online){
+		objectCallback=[&](const s3tools::ObjectInfo& object){ printObject(out,object,options); };
+		prefixCallback=[&](const std::string& prefix){ printPrefix(out,prefix,options); };
+	}
+	else{
+		objectCallback=[&](const s3tools::ObjectInfo& object){ table.add(object); };
+		prefixCallback=[&](const std::string& prefix){ table.addPrefix(prefix); };
+	}
 	
-	do{
+	//each page is requested as soon as the token for it is known, so that it
+	//is in flight while the one before it is received and processed
+	auto requestPage=[&](const std::string& token){
+		if(!token.empty())
+			basicURL.query["continuation-token"]=token;
 		s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"GET",basicURL.str(),60);
-		std::string resultData;
-		
-		CURLcode err;
-		err=curl_easy_setopt(curlSession, CURLOPT_URL, signedURL.str().c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl URL option",err,errBuf);
-		err=curl_easy_setopt(curlSession, CURLOPT_HTTPGET, 1);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl GET option",err,errBuf);
-		err=curl_easy_setopt(curlSession, CURLOPT_WRITEFUNCTION, collectOutput);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback",err,errBuf);
-		err=curl_easy_setopt(curlSession, CURLOPT_WRITEDATA, &resultData);
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl output callback data",err,errBuf);
-		err=curl_easy_perform(curlSession);
-		if(err!=CURLE_OK)
-			reportCurlError("curl perform GET failed",err,errBuf);
-		
-		continuation=parseXML(resultData,options);
-		if(!continuation.empty())
-			basicURL.query["continuation-token"]=continuation;
-	}while(!continuation.empty());
+		return(PendingPage::request(signedURL,session.engine()));
+	};
+	std::shared_ptr<PendingPage> page=requestPage("");
+	while(page){
+		std::shared_ptr<PendingPage> next;
+		std::string token=page->nextToken();
+		if(!token.empty())
+			next=requestPage(token);
+		try{
+			token=page->finish(objectCallback,prefixCallback);
+		}catch(s3tools::S3Error& err){
+			if(next)
+				next->cancel();
+			printError(out,err);
+			break;
+		}catch(...){
+			//nothing will wait for the next page, so its request must not
+			//be left in flight
+			if(next)
+				next->cancel();
+			throw;
+		}
+		//in case the token came only after the entries
+		if(!next && !token.empty())
+			next=requestPage(token);
+		page=next;
+	}
+	printTable(out,table,options);
+}
+
+///The output from listing one of several targets, collected so that it can
+///be printed in one piece
+struct TargetListing{
+	std::ostringstream output;
+	///The error which ended the listing, if any, to be printed after the
+	///output
+	std::string error;
+	bool done;
+
+	TargetListing():done(false){}
+};
+
+///The most targets which are listed at once
+const std::size_t maxConcurrentTargets=32;
+
+///List several targets concurrently, printing the output for each in the
+///order in which they are given, or as each finishes if options.unordered is
+///set
+void listAll(const std::vector<std::string>& targets, const s3tools::CredentialCollection& credentials,
+             OutputBuffer& out, const optionsType& options, CurlSession& session){
+	//each listing waits for its own requests, so the engine is driven by a
+	//thread of its own rather than by whichever listing is waiting
+	session.engine().start();
+	xmlInitParser();
+	std::vector<TargetListing> listings(targets.size());
+	std::mutex lock;
+	std::condition_variable finished;
+	std::size_t nextTarget=0;
+	std::deque<std::size_t> completed;
+	auto work=[&]{
+		while(true){
+			std::size_t index;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if(nextTarget==targets.size())
+					return;
+				index=nextTarget++;
+			}
+			TargetListing& listing=listings[index];
+			try{
+				OutputBuffer buffer(listing.output);
+				list(targets[index],credentials,buffer,options,session);
+			}catch(std::exception& err){
+				listing.error=err.what();
+			}
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				listing.done=true;
+				completed.push_back(index);
+			}
+			finished.notify_all();
+		}
+	};
+	std::vector<std::thread> threads;
+	for(std::size_t i=0; i<std::min(targets.size(),maxConcurrentTargets); i++)
+		threads.emplace_back(work);
+
+	for(std::size_t printed=0; printed<targets.size(); printed++){
+		std::size_t index;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			if(options.unordered){
+				finished.wait(guard,[&]{ return(!completed.empty()); });
+				index=completed.front();
+				completed.pop_front();
+			}
+			else{
+				index=printed;
+				finished.wait(guard,[&]{ return(listings[index].done); });
+			}
+		}
+		TargetListing& listing=listings[index];
+		out << listing.output.str();
+		listing.output.str(std::string());
+		if(!listing.error.empty()){
+			out.flush();
+			std::cerr << listing.error << std::endl;
+		}
+	}
+	for(auto& thread : threads)
+		thread.join();
 }
 
 int main(int argc, char* argv[]){
 	optionsType options;
 	options.verbose=false;
 	options.readableSizes=false;
+	options.recursive=false;
+	options.jobs=1;
+	options.online=false;
+	options.sortBy=s3tools::ListingTable::Column::Name;
+	options.reverse=false;
+	options.format=OutputFormat::Text;
+	options.unordered=false;
+	std::string sortBy, format;
 	bool didPrintHelp=false;
 	std::string usage=
 R"(NAME
  s3ls - list files on an S3 server
 	
 USAGE
- s3ls [-hl] url [additional urls...]
+ s3ls [-hlrSt] [-j jobs] [--sort name|size|time] [--reverse] [--online]
+      [--format text|tsv|json] [--unordered] [--http2] [--trace-file path]
+      url [additional urls...]
+
+DESCRIPTION
+ Lists the buckets on a server, or the objects and common prefixes in a
+ bucket under a prefix. When several urls are given, they are listed
+ concurrently, and the listing of each is printed in one piece.
 
 OPTIONS)";
 	
@@ -186,6 +478,34 @@ OPTIONS)";
 				 "List in long format including sizes and modification times");
 	op.addOption('h',[&]{options.readableSizes=true;},
 				 "Use unit suffixes for sizes");
+	op.addOption({"r","recursive"},[&]{options.recursive=true;},
+				 "List all objects under the given prefix, rather than grouping those whose\n"
+				 "keys continue past the next '/' into common prefixes.");
+	op.addOption({"j","jobs"},options.jobs,
+				 "With -r, divide the listing into ranges of keys and list up to this many\n"
+				 "at once. Objects are still listed in order.","jobs");
+	op.addOption("sort",sortBy,
+				 "Order entries by name (the default), size (largest first), or modification\n"
+				 "time (newest first). Common prefixes have no size or time.","column");
+	op.addOption('S',[&]{sortBy="size";},"Sort by size, largest first");
+	op.addOption('t',[&]{sortBy="time";},"Sort by modification time, newest first");
+	op.addOption("reverse",[&]{options.reverse=true;},"Reverse the order of sorting");
+	op.addOption("online",[&]{options.online=true;},
+				 "Print entries as soon as they are received, in the order in which the\n"
+				 "server sends them, rather than collecting them to be sorted.");
+	op.addOption("format",format,
+				 "Print entries as text (the default), as tab-separated key, size, modification\n"
+				 "time, and ETag, or as JSON objects, one per line.","text|tsv|json");
+	op.addOption("unordered",[&]{options.unordered=true;},
+				 "When listing several urls, print the listing of each as soon as it is\n"
+				 "finished, rather than in the order in which the urls are given.");
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
 	op.allowsShortOptionCombination(true);
 	op.allowsOptionTerminator(true);
 	auto arguments=op.parseArgs(argc,argv);
@@ -198,38 +518,45 @@ OPTIONS)";
 	}
 	//ignore the program name
 	arguments.erase(arguments.begin());
+	if(sortBy=="size" || sortBy=="time"){
+		//unlike names, the most interesting sizes and times are the largest
+		options.sortBy=(sortBy=="size" ? s3tools::ListingTable::Column::Size : s3tools::ListingTable::Column::Time);
+		options.reverse=!options.reverse;
+	}
+	else if(!sortBy.empty() && sortBy!="name"){
+		std::cerr << "Unknown sort order: " << sortBy << std::endl;
+		return(1);
+	}
+	try{
+		if(!format.empty())
+			options.format=parseOutputFormat(format);
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		return(1);
+	}
 	
-	std::cout.precision(3);
-	std::cout.setf(std::ios::floatfield,std::ios::fixed);
+	//all listing output goes through the buffer, which writes it in large
+	//pieces, so the stream need not keep in step with stdio
+	std::ios::sync_with_stdio(false);
+	OutputBuffer out;
 	auto credentials=s3tools::fetchStoredCredentials();
 	
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-	if(err!=CURLE_OK){
-		std::cerr << "Failed to set curl error buffer" << std::endl;
+	std::unique_ptr<CurlSession> session;
+	try{
+		session.reset(new CurlSession(credentials,engineOptions,tracePath));
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
 		return(1);
 	}
-#ifdef USE_CURLOPT_CAINFO
-	std::string caBundlePath=detectCABundlePath();
-	if(!caBundlePath.empty()){
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-		if(err!=CURLE_OK){
-			if(errBuf[0]!=0)
-				std::cerr << "Failed to set curl CA bundle path\n curl error: " << errBuf.get() << std::endl;
-			else
-				std::cerr << "Failed to set curl CA bundle path\n curl error: " << curl_easy_strerror(err) << std::endl;
-		}
-	}
-#endif
 
-	for(const std::string& target : arguments){
-		try{
-			list(target,credentials,options,curlSession.get(),errBuf.get());
-		}catch(std::exception& err){
-			std::cerr << err.what() << std::endl;
-		}
+	if(arguments.size()>1){
+		listAll(arguments,credentials,out,options,*session);
+		return(0);
+	}
+	try{
+		list(arguments.front(),credentials,out,options,*session);
+	}catch(std::exception& err){
+		out.flush();
+		std::cerr << err.what() << std::endl;
 	}
 }
@@ -1,76 +1,173 @@
+#include <chrono>
 #include <iostream>
-
-#include <curl/curl.h>
+#include <memory>
+#include <vector>
 
 #include <s3tools/url.h>
-#include <s3tools/signing.h>
 #include <s3tools/cred_manage.h>
+#include <s3tools/deletion.h>
+#include <s3tools/listing.h>
 
 #include "curl_utils.h"
-#include "xml_utils.h"
 #include "external/cl_options.h"
 
-void removeObject(std::string target, const s3tools::CredentialCollection& credentials, const std::string& caBundlePath){
+struct optionsType{
+	///The number of listing requests, and of deletion requests for each
+	///bucket, to make at once
+	unsigned long jobs;
+	///Whether to remove all objects under each target, rather than the
+	///object it names
+	bool recursive;
+	///Whether to only print the objects which would be removed
+	bool dryRun;
+	///Whether to report the numbers of objects listed and removed as they go
+	bool progress;
+};
+
+///Counts the objects listed and deleted, and reports them to stderr, at most
+///once a second, if requested
+class Progress{
+public:
+	explicit Progress(bool enabled):enabled(enabled),listed(0),deleted(0),failed(0),
+	lastReport(std::chrono::steady_clock::now()){}
+
+	///Note the totals for a deleter which is still working
+	void update(std::size_t listedNow, const s3tools::BatchDeleter* deleter){
+		if(!enabled)
+			return;
+		auto now=std::chrono::steady_clock::now();
+		if(now-lastReport<std::chrono::seconds(1))
+			return;
+		lastReport=now;
+		report(listed+listedNow,deleted+(deleter ? deleter->deleted() : 0),failed+(deleter ? deleter->failed() : 0),'\r');
+	}
+	///Add the totals for a target which has been finished
+	void add(std::size_t listedNow, std::size_t deletedNow, std::size_t failedNow){
+		listed+=listedNow;
+		deleted+=deletedNow;
+		failed+=failedNow;
+	}
+	void finish(){
+		if(enabled)
+			report(listed,deleted,failed,'\n');
+	}
+
+private:
+	bool enabled;
+	std::size_t listed, deleted, failed;
+	std::chrono::steady_clock::time_point lastReport;
+
+	void report(std::size_t listed, std::size_t deleted, std::size_t failed, char end){
+		std::cerr << "\rListed " << listed << ", removed " << deleted;
+		if(failed)
+			std::cerr << ", failed " << failed;
+		std::cerr << end << std::flush;
+	}
+};
+
+///Report an object which could not be deleted
+///\param url the URL of the object
+void printDeleteError(const std::string& url, const s3tools::DeleteError& error){
+	std::cerr << "Error: " << url << ": "
+	          << (error.code.empty() ? "" : error.code+": ") << error.message << std::endl;
+}
+
+///Remove every object under a prefix. The objects are passed to deletion
+///requests as they are listed, so only a few pages of keys are held at once.
+///\return whether all of the objects were removed
+bool removeRecursive(const std::string& target, const s3tools::CredentialCollection& credentials,
+                     const optionsType& options, CurlSession& session, Progress& progress){
 	auto cred=findCredentials(credentials,target).second;
-	s3tools::URL signedURL=s3tools::genURL(cred.username,cred.key,"DELETE",target,60);
-	
-	std::string resultData;
-	std::unique_ptr<CURL,void (*)(CURL*)> curlSession(curl_easy_init(),curl_easy_cleanup);
-	CURLcode err;
-	std::unique_ptr<char[]> errBuf(new char[CURL_ERROR_SIZE]);
-	errBuf[0]=0;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_ERRORBUFFER, errBuf.get());
-	if(err!=CURLE_OK)
-		std::cerr << "Failed to set curl error buffer" << std::endl;
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_URL, signedURL.str().c_str());
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl URL option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_CUSTOMREQUEST, "DELETE");
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl DELETE option",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, collectOutput);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback",err,errBuf.get());
-	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEDATA, &resultData);
-	if(err!=CURLE_OK)
-		reportCurlError("Failed to set curl output callback data",err,errBuf.get());
-#ifdef USE_CURLOPT_CAINFO
-	if(!caBundlePath.empty()){
-		err=curl_easy_setopt(curlSession.get(), CURLOPT_CAINFO, caBundlePath.c_str());
-		if(err!=CURLE_OK)
-			reportCurlError("Failed to set curl CA bundle path",err,errBuf.get());
+	s3tools::URL bucket=s3tools::listObjectsURL(target,"");
+	bucket.query.clear();
+	const std::string bucketURL=bucket.str();
+	bool success=true;
+	std::unique_ptr<s3tools::BatchDeleter> deleter;
+	if(!options.dryRun){
+		deleter.reset(new s3tools::BatchDeleter(session.engine(),cred,bucket,options.jobs,
+		  [&](const s3tools::DeleteError& error){
+			printDeleteError(bucketURL+'/'+error.key,error);
+			success=false;
+		}));
+	}
+	s3tools::ObjectLister lister(session.engine(),cred,target,options.jobs);
+	s3tools::ObjectInfo object;
+	std::size_t listed=0;
+	try{
+		while(lister.next(object)){
+			listed++;
+			if(deleter)
+				deleter->remove(object.key);
+			else
+				std::cout << bucketURL << '/' << object.key << '\n';
+			progress.update(listed,deleter.get());
+		}
+	}catch(s3tools::S3Error& err){
+		std::cout.flush();
+		std::cerr << "Error: " << target << ": " << err.code() << ": " << err.message() << std::endl;
+		success=false;
 	}
-#endif
-	err=curl_easy_perform(curlSession.get());
-	if(err!=CURLE_OK)
-		reportCurlError("curl perform DELETE failed",err,errBuf.get());
-	
-	if(!resultData.empty())
-		handleXMLRepsonse(resultData,
-		                  {},
-		                  {{"NoSuchKey",[&](std::string){std::cerr << "Error: "+target+" does not exist.\n";}}}
-		                  );
+	//objects already listed are still removed
+	if(deleter)
+		deleter->finish();
+	std::cout.flush();
+	progress.add(listed,deleter ? deleter->deleted() : 0,deleter ? deleter->failed() : 0);
+	return(success);
 }
 
 int main(int argc, char* argv[]){
 	std::string usage=
 R"(NAME
  s3rm - remove files from an S3 server
-	
+
 USAGE
- s3rm url [additional urls...]
-    Erase each listed url from its respective server. 
-	
+ s3rm [-j jobs] [--dry-run] [--progress] [--http2] [--trace-file path]
+      url [additional urls...]
+    Erase each listed url from its respective server.
+ s3rm -r [-j jobs] [--dry-run] [--progress] [--http2] [--trace-file path]
+      url [additional urls...]
+    Erase every object under each url, which names a bucket and optionally a
+    prefix.
+
 NOTES
- Currently a separate request is made for each erasure. 
+ The objects are grouped by bucket, and deleted with DeleteObjects requests,
+ each of which erases up to 1000 objects. Objects which do not exist are
+ treated as having been erased, as S3 does.
+
+ With -r, the objects are deleted as they are listed, while the listing
+ continues, so that only a few thousand keys are held in memory however many
+ are removed.
 
 OPTIONS)";
-	
+
+	optionsType options;
+	options.jobs=4;
+	options.recursive=false;
+	options.dryRun=false;
+	options.progress=false;
+	s3tools::RequestEngine::Options engineOptions;
+	std::string tracePath;
 	OptionParser op;
 	op.setBaseUsage(usage);
+	op.addOption({"r","recursive"},[&]{options.recursive=true;},
+				 "Remove all objects under each url, rather than the object it names.");
+	op.addOption({"j","jobs"},options.jobs,
+				 "Have up to this many deletion requests, each for up to 1000 objects, in\n"
+				 "progress at once for each bucket (default 4). With -r, also divide the\n"
+				 "listing into ranges of keys and list up to this many at once.","jobs");
+	op.addOption("dry-run",[&]{options.dryRun=true;},
+				 "Print the urls of the objects which would be removed, without removing\n"
+				 "them.");
+	op.addOption("progress",[&]{options.progress=true;},
+				 "Report the numbers of objects listed and removed to stderr as they change.");
+	op.addOption("http2",[&]{engineOptions.http2=true;},
+				 "Use HTTP/2, multiplexing concurrent requests over shared connections.");
+	op.addOption("trace-file",tracePath,
+				 "Write the timing of each request to this file, as JSON lines, and print a\n"
+				 "summary of request latencies and throughput on exit.","path");
 	op.allowsOptionTerminator(true);
 	auto arguments=op.parseArgs(argc,argv);
-	
+
 	if(op.didPrintUsage())
 		return(0);
 	if(arguments.size()<2){
@@ -79,21 +176,59 @@ OPTIONS)";
 	}
 	//ignore the program name
 	arguments.erase(arguments.begin());
-	
+
 	auto credentials=s3tools::fetchStoredCredentials();
-	
-	std::string caBundlePath
-#ifdef USE_CURLOPT_CAINFO
-	=detectCABundlePath()
-#endif
-	;
-	
-	for(const std::string& target : arguments){
-		try{
-			removeObject(target,credentials,caBundlePath);
-		}catch(std::runtime_error& ex){
-			std::cerr << "Error: " << ex.what() << std::endl;
-			return(1);
+
+	std::unique_ptr<CurlSession> session;
+	try{
+		session.reset(new CurlSession(credentials,engineOptions,tracePath));
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return(1);
+	}
+
+	bool success=true;
+	Progress progress(options.progress);
+	if(options.recursive){
+		for(const std::string& target : arguments){
+			try{
+				success&=removeRecursive(target,credentials,options,*session,progress);
+			}catch(std::exception& ex){
+				std::cerr << "Error: " << ex.what() << std::endl;
+				success=false;
+			}
 		}
+		progress.finish();
+		return(success ? 0 : 1);
+	}
+
+	//a target which does not name an object is reported, but does not stop
+	//the others from being removed
+	std::size_t failed=0;
+	auto buckets=s3tools::groupByBucket(arguments,[&](const std::string& target){
+		std::cerr << "Error: " << target << " does not name an object" << std::endl;
+		failed++;
+	});
+	if(options.dryRun){
+		for(const auto& bucket : buckets){
+			for(const auto& key : bucket.keys)
+				std::cout << bucket.bucket.str() << '/' << key << '\n';
+		}
+		return(failed==0 ? 0 : 1);
+	}
+	std::size_t deleted=0;
+	try{
+		deleted=session->client().remove(buckets,
+		  [&](const std::string& url, const s3tools::DeleteError& error){
+			printDeleteError(url,error);
+			failed++;
+		},options.jobs);
+	}catch(std::exception& ex){
+		std::cerr << "Error: " << ex.what() << std::endl;
+		success=false;
 	}
+	progress.add(0,deleted,failed);
+	success&=(failed==0);
+	progress.finish();
+	return(success ? 0 : 1);
 }
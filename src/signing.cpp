@@ -18,9 +18,12 @@ namespace s3tools{
 std::string get_timestamp(){
 	std::chrono::system_clock::time_point cur_time=std::chrono::system_clock::now();
 	time_t cur_time_tt=std::chrono::system_clock::to_time_t(cur_time);
-	struct tm* cur_time_tm=gmtime(&cur_time_tt);
+	//requests may be signed on several threads at once, so gmtime's shared
+	//result cannot be used
+	struct tm cur_time_tm;
+	gmtime_r(&cur_time_tt,&cur_time_tm);
 	std::string cur_time_s(32,'\0');
-	size_t len=strftime(&cur_time_s[0], 32, "%Y%m%dT%H%M%SZ",cur_time_tm);
+	size_t len=strftime(&cur_time_s[0], 32, "%Y%m%dT%H%M%SZ",&cur_time_tm);
 	cur_time_s.resize(len);
 	return(cur_time_s);
 }
@@ -14,13 +14,14 @@ std::string lowercase(std::string s){
 std::string urlencode(const std::string& in, bool allowSlash){
 	std::ostringstream out;
 	out << std::uppercase << std::hex << std::setfill('0');
-	for(char c : in){
-		if(c=='/' && !allowSlash)
-			out << '%' << std::setw(2) << (int)c;
-		else if(c<'*' || c=='+' || c==',' || (c>=':' && c<='@') || (c>='[' && c<='^') || c=='`' || c>'z')
-			out << '%' << std::setw(2) << (int)c;
-		else
+	//only the unreserved characters of RFC 3986 are left as they are, as
+	//Signature Version 4 requires
+	for(unsigned char c : in){
+		if((c>='A' && c<='Z') || (c>='a' && c<='z') || (c>='0' && c<='9')
+		   || c=='-' || c=='.' || c=='_' || c=='~' || (c=='/' && allowSlash))
 			out << c;
+		else
+			out << '%' << std::setw(2) << (unsigned int)c;
 	}
 	return(out.str());
 }
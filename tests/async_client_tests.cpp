@@ -0,0 +1,159 @@
+#include <s3tools/async_client.h>
+#include <cassert>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "loopback_server.h"
+
+std::string percentDecode(const std::string& s){
+	std::string result;
+	for(std::size_t i=0; i<s.size(); i++){
+		if(s[i]=='%' && i+2<s.size()){
+			result+=(char)std::stoi(s.substr(i+1,2),nullptr,16);
+			i+=2;
+		}
+		else
+			result+=s[i];
+	}
+	return(result);
+}
+
+///A tiny in-memory object store, which lists at most two keys per page
+struct FakeStore{
+	std::mutex lock;
+	std::map<std::string,std::string> objects;
+
+	std::string operator()(const std::string& head, const std::string& body){
+		std::string verb=head.substr(0,head.find(' '));
+		std::string target=head.substr(verb.size()+1,head.find(' ',verb.size()+1)-verb.size()-1);
+		s3tools::URL url("http://localhost"+target);
+		std::lock_guard<std::mutex> guard(lock);
+		if(url.query.count("list-type")){
+			const std::string prefix=url.path.substr(1)+"/"+percentDecode(url.query["prefix"]);
+			std::size_t skip=url.query.count("continuation-token")?std::stoul(url.query["continuation-token"]):0;
+			std::string result="<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ListBucketResult>";
+			std::size_t index=0, listed=0;
+			bool truncated=false;
+			for(const auto& object : objects){
+				if(object.first.compare(0,prefix.size(),prefix)!=0)
+					continue;
+				if(index++<skip)
+					continue;
+				if(listed==2){
+					truncated=true;
+					break;
+				}
+				std::string key=object.first.substr(object.first.find('/')+1);
+				result+="<Contents><Key>"+key+"</Key><Size>"+std::to_string(object.second.size())+"</Size></Contents>";
+				listed++;
+			}
+			result+=std::string("<IsTruncated>")+(truncated?"true":"false")+"</IsTruncated>";
+			if(truncated)
+				result+="<NextContinuationToken>"+std::to_string(skip+listed)+"</NextContinuationToken>";
+			result+="</ListBucketResult>";
+			return(LoopbackServer::response(200,result));
+		}
+		std::string key=url.path.substr(1);
+		if(verb=="PUT"){
+			objects[key]=body;
+			return(LoopbackServer::response(200,""));
+		}
+		auto it=objects.find(key);
+		if(it==objects.end())
+			return(LoopbackServer::response(404,"<Error><Code>NoSuchKey</Code><Message>The specified key does not exist.</Message></Error>"));
+		if(verb=="DELETE"){
+			objects.erase(it);
+			return(LoopbackServer::response(204,""));
+		}
+		return(LoopbackServer::response(200,it->second,"ETag: \"abc\"\r\n"));
+	}
+};
+
+using namespace s3tools;
+
+Task<std::vector<std::string>> listAll(AsyncClient& client, std::string url){
+	std::vector<std::string> keys;
+	auto pages=client.list(url);
+	while(co_await pages.next()){
+		for(const auto& object : pages.value().objects)
+			keys.push_back(object.key);
+	}
+	co_return keys;
+}
+
+Task<void> roundTrip(AsyncClient& client, std::string url, unsigned int& completed){
+	co_await client.put(url,"data for "+url);
+	std::string contents=co_await client.get(url);
+	assert(contents=="data for "+url);
+	completed++;
+}
+
+Task<void> throwNonStandard(bool& started){
+	started=true;
+	throw 7;
+	co_return;
+}
+
+int main(){
+	{ //exceptions not derived from std::exception escaping spawned tasks are
+	  //reported, not fatal
+		bool started=false;
+		spawn(throwNonStandard(started));
+		assert(started);
+	}
+	FakeStore store;
+	LoopbackServer server(std::ref(store));
+	CredentialCollection credentials{{server.url(""),credential{"user","secret",{}}}};
+
+	{ //basic operations, driven by the waiting thread
+		RequestEngine engine;
+		AsyncClient client(engine,credentials);
+		syncWait(engine,client.put(server.url("/bucket/a"),"some data"));
+		assert(store.objects["bucket/a"]=="some data");
+		assert(syncWait(engine,client.get(server.url("/bucket/a")))=="some data");
+		ObjectInfo info=syncWait(engine,client.head(server.url("/bucket/a")));
+		assert(info.key=="a" && info.size==9);
+		assert(info.etag=="\"abc\"");
+		syncWait(engine,client.remove(server.url("/bucket/a")));
+		assert(store.objects.empty());
+		//errors reported by the server are rethrown to the awaiter
+		try{
+			syncWait(engine,client.get(server.url("/bucket/a")));
+			assert(false && "Fetching a missing object should fail");
+		}catch(S3Error& err){
+			assert(err.status()==404);
+			assert(err.code()=="NoSuchKey");
+		}
+	}
+	{ //many interleaved operations on one engine thread, and paged listing
+		RequestEngine engine;
+		engine.start();
+		AsyncClient client(engine,credentials);
+		const unsigned int nObjects=200;
+		unsigned int completed=0;
+		for(unsigned int i=0; i<nObjects; i++)
+			spawn(roundTrip(client,server.url("/bucket/dir/obj"+std::to_string(1000+i)),completed));
+		engine.run();
+		assert(completed==nObjects);
+		std::vector<std::string> keys=syncWait(engine,listAll(client,server.url("/bucket/dir/")));
+		assert(keys.size()==nObjects);
+		for(unsigned int i=0; i<nObjects; i++)
+			assert(keys[i]=="dir/obj"+std::to_string(1000+i));
+		engine.stop();
+	}
+	{ //listing pages parse correctly
+		ListPage page=parseListPage("<ListBucketResult><CommonPrefixes><Prefix>a/</Prefix></CommonPrefixes>"
+		                            "<Contents><Key>b</Key><Size>12</Size><ETag>x</ETag></Contents>"
+		                            "<IsTruncated>true</IsTruncated><NextContinuationToken>t</NextContinuationToken></ListBucketResult>");
+		assert(page.commonPrefixes==std::vector<std::string>{"a/"});
+		assert(page.objects.size()==1 && page.objects[0].key=="b" && page.objects[0].size==12);
+		assert(page.truncated && page.nextContinuationToken=="t");
+		URL url=listObjectsURL("http://host/bucket/some/prefix");
+		assert(url.path=="/bucket");
+		assert(url.query["prefix"]=="some/prefix");
+		assert(url.query["delimiter"]=="/");
+	}
+}
@@ -0,0 +1,202 @@
+#include <s3tools/client.h>
+#include <cassert>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mock_s3.h"
+
+using namespace s3tools;
+
+const credential cred{"tester","secret",{}};
+
+///Read the whole of a file, or return "<missing>" if it cannot be opened
+std::string readFile(const std::string& path){
+	std::ifstream file(path,std::ios::binary);
+	if(!file)
+		return("<missing>");
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	return(contents.str());
+}
+
+int main(){
+	MockS3Server::Options options;
+	options.credentials[cred.username]=cred.key;
+	options.maxKeys=10;
+	MockS3Server server(options);
+	server.createBucket("bucket");
+	Client client(CredentialCollection{{server.url(""),cred}});
+	const std::string bucket=server.url("/bucket");
+
+	{ //objects can be stored and fetched
+		client.put(bucket+"/a","some data");
+		assert(server.getObject("bucket","a")=="some data");
+		assert(client.get(bucket+"/a")=="some data");
+		std::istringstream in("streamed data, partly");
+		client.put(bucket+"/b",in,13);
+		assert(server.getObject("bucket","b")=="streamed data");
+		std::ostringstream out;
+		client.get(bucket+"/b",out);
+		assert(out.str()=="streamed data");
+		ObjectInfo info=client.head(bucket+"/b");
+		assert(info.key=="b" && info.size==13 && !info.etag.empty());
+		//keys with characters which must be encoded for signing
+		const std::string oddKey="odd key*~caf\xC3\xA9";
+		client.put(bucket+"/"+oddKey,"odd");
+		assert(server.getObject("bucket",oddKey)=="odd");
+		client.remove(bucket+"/"+oddKey);
+	}
+	{ //errors are reported by the server's code, and not written as data
+		bool threw=false;
+		std::ostringstream out;
+		try{
+			client.get(bucket+"/missing",out);
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchKey");
+		}
+		assert(threw);
+		assert(out.str().empty());
+		threw=false;
+		try{
+			client.put(server.url("/no-such-bucket/a"),"data");
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchBucket");
+		}
+		assert(threw);
+		threw=false;
+		try{
+			client.get("https://unknown.example.com/bucket/a");
+		}catch(S3Error&){
+			assert(false);
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+	}
+	{ //files
+		char dirTemplate[]="/tmp/s3tools_client_tests_XXXXXX";
+		const std::string dir=mkdtemp(dirTemplate);
+		const std::string path=dir+"/file";
+		std::ofstream(path,std::ios::binary) << "file contents";
+		client.putFile(bucket+"/file",path);
+		assert(server.getObject("bucket","file")=="file contents");
+		const std::string copyPath=dir+"/copy";
+		client.getFile(bucket+"/file",copyPath);
+		assert(readFile(copyPath)=="file contents");
+		//a failed download leaves no file behind
+		const std::string failedPath=dir+"/failed";
+		bool threw=false;
+		try{
+			client.getFile(bucket+"/missing",failedPath);
+		}catch(S3Error&){
+			threw=true;
+		}
+		assert(threw);
+		assert(readFile(failedPath)=="<missing>");
+		unlink(path.c_str());
+		unlink(copyPath.c_str());
+		rmdir(dir.c_str());
+	}
+	{ //copies
+		client.copy(bucket+"/a",bucket+"/a-copy");
+		assert(server.getObject("bucket","a-copy")=="some data");
+		bool threw=false;
+		try{
+			client.copy(bucket+"/missing",bucket+"/other");
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchKey");
+		}
+		assert(threw);
+		assert(!server.hasObject("bucket","other"));
+	}
+
+	server.createBucket("listed");
+	char name[32];
+	for(unsigned int i=0; i<25; i++){
+		snprintf(name,sizeof(name),"dir/obj%02u",i);
+		server.putObject("listed",name,"x");
+	}
+	for(unsigned int i=0; i<12; i++){
+		snprintf(name,sizeof(name),"sub%02u/obj",i);
+		server.putObject("listed",name,"xy");
+	}
+	server.putObject("listed","top","xyz");
+	{ //listings grouped by prefix span pages
+		std::vector<std::string> objects, prefixes;
+		Listing listing=client.list(server.url("/listed"));
+		for(const ListEntry& entry : listing)
+			(entry.isPrefix ? prefixes : objects).push_back(entry.object.key);
+		assert(objects==std::vector<std::string>({"top"}));
+		assert(prefixes.size()==13 && prefixes.front()=="dir/" && prefixes.back()=="sub11/");
+		assert(listing.requests()==2);
+
+		Listing under=client.list(server.url("/listed/dir/"));
+		ListEntry entry;
+		std::size_t count=0;
+		while(under.next(entry)){
+			assert(!entry.isPrefix && entry.object.key.compare(0,4,"dir/")==0 && entry.object.size==1);
+			count++;
+		}
+		assert(count==25);
+		assert(under.requests()==3);
+	}
+	{ //recursive listings include every key
+		std::size_t count=0;
+		std::uint64_t size=0;
+		for(const ListEntry& entry : client.list(server.url("/listed"),true,4)){
+			assert(!entry.isPrefix);
+			count++;
+			size+=entry.object.size;
+		}
+		assert(count==38);
+		assert(size==25+24+3);
+	}
+	{ //listing errors
+		bool threw=false;
+		try{
+			Listing listing=client.list(server.url("/no-such-bucket"));
+			listing.begin();
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchBucket");
+		}
+		assert(threw);
+	}
+	{ //removals
+		client.remove(bucket+"/a-copy");
+		assert(!server.hasObject("bucket","a-copy"));
+		server.protectObject("listed","dir/obj07");
+		std::vector<std::string> urls;
+		for(unsigned int i=0; i<25; i++){
+			snprintf(name,sizeof(name),"/listed/dir/obj%02u",i);
+			urls.push_back(server.url(name));
+		}
+		urls.push_back(bucket+"/a");
+		urls.push_back(bucket+"/b");
+		std::vector<std::string> failures;
+		std::size_t deleted=client.remove(urls,[&](const std::string& url, const DeleteError& error){
+			assert(error.code=="AccessDenied");
+			failures.push_back(url);
+		});
+		assert(deleted==26);
+		assert(failures==std::vector<std::string>({server.url("/listed/dir/obj07")}));
+		assert(server.operationCount("DeleteObjects")==2);
+		assert(server.keys("bucket")==std::vector<std::string>({"file"}));
+		bool threw=false;
+		try{
+			client.remove({bucket},nullptr);
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+	}
+}
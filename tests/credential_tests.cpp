@@ -0,0 +1,172 @@
+#include <s3tools/cred_manage.h>
+#include <cassert>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace s3tools;
+
+///Write a credential file, dated far enough in the past that its contents
+///may be cached
+void writeCredentials(const std::string& path, const CredentialCollection& credentials, long age){
+	std::ofstream file(path);
+	exportCredentials(file,credentials);
+	file.close();
+	chmod(path.c_str(),0600);
+	struct timeval times[2];
+	gettimeofday(&times[0],nullptr);
+	times[0].tv_sec-=age;
+	times[1]=times[0];
+	utimes(path.c_str(),times);
+}
+
+///Get a file's mode bits, or -1 if it does not exist
+int fileMode(const std::string& path){
+	struct stat data;
+	if(stat(path.c_str(),&data)!=0)
+		return(-1);
+	return(data.st_mode&0777);
+}
+
+int main(){
+	{ //longest prefix lookups
+		CredentialCollection credentials{
+			{"https://a.com",credential{"a","1",{}}},
+			{"https://a.com/bucket",credential{"b","2",{}}},
+			{"https://a.com/bucket/deep",credential{"c","3",{}}},
+			{"https://b.com",credential{"d","4",{}}},
+			{"",credential{"e","5",{}}},
+		};
+		CredentialIndex index(credentials);
+		assert(index.size()==4);
+		assert(findCredentials(index,"https://a.com/bucket/deep/x").first=="https://a.com/bucket/deep");
+		assert(findCredentials(index,"https://a.com/bucket/de").first=="https://a.com/bucket");
+		assert(findCredentials(index,"https://a.com/bucketx").first=="https://a.com/bucket");
+		assert(findCredentials(index,"https://a.com/buck").first=="https://a.com");
+		assert(findCredentials(index,"https://b.com/bucket").second.username=="d");
+		assert(index.find("https://c.com")==nullptr);
+		assert(index.find("https://a.co")==nullptr);
+		assert(index.find("")==nullptr);
+		bool threw=false;
+		try{
+			findCredentials(index,"http://a.com");
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+		assert(CredentialIndex().find("https://a.com")==nullptr);
+	}
+	{ //the index agrees with a search of every credential
+		std::mt19937 rng(17);
+		auto randomURL=[&](std::size_t maxLength){
+			std::string url="h";
+			std::size_t length=rng()%maxLength;
+			for(std::size_t i=0; i<length; i++)
+				url+="ab/"[rng()%3];
+			return(url);
+		};
+		CredentialCollection credentials;
+		for(unsigned int i=0; i<200; i++)
+			credentials.emplace(randomURL(8),credential{std::to_string(i),"key",{}});
+		CredentialIndex index(credentials);
+		for(unsigned int i=0; i<5000; i++){
+			std::string url=randomURL(12);
+			const CredentialIndex::Entry* entry=index.find(url);
+			try{
+				auto expected=findCredentials(credentials,url);
+				assert(entry && entry->first==expected.first);
+			}catch(std::runtime_error&){
+				assert(!entry);
+			}
+		}
+	}
+
+	char dirTemplate[]="/tmp/s3tools_credential_tests_XXXXXX";
+	const std::string dir=mkdtemp(dirTemplate);
+	const std::string path=dir+"/credentials";
+	const std::string otherPath=dir+"/other_credentials";
+	const std::string cachePath=path+".cache";
+	setenv("S3_CRED_PATH",path.c_str(),1);
+	const CredentialCollection original{
+		{"https://a.com",credential{"a","1",{"https://a1.com","https://a2.com"}}},
+		{"https://b.com",credential{"b","2",{}}},
+	};
+	const CredentialCollection other{{"https://c.com",credential{"c","3",{}}}};
+	writeCredentials(otherPath,other,60);
+	//switching files forces the next read of the first file to go beyond the
+	//copy kept in memory
+	auto fetchAgain=[&]{
+		setenv("S3_CRED_PATH",otherPath.c_str(),1);
+		auto credentials=fetchStoredCredentials();
+		assert(credentials.size()==1 && credentials.count("https://c.com"));
+		setenv("S3_CRED_PATH",path.c_str(),1);
+		return(fetchStoredCredentials());
+	};
+	auto matches=[](const CredentialCollection& a, const CredentialCollection& b){
+		if(a.size()!=b.size())
+			return(false);
+		for(const auto& record : a){
+			auto it=b.find(record.first);
+			if(it==b.end() || it->second.username!=record.second.username
+			   || it->second.key!=record.second.key || it->second.endpoints!=record.second.endpoints)
+				return(false);
+		}
+		return(true);
+	};
+
+	{ //a file which has just been written is not cached
+		writeCredentials(path,original,0);
+		assert(matches(fetchStoredCredentials(),original));
+		assert(fileMode(cachePath)==-1);
+	}
+	{ //an older file is cached, privately, and the cache is used
+		writeCredentials(path,original,60);
+		assert(matches(fetchStoredCredentials(),original));
+		assert(fileMode(cachePath)==0600);
+		assert(matches(fetchAgain(),original));
+		assert(matches(fetchStoredCredentials(),original));
+	}
+	{ //a changed file replaces the cache
+		CredentialCollection changed=original;
+		changed["https://d.com"]=credential{"d","4",{}};
+		writeCredentials(path,changed,30);
+		assert(matches(fetchStoredCredentials(),changed));
+		assert(matches(fetchAgain(),changed));
+		writeCredentials(path,original,60);
+		assert(matches(fetchAgain(),original));
+	}
+	{ //a damaged cache is ignored and rewritten
+		std::string contents;
+		{
+			std::ifstream cache(cachePath,std::ios::binary);
+			contents.assign(std::istreambuf_iterator<char>(cache),std::istreambuf_iterator<char>());
+		}
+		assert(contents.size()>32);
+		for(std::size_t cut : {contents.size()/2,std::size_t(9)}){
+			std::string damaged=contents;
+			damaged[cut]^=1;
+			std::ofstream(cachePath,std::ios::binary) << damaged;
+			assert(matches(fetchAgain(),original));
+			std::ofstream(cachePath,std::ios::binary) << contents.substr(0,cut);
+			assert(matches(fetchAgain(),original));
+		}
+		std::ofstream(cachePath,std::ios::binary) << contents;
+		chmod(cachePath.c_str(),0644);
+		assert(matches(fetchAgain(),original));
+		assert(fileMode(cachePath)==0600);
+	}
+
+	unlink(path.c_str());
+	unlink(cachePath.c_str());
+	unlink(otherPath.c_str());
+	unlink((otherPath+".cache").c_str());
+	rmdir(dir.c_str());
+}
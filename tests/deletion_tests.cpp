@@ -0,0 +1,106 @@
+#include <s3tools/deletion.h>
+#include <cassert>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mock_s3.h"
+
+using namespace s3tools;
+
+const credential cred{"tester","secret",{}};
+
+int main(){
+	{ //request bodies
+		assert(deleteObjectsBody({"a","b/c"})=="<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Delete><Quiet>true</Quiet>"
+		       "<Object><Key>a</Key></Object><Object><Key>b/c</Key></Object></Delete>");
+		std::string body=deleteObjectsBody({"<f&g>","'q\""});
+		assert(body.find("<Key>&lt;f&amp;g&gt;</Key>")!=std::string::npos);
+		assert(body.find("<Key>&apos;q&quot;</Key>")!=std::string::npos);
+	}
+	{ //objects are grouped by bucket, in the order in which the buckets are named
+		std::vector<std::string> invalid;
+		auto buckets=groupByBucket({"https://h/b1/x","https://h/b2/y/z","https://h/b1/w","https://h/b3",
+		                            "https://h/b3/"},
+		                           [&](const std::string& url){ invalid.push_back(url); });
+		assert(buckets.size()==2);
+		assert(buckets[0].bucket.str()=="https://h/b1" && buckets[0].keys==std::vector<std::string>({"x","w"}));
+		assert(buckets[1].bucket.str()=="https://h/b2" && buckets[1].keys==std::vector<std::string>({"y/z"}));
+		assert(invalid==std::vector<std::string>({"https://h/b3","https://h/b3/"}));
+		bool threw=false;
+		try{
+			groupByBucket({"https://h/b1/x","https://h/b3"});
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+	}
+	{ //responses
+		auto errors=parseDeleteResult("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<DeleteResult>"
+		  "<Deleted><Key>a</Key></Deleted><Error><Key>b&amp;c</Key><Code>AccessDenied</Code>"
+		  "<Message>Access Denied</Message></Error></DeleteResult>");
+		assert(errors.size()==1);
+		assert(errors[0].key=="b&c" && errors[0].code=="AccessDenied" && errors[0].message=="Access Denied");
+		assert(parseDeleteResult("<DeleteResult/>").empty());
+		bool threw=false;
+		try{
+			parseDeleteResult("<Error><Code>InternalError</Code><Message>Oops</Message></Error>");
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="InternalError");
+		}
+		assert(threw);
+	}
+
+	MockS3Server::Options options;
+	options.credentials[cred.username]=cred.key;
+	MockS3Server server(options);
+	server.createBucket("bucket");
+	RequestEngine engine;
+
+	{ //objects are deleted in batches, and those which cannot be are reported
+		std::vector<std::string> keys;
+		char name[32];
+		for(unsigned int i=0; i<2500; i++){
+			snprintf(name,sizeof(name),"obj%05u",i);
+			keys.push_back(name);
+			server.putObject("bucket",name,"data");
+		}
+		keys.push_back("f&g <h>");
+		server.putObject("bucket",keys.back(),"data");
+		keys.push_back("missing");
+		server.putObject("bucket","kept","data");
+		server.protectObject("bucket","obj01234");
+
+		std::vector<DeleteError> errors;
+		BatchDeleter deleter(engine,cred,URL(server.url("/bucket")),3,
+		                     [&](const DeleteError& error){ errors.push_back(error); });
+		for(const auto& key : keys)
+			deleter.remove(key);
+		deleter.finish();
+		assert(server.operationCount("DeleteObjects")==3);
+		assert(deleter.requests()==3);
+		assert(deleter.deleted()==keys.size()-1);
+		assert(deleter.failed()==1);
+		assert(errors.size()==1 && errors[0].key=="obj01234" && errors[0].code=="AccessDenied");
+		assert(server.keys("bucket")==std::vector<std::string>({"kept","obj01234"}));
+	}
+	{ //failures of whole requests are reported for each object
+		std::vector<DeleteError> errors;
+		BatchDeleter deleter(engine,cred,URL(server.url("/no-such-bucket")),2,
+		                     [&](const DeleteError& error){ errors.push_back(error); },2);
+		for(const std::string key : {"a","b","c"})
+			deleter.remove(key);
+		deleter.finish();
+		assert(deleter.requests()==2 && deleter.deleted()==0 && deleter.failed()==3);
+		assert(errors.size()==3);
+		for(const auto& error : errors)
+			assert(error.code=="NoSuchBucket");
+	}
+	{ //deleting nothing makes no requests
+		BatchDeleter deleter(engine,cred,URL(server.url("/bucket")));
+		deleter.finish();
+		assert(deleter.requests()==0);
+	}
+}
@@ -0,0 +1,57 @@
+#include <s3tools/request_engine.h>
+#include <cassert>
+
+#include <string>
+
+#include "tls_server.h"
+
+using namespace s3tools;
+
+///Make a mixture of concurrent GET, PUT and DELETE requests
+///\return the number which succeeded
+unsigned int makeRequests(RequestEngine& engine, const TLSServer& server, unsigned int nRequests){
+	unsigned int completed=0;
+	for(unsigned int i=0; i<nRequests; i++){
+		HTTPRequest request(URL(server.url("/obj"+std::to_string(i))));
+		if(i%3==1){
+			request.url.verb="PUT";
+			request.body=std::string(100000,'x');
+		}
+		else if(i%3==2)
+			request.url.verb="DELETE";
+		engine.submit(request,[&](HTTPResponse response){
+			assert(response.complete());
+			assert(response.status==200);
+			assert(response.body=="hello");
+			completed++;
+		});
+	}
+	engine.run();
+	return(completed);
+}
+
+int main(){
+	const unsigned int nRequests=300;
+	{ //with HTTP/2, concurrent requests share a connection
+		TLSServer server("hello",std::chrono::milliseconds(20));
+		RequestEngine::Options options;
+		options.caBundlePath=server.caFile;
+		options.http2=true;
+		RequestEngine engine(options);
+		assert(makeRequests(engine,server,nRequests)==nRequests);
+		assert(server.requests==nRequests);
+		assert(server.connections==1);
+		assert(server.http2Connections==1);
+	}
+	{ //by default, each concurrent request needs its own HTTP/1.1 connection
+		TLSServer server("hello",std::chrono::milliseconds(20));
+		RequestEngine::Options options;
+		options.caBundlePath=server.caFile;
+		options.maxConcurrent=16;
+		RequestEngine engine(options);
+		assert(makeRequests(engine,server,nRequests)==nRequests);
+		assert(server.requests==nRequests);
+		assert(server.connections>1 && server.connections<=16);
+		assert(server.http2Connections==0);
+	}
+}
@@ -0,0 +1,269 @@
+#include <s3tools/index.h>
+#include <cassert>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mock_s3.h"
+
+using namespace s3tools;
+
+const credential cred{"tester","secret",{}};
+
+ObjectInfo makeObject(unsigned int i){
+	char key[32];
+	snprintf(key,sizeof(key),"dir%u/object%05u",i/500,i);
+	ObjectInfo object;
+	object.key=key;
+	object.size=(std::uint64_t)i*i*1000;
+	char time[32];
+	snprintf(time,sizeof(time),"2023-%02u-%02uT%02u:%02u:%02u.%03uZ",1+i%12,1+i%28,i%24,i%60,(i*7)%60,i%1000);
+	object.lastModified=time;
+	if(i%3==0)
+		object.etag="\"0123456789abcdef0123456789abcdef\"";
+	else if(i%3==1)
+		object.etag="\"fedcba9876543210fedcba9876543210-"+std::to_string(i)+"\"";
+	else if(i%5==0)
+		object.etag="W/\"other\"";
+	return(object);
+}
+
+bool sameObject(const ObjectInfo& a, const ObjectInfo& b){
+	return(a.key==b.key && a.size==b.size && a.lastModified==b.lastModified && a.etag==b.etag);
+}
+
+std::vector<ObjectInfo> readAll(const ListingIndex& index, const std::string& from=""){
+	std::vector<ObjectInfo> objects;
+	index.scan(from,[&](const ObjectInfo& object){
+		objects.push_back(object);
+		return(true);
+	});
+	return(objects);
+}
+
+std::vector<std::string> findKeys(const ListingIndex& index, const ListingIndex::Query& query){
+	std::vector<std::string> keys;
+	index.find(query,[&](const ObjectInfo& object){
+		keys.push_back(object.key);
+		return(true);
+	});
+	return(keys);
+}
+
+bool exists(const std::string& path){
+	return(access(path.c_str(),F_OK)==0);
+}
+
+int main(){
+	char dirTemplate[]="/tmp/s3tools_index_tests_XXXXXX";
+	const std::string dir=mkdtemp(dirTemplate);
+	const std::string path=dir+"/index";
+	const std::size_t count=2000;
+
+	{ //entries are stored exactly, and can be searched
+		IndexWriter writer(path,"http://example.com/bucket/");
+		assert(!writer.resumed());
+		for(unsigned int i=0; i<count; i++)
+			writer.add(makeObject(i));
+		bool threw=false;
+		try{
+			writer.add(makeObject(5));
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+		writer.finish();
+		assert(!exists(path+".partial"));
+
+		ListingIndex index(path);
+		assert(index.target()=="http://example.com/bucket/");
+		assert(index.size()==count);
+		assert(index.lastKey()==makeObject(count-1).key);
+		std::vector<ObjectInfo> objects=readAll(index);
+		assert(objects.size()==count);
+		for(unsigned int i=0; i<count; i++)
+			assert(sameObject(objects[i],makeObject(i)));
+		//starting part way through, at keys which are and are not present
+		assert(readAll(index,makeObject(700).key).front().key==makeObject(700).key);
+		assert(readAll(index,makeObject(700).key+"!").front().key==makeObject(701).key);
+		assert(readAll(index,"").size()==count);
+		assert(readAll(index,"zzz").empty());
+
+		ListingIndex::Query query;
+		query.prefix="dir1/";
+		auto keys=findKeys(index,query);
+		assert(keys.size()==500 && keys.front()=="dir1/object00500" && keys.back()=="dir1/object00999");
+		query.prefix="dir1/object006";
+		assert(findKeys(index,query).size()==100);
+		query.prefix="nothing";
+		assert(findKeys(index,query).empty());
+		query=ListingIndex::Query();
+		query.glob="dir2/*7";
+		keys=findKeys(index,query);
+		assert(keys.size()==50 && keys.front()=="dir2/object01007");
+		query.glob="*/object0001?";
+		assert(findKeys(index,query).size()==10);
+		query.glob="dir*";
+		assert(findKeys(index,query).empty());
+		query.glob="";
+		query.prefix="dir3/";
+		query.minSize=(std::uint64_t)1600*1600*1000;
+		query.maxSize=(std::uint64_t)1700*1700*1000;
+		keys=findKeys(index,query);
+		assert(keys.size()==101 && keys.front()=="dir3/object01600");
+
+		//visitors may stop early
+		std::size_t visited=0;
+		index.scan("",[&](const ObjectInfo&){ return(++visited<10); });
+		assert(visited==10);
+	}
+	{ //empty indices
+		IndexWriter writer(path,"http://example.com/empty/");
+		writer.finish();
+		ListingIndex index(path);
+		assert(index.size()==0 && index.lastKey().empty() && readAll(index).empty());
+	}
+	{ //interrupted indices are resumed from the last complete block
+		{
+			IndexWriter writer(path+"2","http://example.com/bucket/");
+			for(unsigned int i=0; i<200; i++)
+				writer.add(makeObject(i));
+			writer.checkpoint();
+		}
+		assert(exists(path+"2.partial") && !exists(path+"2"));
+		{
+			//but not for a different target
+			IndexWriter writer(path+"3","http://example.com/other/");
+			for(unsigned int i=0; i<200; i++)
+				writer.add(makeObject(i));
+		}
+		{
+			IndexWriter writer(path+"3","http://example.com/bucket/");
+			assert(!writer.resumed());
+		}
+		//a damaged block is discarded, along with those after it
+		{
+			std::fstream file(path+"2.partial",std::ios::in|std::ios::out|std::ios::binary);
+			file.seekg(0,std::ios::end);
+			std::size_t length=file.tellg();
+			file.seekp(length*3/4);
+			file.put('\xff');
+		}
+		IndexWriter writer(path+"2","http://example.com/bucket/");
+		assert(writer.resumed());
+		assert(writer.size()==128);
+		assert(writer.lastKey()==makeObject(127).key);
+		for(unsigned int i=128; i<300; i++)
+			writer.add(makeObject(i));
+		writer.finish();
+		ListingIndex index(path+"2");
+		std::vector<ObjectInfo> objects=readAll(index);
+		assert(objects.size()==300);
+		for(unsigned int i=0; i<300; i++)
+			assert(sameObject(objects[i],makeObject(i)));
+	}
+	{ //damaged and incomplete files are rejected
+		std::ofstream(path+"4") << "not an index";
+		bool threw=false;
+		try{
+			ListingIndex index(path+"4");
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+		threw=false;
+		try{
+			ListingIndex index(dir+"/missing");
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+	}
+	{ //indices of a server
+		MockS3Server::Options options;
+		options.credentials[cred.username]=cred.key;
+		options.maxKeys=50;
+		MockS3Server server(options);
+		server.createBucket("bucket");
+		for(unsigned int i=0; i<300; i++)
+			server.putObject("bucket",makeObject(i).key,std::string(i%7,'x'));
+		server.putObject("bucket","other","");
+		RequestEngine engine;
+		const std::string target=server.url("/bucket/dir");
+		const std::string serverIndex=dir+"/server";
+
+		assert(updateIndex(engine,cred,serverIndex,target,4,true)==300);
+		{
+			ListingIndex index(serverIndex);
+			assert(index.target()==target && index.size()==300);
+			std::vector<ObjectInfo> objects=readAll(index);
+			for(unsigned int i=0; i<300; i++){
+				assert(objects[i].key==makeObject(i).key);
+				assert(objects[i].size==i%7);
+				assert(objects[i].etag.size()==34 && !objects[i].lastModified.empty());
+			}
+		}
+
+		//updating lists only the objects after the last one
+		for(unsigned int i=300; i<420; i++)
+			server.putObject("bucket",makeObject(i).key,"");
+		unsigned int pagesBefore=server.operationCount("ListObjectsV2");
+		assert(updateIndex(engine,cred,serverIndex,target,1)==120);
+		assert(server.operationCount("ListObjectsV2")==pagesBefore+3);
+		{
+			ListingIndex index(serverIndex);
+			assert(index.size()==420);
+			std::vector<ObjectInfo> objects=readAll(index);
+			for(unsigned int i=0; i<420; i++)
+				assert(objects[i].key==makeObject(i).key);
+		}
+		assert(updateIndex(engine,cred,serverIndex,target,4)==0);
+		assert(ListingIndex(serverIndex).size()==420);
+
+		//an interrupted update is resumed
+		for(unsigned int i=420; i<600; i++)
+			server.putObject("bucket",makeObject(i).key,"");
+		{
+			IndexWriter writer(serverIndex,target,makeObject(419).key);
+			for(unsigned int i=420; i<500; i++)
+				writer.add(makeObject(i));
+		}
+		pagesBefore=server.operationCount("ListObjectsV2");
+		assert(updateIndex(engine,cred,serverIndex,target,1)==600-484);
+		assert(server.operationCount("ListObjectsV2")==pagesBefore+3);
+		{
+			ListingIndex index(serverIndex);
+			assert(index.size()==600);
+			std::vector<ObjectInfo> objects=readAll(index);
+			for(unsigned int i=0; i<600; i++)
+				assert(objects[i].key==makeObject(i).key);
+			//the entries written before the interruption are kept as they were
+			assert(sameObject(objects[450],makeObject(450)));
+		}
+
+		//deletions are only found by rebuilding
+		server.removeObject("bucket",makeObject(10).key);
+		assert(updateIndex(engine,cred,serverIndex,target,4)==0);
+		assert(ListingIndex(serverIndex).size()==600);
+		assert(updateIndex(engine,cred,serverIndex,target,4,true)==599);
+		assert(ListingIndex(serverIndex).size()==599);
+
+		bool threw=false;
+		try{
+			updateIndex(engine,cred,dir+"/bad",server.url("/missing/"),4,true);
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchBucket");
+		}
+		assert(threw);
+	}
+
+	std::system(("rm -rf "+dir).c_str());
+}
@@ -0,0 +1,379 @@
+#include <s3tools/listing.h>
+#include <cassert>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mock_s3.h"
+
+using namespace s3tools;
+
+const credential cred{"tester","secret",{}};
+
+std::vector<std::string> listAll(RequestEngine& engine, const std::string& target, std::size_t concurrency,
+                                 std::size_t* requests=nullptr){
+	ObjectLister lister(engine,cred,target,concurrency);
+	std::vector<std::string> keys;
+	ObjectInfo object;
+	while(lister.next(object)){
+		assert(object.size==object.key.size());
+		keys.push_back(object.key);
+	}
+	if(requests)
+		*requests=lister.requests();
+	return(keys);
+}
+
+void testListingTable(){
+	{ //entries are stored compactly but exactly
+		ListingTable table(true);
+		ObjectInfo object;
+		object.key="b/object";
+		object.size=12345678901234ULL;
+		object.lastModified="2023-06-10T12:34:56.789Z";
+		object.etag="\"0123456789abcdef0123456789abcdef\"";
+		table.add(object);
+		table.addPrefix("a/");
+		object.key="c";
+		object.size=0;
+		object.lastModified="1969-12-31T23:59:59.500Z";
+		object.etag="\"fedcba9876543210fedcba9876543210-17\"";
+		table.add(object);
+		object.key=std::string(0xFFFF,'k');
+		object.lastModified="not a time";
+		object.etag="W/\"something else\"";
+		table.add(object);
+		object.key="";
+		object.lastModified="2000-02-29T00:00:00Z";
+		object.etag="";
+		table.add(object);
+		assert(table.size()==5);
+
+		ObjectInfo result;
+		table.get(0,result);
+		assert(result.key=="b/object" && result.size==12345678901234ULL);
+		assert(result.lastModified=="2023-06-10T12:34:56.789Z");
+		assert(result.etag=="\"0123456789abcdef0123456789abcdef\"");
+		assert(table.isPrefix(1) && !table.isPrefix(0));
+		assert(table.key(1)=="a/" && table.etag(1).empty() && !table.hasTime(1));
+		table.get(2,result);
+		assert(result.key=="c" && result.size==0);
+		assert(result.lastModified=="1969-12-31T23:59:59.500Z");
+		assert(result.etag=="\"fedcba9876543210fedcba9876543210-17\"");
+		table.get(3,result);
+		assert(result.key.size()==0xFFFF && result.lastModified.empty());
+		assert(result.etag=="W/\"something else\"");
+		table.get(4,result);
+		assert(result.key.empty() && result.etag.empty());
+		assert(result.lastModified=="2000-02-29T00:00:00.000Z");
+
+		object.key=std::string(0x10000,'k');
+		bool threw=false;
+		try{
+			table.add(object);
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw && table.size()==5);
+	}
+	{ //sorting
+		ListingTable table;
+		auto add=[&](const std::string& key, std::uint64_t size, const std::string& time){
+			ObjectInfo object;
+			object.key=key;
+			object.size=size;
+			object.lastModified=time;
+			table.add(object);
+		};
+		add("b",30,"2023-01-02T00:00:00.000Z");
+		add("a",30,"2023-01-03T00:00:00.000Z");
+		table.addPrefix("ab/");
+		add("c",5,"2023-01-01T00:00:00.000Z");
+		add("aa",100,"2023-01-02T00:00:00.000Z");
+		auto keys=[&](ListingTable::Column column, bool descending){
+			std::string result;
+			for(std::uint32_t index : table.order(column,descending))
+				result+=table.key(index)+" ";
+			return(result);
+		};
+		assert(keys(ListingTable::Column::Name,false)=="a aa ab/ b c ");
+		assert(keys(ListingTable::Column::Name,true)=="c b ab/ aa a ");
+		//ties are broken by name
+		assert(keys(ListingTable::Column::Size,false)=="ab/ c a b aa ");
+		assert(keys(ListingTable::Column::Size,true)=="aa a b c ab/ ");
+		assert(keys(ListingTable::Column::Time,true)=="a aa b c ab/ ");
+	}
+	{ //keys spanning many blocks
+		ListingTable table;
+		ObjectInfo object;
+		for(unsigned int i=0; i<100000; i++){
+			object.key=std::to_string(i)+std::string(40,'x');
+			object.size=i;
+			table.add(object);
+		}
+		for(unsigned int i=0; i<100000; i+=997)
+			assert(table.key(i)==std::to_string(i)+std::string(40,'x') && table.objectSize(i)==i);
+		std::size_t length;
+		table.key(99999,length);
+		assert(length==45);
+		//allowing for the growth of the columns, and the unused end of the last block
+		assert(table.memoryUsage()<100000*(45+2*24)+(1<<20));
+	}
+}
+
+void testParsing(){
+	{ //incremental parsing of listings, independent of how the data is divided
+		const std::string xml="<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		  "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Name>bucket</Name>"
+		  "<IsTruncated>true</IsTruncated><NextContinuationToken>abc</NextContinuationToken>"
+		  "<Contents><Key> x &amp; y</Key><LastModified>2020-01-01T00:00:00.000Z</LastModified>"
+		  "<ETag>&quot;e&quot;</ETag><Size>12345678901</Size></Contents>"
+		  "<Contents><Key>z</Key><Size>0</Size></Contents>"
+		  "<CommonPrefixes><Prefix>p/</Prefix></CommonPrefixes></ListBucketResult>";
+		for(std::size_t chunk : {std::size_t(1),std::size_t(7),xml.size()}){
+			std::vector<ObjectInfo> objects;
+			std::vector<std::string> prefixes;
+			std::string token;
+			ListParser parser([&](const ObjectInfo& object){ objects.push_back(object); },
+			                  [&](const std::string& prefix){ prefixes.push_back(prefix); });
+			parser.onContinuationToken([&](const std::string& t){
+				//before any of the entries
+				assert(token.empty() && objects.empty());
+				token=t;
+			});
+			for(std::size_t i=0; i<xml.size(); i+=chunk){
+				parser.feed(xml.data()+i,std::min(chunk,xml.size()-i));
+				//each object is reported as soon as it is complete
+				if(i+chunk<xml.find("</Contents>"))
+					assert(objects.empty());
+				//as is the continuation token
+				if(i+chunk>=xml.find("</NextContinuationToken>")+24)
+					assert(token=="abc");
+			}
+			parser.finish();
+			assert(objects.size()==2);
+			assert(objects[0].key==" x & y" && objects[0].size==12345678901ULL);
+			assert(objects[0].etag=="\"e\"" && objects[0].lastModified=="2020-01-01T00:00:00.000Z");
+			assert(objects[1].key=="z" && objects[1].size==0 && objects[1].etag.empty());
+			assert((prefixes==std::vector<std::string>{"p/"}));
+			assert(parser.truncated() && parser.nextContinuationToken()=="abc");
+		}
+
+		auto ignoreObject=[](const ObjectInfo&){};
+		auto ignorePrefix=[](const std::string&){};
+		const std::string error="<Error><Code>NoSuchBucket</Code><Message>gone</Message></Error>";
+		ListParser failed(ignoreObject,ignorePrefix);
+		failed.feed(error.data(),error.size());
+		try{
+			failed.finish(404);
+			assert(false && "An error document should be reported");
+		}catch(S3Error& err){
+			assert(err.status()==404 && err.code()=="NoSuchBucket" && err.message()=="gone");
+		}
+
+		const std::string broken="<ListBucketResult><Contents></ListBucketResult>";
+		ListParser invalid(ignoreObject,ignorePrefix);
+		bool threw=false;
+		try{
+			invalid.feed(broken.data(),broken.size());
+			invalid.finish();
+		}catch(S3Error&){
+			assert(false && "Malformed data is not an S3 error");
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+
+		//sizes must be numbers
+		const std::string badSize="<ListBucketResult><Contents><Key>k</Key><Size>12a</Size></Contents></ListBucketResult>";
+		ListParser sized(ignoreObject,ignorePrefix);
+		threw=false;
+		try{
+			sized.feed(badSize.data(),badSize.size());
+		}catch(std::runtime_error& err){
+			threw=std::string(err.what()).find("'12a'")!=std::string::npos;
+		}
+		assert(threw);
+
+		//exceptions from the callbacks stop parsing and are passed on
+		ListParser rejecting([](const ObjectInfo&){ throw std::out_of_range("rejected"); },ignorePrefix);
+		threw=false;
+		try{
+			rejecting.feed(xml.data(),xml.size());
+		}catch(std::out_of_range&){
+			threw=true;
+		}
+		assert(threw);
+	}
+	{ //parsing of numeric and time fields
+		auto number=[](const std::string& text, std::uint64_t& value){
+			return(parseUnsigned(text.data(),text.data()+text.size(),value));
+		};
+		std::uint64_t value=7;
+		assert(number("0",value) && value==0);
+		assert(number("1234567890123",value) && value==1234567890123ULL);
+		assert(number("18446744073709551615",value) && value==18446744073709551615ULL);
+		value=7;
+		for(std::string bad : {"","18446744073709551616","99999999999999999999","-1","+1"," 1","1 ","1.5","0x10"})
+			assert(!number(bad,value) && value==7);
+
+		using std::chrono::system_clock;
+		auto since=[](const system_clock::time_point& time){
+			return(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+		};
+		assert(since(parseTimestamp("1970-01-01T00:00:00Z"))==0);
+		assert(since(parseTimestamp("2018-02-03T21:50:05.397Z"))==1517694605397LL);
+		assert(since(parseTimestamp("2000-02-29T12:00:00.5Z"))==951825600500LL);
+		assert(since(parseTimestamp("1969-12-31T23:59:59Z"))==-1000);
+		assert(since(parseTimestamp("2038-01-19T03:14:08.000000Z"))==2147483648000LL);
+		for(std::string bad : {"","2018-02-03","2018-02-03T21:50:05","2018-02-03T21:50:05.Z","2018-13-03T21:50:05Z",
+		                       "2018-02-30T21:50:05Z","2019-02-29T00:00:00Z","2018-02-03 21:50:05Z","2018-02-03T24:00:00Z",
+		                       "2018-02-03T21:50:05Zx","Sat, 03 Feb 2018 21:50:05 GMT"}){
+			system_clock::time_point time;
+			const system_clock::time_point before=time;
+			assert(!parseTimestamp(bad.data(),bad.data()+bad.size(),time) && time==before);
+		}
+		bool threw=false;
+		try{
+			parseTimestamp("yesterday");
+		}catch(std::runtime_error&){
+			threw=true;
+		}
+		assert(threw);
+	}
+}
+
+int main(){
+	testListingTable();
+	testParsing();
+
+	MockS3Server::Options options;
+	options.credentials[cred.username]=cred.key;
+	options.maxKeys=10;
+
+	{ //the same objects are listed, in the same order, however many requests are made at once
+		MockS3Server server(options);
+		server.createBucket("bucket");
+		std::vector<std::string> expected;
+		char name[32];
+		for(unsigned int i=0; i<300; i++){
+			snprintf(name,sizeof(name),"a/%04u",i);
+			expected.push_back(name);
+		}
+		for(unsigned int i=0; i<40; i++){
+			snprintf(name,sizeof(name),"b/c/%03u",i);
+			expected.push_back(name);
+		}
+		for(unsigned int i=0; i<250; i++){
+			snprintf(name,sizeof(name),"flat%05u",i*37);
+			expected.push_back(name);
+		}
+		for(std::string key : {"b","f&g","some space","z","z/","\xc3\xa9t\xc3\xa9"})
+			expected.push_back(key);
+		std::sort(expected.begin(),expected.end());
+		for(const auto& key : expected)
+			server.putObject("bucket",key,key);
+
+		RequestEngine engine;
+		std::size_t requests=0;
+		assert(listAll(engine,server.url("/bucket"),1,&requests)==expected);
+		assert(requests==(expected.size()+9)/10);
+		for(std::size_t concurrency : {2,4,16}){
+			assert(listAll(engine,server.url("/bucket/"),concurrency,&requests)==expected);
+			//dividing the listing costs some extra requests, but not many
+			std::size_t pages=(expected.size()+9)/10;
+			assert(requests<pages+pages/2+concurrency);
+		}
+
+		//listing under a prefix
+		std::vector<std::string> expectedA(expected.begin(),expected.begin()+300);
+		assert(listAll(engine,server.url("/bucket/a/"),8)==expectedA);
+		assert(listAll(engine,server.url("/bucket/a/01"),8).size()==100);
+		assert(listAll(engine,server.url("/bucket/missing"),8).empty());
+
+		//filtering, which should not change how the listing is divided
+		std::vector<std::string> expectedFiltered;
+		for(const auto& key : expected){
+			if(key.back()=='7')
+				expectedFiltered.push_back(key);
+		}
+		for(std::size_t concurrency : {1,4,16}){
+			ObjectLister lister(engine,cred,server.url("/bucket/"),concurrency,"",
+			                    [](const ObjectInfo& object){ return(object.key.back()=='7'); });
+			std::vector<std::string> keys;
+			ObjectInfo object;
+			while(lister.next(object))
+				keys.push_back(object.key);
+			assert(keys==expectedFiltered);
+			std::size_t pages=(expected.size()+9)/10;
+			assert(lister.requests()<pages+pages/2+concurrency);
+		}
+		{
+			ObjectLister lister(engine,cred,server.url("/bucket/"),4,"",[](const ObjectInfo&){ return(false); });
+			ObjectInfo object;
+			assert(!lister.next(object));
+		}
+	}
+	{ //patterns
+		assert(globPrefix("logs/2023-*/*.gz")=="logs/2023-");
+		assert(globPrefix("a?b")=="a" && globPrefix("[ab]")=="" && globPrefix("plain")=="plain");
+		assert(matchGlob("logs/*.gz","logs/x.gz"));
+		assert(!matchGlob("logs/*.gz","logs/x/y.gz"));
+		assert(matchGlob("logs/*/*.gz","logs/x/y.gz"));
+		assert(matchGlob("f[0-9]?","f1a") && !matchGlob("f[0-9]?","fa1"));
+	}
+	{ //listing is faster with more requests at once
+		MockS3Server::Options slow=options;
+		slow.latency=std::chrono::milliseconds(20);
+		MockS3Server server(slow);
+		server.createBucket("bucket");
+		char name[32];
+		for(unsigned int i=0; i<500; i++){
+			snprintf(name,sizeof(name),"dir%u/object%04u",i%5,i);
+			server.putObject("bucket",name,name);
+		}
+		RequestEngine engine;
+		auto time=[&](std::size_t concurrency){
+			auto start=std::chrono::steady_clock::now();
+			assert(listAll(engine,server.url("/bucket/"),concurrency).size()==500);
+			return(std::chrono::steady_clock::now()-start);
+		};
+		auto sequential=time(1);
+		auto parallel=time(8);
+		assert(sequential>=std::chrono::milliseconds(50*20));
+		assert(parallel*2<sequential);
+	}
+	{ //errors are reported, and listers may be abandoned part way through
+		MockS3Server server(options);
+		server.createBucket("bucket");
+		for(unsigned int i=0; i<100; i++)
+			server.putObject("bucket","key"+std::to_string(i),"");
+		RequestEngine engine;
+		bool threw=false;
+		try{
+			listAll(engine,server.url("/nonexistent/"),4);
+		}catch(S3Error& err){
+			threw=true;
+			assert(err.code()=="NoSuchBucket");
+		}
+		assert(threw);
+
+		{
+			ObjectLister lister(engine,cred,server.url("/bucket/"),4);
+			ObjectInfo object;
+			assert(lister.next(object) && object.key=="key0");
+		}
+		engine.run();
+		assert(engine.outstanding()==0);
+		std::size_t count=0;
+		ObjectLister lister(engine,cred,server.url("/bucket/"),4);
+		ObjectInfo object;
+		while(lister.next(object))
+			count++;
+		assert(count==100);
+	}
+}
@@ -0,0 +1,127 @@
+#ifndef S3TOOLS_TESTS_LOOPBACK_SERVER_H
+#define S3TOOLS_TESTS_LOOPBACK_SERVER_H
+
+#include <cassert>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+///A socket listening on a local port, chosen arbitrarily unless specified
+struct Listener{
+	int fd;
+	unsigned int port;
+
+	explicit Listener(unsigned int port=0){
+		fd=socket(AF_INET,SOCK_STREAM,0);
+		assert(fd>=0);
+		int one=1;
+		setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+		sockaddr_in addr={};
+		addr.sin_family=AF_INET;
+		addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+		addr.sin_port=htons(port);
+		if(bind(fd,(sockaddr*)&addr,sizeof(addr))!=0 || listen(fd,1024)!=0){
+			close(fd);
+			throw std::runtime_error("Unable to listen on port "+std::to_string(port));
+		}
+		socklen_t len=sizeof(addr);
+		getsockname(fd,(sockaddr*)&addr,&len);
+		this->port=ntohs(addr.sin_port);
+	}
+	~Listener(){ close(fd); }
+	std::string url(const std::string& path="/") const{
+		return("http://127.0.0.1:"+std::to_string(port)+path);
+	}
+};
+
+///A minimal HTTP/1.1 server which answers each request on each connection it
+///accepts by calling a responder function, using a thread per connection and
+///counting the connections used
+struct LoopbackServer : public Listener{
+	///Given the request line and headers, and the request body, produce a
+	///complete HTTP response
+	using Responder=std::function<std::string(const std::string&,const std::string&)>;
+
+	Responder responder;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned int> connections;
+	std::thread acceptor;
+	std::vector<std::thread> handlers;
+
+	explicit LoopbackServer(Responder responder=fixedResponse("hello")):
+	responder(responder),stopping(false),connections(0){
+		acceptor=std::thread([this]{
+			while(true){
+				int conn=accept(fd,nullptr,nullptr);
+				if(conn<0 || stopping){
+					if(conn>=0)
+						close(conn);
+					return;
+				}
+				connections++;
+				handlers.emplace_back([this,conn]{ serve(conn); });
+			}
+		});
+	}
+	~LoopbackServer(){
+		stopping=true;
+		//unblock accept
+		shutdown(fd,SHUT_RDWR);
+		acceptor.join();
+		for(auto& handler : handlers)
+			handler.join();
+	}
+
+	///Construct a complete HTTP response
+	static std::string response(unsigned int status, const std::string& body, const std::string& extraHeaders=""){
+		return("HTTP/1.1 "+std::to_string(status)+" Status\r\nContent-Length: "+std::to_string(body.size())+"\r\n"+extraHeaders+"\r\n"+body);
+	}
+	///A responder which gives the same successful response to every request
+	static Responder fixedResponse(const std::string& body){
+		std::string fixed=response(200,body,"X-Test: yes\r\n");
+		return([fixed](const std::string&, const std::string&){ return(fixed); });
+	}
+
+	void serve(int conn){
+		std::string buffer;
+		char data[4096];
+		while(true){
+			ssize_t amount=read(conn,data,sizeof(data));
+			if(amount<=0)
+				break;
+			buffer.append(data,amount);
+			size_t end;
+			while((end=buffer.find("\r\n\r\n"))!=std::string::npos){
+				std::string head=buffer.substr(0,end+2);
+				std::string lowered=head;
+				std::transform(lowered.begin(),lowered.end(),lowered.begin(),::tolower);
+				std::size_t bodySize=0, pos=lowered.find("\r\ncontent-length:");
+				if(pos!=std::string::npos)
+					bodySize=std::stoul(lowered.substr(pos+17));
+				if(buffer.size()<end+4+bodySize)
+					break; //wait for the rest of the body
+				std::string body=buffer.substr(end+4,bodySize);
+				buffer.erase(0,end+4+bodySize);
+				std::string reply=responder(head,body);
+				if(head.compare(0,5,"HEAD ")==0) //never send a body in reply to HEAD
+					reply.erase(reply.find("\r\n\r\n")+4);
+				//the client may have given up and closed the connection
+				if(send(conn,reply.data(),reply.size(),MSG_NOSIGNAL)<0)
+					break;
+			}
+		}
+		close(conn);
+	}
+};
+
+#endif //S3TOOLS_TESTS_LOOPBACK_SERVER_H
@@ -0,0 +1,1262 @@
+#include "mock_s3.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+#include <cryptopp/base64.h>
+#include <cryptopp/hex.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/md5.h>
+#include <cryptopp/sha.h>
+
+#include <s3tools/signing.h>
+#include <s3tools/url.h>
+
+namespace{
+
+const std::string xmlHeader="<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+const std::string s3Namespace=" xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"";
+
+std::string percentDecode(const std::string& s){
+	std::string result;
+	result.reserve(s.size());
+	for(std::size_t i=0; i<s.size(); i++){
+		if(s[i]=='%' && i+2<s.size() && isxdigit(s[i+1]) && isxdigit(s[i+2])){
+			result+=(char)std::stoi(s.substr(i+1,2),nullptr,16);
+			i+=2;
+		}
+		else
+			result+=s[i];
+	}
+	return(result);
+}
+
+std::string xmlEscape(const std::string& s){
+	std::string result;
+	result.reserve(s.size());
+	for(char c : s){
+		switch(c){
+			case '<': result+="&lt;"; break;
+			case '>': result+="&gt;"; break;
+			case '&': result+="&amp;"; break;
+			case '"': result+="&quot;"; break;
+			case '\'': result+="&apos;"; break;
+			default: result+=c;
+		}
+	}
+	return(result);
+}
+
+std::string xmlUnescape(const std::string& s){
+	std::string result;
+	result.reserve(s.size());
+	for(std::size_t i=0; i<s.size(); i++){
+		std::size_t end;
+		if(s[i]!='&' || (end=s.find(';',i))==std::string::npos){
+			result+=s[i];
+			continue;
+		}
+		std::string entity=s.substr(i+1,end-i-1);
+		if(entity=="lt") result+='<';
+		else if(entity=="gt") result+='>';
+		else if(entity=="amp") result+='&';
+		else if(entity=="quot") result+='"';
+		else if(entity=="apos") result+='\'';
+		else if(entity.size()>1 && entity[0]=='#'){
+			unsigned long code=(entity[1]=='x') ? std::stoul(entity.substr(2),nullptr,16) : std::stoul(entity.substr(1));
+			//encode as UTF-8
+			if(code<0x80)
+				result+=(char)code;
+			else if(code<0x800){
+				result+=(char)(0xC0|(code>>6));
+				result+=(char)(0x80|(code&0x3F));
+			}
+			else if(code<0x10000){
+				result+=(char)(0xE0|(code>>12));
+				result+=(char)(0x80|((code>>6)&0x3F));
+				result+=(char)(0x80|(code&0x3F));
+			}
+			else{
+				result+=(char)(0xF0|(code>>18));
+				result+=(char)(0x80|((code>>12)&0x3F));
+				result+=(char)(0x80|((code>>6)&0x3F));
+				result+=(char)(0x80|(code&0x3F));
+			}
+		}
+		else
+			throw std::runtime_error("Unknown XML entity");
+		i=end;
+	}
+	return(result);
+}
+
+///Find the contents of each occurrence of an element in a simple XML document.
+///Nesting of elements with the same name is not supported.
+std::vector<std::string> elements(const std::string& xml, const std::string& name){
+	std::vector<std::string> result;
+	const std::string open="<"+name, close="</"+name+">";
+	std::size_t pos=0;
+	while((pos=xml.find(open,pos))!=std::string::npos){
+		pos+=open.size();
+		//skip other elements whose names begin with this one
+		if(pos>=xml.size() || (xml[pos]!='>' && xml[pos]!='/' && !isspace(xml[pos])))
+			continue;
+		std::size_t start=xml.find('>',pos);
+		if(start==std::string::npos)
+			break;
+		if(xml[start-1]=='/'){ //an empty element
+			result.emplace_back();
+			pos=start;
+			continue;
+		}
+		std::size_t end=xml.find(close,start);
+		if(end==std::string::npos)
+			break;
+		result.push_back(xml.substr(start+1,end-start-1));
+		pos=end+close.size();
+	}
+	return(result);
+}
+
+///The unescaped contents of the first occurrence of an element, or an empty
+///string if there is none
+std::string element(const std::string& xml, const std::string& name){
+	auto found=elements(xml,name);
+	if(found.empty())
+		return("");
+	return(xmlUnescape(found.front()));
+}
+
+std::string hexEncode(const std::string& data){
+	static const char* digits="0123456789abcdef";
+	std::string result;
+	result.reserve(2*data.size());
+	for(unsigned char c : data){
+		result+=digits[c>>4];
+		result+=digits[c&0xF];
+	}
+	return(result);
+}
+
+///\throws std::invalid_argument if the input is not valid hexadecimal
+std::string hexDecode(const std::string& hex){
+	if(hex.size()%2 || hex.find_first_not_of("0123456789abcdefABCDEF")!=std::string::npos)
+		throw std::invalid_argument("Invalid hexadecimal data");
+	std::string result;
+	for(std::size_t i=0; i<hex.size(); i+=2)
+		result+=(char)std::stoi(hex.substr(i,2),nullptr,16);
+	return(result);
+}
+
+///Compute the raw MD5 digest of some data
+std::string md5(const std::string& data){
+	using namespace CryptoPP;
+	std::string digest;
+	Weak::MD5 hash;
+	StringSource s(data, true, new HashFilter(hash, new StringSink(digest)));
+	return(digest);
+}
+
+///Encode data as base64, without line breaks
+std::string base64(const std::string& data){
+	using namespace CryptoPP;
+	std::string encoded;
+	StringSource s(data, true, new Base64Encoder(new StringSink(encoded), false));
+	return(encoded);
+}
+
+std::string formatTime(std::time_t time, const char* format){
+	struct tm parts;
+	gmtime_r(&time,&parts);
+	char buffer[64];
+	std::size_t length=strftime(buffer,sizeof(buffer),format,&parts);
+	return(std::string(buffer,length));
+}
+///The time format used in XML documents
+std::string isoTime(std::time_t time){
+	return(formatTime(time,"%Y-%m-%dT%H:%M:%S.000Z"));
+}
+///The time format used in HTTP headers
+std::string httpTime(std::time_t time){
+	return(formatTime(time,"%a, %d %b %Y %H:%M:%S GMT"));
+}
+///Parse a SigV4 timestamp, like 20130524T000000Z
+///\return the time, or -1 if the timestamp is not valid
+std::time_t parseTimestamp(const std::string& timestamp){
+	struct tm parts={};
+	const char* end=strptime(timestamp.c_str(),"%Y%m%dT%H%M%SZ",&parts);
+	if(!end || *end)
+		return(-1);
+	return(timegm(&parts));
+}
+
+///The smallest string which sorts after the given one
+std::string successor(const std::string& s){
+	return(s+'\0');
+}
+///The smallest string which sorts after all strings beginning with the given
+///one, or an empty string if there is no such string
+std::string prefixEnd(std::string prefix){
+	while(!prefix.empty() && (unsigned char)prefix.back()==0xFF)
+		prefix.pop_back();
+	if(!prefix.empty())
+		prefix.back()++;
+	return(prefix);
+}
+
+std::string trim(const std::string& s){
+	std::size_t start=s.find_first_not_of(" \t");
+	if(start==std::string::npos)
+		return("");
+	return(s.substr(start,s.find_last_not_of(" \t")-start+1));
+}
+
+std::string reasonPhrase(unsigned int status){
+	switch(status){
+		case 100: return("Continue");
+		case 200: return("OK");
+		case 204: return("No Content");
+		case 206: return("Partial Content");
+		case 400: return("Bad Request");
+		case 403: return("Forbidden");
+		case 404: return("Not Found");
+		case 405: return("Method Not Allowed");
+		case 409: return("Conflict");
+		case 411: return("Length Required");
+		case 416: return("Requested Range Not Satisfiable");
+		case 500: return("Internal Server Error");
+		case 501: return("Not Implemented");
+		case 503: return("Slow Down");
+		default: return("Unknown");
+	}
+}
+
+bool sendAll(int fd, const char* data, std::size_t size){
+	while(size){
+		ssize_t amount=send(fd,data,size,MSG_NOSIGNAL);
+		if(amount<=0)
+			return(false);
+		data+=amount;
+		size-=amount;
+	}
+	return(true);
+}
+
+///Percent-encode a string as Signature Version 4 requires, leaving only the
+///unreserved characters of RFC 3986, and optionally '/', as they are
+std::string sigV4Encode(const std::string& s, bool keepSlash){
+	static const char digits[]="0123456789ABCDEF";
+	std::string result;
+	result.reserve(s.size());
+	for(unsigned char c : s){
+		if((c>='A' && c<='Z') || (c>='a' && c<='z') || (c>='0' && c<='9')
+		   || c=='-' || c=='.' || c=='_' || c=='~' || (keepSlash && c=='/'))
+			result+=c;
+		else{
+			result+='%';
+			result+=digits[c>>4];
+			result+=digits[c&0xF];
+		}
+	}
+	return(result);
+}
+
+///A raw SHA-256 HMAC
+std::string hmacSHA256(const std::string& key, const std::string& message){
+	using namespace CryptoPP;
+	std::string digest(HMAC<SHA256>::DIGESTSIZE,'\0');
+	HMAC<SHA256> hmac((const byte*)key.data(),key.size());
+	hmac.CalculateDigest((byte*)&digest[0],(const byte*)message.data(),message.size());
+	return(digest);
+}
+
+std::string lowercaseHex(const std::string& data){
+	using namespace CryptoPP;
+	std::string result;
+	StringSource s(data, true, new HexEncoder(new StringSink(result)));
+	return(s3tools::lowercase(result));
+}
+
+} //anonymous namespace
+
+MockS3Server::MockS3Server(Options options):Listener(options.port),
+connections(0),requests(0),rejectedSignatures(0),injectedErrors(0),
+opts(std::move(options)),stopping(false),nextUploadID(1),random(opts.seed){
+	acceptor=std::thread([this]{ accept(); });
+}
+
+MockS3Server::~MockS3Server(){
+	stopping=true;
+	//unblock accept
+	shutdown(fd,SHUT_RDWR);
+	acceptor.join();
+	std::lock_guard<std::mutex> guard(connectionLock);
+	//unblock any connections waiting for requests
+	for(auto& connection : active)
+		shutdown(connection.fd,SHUT_RDWR);
+	for(auto& connection : active){
+		connection.handler.join();
+		close(connection.fd);
+	}
+}
+
+void MockS3Server::accept(){
+	while(true){
+		int conn=::accept(fd,nullptr,nullptr);
+		if(conn<0 || stopping){
+			if(conn>=0)
+				close(conn);
+			return;
+		}
+		connections++;
+		std::lock_guard<std::mutex> guard(connectionLock);
+		//clean up after connections which have been closed
+		for(auto it=active.begin(); it!=active.end();){
+			if(it->finished){
+				it->handler.join();
+				close(it->fd);
+				it=active.erase(it);
+			}
+			else
+				++it;
+		}
+		active.emplace_back(conn);
+		Connection& connection=active.back();
+		connection.handler=std::thread([this,&connection]{
+			serve(connection);
+			connection.finished=true;
+		});
+	}
+}
+
+void MockS3Server::serve(Connection& connection){
+	std::string buffer;
+	while(!stopping){
+		Request request;
+		if(!readRequest(connection.fd,buffer,request))
+			break;
+		requests++;
+		if(chance(opts.dropRate)){
+			injectedErrors++;
+			break;
+		}
+		Response response;
+		if(chance(opts.errorRate)){
+			injectedErrors++;
+			response=error(503,"SlowDown","Please reduce your request rate.",request.path);
+		}
+		else{
+			try{
+				response=handle(request);
+			}catch(std::exception& ex){
+				response=error(500,"InternalError",ex.what(),request.path);
+			}
+		}
+		std::this_thread::sleep_for(opts.latency);
+		if(!sendResponse(connection.fd,request,response))
+			break;
+		if(s3tools::lowercase(request.header("connection"))=="close")
+			break;
+	}
+	//let the client know immediately that the connection is finished
+	shutdown(connection.fd,SHUT_RDWR);
+}
+
+bool MockS3Server::readRequest(int fd, std::string& buffer, Request& request){
+	std::size_t end;
+	char data[65536];
+	while((end=buffer.find("\r\n\r\n"))==std::string::npos){
+		if(buffer.size()>65536) //unreasonably large headers
+			return(false);
+		ssize_t amount=recv(fd,data,sizeof(data),0);
+		if(amount<=0)
+			return(false);
+		buffer.append(data,amount);
+	}
+	std::istringstream head(buffer.substr(0,end+2));
+	buffer.erase(0,end+4);
+
+	std::string line, target;
+	if(!std::getline(head,line))
+		return(false);
+	std::istringstream requestLine(line);
+	if(!(requestLine >> request.verb >> target))
+		return(false);
+	while(std::getline(head,line)){
+		if(!line.empty() && line.back()=='\r')
+			line.pop_back();
+		std::size_t colon=line.find(':');
+		if(colon==std::string::npos)
+			continue;
+		std::string name=s3tools::lowercase(line.substr(0,colon));
+		std::string value=trim(line.substr(colon+1));
+		auto it=request.headers.find(name);
+		if(it==request.headers.end())
+			request.headers.emplace(name,value);
+		else
+			it->second+=","+value;
+	}
+
+	std::size_t queryStart=target.find('?');
+	request.path=percentDecode(target.substr(0,queryStart));
+	if(queryStart!=std::string::npos){
+		request.rawQuery=target.substr(queryStart+1);
+		std::istringstream query(request.rawQuery);
+		std::string item;
+		while(std::getline(query,item,'&')){
+			std::size_t equals=item.find('=');
+			request.query[percentDecode(item.substr(0,equals))]=(equals==std::string::npos ? "" : percentDecode(item.substr(equals+1)));
+		}
+	}
+
+	std::string length=request.header("content-length");
+	bool chunked=s3tools::lowercase(request.header("transfer-encoding")).find("chunked")!=std::string::npos;
+	if((length.empty() || length=="0") && !chunked)
+		return(true);
+	//clients which ask may send their bodies once they are told to
+	if(s3tools::lowercase(request.header("expect"))=="100-continue"){
+		const std::string proceed="HTTP/1.1 100 Continue\r\n\r\n";
+		if(!sendAll(fd,proceed.data(),proceed.size()))
+			return(false);
+	}
+	if(!chunked){
+		std::size_t size;
+		try{
+			size=std::stoull(length);
+		}catch(std::exception&){
+			return(false);
+		}
+		return(readBody(fd,buffer,size,request.body));
+	}
+	while(true){
+		std::string sizeLine;
+		while((end=buffer.find("\r\n"))==std::string::npos){
+			ssize_t amount=recv(fd,data,sizeof(data),0);
+			if(amount<=0)
+				return(false);
+			buffer.append(data,amount);
+		}
+		std::size_t size;
+		try{
+			size=std::stoull(buffer.substr(0,end),nullptr,16);
+		}catch(std::exception&){
+			return(false);
+		}
+		buffer.erase(0,end+2);
+		std::string chunk;
+		//read the chunk and the line ending which follows it
+		if(!readBody(fd,buffer,size+2,chunk))
+			return(false);
+		if(size==0){
+			//skip any trailers
+			while(chunk!="\r\n"){
+				if(!readBody(fd,buffer,2,chunk))
+					return(false);
+			}
+			return(true);
+		}
+		request.body.append(chunk,0,size);
+	}
+}
+
+bool MockS3Server::readBody(int fd, std::string& buffer, std::size_t size, std::string& body){
+	auto start=std::chrono::steady_clock::now();
+	char data[65536];
+	while(buffer.size()<size){
+		ssize_t amount=recv(fd,data,std::min(sizeof(data),size-buffer.size()),0);
+		if(amount<=0)
+			return(false);
+		buffer.append(data,amount);
+		throttle(start,buffer.size());
+	}
+	body=buffer.substr(0,size);
+	buffer.erase(0,size);
+	return(true);
+}
+
+bool MockS3Server::sendResponse(int fd, const Request& request, const Response& response){
+	static std::atomic<unsigned long long> requestID(0);
+	std::ostringstream head;
+	head << "HTTP/1.1 " << response.status << ' ' << reasonPhrase(response.status) << "\r\n";
+	head << "Date: " << httpTime(std::time(nullptr)) << "\r\n";
+	head << "Server: MockS3\r\n";
+	head << "x-amz-request-id: " << std::hex << std::uppercase << ++requestID << std::dec << "\r\n";
+	for(const auto& header : response.headers)
+		head << header.first << ": " << header.second << "\r\n";
+	head << "Content-Length: " << response.length << "\r\n\r\n";
+	const std::string headData=head.str();
+	if(!sendAll(fd,headData.data(),headData.size()))
+		return(false);
+	//responses to HEAD requests describe the body without including it
+	if(request.verb=="HEAD" || !response.length)
+		return(true);
+
+	const char* data=response.body->data()+response.offset;
+	if(!opts.bandwidth)
+		return(sendAll(fd,data,response.length));
+	auto start=std::chrono::steady_clock::now();
+	const std::size_t chunkSize=std::max<std::size_t>(1024,std::min<std::size_t>(65536,opts.bandwidth/100));
+	for(std::size_t sent=0; sent<response.length;){
+		throttle(start,sent);
+		std::size_t amount=std::min(chunkSize,response.length-sent);
+		if(!sendAll(fd,data+sent,amount))
+			return(false);
+		sent+=amount;
+	}
+	return(true);
+}
+
+void MockS3Server::throttle(std::chrono::steady_clock::time_point start, std::size_t transferred) const{
+	if(!opts.bandwidth)
+		return;
+	std::this_thread::sleep_until(start+std::chrono::microseconds((long long)(transferred*1e6/opts.bandwidth)));
+}
+
+bool MockS3Server::chance(double probability){
+	if(probability<=0)
+		return(false);
+	std::lock_guard<std::mutex> guard(randomLock);
+	return(std::uniform_real_distribution<double>(0,1)(random)<probability);
+}
+
+void MockS3Server::count(const std::string& operation){
+	//called with storeLock held
+	operations[operation]++;
+}
+
+MockS3Server::Response MockS3Server::handle(const Request& request){
+	if(opts.verifySignatures){
+		if(auto failure=checkSignature(request))
+			return(*failure);
+	}
+	if(request.path.empty() || request.path[0]!='/')
+		return(error(400,"InvalidURI","Couldn't parse the specified URI.",request.path));
+	std::size_t slash=request.path.find('/',1);
+	std::string bucket=request.path.substr(1,slash==std::string::npos ? std::string::npos : slash-1);
+	std::string key=(slash==std::string::npos ? "" : request.path.substr(slash+1));
+	const std::string& verb=request.verb;
+	//whether any subresource or other parameter is given, besides a signature
+	const bool parameters=std::any_of(request.query.begin(),request.query.end(),
+		[](const std::pair<const std::string,std::string>& item){ return(item.first.compare(0,6,"X-Amz-")!=0); });
+
+	if(bucket.empty()){
+		if(verb=="GET")
+			return(listBuckets(request));
+	}
+	else if(key.empty()){
+		if(verb=="GET"){
+			if(request.hasQuery("location"))
+				return(getBucketLocation(request,bucket));
+			if(request.hasQuery("versioning"))
+				return(getBucketVersioning(request,bucket));
+			if(request.hasQuery("uploads"))
+				return(listUploads(request,bucket));
+			return(listObjects(request,bucket));
+		}
+		if(verb=="PUT" && !parameters)
+			return(createBucket(request,bucket));
+		if(verb=="DELETE" && !parameters)
+			return(deleteBucket(request,bucket));
+		if(verb=="HEAD")
+			return(headBucket(request,bucket));
+		if(verb=="POST" && request.hasQuery("delete"))
+			return(deleteObjects(request,bucket));
+	}
+	else{
+		if(verb=="GET" || verb=="HEAD"){
+			if(!request.hasQuery("uploadId"))
+				return(getObject(request,bucket,key));
+		}
+		else if(verb=="PUT"){
+			if(request.hasQuery("partNumber") && request.hasQuery("uploadId"))
+				return(uploadPart(request,bucket,key));
+			if(!request.header("x-amz-copy-source").empty())
+				return(copyObject(request,bucket,key));
+			return(putObject(request,bucket,key));
+		}
+		else if(verb=="DELETE"){
+			if(request.hasQuery("uploadId"))
+				return(abortUpload(request,bucket,key));
+			return(deleteObject(request,bucket,key));
+		}
+		else if(verb=="POST"){
+			if(request.hasQuery("uploads"))
+				return(createUpload(request,bucket,key));
+			if(request.hasQuery("uploadId"))
+				return(completeUpload(request,bucket,key));
+		}
+	}
+	if(verb!="GET" && verb!="HEAD" && verb!="PUT" && verb!="POST" && verb!="DELETE")
+		return(error(405,"MethodNotAllowed","The specified method is not allowed against this resource.",request.path));
+	return(error(501,"NotImplemented","A header or query parameter you provided implies functionality that is not implemented.",request.path));
+}
+
+std::unique_ptr<MockS3Server::Response> MockS3Server::checkSignature(const Request& request){
+	auto reject=[&](unsigned int status, const std::string& code, const std::string& message){
+		rejectedSignatures++;
+		return(std::unique_ptr<Response>(new Response(error(status,code,message,request.path))));
+	};
+	auto queryValue=[&](const std::string& name)->std::string{
+		auto it=request.query.find(name);
+		return(it==request.query.end() ? "" : it->second);
+	};
+
+	const bool presigned=request.hasQuery("X-Amz-Algorithm");
+	std::string credential, timestamp, signedHeaders, signature;
+	unsigned long expires=0;
+	if(presigned){
+		if(queryValue("X-Amz-Algorithm")!="AWS4-HMAC-SHA256")
+			return(reject(400,"AuthorizationQueryParametersError","X-Amz-Algorithm only supports \"AWS4-HMAC-SHA256\""));
+		credential=queryValue("X-Amz-Credential");
+		timestamp=queryValue("X-Amz-Date");
+		signedHeaders=queryValue("X-Amz-SignedHeaders");
+		signature=queryValue("X-Amz-Signature");
+		try{
+			expires=std::stoul(queryValue("X-Amz-Expires"));
+		}catch(std::exception&){
+			return(reject(400,"AuthorizationQueryParametersError","X-Amz-Expires should be a number"));
+		}
+	}
+	else{
+		const std::string scheme="AWS4-HMAC-SHA256 ";
+		std::string authorization=request.header("authorization");
+		if(authorization.empty())
+			return(reject(403,"AccessDenied","Access Denied"));
+		if(authorization.compare(0,scheme.size(),scheme)!=0)
+			return(reject(400,"InvalidArgument","Unsupported Authorization Type"));
+		std::istringstream fields(authorization.substr(scheme.size()));
+		std::string field;
+		while(std::getline(fields,field,',')){
+			field=trim(field);
+			std::size_t equals=field.find('=');
+			std::string name=field.substr(0,equals), value=(equals==std::string::npos ? "" : field.substr(equals+1));
+			if(name=="Credential")
+				credential=value;
+			else if(name=="SignedHeaders")
+				signedHeaders=value;
+			else if(name=="Signature")
+				signature=value;
+		}
+		timestamp=request.header("x-amz-date");
+	}
+
+	std::string accessKey=credential.substr(0,credential.find('/'));
+	auto secret=opts.credentials.find(accessKey);
+	if(secret==opts.credentials.end())
+		return(reject(403,"InvalidAccessKeyId","The AWS Access Key Id you provided does not exist in our records."));
+	std::time_t time=parseTimestamp(timestamp), now=std::time(nullptr);
+	if(time<0)
+		return(reject(403,"AccessDenied","AWS authentication requires a valid Date or x-amz-date header"));
+	if(presigned && now>time+(std::time_t)expires)
+		return(reject(403,"AccessDenied","Request has expired"));
+	if(!presigned && std::abs(now-time)>15*60)
+		return(reject(403,"RequestTimeTooSkewed","The difference between the request time and the current time is too large."));
+
+	std::istringstream headerNames(signedHeaders);
+	std::string name;
+	while(std::getline(headerNames,name,';')){
+		if(!request.headers.count(name))
+			return(reject(403,"SignatureDoesNotMatch","A header which was signed is missing from the request."));
+	}
+
+	//the signature is computed from the request as received, independently
+	//of the library's signing code, so that mistakes there are not repeated
+	std::string scope=credential.substr(std::min(accessKey.size()+1,credential.size()));
+	if(scope.compare(0,8,timestamp.substr(0,8))!=0)
+		return(reject(403,"SignatureDoesNotMatch","The credential scope does not match the date of the request."));
+	std::string expected=MockS3Server::signature(secret->second,timestamp,scope,
+	                                             canonicalRequest(request,signedHeaders,presigned));
+	if(expected!=signature)
+		return(reject(403,"SignatureDoesNotMatch","The request signature we calculated does not match the signature you provided. Check your key and signing method."));
+
+	std::string payloadHash=request.header("x-amz-content-sha256");
+	if(!payloadHash.empty() && payloadHash!="UNSIGNED-PAYLOAD" && payloadHash.compare(0,9,"STREAMING")!=0
+	   && s3tools::lowercase(payloadHash)!=s3tools::lowercase(s3tools::SHA256Hash(request.body)))
+		return(reject(400,"XAmzContentSHA256Mismatch","The provided 'x-amz-content-sha256' header does not match what was computed."));
+	return(nullptr);
+}
+
+std::string MockS3Server::canonicalRequest(const Request& request, const std::string& signedHeaders, bool presigned){
+	std::string result=request.verb+'\n'+sigV4Encode(request.path,true)+'\n';
+	//query parameters are encoded afresh, and sorted by their encoded names
+	std::vector<std::pair<std::string,std::string>> parameters;
+	std::istringstream query(request.rawQuery);
+	std::string item;
+	while(std::getline(query,item,'&')){
+		if(item.empty())
+			continue;
+		std::size_t equals=item.find('=');
+		std::string name=sigV4Encode(percentDecode(item.substr(0,equals)),false);
+		if(presigned && name=="X-Amz-Signature")
+			continue;
+		parameters.emplace_back(name,equals==std::string::npos ? "" : sigV4Encode(percentDecode(item.substr(equals+1)),false));
+	}
+	std::sort(parameters.begin(),parameters.end());
+	for(std::size_t i=0; i<parameters.size(); i++)
+		result+=(i ? "&" : "")+parameters[i].first+'='+parameters[i].second;
+	result+='\n';
+	//header values are trimmed, and runs of spaces within them collapsed
+	std::istringstream headerNames(signedHeaders);
+	std::string name;
+	while(std::getline(headerNames,name,';')){
+		std::string value=trim(request.header(name));
+		value.erase(std::unique(value.begin(),value.end(),[](char a, char b){ return(a==' ' && b==' '); }),value.end());
+		result+=name+':'+value+'\n';
+	}
+	result+='\n'+signedHeaders+'\n';
+	//S3 requires x-amz-content-sha256 with header signing, but this server
+	//also accepts an unsigned payload in its absence
+	std::string payloadHash=(presigned ? "" : request.header("x-amz-content-sha256"));
+	result+=(payloadHash.empty() ? "UNSIGNED-PAYLOAD" : payloadHash);
+	return(result);
+}
+
+std::string MockS3Server::signature(const std::string& secret, const std::string& timestamp,
+                                    const std::string& scope, const std::string& canonicalRequest){
+	using namespace CryptoPP;
+	std::string requestHash;
+	SHA256 hash;
+	StringSource s(canonicalRequest, true, new HashFilter(hash, new StringSink(requestHash)));
+	std::string stringToSign="AWS4-HMAC-SHA256\n"+timestamp+'\n'+scope+'\n'+lowercaseHex(requestHash);
+	//the signing key is derived from the secret by each part of the scope in
+	//turn: the date, region, service, and "aws4_request"
+	std::string key="AWS4"+secret;
+	std::istringstream parts(scope);
+	std::string part;
+	while(std::getline(parts,part,'/'))
+		key=hmacSHA256(key,part);
+	return(lowercaseHex(hmacSHA256(key,stringToSign)));
+}
+
+MockS3Server::Response MockS3Server::error(unsigned int status, const std::string& code,
+                                           const std::string& message, const std::string& resource){
+	Response response(status,xmlHeader+"<Error><Code>"+code+"</Code><Message>"+xmlEscape(message)
+	                  +"</Message><Resource>"+xmlEscape(resource)+"</Resource></Error>");
+	response.headers["Content-Type"]="application/xml";
+	return(response);
+}
+
+MockS3Server::Object MockS3Server::makeObject(std::string data){
+	Object object;
+	object.etag="\""+hexEncode(md5(data))+"\"";
+	object.data=std::make_shared<const std::string>(std::move(data));
+	object.lastModified=std::time(nullptr);
+	return(object);
+}
+
+//Direct access
+
+void MockS3Server::createBucket(const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	buckets[bucket].created=std::time(nullptr);
+}
+
+bool MockS3Server::hasBucket(const std::string& bucket) const{
+	std::lock_guard<std::mutex> guard(storeLock);
+	return(buckets.count(bucket));
+}
+
+void MockS3Server::putObject(const std::string& bucket, const std::string& key, std::string data){
+	Object object=makeObject(std::move(data));
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=buckets.find(bucket);
+	if(it==buckets.end())
+		throw std::runtime_error("No bucket named "+bucket);
+	it->second.objects[key]=std::move(object);
+}
+
+bool MockS3Server::hasObject(const std::string& bucket, const std::string& key) const{
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=buckets.find(bucket);
+	return(it!=buckets.end() && it->second.objects.count(key));
+}
+
+bool MockS3Server::removeObject(const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=buckets.find(bucket);
+	return(it!=buckets.end() && it->second.objects.erase(key));
+}
+
+void MockS3Server::protectObject(const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	protectedObjects.insert(bucket+"/"+key);
+}
+
+std::string MockS3Server::getObject(const std::string& bucket, const std::string& key) const{
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=buckets.find(bucket);
+	if(it==buckets.end() || !it->second.objects.count(key))
+		throw std::runtime_error("No object "+bucket+"/"+key);
+	return(*it->second.objects.find(key)->second.data);
+}
+
+std::vector<std::string> MockS3Server::keys(const std::string& bucket) const{
+	std::vector<std::string> result;
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=buckets.find(bucket);
+	if(it!=buckets.end()){
+		for(const auto& object : it->second.objects)
+			result.push_back(object.first);
+	}
+	return(result);
+}
+
+std::string MockS3Server::startUpload(const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	if(!buckets.count(bucket))
+		throw std::runtime_error("No bucket "+bucket);
+	std::string id=hexEncode(md5(bucket+"/"+key+"/"+std::to_string(nextUploadID++)));
+	Upload& upload=uploads[id];
+	upload.bucket=bucket;
+	upload.key=key;
+	upload.initiated=std::time(nullptr);
+	return(id);
+}
+
+std::size_t MockS3Server::uploadsInProgress() const{
+	std::lock_guard<std::mutex> guard(storeLock);
+	return(uploads.size());
+}
+
+unsigned int MockS3Server::operationCount(const std::string& operation) const{
+	std::lock_guard<std::mutex> guard(storeLock);
+	auto it=operations.find(operation);
+	return(it==operations.end() ? 0 : it->second);
+}
+
+//Buckets
+
+MockS3Server::Response MockS3Server::listBuckets(const Request&){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("ListBuckets");
+	std::ostringstream result;
+	result << xmlHeader << "<ListAllMyBucketsResult" << s3Namespace << "><Owner><ID>mock</ID><DisplayName>mock</DisplayName></Owner><Buckets>";
+	for(const auto& bucket : buckets)
+		result << "<Bucket><Name>" << xmlEscape(bucket.first) << "</Name><CreationDate>" << isoTime(bucket.second.created) << "</CreationDate></Bucket>";
+	result << "</Buckets></ListAllMyBucketsResult>";
+	return(Response(200,result.str()));
+}
+
+MockS3Server::Response MockS3Server::createBucket(const Request& request, const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("CreateBucket");
+	if(buckets.count(bucket))
+		return(error(409,"BucketAlreadyOwnedByYou","Your previous request to create the named bucket succeeded and you already own it.",request.path));
+	buckets[bucket].created=std::time(nullptr);
+	Response response;
+	response.headers["Location"]="/"+bucket;
+	return(response);
+}
+
+MockS3Server::Response MockS3Server::deleteBucket(const Request& request, const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("DeleteBucket");
+	auto it=buckets.find(bucket);
+	if(it==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	if(!it->second.objects.empty())
+		return(error(409,"BucketNotEmpty","The bucket you tried to delete is not empty",request.path));
+	buckets.erase(it);
+	return(Response(204));
+}
+
+MockS3Server::Response MockS3Server::headBucket(const Request&, const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("HeadBucket");
+	return(Response(buckets.count(bucket) ? 200 : 404));
+}
+
+MockS3Server::Response MockS3Server::getBucketLocation(const Request& request, const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("GetBucketLocation");
+	if(!buckets.count(bucket))
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	//like US East (N. Virginia), which is reported as an empty location
+	return(Response(200,xmlHeader+"<LocationConstraint"+s3Namespace+"/>"));
+}
+
+MockS3Server::Response MockS3Server::getBucketVersioning(const Request& request, const std::string& bucket){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("GetBucketVersioning");
+	if(!buckets.count(bucket))
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	//versioning has never been enabled
+	return(Response(200,xmlHeader+"<VersioningConfiguration"+s3Namespace+"/>"));
+}
+
+MockS3Server::Response MockS3Server::listObjects(const Request& request, const std::string& bucket){
+	auto queryValue=[&](const std::string& name)->std::string{
+		auto it=request.query.find(name);
+		return(it==request.query.end() ? "" : it->second);
+	};
+	const bool v2=(queryValue("list-type")=="2");
+	const std::string prefix=queryValue("prefix"), delimiter=queryValue("delimiter");
+	const bool encode=(queryValue("encoding-type")=="url");
+	auto encoded=[&](const std::string& s){ return(xmlEscape(encode ? s3tools::urlencode(s,true) : s)); };
+	std::size_t maxKeys=opts.maxKeys;
+	if(request.hasQuery("max-keys")){
+		try{
+			maxKeys=std::min<std::size_t>(maxKeys,std::stoul(queryValue("max-keys")));
+		}catch(std::exception&){
+			return(error(400,"InvalidArgument","Provided max-keys not an integer or within integer range",request.path));
+		}
+	}
+
+	//the first key which may be listed
+	std::string start;
+	if(v2){
+		if(request.hasQuery("continuation-token")){
+			try{
+				start=hexDecode(queryValue("continuation-token"));
+			}catch(std::exception&){
+				return(error(400,"InvalidArgument","The continuation token provided is incorrect",request.path));
+			}
+		}
+		else if(request.hasQuery("start-after"))
+			start=successor(queryValue("start-after"));
+	}
+	else if(request.hasQuery("marker")){
+		std::string marker=queryValue("marker");
+		//a marker may be a common prefix, all of which was listed
+		if(!delimiter.empty() && marker.size()>=delimiter.size()+prefix.size() && marker.compare(0,prefix.size(),prefix)==0
+		   && marker.compare(marker.size()-delimiter.size(),delimiter.size(),delimiter)==0)
+			start=prefixEnd(marker);
+		else
+			start=successor(marker);
+	}
+	start=std::max(start,prefix);
+
+	std::lock_guard<std::mutex> guard(storeLock);
+	count(v2 ? "ListObjectsV2" : "ListObjects");
+	auto b=buckets.find(bucket);
+	if(b==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	const auto& objects=b->second.objects;
+
+	std::ostringstream contents, commonPrefixes;
+	std::size_t listed=0;
+	bool truncated=false;
+	std::string last, next;
+	for(auto it=objects.lower_bound(start); it!=objects.end() && it->first.compare(0,prefix.size(),prefix)==0;){
+		if(listed==maxKeys){
+			truncated=true;
+			break;
+		}
+		std::size_t split=(delimiter.empty() ? std::string::npos : it->first.find(delimiter,prefix.size()));
+		if(split!=std::string::npos){
+			last=it->first.substr(0,split+delimiter.size());
+			commonPrefixes << "<CommonPrefixes><Prefix>" << encoded(last) << "</Prefix></CommonPrefixes>";
+			next=prefixEnd(last);
+			it=(next.empty() ? objects.end() : objects.lower_bound(next));
+		}
+		else{
+			last=it->first;
+			next=successor(last);
+			contents << "<Contents><Key>" << encoded(it->first) << "</Key><LastModified>" << isoTime(it->second.lastModified)
+			         << "</LastModified><ETag>" << xmlEscape(it->second.etag) << "</ETag><Size>" << it->second.data->size()
+			         << "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+			++it;
+		}
+		listed++;
+	}
+
+	std::ostringstream result;
+	result << xmlHeader << "<ListBucketResult" << s3Namespace << "><Name>" << xmlEscape(bucket) << "</Name><Prefix>" << encoded(prefix) << "</Prefix>";
+	if(v2){
+		if(request.hasQuery("continuation-token"))
+			result << "<ContinuationToken>" << xmlEscape(queryValue("continuation-token")) << "</ContinuationToken>";
+		if(request.hasQuery("start-after"))
+			result << "<StartAfter>" << encoded(queryValue("start-after")) << "</StartAfter>";
+		result << "<KeyCount>" << listed << "</KeyCount>";
+	}
+	else{
+		result << "<Marker>" << encoded(queryValue("marker")) << "</Marker>";
+		if(truncated && !delimiter.empty())
+			result << "<NextMarker>" << encoded(last) << "</NextMarker>";
+	}
+	result << "<MaxKeys>" << maxKeys << "</MaxKeys>";
+	if(!delimiter.empty())
+		result << "<Delimiter>" << encoded(delimiter) << "</Delimiter>";
+	if(encode)
+		result << "<EncodingType>url</EncodingType>";
+	result << "<IsTruncated>" << (truncated ? "true" : "false") << "</IsTruncated>";
+	if(v2 && truncated)
+		result << "<NextContinuationToken>" << hexEncode(next) << "</NextContinuationToken>";
+	result << contents.str() << commonPrefixes.str() << "</ListBucketResult>";
+	return(Response(200,result.str()));
+}
+
+MockS3Server::Response MockS3Server::listUploads(const Request& request, const std::string& bucket){
+	auto prefix=request.query.find("prefix");
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("ListMultipartUploads");
+	if(!buckets.count(bucket))
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	std::ostringstream result;
+	result << xmlHeader << "<ListMultipartUploadsResult" << s3Namespace << "><Bucket>" << xmlEscape(bucket) << "</Bucket>";
+	if(prefix!=request.query.end())
+		result << "<Prefix>" << xmlEscape(prefix->second) << "</Prefix>";
+	result << "<IsTruncated>false</IsTruncated>";
+	for(const auto& upload : uploads){
+		if(upload.second.bucket!=bucket)
+			continue;
+		if(prefix!=request.query.end() && upload.second.key.compare(0,prefix->second.size(),prefix->second)!=0)
+			continue;
+		result << "<Upload><Key>" << xmlEscape(upload.second.key) << "</Key><UploadId>" << upload.first
+		       << "</UploadId><Initiated>" << isoTime(upload.second.initiated) << "</Initiated><StorageClass>STANDARD</StorageClass></Upload>";
+	}
+	result << "</ListMultipartUploadsResult>";
+	return(Response(200,result.str()));
+}
+
+MockS3Server::Response MockS3Server::deleteObjects(const Request& request, const std::string& bucket){
+	std::string digest=request.header("content-md5");
+	if(digest.empty())
+		return(error(400,"InvalidRequest","Missing required header for this request: Content-MD5",request.path));
+	if(digest!=base64(md5(request.body)))
+		return(error(400,"BadDigest","The Content-MD5 you specified did not match what we received.",request.path));
+	std::vector<std::string> keys;
+	bool quiet=false;
+	try{
+		for(const auto& object : elements(request.body,"Object"))
+			keys.push_back(element(object,"Key"));
+		quiet=(element(request.body,"Quiet")=="true");
+	}catch(std::exception&){
+		keys.clear();
+	}
+	if(keys.empty() || keys.size()>1000)
+		return(error(400,"MalformedXML","The XML you provided was not well-formed or did not validate against our published schema",request.path));
+
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("DeleteObjects");
+	auto b=buckets.find(bucket);
+	if(b==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	std::ostringstream result;
+	result << xmlHeader << "<DeleteResult" << s3Namespace << ">";
+	for(const auto& key : keys){
+		if(protectedObjects.count(bucket+"/"+key)){
+			result << "<Error><Key>" << xmlEscape(key) << "</Key><Code>AccessDenied</Code><Message>Access Denied</Message></Error>";
+			continue;
+		}
+		//as for single deletions, deleting an object which does not exist succeeds
+		b->second.objects.erase(key);
+		if(!quiet)
+			result << "<Deleted><Key>" << xmlEscape(key) << "</Key></Deleted>";
+	}
+	result << "</DeleteResult>";
+	return(Response(200,result.str()));
+}
+
+//Objects
+
+MockS3Server::Response MockS3Server::getObject(const Request& request, const std::string& bucket, const std::string& key){
+	Object object;
+	{
+		std::lock_guard<std::mutex> guard(storeLock);
+		count(request.verb=="HEAD" ? "HeadObject" : "GetObject");
+		auto b=buckets.find(bucket);
+		if(b==buckets.end())
+			return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+		auto it=b->second.objects.find(key);
+		if(it==b->second.objects.end())
+			return(error(404,"NoSuchKey","The specified key does not exist.",request.path));
+		object=it->second;
+	}
+	Response response;
+	response.body=object.data;
+	response.length=object.data->size();
+	response.headers["ETag"]=object.etag;
+	response.headers["Last-Modified"]=httpTime(object.lastModified);
+	response.headers["Accept-Ranges"]="bytes";
+	response.headers["Content-Type"]="binary/octet-stream";
+
+	//only single ranges are supported; as in S3, anything else is ignored
+	const std::string unit="bytes=";
+	std::string range=request.header("range");
+	if(range.compare(0,unit.size(),unit)!=0 || range.find(',')!=std::string::npos)
+		return(response);
+	range.erase(0,unit.size());
+	std::size_t dash=range.find('-');
+	if(dash==std::string::npos)
+		return(response);
+	const std::size_t size=object.data->size();
+	std::size_t first, last;
+	try{
+		if(dash==0){ //a suffix of the object
+			std::size_t suffix=std::stoull(range.substr(1));
+			first=(suffix>=size ? 0 : size-suffix);
+			last=size-1;
+			if(!suffix)
+				first=size;
+		}
+		else{
+			first=std::stoull(range.substr(0,dash));
+			last=(dash+1==range.size() ? size-1 : std::min<std::size_t>(std::stoull(range.substr(dash+1)),size-1));
+			if(first>last && first<size)
+				return(response); //an invalid range is ignored
+		}
+	}catch(std::exception&){
+		return(response);
+	}
+	if(first>=size){
+		Response unsatisfiable=error(416,"InvalidRange","The requested range is not satisfiable",request.path);
+		unsatisfiable.headers["Content-Range"]="bytes */"+std::to_string(size);
+		return(unsatisfiable);
+	}
+	response.status=206;
+	response.offset=first;
+	response.length=last-first+1;
+	response.headers["Content-Range"]="bytes "+std::to_string(first)+"-"+std::to_string(last)+"/"+std::to_string(size);
+	return(response);
+}
+
+MockS3Server::Response MockS3Server::putObject(const Request& request, const std::string& bucket, const std::string& key){
+	std::string digest=request.header("content-md5");
+	if(!digest.empty() && digest!=base64(md5(request.body)))
+		return(error(400,"BadDigest","The Content-MD5 you specified did not match what we received.",request.path));
+	Object object=makeObject(request.body);
+	Response response;
+	response.headers["ETag"]=object.etag;
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("PutObject");
+	auto b=buckets.find(bucket);
+	if(b==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	b->second.objects[key]=std::move(object);
+	return(response);
+}
+
+MockS3Server::Response MockS3Server::copyObject(const Request& request, const std::string& bucket, const std::string& key){
+	std::string source=percentDecode(request.header("x-amz-copy-source"));
+	source.erase(0,source.find_first_not_of('/'));
+	source=source.substr(0,source.find('?')); //ignore any version ID
+	std::size_t slash=source.find('/');
+	if(slash==std::string::npos || slash+1==source.size())
+		return(error(400,"InvalidArgument","Copy Source must mention the source bucket and key: sourcebucket/sourcekey",request.path));
+	std::string sourceBucket=source.substr(0,slash), sourceKey=source.substr(slash+1);
+
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("CopyObject");
+	auto from=buckets.find(sourceBucket), to=buckets.find(bucket);
+	if(from==buckets.end() || to==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	auto it=from->second.objects.find(sourceKey);
+	if(it==from->second.objects.end())
+		return(error(404,"NoSuchKey","The specified key does not exist.",request.path));
+	Object copy=it->second;
+	copy.lastModified=std::time(nullptr);
+	to->second.objects[key]=copy;
+	return(Response(200,xmlHeader+"<CopyObjectResult"+s3Namespace+"><LastModified>"+isoTime(copy.lastModified)
+	                +"</LastModified><ETag>"+xmlEscape(copy.etag)+"</ETag></CopyObjectResult>"));
+}
+
+MockS3Server::Response MockS3Server::deleteObject(const Request& request, const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("DeleteObject");
+	auto b=buckets.find(bucket);
+	if(b==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	if(protectedObjects.count(bucket+"/"+key))
+		return(error(403,"AccessDenied","Access Denied",request.path));
+	b->second.objects.erase(key);
+	return(Response(204));
+}
+
+//Multipart uploads
+
+MockS3Server::Response MockS3Server::createUpload(const Request& request, const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("CreateMultipartUpload");
+	if(!buckets.count(bucket))
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	std::string id=hexEncode(md5(bucket+"/"+key+"/"+std::to_string(nextUploadID++)));
+	Upload& upload=uploads[id];
+	upload.bucket=bucket;
+	upload.key=key;
+	upload.initiated=std::time(nullptr);
+	return(Response(200,xmlHeader+"<InitiateMultipartUploadResult"+s3Namespace+"><Bucket>"+xmlEscape(bucket)+"</Bucket><Key>"
+	                +xmlEscape(key)+"</Key><UploadId>"+id+"</UploadId></InitiateMultipartUploadResult>"));
+}
+
+MockS3Server::Response MockS3Server::uploadPart(const Request& request, const std::string& bucket, const std::string& key){
+	unsigned long partNumber=0;
+	try{
+		partNumber=std::stoul(request.query.find("partNumber")->second);
+	}catch(std::exception&){}
+	if(partNumber<1 || partNumber>10000)
+		return(error(400,"InvalidArgument","Part number must be an integer between 1 and 10000, inclusive",request.path));
+	std::string digest=request.header("content-md5");
+	if(!digest.empty() && digest!=base64(md5(request.body)))
+		return(error(400,"BadDigest","The Content-MD5 you specified did not match what we received.",request.path));
+	Object part=makeObject(request.body);
+	Response response;
+	response.headers["ETag"]=part.etag;
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("UploadPart");
+	auto upload=uploads.find(request.query.find("uploadId")->second);
+	if(upload==uploads.end() || upload->second.bucket!=bucket || upload->second.key!=key)
+		return(error(404,"NoSuchUpload","The specified upload does not exist. The upload ID may be invalid, or the upload may have been aborted or completed.",request.path));
+	upload->second.parts[partNumber]=std::move(part);
+	return(response);
+}
+
+MockS3Server::Response MockS3Server::completeUpload(const Request& request, const std::string& bucket, const std::string& key){
+	std::vector<std::pair<unsigned long,std::string>> requested;
+	try{
+		for(const auto& part : elements(request.body,"Part")){
+			std::string etag=element(part,"ETag");
+			if(etag.empty() || etag.front()!='"')
+				etag="\""+etag+"\"";
+			requested.emplace_back(std::stoul(element(part,"PartNumber")),etag);
+		}
+	}catch(std::exception&){
+		requested.clear();
+	}
+	if(requested.empty())
+		return(error(400,"MalformedXML","The XML you provided was not well-formed or did not validate against our published schema",request.path));
+
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("CompleteMultipartUpload");
+	auto upload=uploads.find(request.query.find("uploadId")->second);
+	if(upload==uploads.end() || upload->second.bucket!=bucket || upload->second.key!=key)
+		return(error(404,"NoSuchUpload","The specified upload does not exist. The upload ID may be invalid, or the upload may have been aborted or completed.",request.path));
+	auto b=buckets.find(bucket);
+	if(b==buckets.end())
+		return(error(404,"NoSuchBucket","The specified bucket does not exist",request.path));
+	for(std::size_t i=1; i<requested.size(); i++){
+		if(requested[i].first<=requested[i-1].first)
+			return(error(400,"InvalidPartOrder","The list of parts was not in ascending order. The parts list must be specified in order by part number.",request.path));
+	}
+	std::string data, digests;
+	for(std::size_t i=0; i<requested.size(); i++){
+		auto part=upload->second.parts.find(requested[i].first);
+		if(part==upload->second.parts.end() || part->second.etag!=requested[i].second)
+			return(error(400,"InvalidPart","One or more of the specified parts could not be found. The part might not have been uploaded, or the specified entity tag might not have matched the part's entity tag.",request.path));
+		if(i+1<requested.size() && part->second.data->size()<opts.minPartSize)
+			return(error(400,"EntityTooSmall","Your proposed upload is smaller than the minimum allowed object size.",request.path));
+		data+=*part->second.data;
+		digests+=hexDecode(part->second.etag.substr(1,32));
+	}
+	Object object=makeObject(std::move(data));
+	//the entity tag of a multipart object is derived from those of its parts
+	object.etag="\""+hexEncode(md5(digests))+"-"+std::to_string(requested.size())+"\"";
+	std::string etag=object.etag;
+	b->second.objects[key]=std::move(object);
+	uploads.erase(upload);
+	return(Response(200,xmlHeader+"<CompleteMultipartUploadResult"+s3Namespace+"><Location>"+xmlEscape(request.path)+"</Location><Bucket>"
+	                +xmlEscape(bucket)+"</Bucket><Key>"+xmlEscape(key)+"</Key><ETag>"+xmlEscape(etag)+"</ETag></CompleteMultipartUploadResult>"));
+}
+
+MockS3Server::Response MockS3Server::abortUpload(const Request& request, const std::string& bucket, const std::string& key){
+	std::lock_guard<std::mutex> guard(storeLock);
+	count("AbortMultipartUpload");
+	auto upload=uploads.find(request.query.find("uploadId")->second);
+	if(upload==uploads.end() || upload->second.bucket!=bucket || upload->second.key!=key)
+		return(error(404,"NoSuchUpload","The specified upload does not exist. The upload ID may be invalid, or the upload may have been aborted or completed.",request.path));
+	uploads.erase(upload);
+	return(Response(204));
+}
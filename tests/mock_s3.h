@@ -0,0 +1,246 @@
+#ifndef S3TOOLS_TESTS_MOCK_S3_H
+#define S3TOOLS_TESTS_MOCK_S3_H
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loopback_server.h"
+
+///An in-memory stand-in for an S3 server, listening on the loopback interface,
+///so that the tools and library can be exercised without network access.
+///
+///Buckets are addressed by path (http://127.0.0.1:port/bucket/key). Supported
+///operations are:
+/// - ListBuckets, and creating, deleting, and checking for buckets, as well as
+///   their location and versioning subresources
+/// - ListObjectsV2 (and the original ListObjects), with prefixes,
+///   delimiters, and continuation tokens
+/// - GET (including byte ranges), HEAD, PUT, and DELETE for objects
+/// - Server-side copies, via x-amz-copy-source
+/// - Multipart uploads: initiating, uploading parts, completing, aborting,
+///   and listing uploads in progress
+/// - DeleteObjects
+///
+///Every request must carry an AWS Signature Version 4, either in the query
+///string or in an Authorization header, made with one of the configured
+///credentials, and is rejected as real S3 would if it does not.
+///
+///Each connection is served by its own thread, using HTTP/1.1. To make the
+///server behave more like a remote one, responses can be delayed, bodies sent
+///and received at a limited rate, and a fraction of requests can be failed.
+class MockS3Server : public Listener{
+public:
+	struct Options{
+		///The port on which to listen, or zero to choose one arbitrarily
+		unsigned int port;
+		///The time by which each response is delayed
+		std::chrono::milliseconds latency;
+		///The rate in bytes per second at which each connection sends and
+		///receives bodies, or zero for no limit
+		std::size_t bandwidth;
+		///The fraction of requests which are answered with a 503 SlowDown
+		///error rather than being carried out
+		double errorRate;
+		///The fraction of requests after which the connection is closed
+		///without any response being sent
+		double dropRate;
+		///The largest number of keys returned in one page of a listing
+		std::size_t maxKeys;
+		///The smallest permitted size for parts of a multipart upload other
+		///than the last
+		std::size_t minPartSize;
+		///Access key IDs and the secret keys which go with them
+		std::map<std::string,std::string> credentials;
+		///Whether to check request signatures
+		bool verifySignatures;
+		///The seed for choosing which requests fail
+		unsigned int seed;
+
+		Options():port(0),latency(0),bandwidth(0),errorRate(0),dropRate(0),
+		maxKeys(1000),minPartSize(5UL<<20),verifySignatures(true),seed(0){}
+	};
+
+	explicit MockS3Server(Options options=Options());
+	///Closes all connections, and waits for the threads serving them to finish
+	~MockS3Server();
+	MockS3Server(const MockS3Server&)=delete;
+	MockS3Server& operator=(const MockS3Server&)=delete;
+
+	const Options& options() const{ return(opts); }
+
+	//Direct access to the stored data, for setting up and checking tests
+
+	void createBucket(const std::string& bucket);
+	bool hasBucket(const std::string& bucket) const;
+	///\throws std::runtime_error if the bucket does not exist
+	void putObject(const std::string& bucket, const std::string& key, std::string data);
+	bool hasObject(const std::string& bucket, const std::string& key) const;
+	///\return whether the object existed
+	bool removeObject(const std::string& bucket, const std::string& key);
+	///Make requests to delete an object fail with AccessDenied, whether made
+	///alone or as part of DeleteObjects
+	void protectObject(const std::string& bucket, const std::string& key);
+	///\throws std::runtime_error if the object does not exist
+	std::string getObject(const std::string& bucket, const std::string& key) const;
+	///\return the keys of all objects in a bucket, in order
+	std::vector<std::string> keys(const std::string& bucket) const;
+	///Begin a multipart upload, as an interrupted transfer might have left
+	///\throws std::runtime_error if the bucket does not exist
+	///\return the upload ID
+	std::string startUpload(const std::string& bucket, const std::string& key);
+	///\return the number of multipart uploads which have been neither
+	///        completed nor aborted
+	std::size_t uploadsInProgress() const;
+	///\return the number of requests made for the given operation, named as in
+	///        the S3 API reference (e.g. "ListObjectsV2", "GetObject")
+	unsigned int operationCount(const std::string& operation) const;
+
+	///The number of connections accepted
+	std::atomic<unsigned int> connections;
+	///The number of requests received
+	std::atomic<unsigned int> requests;
+	///The number of requests rejected because of their signatures
+	std::atomic<unsigned int> rejectedSignatures;
+	///The number of requests failed by error injection
+	std::atomic<unsigned int> injectedErrors;
+
+	///A parsed HTTP request
+	struct Request{
+		std::string verb;
+		///The percent-decoded path
+		std::string path;
+		///The raw query string, without the leading '?'
+		std::string rawQuery;
+		///The query parameters, percent-decoded
+		std::map<std::string,std::string> query;
+		///The request headers, with names converted to lowercase
+		std::map<std::string,std::string> headers;
+		std::string body;
+
+		bool hasQuery(const std::string& name) const{ return(query.count(name)); }
+		std::string header(const std::string& name) const{
+			auto it=headers.find(name);
+			return(it==headers.end()?"":it->second);
+		}
+	};
+
+	///Build the canonical request which Signature Version 4 signs, from a
+	///request as it was received. This follows the published algorithm
+	///rather than using the library's signing code, so that each checks the
+	///other.
+	///\param signedHeaders the names of the signed headers, separated by ';'
+	///\param presigned whether the request is signed with query parameters,
+	///                 rather than an Authorization header
+	static std::string canonicalRequest(const Request& request, const std::string& signedHeaders, bool presigned);
+	///Compute a Signature Version 4 signature
+	///\param secret the secret key
+	///\param timestamp the time of signing, like 20130524T000000Z
+	///\param scope the credential scope, like 20130524/us-east-1/s3/aws4_request
+	///\return the signature, in lowercase hexadecimal
+	static std::string signature(const std::string& secret, const std::string& timestamp,
+	                             const std::string& scope, const std::string& canonicalRequest);
+
+	///An HTTP response
+	struct Response{
+		unsigned int status;
+		std::map<std::string,std::string> headers;
+		///The body, shared to avoid copying large objects
+		std::shared_ptr<const std::string> body;
+		///The part of the body to send
+		std::size_t offset, length;
+
+		Response(unsigned int status=200, std::string body=""):status(status),
+		body(std::make_shared<const std::string>(std::move(body))),offset(0),length(this->body->size()){}
+	};
+
+private:
+	struct Object{
+		std::shared_ptr<const std::string> data;
+		///The quoted entity tag
+		std::string etag;
+		std::time_t lastModified;
+	};
+	struct Bucket{
+		std::map<std::string,Object> objects;
+		std::time_t created;
+	};
+	struct Upload{
+		std::string bucket, key;
+		std::map<unsigned int,Object> parts;
+		std::time_t initiated;
+	};
+	struct Connection{
+		int fd;
+		std::thread handler;
+		std::atomic<bool> finished;
+		Connection(int fd):fd(fd),finished(false){}
+	};
+
+	Options opts;
+	std::atomic<bool> stopping;
+	std::thread acceptor;
+	std::mutex connectionLock;
+	std::list<Connection> active;
+
+	mutable std::mutex storeLock;
+	std::map<std::string,Bucket> buckets;
+	std::map<std::string,Upload> uploads;
+	unsigned long long nextUploadID;
+	std::map<std::string,unsigned int> operations;
+	///Objects which cannot be deleted, as bucket/key
+	std::set<std::string> protectedObjects;
+
+	std::mutex randomLock;
+	std::mt19937 random;
+
+	void accept();
+	void serve(Connection& connection);
+	///Read one request from a connection
+	///\return false if the connection was closed or the request was malformed
+	bool readRequest(int fd, std::string& buffer, Request& request);
+	bool readBody(int fd, std::string& buffer, std::size_t size, std::string& body);
+	bool sendResponse(int fd, const Request& request, const Response& response);
+	///Wait as needed to keep a transfer which began at the given time within
+	///the bandwidth limit
+	void throttle(std::chrono::steady_clock::time_point start, std::size_t transferred) const;
+	bool chance(double probability);
+
+	Response handle(const Request& request);
+	///\return an error response if the request is not correctly signed
+	std::unique_ptr<Response> checkSignature(const Request& request);
+	void count(const std::string& operation);
+
+	Response listBuckets(const Request& request);
+	Response createBucket(const Request& request, const std::string& bucket);
+	Response deleteBucket(const Request& request, const std::string& bucket);
+	Response headBucket(const Request& request, const std::string& bucket);
+	Response getBucketLocation(const Request& request, const std::string& bucket);
+	Response getBucketVersioning(const Request& request, const std::string& bucket);
+	Response listObjects(const Request& request, const std::string& bucket);
+	Response listUploads(const Request& request, const std::string& bucket);
+	Response deleteObjects(const Request& request, const std::string& bucket);
+	Response getObject(const Request& request, const std::string& bucket, const std::string& key);
+	Response putObject(const Request& request, const std::string& bucket, const std::string& key);
+	Response copyObject(const Request& request, const std::string& bucket, const std::string& key);
+	Response deleteObject(const Request& request, const std::string& bucket, const std::string& key);
+	Response createUpload(const Request& request, const std::string& bucket, const std::string& key);
+	Response uploadPart(const Request& request, const std::string& bucket, const std::string& key);
+	Response completeUpload(const Request& request, const std::string& bucket, const std::string& key);
+	Response abortUpload(const Request& request, const std::string& bucket, const std::string& key);
+
+	static Response error(unsigned int status, const std::string& code,
+	                      const std::string& message, const std::string& resource="");
+	static Object makeObject(std::string data);
+};
+
+#endif //S3TOOLS_TESTS_MOCK_S3_H
@@ -0,0 +1,87 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mock_s3.h"
+#include "../src/external/cl_options.h"
+
+int main(int argc, char* argv[]){
+	std::string usage=R"(NAME
+ mock_s3 - run a local, in-memory stand-in for an S3 server
+
+USAGE
+ mock_s3 [options]
+    Serve requests on the loopback interface until interrupted. Data is kept
+    only in memory, and is lost when the server stops. Requests must be signed
+    with one of the configured credentials, which should also be stored (see
+    s3cred) for the URL printed on startup.
+
+OPTIONS)";
+	MockS3Server::Options options;
+	std::vector<std::string> buckets;
+	unsigned long latency=0;
+	OptionParser op;
+	op.setBaseUsage(usage);
+	op.addOption({"p","port"},options.port,
+				 "The port on which to listen. By default one is chosen arbitrarily.","port");
+	op.addOption({"c","credential"},std::function<void(std::string)>([&](std::string value){
+		std::size_t colon=value.find(':');
+		if(colon==std::string::npos)
+			throw std::runtime_error("Credentials must be given as KEY_ID:SECRET");
+		options.credentials[value.substr(0,colon)]=value.substr(colon+1);
+	}),"Accept requests signed with the given access key ID and secret key.\n"
+	    "May be given multiple times. If not given, mock:mocksecret is used.","KEY_ID:SECRET");
+	op.addOption({"b","bucket"},std::function<void(std::string)>([&](std::string bucket){ buckets.push_back(bucket); }),
+				 "Create a bucket on startup. May be given multiple times.","name");
+	op.addOption("latency",latency,"Delay each response by this many milliseconds.","ms");
+	op.addOption("bandwidth",options.bandwidth,
+				 "Limit each connection to sending and receiving this many bytes per\n"
+				 "second of request and response bodies.","bytes/s");
+	op.addOption("error-rate",options.errorRate,
+				 "Answer this fraction of requests with a 503 SlowDown error.","fraction");
+	op.addOption("drop-rate",options.dropRate,
+				 "Close the connection without answering this fraction of requests.","fraction");
+	op.addOption("max-keys",options.maxKeys,
+				 "The largest number of keys to return in one page of a listing.","count");
+	op.addOption("min-part-size",options.minPartSize,
+				 "The smallest size allowed for parts of multipart uploads, other than the\n"
+				 "last.","bytes");
+	op.addOption("no-verify",[&]{options.verifySignatures=false;},
+				 "Accept requests without checking their signatures.");
+	std::vector<std::string> arguments;
+	try{
+		arguments=op.parseArgs(argc,argv);
+	}catch(std::exception& ex){
+		std::cerr << ex.what() << std::endl;
+		return(1);
+	}
+	if(op.didPrintUsage())
+		return(0);
+	if(arguments.size()!=1){
+		std::cout << op.getUsage() << std::endl;
+		return(1);
+	}
+	options.latency=std::chrono::milliseconds(latency);
+	if(options.credentials.empty())
+		options.credentials["mock"]="mocksecret";
+
+	//wait for a signal in this thread, keeping it from the server's threads
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals,SIGINT);
+	sigaddset(&signals,SIGTERM);
+	pthread_sigmask(SIG_BLOCK,&signals,nullptr);
+	try{
+		MockS3Server server(options);
+		for(const auto& bucket : buckets)
+			server.createBucket(bucket);
+		std::cout << "Listening at " << server.url("") << std::endl;
+		int signal;
+		sigwait(&signals,&signal);
+		std::cout << server.requests << " requests received on " << server.connections << " connections" << std::endl;
+	}catch(std::exception& ex){
+		std::cerr << ex.what() << std::endl;
+		return(1);
+	}
+}
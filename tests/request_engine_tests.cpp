@@ -0,0 +1,228 @@
+#include <s3tools/request_engine.h>
+#include <cassert>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "loopback_server.h"
+
+int main(){
+	using namespace s3tools;
+
+	{ //a request to a server which never answers should time out
+		Listener silent;
+		RequestEngine engine;
+		HTTPRequest request(URL(silent.url()));
+		request.setTimeout(std::chrono::milliseconds(200));
+		HTTPResponse response=engine.perform(request);
+		assert(response.result==RequestStatus::TimedOut);
+		assert(!response.complete());
+	}
+	{ //cancelling a request which is in progress
+		Listener silent;
+		RequestEngine engine;
+		bool called=false;
+		RequestStatus result=RequestStatus::Complete;
+		auto id=engine.submit(HTTPRequest(URL(silent.url())),[&](HTTPResponse response){
+			called=true;
+			result=response.result;
+		});
+		engine.poll(std::chrono::milliseconds(50));
+		assert(!called);
+		assert(engine.cancel(id));
+		engine.run();
+		assert(called);
+		assert(result==RequestStatus::Cancelled);
+		assert(!engine.cancel(id)); //no longer known
+	}
+	{ //queued requests whose deadlines pass before they can start
+		Listener silent;
+		RequestEngine::Options options;
+		options.maxConcurrent=1;
+		RequestEngine engine(options);
+		HTTPRequest first(URL(silent.url()));
+		first.setTimeout(std::chrono::milliseconds(300));
+		HTTPRequest second(URL(silent.url()));
+		second.setTimeout(std::chrono::milliseconds(100));
+		auto firstResult=engine.submit(first);
+		auto secondResult=engine.submit(second);
+		engine.run();
+		assert(firstResult.get().result==RequestStatus::TimedOut);
+		HTTPResponse response=secondResult.get();
+		assert(response.result==RequestStatus::TimedOut);
+		assert(response.status==0);
+	}
+	{ //many concurrent requests from one thread reuse a small number of connections
+		LoopbackServer server;
+		RequestEngine::Options options;
+		options.maxHostConnections=4;
+		RequestEngine engine(options);
+		const unsigned int nRequests=500;
+		unsigned int completed=0;
+		for(unsigned int i=0; i<nRequests; i++){
+			engine.submit(HTTPRequest(URL(server.url("/obj"+std::to_string(i)))),[&](HTTPResponse response){
+				assert(response.complete());
+				assert(response.status==200);
+				assert(response.body=="hello");
+				assert(response.headers["x-test"]=="yes");
+				completed++;
+			});
+		}
+		engine.run();
+		assert(completed==nRequests);
+		assert(server.connections<=4);
+	}
+	{ //futures with a background thread driving the engine
+		LoopbackServer server;
+		RequestEngine engine;
+		engine.start();
+		std::vector<std::future<HTTPResponse>> results;
+		for(unsigned int i=0; i<50; i++){
+			HTTPRequest request(URL(server.url()));
+			request.url.verb="PUT";
+			request.body="data";
+			results.push_back(engine.submit(request));
+		}
+		for(auto& result : results){
+			HTTPResponse response=result.get();
+			assert(response.complete());
+			assert(response.body=="hello");
+		}
+		//sinks receive the body instead of the response
+		std::string received;
+		HTTPRequest request(URL(server.url()));
+		request.sink=[&](const char* data, std::size_t size){ received.append(data,size); return(true); };
+		HTTPResponse response=engine.perform(request);
+		assert(response.complete());
+		assert(response.body.empty());
+		assert(received=="hello");
+		//a sink which refuses data fails the request
+		request.sink=[](const char*, std::size_t){ return(false); };
+		response=engine.perform(request);
+		assert(response.result==RequestStatus::Failed);
+		engine.stop();
+	}
+	{ //observers see each finished request, with its timing
+		LoopbackServer server;
+		RequestEngine::Options options;
+		std::vector<std::string> observed;
+		options.observer=[&](const HTTPRequest& request, const HTTPResponse& response){
+			observed.push_back(request.url.path);
+			assert(response.complete());
+			assert(response.timing.total>=response.timing.startTransfer);
+			assert(response.timing.startTransfer>=response.timing.connect);
+			assert(response.timing.bytesReceived==5);
+		};
+		RequestEngine engine(options);
+		HTTPRequest request(URL(server.url("/first")));
+		request.url.verb="PUT";
+		request.body="data";
+		HTTPResponse response=engine.perform(request);
+		assert(response.timing.bytesSent==4);
+		assert(response.timing.total.count()>0);
+		engine.perform(HTTPRequest(URL(server.url("/second"))));
+		assert((observed==std::vector<std::string>{"/first","/second"}));
+	}
+	{ //requests are spread among equivalent endpoints, without changing their URLs
+		std::atomic<unsigned int> counts[3]={{0},{0},{0}};
+		std::vector<std::unique_ptr<LoopbackServer>> servers;
+		RequestEngine::Options options;
+		for(unsigned int i=0; i<3; i++){
+			std::atomic<unsigned int>& count=counts[i];
+			servers.emplace_back(new LoopbackServer([&count](const std::string& head, const std::string&){
+				assert(head.find("\r\nHost: gateway.invalid:1234\r\n")!=std::string::npos);
+				count++;
+				return(LoopbackServer::response(200,"hello"));
+			}));
+			options.endpoints["http://gateway.invalid:1234"].push_back(servers.back()->url());
+		}
+		RequestEngine engine(options);
+		const unsigned int nRequests=300;
+		unsigned int completed=0;
+		for(unsigned int i=0; i<nRequests; i++){
+			engine.submit(HTTPRequest(URL("http://gateway.invalid:1234/obj"+std::to_string(i))),[&](HTTPResponse response){
+				assert(response.complete());
+				assert(response.body=="hello");
+				completed++;
+			});
+		}
+		engine.run();
+		assert(completed==nRequests);
+		for(const auto& count : counts)
+			assert(count>=nRequests/6);
+	}
+	{ //endpoints which cannot be reached are avoided
+		unsigned int deadPort;
+		{
+			Listener closed;
+			deadPort=closed.port;
+		}
+		LoopbackServer server;
+		RequestEngine::Options options;
+		options.endpoints["http://gateway.invalid"]={"http://127.0.0.1:"+std::to_string(deadPort),server.url()};
+		RequestEngine engine(options);
+		unsigned int retries=0;
+		for(unsigned int i=0; i<20; i++){
+			HTTPResponse response=engine.perform(HTTPRequest(URL("http://gateway.invalid/obj")));
+			assert(response.complete());
+			assert(response.body=="hello");
+			retries+=response.retries;
+		}
+		//the unreachable endpoint is tried at most once before being ejected
+		assert(retries<=1);
+	}
+	{ //hedged requests which are slow to get a response are duplicated
+		//the first request for each path is answered slowly, and any others quickly
+		std::mutex seenLock;
+		std::set<std::string> seen;
+		LoopbackServer server([&](const std::string& head, const std::string&){
+			std::string path=head.substr(4,head.find(' ',4)-4);
+			bool first;
+			{
+				std::lock_guard<std::mutex> guard(seenLock);
+				first=seen.insert(path).second;
+			}
+			if(first)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			return(LoopbackServer::response(200,first ? "slow" : "fast"));
+		});
+		RequestEngine::Options options;
+		options.hedgeDelay=std::chrono::milliseconds(50);
+		options.hedgeBudget=0;
+		RequestEngine engine(options);
+		auto start=std::chrono::steady_clock::now();
+		std::string received;
+		HTTPRequest request(URL(server.url("/object")));
+		request.hedge=true;
+		request.sink=[&](const char* data, std::size_t size){ received.append(data,size); return(true); };
+		HTTPResponse response=engine.perform(request);
+		assert(response.complete());
+		assert(response.hedged);
+		assert(received=="fast");
+		assert(std::chrono::steady_clock::now()-start<std::chrono::milliseconds(500));
+		//requests which are not hedged just wait
+		response=engine.perform(HTTPRequest(URL(server.url("/other"))));
+		assert(!response.hedged && response.body=="slow");
+
+		//with no budget, only the initial allowance of duplicates is sent
+		std::vector<std::future<HTTPResponse>> results;
+		for(unsigned int i=0; i<10; i++){
+			HTTPRequest request(URL(server.url("/object"+std::to_string(i))));
+			request.hedge=true;
+			results.push_back(engine.submit(request));
+		}
+		engine.run();
+		unsigned int hedged=0;
+		for(auto& result : results){
+			HTTPResponse response=result.get();
+			assert(response.complete());
+			hedged+=response.hedged;
+		}
+		assert(hedged==1);
+	}
+}
@@ -0,0 +1,294 @@
+#ifndef S3TOOLS_TESTS_TLS_SERVER_H
+#define S3TOOLS_TESTS_TLS_SERVER_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <stdlib.h>
+
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include "loopback_server.h"
+
+///A stand-in for an HTTPS front-end which speaks both HTTP/2 and HTTP/1.1,
+///selected by ALPN during the TLS handshake, using a self-signed certificate
+///generated on construction.
+///
+///Every request is answered with the same response after a fixed delay. On
+///HTTP/2 connections requests are answered independently, so many can be
+///waiting at once, while HTTP/1.1 connections answer one request at a time.
+///Request headers are not decoded, so only enough of HTTP/2 is implemented to
+///serve clients which can be trusted to be well behaved.
+struct TLSServer : public Listener{
+	std::string body;
+	std::chrono::milliseconds latency;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned int> connections;
+	std::atomic<unsigned int> http2Connections;
+	std::atomic<unsigned int> requests;
+	std::thread acceptor;
+	std::vector<std::thread> handlers;
+	SSL_CTX* context;
+	///The path to a file containing the server's certificate, which clients
+	///should trust
+	std::string caFile;
+
+	explicit TLSServer(std::string body="hello", std::chrono::milliseconds latency=std::chrono::milliseconds(0)):
+	body(body),latency(latency),stopping(false),connections(0),http2Connections(0),requests(0){
+		context=SSL_CTX_new(TLS_server_method());
+		assert(context);
+		makeCertificate();
+		SSL_CTX_set_alpn_select_cb(context,&selectProtocol,nullptr);
+		acceptor=std::thread([this]{
+			while(true){
+				int conn=accept(fd,nullptr,nullptr);
+				if(conn<0 || stopping){
+					if(conn>=0)
+						close(conn);
+					return;
+				}
+				connections++;
+				handlers.emplace_back([this,conn]{ serve(conn); });
+			}
+		});
+	}
+	~TLSServer(){
+		stopping=true;
+		//unblock accept
+		shutdown(fd,SHUT_RDWR);
+		acceptor.join();
+		for(auto& handler : handlers)
+			handler.join();
+		SSL_CTX_free(context);
+		unlink(caFile.c_str());
+	}
+	std::string url(const std::string& path="/") const{
+		return("https://127.0.0.1:"+std::to_string(port)+path);
+	}
+
+	void makeCertificate(){
+		EVP_PKEY* key=nullptr;
+		EVP_PKEY_CTX* keyContext=EVP_PKEY_CTX_new_id(EVP_PKEY_EC,nullptr);
+		EVP_PKEY_keygen_init(keyContext);
+		EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext,NID_X9_62_prime256v1);
+		EVP_PKEY_keygen(keyContext,&key);
+		EVP_PKEY_CTX_free(keyContext);
+		assert(key);
+
+		X509* cert=X509_new();
+		X509_set_version(cert,2);
+		ASN1_INTEGER_set(X509_get_serialNumber(cert),1);
+		X509_gmtime_adj(X509_getm_notBefore(cert),-3600);
+		X509_gmtime_adj(X509_getm_notAfter(cert),24*3600);
+		X509_set_pubkey(cert,key);
+		X509_NAME* name=X509_get_subject_name(cert);
+		X509_NAME_add_entry_by_txt(name,"CN",MBSTRING_ASC,(const unsigned char*)"127.0.0.1",-1,-1,0);
+		X509_set_issuer_name(cert,name);
+		X509V3_CTX extContext;
+		X509V3_set_ctx_nodb(&extContext);
+		X509V3_set_ctx(&extContext,cert,cert,nullptr,nullptr,0);
+		for(auto ext : {std::make_pair(NID_subject_alt_name,"IP:127.0.0.1"),std::make_pair(NID_basic_constraints,"critical,CA:TRUE")}){
+			X509_EXTENSION* extension=X509V3_EXT_conf_nid(nullptr,&extContext,ext.first,ext.second);
+			X509_add_ext(cert,extension,-1);
+			X509_EXTENSION_free(extension);
+		}
+		X509_sign(cert,key,EVP_sha256());
+		SSL_CTX_use_certificate(context,cert);
+		SSL_CTX_use_PrivateKey(context,key);
+
+		char path[]="/tmp/s3tools_test_cert_XXXXXX";
+		int certFD=mkstemp(path);
+		assert(certFD>=0);
+		FILE* certFile=fdopen(certFD,"w");
+		PEM_write_X509(certFile,cert);
+		fclose(certFile);
+		caFile=path;
+		X509_free(cert);
+		EVP_PKEY_free(key);
+	}
+
+	static int selectProtocol(SSL*, const unsigned char** out, unsigned char* outlen,
+	                          const unsigned char* in, unsigned int inlen, void*){
+		static const unsigned char supported[]="\x02h2\x08http/1.1";
+		if(SSL_select_next_proto((unsigned char**)out,outlen,supported,sizeof(supported)-1,in,inlen)!=OPENSSL_NPN_NEGOTIATED)
+			return(SSL_TLSEXT_ERR_NOACK);
+		return(SSL_TLSEXT_ERR_OK);
+	}
+
+	static bool readFully(SSL* ssl, std::string& buffer, std::size_t size){
+		buffer.resize(size);
+		std::size_t done=0;
+		while(done<size){
+			int amount=SSL_read(ssl,&buffer[done],size-done);
+			if(amount<=0)
+				return(false);
+			done+=amount;
+		}
+		return(true);
+	}
+	static bool writeFully(SSL* ssl, const std::string& data){
+		return(data.empty() || SSL_write(ssl,data.data(),data.size())==(int)data.size());
+	}
+
+	void serve(int conn){
+		SSL* ssl=SSL_new(context);
+		SSL_set_fd(ssl,conn);
+		if(SSL_accept(ssl)==1){
+			const unsigned char* protocol;
+			unsigned int protocolLength=0;
+			SSL_get0_alpn_selected(ssl,&protocol,&protocolLength);
+			if(std::string((const char*)protocol,protocolLength)=="h2"){
+				http2Connections++;
+				serveHTTP2(ssl,conn);
+			}
+			else
+				serveHTTP1(ssl);
+			SSL_shutdown(ssl);
+		}
+		SSL_free(ssl);
+		close(conn);
+	}
+
+	void serveHTTP1(SSL* ssl){
+		const std::string response=LoopbackServer::response(200,body);
+		std::string buffer;
+		char data[4096];
+		bool continued=false;
+		while(true){
+			int amount=SSL_read(ssl,data,sizeof(data));
+			if(amount<=0)
+				return;
+			buffer.append(data,amount);
+			size_t end;
+			while((end=buffer.find("\r\n\r\n"))!=std::string::npos){
+				std::string lowered=buffer.substr(0,end+2);
+				std::transform(lowered.begin(),lowered.end(),lowered.begin(),::tolower);
+				std::size_t bodySize=0, pos=lowered.find("\r\ncontent-length:");
+				if(pos!=std::string::npos)
+					bodySize=std::stoul(lowered.substr(pos+17));
+				if(buffer.size()<end+4+bodySize){
+					//don't make the client wait to find out that it may send the body
+					if(!continued && lowered.find("\r\nexpect: 100-continue")!=std::string::npos){
+						if(!writeFully(ssl,"HTTP/1.1 100 Continue\r\n\r\n"))
+							return;
+						continued=true;
+					}
+					break; //wait for the rest of the body
+				}
+				buffer.erase(0,end+4+bodySize);
+				continued=false;
+				requests++;
+				std::this_thread::sleep_for(latency);
+				if(!writeFully(ssl,response))
+					return;
+			}
+		}
+	}
+
+	enum FrameType : std::uint8_t{DATA=0,HEADERS=1,SETTINGS=4,PING=6,GOAWAY=7,WINDOW_UPDATE=8};
+	enum Flags : std::uint8_t{END_STREAM=1,ACK=1,END_HEADERS=4};
+
+	static std::string frame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream, const std::string& payload){
+		std::string result(9,'\0');
+		result[0]=(char)(payload.size()>>16);
+		result[1]=(char)(payload.size()>>8);
+		result[2]=(char)payload.size();
+		result[3]=(char)type;
+		result[4]=(char)flags;
+		return(result.replace(5,4,uint32(stream))+payload);
+	}
+	static std::string uint32(std::uint32_t value){
+		std::string result(4,'\0');
+		for(unsigned int i=0; i<4; i++)
+			result[i]=(char)(value>>(8*(3-i)));
+		return(result);
+	}
+
+	std::string http2Response(std::uint32_t stream) const{
+		//HPACK: indexed ':status: 200', then 'content-length' as a literal
+		//with an indexed name, without Huffman coding
+		std::string length=std::to_string(body.size());
+		std::string headers="\x88\x0f\x0d";
+		headers+=(char)length.size();
+		headers+=length;
+		std::string result=frame(HEADERS,END_HEADERS,stream,headers);
+		const std::size_t maxFrame=16384;
+		std::size_t offset=0;
+		do{
+			std::size_t amount=std::min(maxFrame,body.size()-offset);
+			bool last=(offset+amount==body.size());
+			result+=frame(DATA,last?END_STREAM:0,stream,body.substr(offset,amount));
+			offset+=amount;
+		}while(offset<body.size());
+		return(result);
+	}
+
+	void serveHTTP2(SSL* ssl, int conn){
+		//streams whose requests are complete, in order of when to answer them
+		using Due=std::pair<std::chrono::steady_clock::time_point,std::uint32_t>;
+		std::priority_queue<Due,std::vector<Due>,std::greater<Due>> due;
+
+		std::string header, payload;
+		//the client connection preface
+		if(!readFully(ssl,header,24) || header!="PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")
+			return;
+		//SETTINGS_MAX_CONCURRENT_STREAMS=1000
+		if(!writeFully(ssl,frame(SETTINGS,0,0,std::string("\x00\x03",2)+uint32(1000))))
+			return;
+		while(true){
+			std::string output;
+			auto now=std::chrono::steady_clock::now();
+			while(!due.empty() && due.top().first<=now){
+				output+=http2Response(due.top().second);
+				due.pop();
+			}
+			if(!writeFully(ssl,output))
+				return;
+			if(!SSL_pending(ssl)){
+				//wait for more data from the client, or until the next response is due
+				int timeout=-1;
+				if(!due.empty())
+					timeout=std::chrono::duration_cast<std::chrono::milliseconds>(due.top().first-now).count()+1;
+				pollfd pfd={conn,POLLIN,0};
+				if(poll(&pfd,1,timeout)==0)
+					continue;
+			}
+
+			if(!readFully(ssl,header,9))
+				return;
+			std::size_t length=((std::uint8_t)header[0]<<16)|((std::uint8_t)header[1]<<8)|(std::uint8_t)header[2];
+			std::uint8_t type=header[3], flags=header[4];
+			std::uint32_t stream=(((std::uint8_t)header[5]&0x7F)<<24)|((std::uint8_t)header[6]<<16)|((std::uint8_t)header[7]<<8)|(std::uint8_t)header[8];
+			if(!readFully(ssl,payload,length) || type==GOAWAY)
+				return;
+			if(type==SETTINGS && !(flags&ACK))
+				output=frame(SETTINGS,ACK,0,"");
+			else if(type==PING && !(flags&ACK))
+				output=frame(PING,ACK,0,payload);
+			else if(type==DATA && length)
+				//return the flow-control credit used by uploaded data
+				output=frame(WINDOW_UPDATE,0,0,uint32(length))+frame(WINDOW_UPDATE,0,stream,uint32(length));
+			else
+				output.clear();
+			if(!writeFully(ssl,output))
+				return;
+			if((type==HEADERS || type==DATA) && (flags&END_STREAM)){
+				requests++;
+				due.emplace(std::chrono::steady_clock::now()+latency,stream);
+			}
+		}
+	}
+};
+
+#endif //S3TOOLS_TESTS_TLS_SERVER_H
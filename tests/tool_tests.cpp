@@ -0,0 +1,453 @@
+#include <s3tools/cred_manage.h>
+#include <cassert>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "mock_s3.h"
+
+//The tools are run as separate processes, from the directory containing the
+//build, against a mock server run by this program.
+
+///Run a command, collecting everything it writes to stdout and stderr
+///\return the command's exit status
+int run(const std::string& command, std::string& output){
+	output.clear();
+	FILE* pipe=popen((command+" 2>&1").c_str(),"r");
+	assert(pipe);
+	char buffer[4096];
+	std::size_t amount;
+	while((amount=fread(buffer,1,sizeof(buffer),pipe))>0)
+		output.append(buffer,amount);
+	int status=pclose(pipe);
+	return(WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+int run(const std::string& command){
+	std::string output;
+	return(run(command,output));
+}
+
+///Store the credentials to be used by the tools
+void writeCredentials(const std::string& path, const s3tools::CredentialCollection& credentials){
+	std::ofstream file(path);
+	s3tools::exportCredentials(file,credentials);
+	file.close();
+	chmod(path.c_str(),0600);
+}
+
+std::string readFile(const std::string& path){
+	std::ifstream file(path,std::ios::binary);
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	return(contents.str());
+}
+
+bool contains(const std::string& output, const std::string& text){
+	return(output.find(text)!=std::string::npos);
+}
+
+int main(){
+	MockS3Server::Options options;
+	options.credentials["tester"]="secret";
+	options.maxKeys=10;
+	MockS3Server server(options);
+	const std::string url=server.url("");
+
+	char dirTemplate[]="/tmp/s3tools_tool_tests_XXXXXX";
+	const std::string dir=mkdtemp(dirTemplate);
+	const std::string credFile=dir+"/credentials";
+	writeCredentials(credFile,{{url,s3tools::credential{"tester","secret",{}}}});
+	setenv("S3_CRED_PATH",credFile.c_str(),1);
+	std::string output;
+
+	{ //bucket management
+		assert(run("bin/s3bucket add "+url+" bucket",output)==0);
+		assert(server.hasBucket("bucket"));
+		assert(run("bin/s3bucket add "+url+" other-bucket")==0);
+		assert(run("bin/s3bucket list "+url,output)==0);
+		assert(output=="bucket\nother-bucket\n");
+		assert(run("bin/s3bucket --format tsv list "+url,output)==0);
+		assert(output.substr(0,7)=="bucket\t" && contains(output,"\nother-bucket\t20"));
+		assert(run("bin/s3bucket --format json list "+url,output)==0);
+		assert(output.substr(0,36)=="{\"name\":\"bucket\",\"creation_date\":\"20");
+		assert(run("bin/s3bucket --format xml list "+url,output)!=0);
+		assert(run("bin/s3bucket info "+url+" bucket",output)==0);
+		assert(contains(output,"Versioning: Not enabled"));
+		assert(run("bin/s3bucket add "+url+" Invalid_Name")!=0);
+		//counting objects takes several pages of listing
+		for(unsigned int i=0; i<12; i++)
+			server.putObject("other-bucket","obj"+std::to_string(i),std::string(i,'x'));
+		assert(run("bin/s3bucket --details list "+url,output)==0);
+		assert(output=="bucket\t -\t Not enabled\t 0 objects\t 0 bytes\n"
+		               "other-bucket\t -\t Not enabled\t 12 objects\t 66 bytes\n");
+		assert(run("bin/s3bucket --details --format tsv list "+url,output)==0);
+		assert(contains(output,"\t\tNot enabled\t12\t66\n"));
+		assert(run("bin/s3bucket --details --format json list "+url,output)==0);
+		assert(contains(output,",\"location\":\"\",\"versioning\":\"Not enabled\",\"objects\":12,\"size\":66}\n"));
+		for(unsigned int i=0; i<12; i++)
+			server.removeObject("other-bucket","obj"+std::to_string(i));
+	}
+	{ //uploading, downloading, and copying
+		const std::string data(100000,'d');
+		std::ofstream(dir+"/upload") << data;
+		assert(run("bin/s3cp "+dir+"/upload "+url+"/bucket/dir/file")==0);
+		assert(server.getObject("bucket","dir/file")==data);
+		assert(run("bin/s3cp "+url+"/bucket/dir/file "+dir+"/download")==0);
+		assert(readFile(dir+"/download")==data);
+		assert(run("bin/s3cp "+url+"/bucket/dir/file "+url+"/bucket/copy")==0);
+		assert(server.getObject("bucket","copy")==data);
+		assert(run("bin/s3cp "+url+"/bucket/missing "+url+"/bucket/copy2",output)==0);
+		assert(contains(output,"does not exist"));
+	}
+	{ //listing, over several pages
+		for(unsigned int i=0; i<25; i++)
+			server.putObject("bucket","dir/obj"+std::to_string(100+i),std::string(i,'x'));
+		unsigned int pagesBefore=server.operationCount("ListObjectsV2");
+		assert(run("bin/s3ls "+url+"/bucket/dir/",output)==0);
+		std::string expected="dir/file\n";
+		for(unsigned int i=0; i<25; i++)
+			expected+="dir/obj"+std::to_string(100+i)+"\n";
+		assert(output==expected);
+		assert(server.operationCount("ListObjectsV2")==pagesBefore+3);
+		assert(run("bin/s3ls "+url+"/bucket/",output)==0);
+		assert(output=="copy\ndir/\n");
+		//sorting, with common prefixes at the end by size
+		assert(run("bin/s3ls -S "+url+"/bucket/",output)==0);
+		assert(output=="copy\ndir/\n");
+		assert(run("bin/s3ls -S --reverse "+url+"/bucket/",output)==0);
+		assert(output=="dir/\ncopy\n");
+		assert(run("bin/s3ls --sort name --reverse "+url+"/bucket/",output)==0);
+		assert(output=="dir/\ncopy\n");
+		assert(run("bin/s3ls --online "+url+"/bucket/",output)==0);
+		assert(output=="copy\ndir/\n");
+		assert(run("bin/s3ls --sort colour "+url+"/bucket/",output)!=0);
+		assert(run("bin/s3ls -r -S "+url+"/bucket/dir/",output)==0);
+		assert(output.substr(0,output.find('\n'))=="dir/file");
+		assert(output.substr(output.find("\n")+1,11)=="dir/obj124\n");
+		assert(run("bin/s3ls -S --reverse "+url+"/bucket/dir/",output)==0);
+		assert(output.substr(0,11)=="dir/obj100\n");
+		assert(output.substr(output.size()-9)=="dir/file\n");
+		assert(run("bin/s3ls -l "+url+"/bucket/dir/obj124",output)==0);
+		assert(contains(output,"dir/obj124\t ") && contains(output,"\t 24\n"));
+		//machine-readable output
+		assert(run("bin/s3ls --format tsv "+url+"/bucket/dir/obj124",output)==0);
+		assert(output.substr(0,14)=="dir/obj124\t24\t" && output.substr(output.size()-2)=="\"\n"
+		       && std::count(output.begin(),output.end(),'\t')==3);
+		assert(run("bin/s3ls --format json "+url+"/bucket/",output)==0);
+		assert(output.substr(0,28)=="{\"key\":\"copy\",\"size\":100000,"
+		       && contains(output,"\"etag\":\"\\\"") && contains(output,"}\n{\"prefix\":\"dir/\"}\n"));
+		assert(run("bin/s3ls -r -j 4 --format json "+url+"/bucket/dir/obj12",output)==0);
+		assert(std::count(output.begin(),output.end(),'\n')==5);
+		assert(output.substr(0,37)=="{\"key\":\"dir/obj120\",\"size\":20,\"last_m");
+		assert(run("bin/s3ls --format yaml "+url+"/bucket/",output)!=0);
+		//recursively, with and without dividing the listing
+		assert(run("bin/s3ls -r "+url+"/bucket/",output)==0);
+		assert(output=="copy\n"+expected);
+		assert(run("bin/s3ls -r -j 4 "+url+"/bucket/",output)==0);
+		assert(output=="copy\n"+expected);
+		assert(run("bin/s3ls -r -j 4 "+url+"/bucket/dir/obj11",output)==0);
+		assert(output==expected.substr(expected.find("dir/obj110"),10*11));
+		//several targets at once, each printed in one piece
+		assert(run("bin/s3ls "+url+"/bucket/dir/ "+url+"/bucket/ "+url+"/bucket/dir/obj11",output)==0);
+		assert(output==expected+"copy\ndir/\n"+expected.substr(expected.find("dir/obj110"),10*11));
+		assert(run("bin/s3ls --unordered "+url+"/bucket/dir/ "+url+"/bucket/",output)==0);
+		assert(output==expected+"copy\ndir/\n" || output=="copy\ndir/\n"+expected);
+		assert(run("bin/s3ls "+url+"/bucket/ "+url+"/missing-bucket/ "+url+"/bucket/dir/obj124",output)==0);
+		assert(output.substr(0,10)=="copy\ndir/\n" && contains(output,"NoSuchBucket")
+		       && output.substr(output.size()-11)=="dir/obj124\n");
+	}
+	{ //space used
+		server.putObject("bucket","dir/sub/a",std::string(1000,'a'));
+		server.putObject("bucket","dir/sub/deeper/b",std::string(2000,'b'));
+		server.putObject("bucket","dir/sub2/c",std::string(5,'c'));
+		//dir/file, dir/obj100 to dir/obj124, and copy
+		const unsigned int dirSize=100000+300;
+		assert(run("bin/s3du "+url+"/bucket/",output)==0);
+		assert(output=="2000\t1\tdir/sub/deeper/\n"
+		               "3000\t2\tdir/sub/\n"
+		               "5\t1\tdir/sub2/\n"
+		               +std::to_string(dirSize+3005)+"\t29\tdir/\n"
+		               +std::to_string(dirSize+3005+100000)+"\t30\t"+url+"/bucket/\n");
+		assert(run("bin/s3du -d 1 -j 1 "+url+"/bucket/",output)==0);
+		assert(output==std::to_string(dirSize+3005)+"\t29\tdir/\n"
+		               +std::to_string(dirSize+3005+100000)+"\t30\t"+url+"/bucket/\n");
+		assert(run("bin/s3du -sh "+url+"/bucket/dir/sub",output)==0);
+		assert(output=="2.93K\t3\t"+url+"/bucket/dir/sub\n");
+		assert(run("bin/s3du "+url+"/missing/",output)!=0);
+		for(std::string key : {"dir/sub/a","dir/sub/deeper/b","dir/sub2/c"})
+			server.removeObject("bucket",key);
+	}
+	{ //searching
+		//only the keys beginning with the literal part of the pattern are listed
+		unsigned int pagesBefore=server.operationCount("ListObjectsV2");
+		assert(run("bin/s3find -j 1 --glob 'dir/obj11*' "+url+"/bucket/",output)==0);
+		assert(server.operationCount("ListObjectsV2")==pagesBefore+1);
+		std::string expected;
+		for(unsigned int i=10; i<20; i++)
+			expected+="dir/obj1"+std::to_string(i)+"\n";
+		assert(output==expected);
+		assert(run("bin/s3find --name 'obj12?' --min-size 22 "+url+"/bucket/",output)==0);
+		assert(output=="dir/obj122\ndir/obj123\ndir/obj124\n");
+		assert(run("bin/s3find -l --max-size 0 "+url+"/bucket/dir/",output)==0);
+		assert(output.substr(0,output.find('\t'))=="dir/obj100" && output.find('\n')==output.size()-1);
+		assert(run("bin/s3find --glob 'other*' "+url+"/bucket/dir/",output)==0);
+		assert(output.empty());
+		assert(run("bin/s3find --newer 1h --glob 'dir/obj11*' "+url+"/bucket/",output)==0);
+		assert(output==expected);
+		assert(run("bin/s3find --older 2020-01-01T00:00:00Z "+url+"/bucket/",output)==0);
+		assert(output.empty());
+		assert(run("bin/s3find --newer yesterday "+url+"/bucket/",output)!=0);
+		assert(run("bin/s3find --sign --glob 'dir/obj110' "+url+"/bucket/",output)==0);
+		assert(contains(output,"/bucket/dir/obj110?") && contains(output,"X-Amz-Signature="));
+		assert(output.find('\n')==output.size()-1);
+		for(std::string key : {"tmp/a1","tmp/a2","tmp/b1"})
+			server.putObject("bucket",key,"");
+		unsigned int batchesBefore=server.operationCount("DeleteObjects");
+		assert(run("bin/s3find --delete -j 4 --glob 'tmp/a*' "+url+"/bucket/",output)==0);
+		assert(!server.hasObject("bucket","tmp/a1") && !server.hasObject("bucket","tmp/a2"));
+		assert(server.operationCount("DeleteObjects")==batchesBefore+1);
+		assert(server.hasObject("bucket","tmp/b1"));
+		server.removeObject("bucket","tmp/b1");
+		assert(run("bin/s3find "+url+"/missing/",output)!=0);
+	}
+	{ //local listing indices
+		const std::string index=dir+"/index";
+		assert(run("bin/s3index build "+url+"/bucket/dir/ "+index,output)==0);
+		assert(contains(output,"Listed 26 objects; 26 in index"));
+		assert(run("bin/s3index query --prefix dir/obj11 "+index,output)==0);
+		std::string expected;
+		for(unsigned int i=10; i<20; i++)
+			expected+="dir/obj1"+std::to_string(i)+"\n";
+		assert(output==expected);
+		assert(run("bin/s3index query --glob 'dir/*4' --min-size 10 "+index,output)==0);
+		assert(output=="dir/obj114\ndir/obj124\n");
+		assert(run("bin/s3index query -l --max-size 0 "+index,output)==0);
+		assert(output.substr(0,output.find('\t'))=="dir/obj100" && contains(output,"\t 0\t \""));
+		server.putObject("bucket","dir/obj125","");
+		assert(run("bin/s3index update "+index,output)==0);
+		assert(contains(output,"Listed 1 objects; 27 in index"));
+		assert(run("bin/s3index info "+index,output)==0);
+		assert(contains(output,"Target: "+url+"/bucket/dir/") && contains(output,"Objects: 27"));
+		assert(run("bin/s3index query "+dir+"/missing",output)!=0);
+	}
+	{ //request tracing
+		const std::string traceFile=dir+"/trace";
+		assert(run("bin/s3ls --trace-file "+traceFile+" "+url+"/bucket/dir/",output)==0);
+		assert(contains(output,"Requests: 3 (0 failed)"));
+		assert(contains(output,"Latency: p50 "));
+		std::istringstream trace(readFile(traceFile));
+		std::string line;
+		unsigned int lines=0;
+		while(std::getline(trace,line)){
+			lines++;
+			assert(line.front()=='{' && line.back()=='}');
+			assert(contains(line,"\"verb\":\"GET\""));
+			assert(contains(line,"\"status\":200"));
+			assert(contains(line,"\"starttransfer\":"));
+			//signatures are left out
+			assert(!contains(line,"X-Amz-Signature"));
+		}
+		assert(lines==3);
+		remove(traceFile.c_str());
+
+		//each page is requested while the one before it is still arriving
+		MockS3Server::Options slowOptions=options;
+		slowOptions.bandwidth=10000; //bytes per second
+		MockS3Server slow(slowOptions);
+		slow.createBucket("bucket");
+		for(unsigned int i=0; i<25; i++)
+			slow.putObject("bucket","pipelined/"+std::string(90,'k')+std::to_string(100+i),"");
+		writeCredentials(credFile,{{url,s3tools::credential{"tester","secret",{}}},
+		                           {slow.url(""),s3tools::credential{"tester","secret",{}}}});
+		assert(run("bin/s3ls --trace-file "+traceFile+" "+slow.url("/bucket/pipelined/"),output)==0);
+		assert(std::count(output.begin(),output.end(),'\n')==25+3);
+		auto field=[](const std::string& line, const std::string& name){
+			std::size_t pos=line.find("\""+name+"\":");
+			assert(pos!=std::string::npos);
+			return(std::stod(line.substr(pos+name.size()+3)));
+		};
+		std::vector<std::pair<double,double>> requests; //start and finish
+		trace.clear();
+		trace.str(readFile(traceFile));
+		while(std::getline(trace,line))
+			requests.emplace_back(field(line,"start"),field(line,"start")+field(line,"total"));
+		assert(requests.size()==3);
+		std::sort(requests.begin(),requests.end());
+		for(std::size_t i=1; i<requests.size(); i++)
+			assert(requests[i].first<requests[i-1].second);
+		remove(traceFile.c_str());
+		writeCredentials(credFile,{{url,s3tools::credential{"tester","secret",{}}}});
+	}
+	{ //requests for a URL with equivalent endpoints go to those endpoints
+		const std::string gateway="http://gateway.invalid";
+		writeCredentials(credFile,{{url,s3tools::credential{"tester","secret",{}}},
+		                           {gateway,s3tools::credential{"tester","secret",{url}}}});
+		assert(run("bin/s3cred list",output)==0);
+		assert(contains(output,gateway+": tester\n  "+url+"\n"));
+		assert(run("bin/s3ls "+gateway+"/bucket/dir/obj124",output)==0);
+		assert(output=="dir/obj124\n");
+		assert(run("bin/s3cred endpoints "+gateway)==0);
+		run("bin/s3ls "+gateway+"/bucket/dir/obj124",output);
+		assert(!contains(output,"dir/obj124"));
+		assert(run("bin/s3cred endpoints "+gateway+" "+url+" "+url)==0);
+		assert(run("bin/s3ls "+gateway+"/bucket/dir/obj124",output)==0);
+		assert(output=="dir/obj124\n");
+		//replacing the credential's key keeps its endpoints
+		assert(run("printf '"+gateway+"\\ntester\\nsecret\\nsecret\\ny\\n' | bin/s3cred add")==0);
+		assert(run("bin/s3cred list",output)==0);
+		assert(contains(output,gateway+": tester\n  "+url+"\n  "+url+"\n"));
+		writeCredentials(credFile,{{url,s3tools::credential{"tester","secret",{}}}});
+	}
+	{ //removal
+		assert(run("bin/s3rm "+url+"/bucket/copy "+url+"/bucket/dir/file")==0);
+		assert(!server.hasObject("bucket","copy"));
+		assert(!server.hasObject("bucket","dir/file"));
+		unsigned int batchesBefore=server.operationCount("DeleteObjects");
+		server.putObject("other-bucket","a","");
+		server.putObject("other-bucket","b","");
+		server.protectObject("other-bucket","b");
+		assert(run("bin/s3rm "+url+"/other-bucket/a "+url+"/bucket/dir/obj100 "+url+"/other-bucket/b",output)==1);
+		assert(output=="Error: "+url+"/other-bucket/b: AccessDenied: Access Denied\n");
+		assert(server.operationCount("DeleteObjects")==batchesBefore+2);
+		assert(!server.hasObject("other-bucket","a") && !server.hasObject("bucket","dir/obj100"));
+		assert(server.hasObject("other-bucket","b"));
+		assert(run("bin/s3rm "+url+"/bucket",output)==1);
+		assert(contains(output,"does not name an object"));
+		//a target which names no object does not stop the others being removed
+		server.putObject("other-bucket","c","");
+		assert(run("bin/s3rm "+url+"/other-bucket "+url+"/other-bucket/c "+url+"/bucket/",output)==1);
+		assert(output=="Error: "+url+"/other-bucket does not name an object\n"
+		               "Error: "+url+"/bucket/ does not name an object\n");
+		assert(!server.hasObject("other-bucket","c"));
+		//recursively, deleting objects while they are listed
+		std::size_t dirObjects=0;
+		for(const auto& key : server.keys("bucket"))
+			dirObjects+=(key.compare(0,4,"dir/")==0);
+		assert(run("bin/s3rm -r --dry-run "+url+"/bucket/dir/",output)==0);
+		assert(output.substr(0,url.size()+19)==url+"/bucket/dir/obj101\n");
+		assert((std::size_t)std::count(output.begin(),output.end(),'\n')==dirObjects);
+		assert(server.hasObject("bucket","dir/obj101"));
+		for(unsigned int i=0; i<2100; i++)
+			server.putObject("bucket","bulk/"+std::to_string(10000+i),"");
+		batchesBefore=server.operationCount("DeleteObjects");
+		assert(run("bin/s3rm -r -j 8 --progress "+url+"/bucket/bulk/",output)==0);
+		assert(contains(output,"Listed 2100, removed 2100\n"));
+		assert(server.operationCount("DeleteObjects")==batchesBefore+3);
+		assert(!server.hasObject("bucket","bulk/10000") && !server.hasObject("bucket","bulk/12099"));
+		assert(server.hasObject("bucket","dir/obj101"));
+		assert(run("bin/s3rm -r "+url+"/missing-bucket/",output)==1);
+		assert(contains(output,"NoSuchBucket"));
+		assert(run("bin/s3bucket delete "+url+" bucket",output)==0);
+		assert(contains(output,"not empty"));
+		assert(server.hasBucket("bucket"));
+		for(const auto& key : server.keys("bucket"))
+			assert(run("bin/s3rm "+url+"/bucket/"+key)==0);
+		assert(server.keys("bucket").empty());
+		assert(run("bin/s3bucket delete "+url+" bucket")==0);
+		assert(!server.hasBucket("bucket"));
+		//forcibly, removing the objects and uploads first
+		assert(run("bin/s3bucket add "+url+" doomed")==0);
+		for(unsigned int i=0; i<2500; i++)
+			server.putObject("doomed","k"+std::to_string(i),"");
+		std::size_t uploadsBefore=server.uploadsInProgress();
+		server.startUpload("doomed","partial");
+		assert(run("bin/s3bucket --force -j 4 --progress delete "+url+" doomed",output)==0);
+		assert(contains(output,"Removed 2500 objects, ") && contains(output,"Aborted 1 multipart uploads\n"));
+		assert(!server.hasBucket("doomed"));
+		assert(server.uploadsInProgress()==uploadsBefore);
+		assert(run("bin/s3bucket --force delete "+url+" doomed",output)==1);
+		assert(contains(output,"does not exist"));
+	}
+	{ //batches of operations
+		std::ofstream(dir+"/batch") << "# dependent operations, run in order\n"
+		  "cp "+dir+"/upload "+url+"/other-bucket/x\n"
+		  "head "+url+"/other-bucket/x\n"
+		  "cp "+url+"/other-bucket/x "+url+"/other-bucket/y\n"
+		  "\n"
+		  "cp "+url+"/other-bucket/y "+dir+"\n"
+		  "sign "+url+"/other-bucket/x\n"
+		  "ls "+url+"/other-bucket/\n"
+		  "rm "+url+"/other-bucket/y\n"
+		  "rm "+url+"/other-bucket/b\n"
+		  "frobnicate\n";
+		assert(run("bin/s3batch -j 1 "+dir+"/batch",output)==1);
+		std::istringstream lines(output);
+		std::vector<std::string> results;
+		for(std::string line; std::getline(lines,line);)
+			results.push_back(line);
+		assert(results.size()==12);
+		assert(results[0]=="2\tok");
+		assert(results[1].substr(0,12)=="3\tok\t100000\t");
+		assert(results[2]=="4\tok" && results[3]=="6\tok");
+		assert(readFile(dir+"/y")==readFile(dir+"/upload"));
+		assert(results[4].substr(0,5+url.size())=="7\tok\t"+url && contains(results[4],"X-Amz-Signature="));
+		assert(results[5]=="8\t\tb\t0" && results[6]=="8\t\tx\t100000" && results[7]=="8\t\ty\t100000" && results[8]=="8\tok\t3");
+		assert(results[9]=="9\tok" && !server.hasObject("other-bucket","y"));
+		assert(results[10]=="10\terror\tAccessDenied: Access Denied");
+		assert(results[11]=="11\terror\tUnknown operation: frobnicate");
+		//independent operations run concurrently, but are reported in order
+		std::ofstream heads(dir+"/heads");
+		for(unsigned int i=0; i<50; i++)
+			heads << "head "+url+"/other-bucket/"+(i%10==9 ? "missing" : "x")+"\n";
+		heads.close();
+		unsigned int connectionsBefore=server.connections;
+		assert(run("bin/s3batch -j 8 < "+dir+"/heads",output)==1);
+		lines.clear();
+		lines.str(output);
+		unsigned int count=0;
+		for(std::string line; std::getline(lines,line); count++){
+			assert(line.substr(0,line.find('\t'))==std::to_string(count+1));
+			assert(contains(line,count%10==9 ? "\terror\t" : "\tok\t100000\t"));
+		}
+		assert(count==50);
+		assert(server.connections-connectionsBefore<=8);
+		//long listings are passed through rather than held
+		for(unsigned int i=0; i<3000; i++)
+			server.putObject("other-bucket","many/"+std::to_string(10000+i),"");
+		std::ofstream(dir+"/listings") << "ls -r "+url+"/other-bucket/many/\n"
+		  "ls -r "+url+"/other-bucket/many/\n"
+		  "head "+url+"/other-bucket/x\n";
+		assert(run("bin/s3batch -j 3 "+dir+"/listings",output)==0);
+		std::string expected;
+		for(unsigned int line=1; line<=2; line++){
+			for(unsigned int i=0; i<3000; i++)
+				expected+=std::to_string(line)+"\t\tmany/"+std::to_string(10000+i)+"\t0\n";
+			expected+=std::to_string(line)+"\tok\t3000\n";
+		}
+		expected+="3\tok\t100000\t";
+		assert(output.substr(0,expected.size())==expected);
+		for(unsigned int i=0; i<3000; i++)
+			server.removeObject("other-bucket","many/"+std::to_string(10000+i));
+		assert(run("bin/s3batch -j 1 "+dir+"/no-such-file",output)==1);
+		assert(run("echo 'cp "+url+"/other-bucket/missing "+url+"/other-bucket/z' | bin/s3batch",output)==1);
+		assert(output=="1\terror\tNoSuchKey: The source object "+url+"/other-bucket/missing does not exist.\n");
+		assert(run("echo 'rm "+url+"/other-bucket/x' | bin/s3batch",output)==0);
+		assert(output=="1\tok\n" && !server.hasObject("other-bucket","x"));
+		remove((dir+"/batch").c_str());
+		remove((dir+"/heads").c_str());
+		remove((dir+"/listings").c_str());
+		remove((dir+"/y").c_str());
+	}
+	{ //requests which are incorrectly signed are rejected
+		writeCredentials(credFile,{{url,s3tools::credential{"tester","wrong",{}}}});
+		unsigned int rejected=server.rejectedSignatures;
+		assert(run("bin/s3bucket add "+url+" third-bucket",output)!=0);
+		assert(contains(output,"SignatureDoesNotMatch"));
+		assert(!server.hasBucket("third-bucket"));
+		assert(server.rejectedSignatures==rejected+1);
+	}
+
+	remove(credFile.c_str());
+	remove((credFile+".cache").c_str());
+	remove((dir+"/upload").c_str());
+	remove((dir+"/download").c_str());
+	rmdir(dir.c_str());
+}
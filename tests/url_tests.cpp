@@ -85,4 +85,9 @@ int main(){
 		assert(url.port==8080);
 		assert(url.path=="/foo");
 	}
+	{ //encoding leaves only unreserved characters
+		assert(s3tools::urlencode("a-z_0.9~")=="a-z_0.9~");
+		assert(s3tools::urlencode("a b*c+d/e")=="a%20b%2Ac%2Bd%2Fe");
+		assert(s3tools::urlencode("/dir/caf\xC3\xA9",true)=="/dir/caf%C3%A9");
+	}
 }
\ No newline at end of file